@@ -1,7 +1,20 @@
 #pragma once
 
+#include <cstdint>
+#include <string>
 #include "app/state.h"
 
+/**
+ * @struct LaunchOptions
+ * @brief Command-line options passed to the Application.
+ */
+struct LaunchOptions {
+    std::string modelPath; ///< BVH model to load at startup (empty = default bunny).
+    std::string bvhMetricsPath; ///< If set, write BVH metrics as JSON here and exit without rendering.
+    bool leanMemory = false; ///< Start in lean memory mode (CPU mesh arrays dropped after upload).
+    int64_t bvhPageTexels = 0; ///< Texture buffer limit for BVH data (0 = GL_MAX_TEXTURE_BUFFER_SIZE).
+};
+
 /**
  * @class Application
  * @brief Main entry point of the rendering engine.
@@ -22,8 +35,10 @@ public:
      * No heavy initialization is performed here; the constructor only
      * sets up basic fields. All resource creation is deferred to run()
      * and its helper initialization functions.
+     *
+     * @param launchOptions Command-line options.
      */
-    Application();
+    explicit Application(LaunchOptions launchOptions = {});
 
     /**
      * @brief Releases application resources and shuts down subsystems.
@@ -42,11 +57,17 @@ public:
      * the user closes the window. The returned integer can be used
      * as the program's exit code.
      *
+     * With LaunchOptions::bvhMetricsPath set, run() returns right after
+     * writing the metrics of the startup BVH instead.
+     *
      * @return 0 on clean exit, non-zero if initialization failed.
      */
     int run();
 
 private:
+    /// Options the application was launched with.
+    LaunchOptions options;
+
     /// Global application state containing renderers, UI, and GPU resources.
     AppState app;
 
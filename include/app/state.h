@@ -1,6 +1,7 @@
 #pragma once
 
 #include <memory>
+#include <string>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include "render/accum.h"
@@ -10,6 +11,11 @@
 #include "render/Shader.h"
 #include "scene/model.h"
 #include "scene/bvh.h"
+#include "scene/bvh_dynamic.h"
+#include "scene/bvh_gpu.h"
+#include "scene/bvh_loader.h"
+#include "scene/bvh_residency.h"
+#include "scene/keyframes.h"
 #include "io/input.h"
 #include "ui/gui.h"
 #include "io/Camera.h"
@@ -68,6 +74,9 @@ public:
     /// Path tracer shader (primary + indirect rays).
     std::unique_ptr<Shader> rtShader;
 
+    /// Wide traversal stack (BVH_WIDE_STACK) rtShader was compiled with.
+    int rtWideStack = 64;
+
     /// Shader responsible for tone-mapping and presenting the accumulation buffer.
     std::unique_ptr<Shader> presentShader;
 
@@ -104,9 +113,63 @@ public:
     /// Transform applied to the BVH geometry before intersection tests.
     glm::mat4 bvhTransform = defaultBvhTransform();
 
-    /// Raster version of the BVH geometry, used for debugging.
+    /// CPU copy of the uploaded BVH, refitted while a keyframe sequence plays.
+    BVHGeometry bvhGeometry;
+
+    /// Editable copy of the single-level BVH once props are inserted (bvhGeometry is moved into it).
+    BVHDynamic bvhEdit;
+
+    /// Range ids of the inserted props, in insertion order.
+    std::vector<int> bvhProps;
+
+    /// Keyframes of the current BVH model, if it is part of an OBJ sequence.
+    KeyframeSequence bvhAnim;
+
+    /// Playback time of bvhAnim in seconds.
+    double bvhAnimTime = 0.0;
+
+    /// Scratch triangles for the sampled keyframe (reused across frames).
+    std::vector<CPU_Triangle> bvhAnimTris;
+
+    /// Two-level scene (TLAS over per-mesh BLAS), used when instancing is enabled.
+    BVHScene bvhScene;
+
+    /// TLAS node count passed to the shader (0 = single-level BVH).
+    int bvhTlasNodeCount = 0;
+
+    /// Node width of the uploaded BVH: 2 (binary) or 4/8 (collapsed wide nodes).
+    int bvhGpuWidth = 2;
+
+    /// Animation time of the instances in seconds.
+    double bvhInstanceTime = 0.0;
+
+    /// Raster version of the BVH geometry, used for debugging (empty after a BVH cache hit).
     std::unique_ptr<Model> bvhModel;
 
+    /// Directory of the on-disk BVH cache (see bvh_cache.h).
+    std::string bvhCacheDir = "bvh_cache";
+
+    /// What the current single-level BVH was built from (invalid for two-level scenes and previews).
+    BVHResidentKey bvhKey;
+
+    /// Traced surface of the current BVH, independent of the tree over it (empty for two-level scenes).
+    std::string bvhSurface;
+
+    /// True while the current BVH is the coarse preview of a progressive load.
+    bool bvhIsPreview = false;
+
+    /// Key of the BVH the current preview replaced (stashed in bvhResident), restored if the load fails.
+    BVHResidentKey bvhBeforePreview;
+
+    /// Recently used BVHs kept uploaded for instant switching back.
+    BVHResidencyCache bvhResident;
+
+    /// Background thread importing models and building their BVHs.
+    BVHLoader bvhLoader;
+
+    /// Builds the BVH on the GPU when bvh_gpu_build_applies(); its passes are compiled on first use.
+    BVHGpuBuilder bvhGpuBuilder;
+
     /// UI state for selecting BVH models from disk.
     ui::BvhModelPickerState bvhPicker;
 
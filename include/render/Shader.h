@@ -2,6 +2,7 @@
 
 #include <string>
 #include <unordered_map>
+#include <vector>
 #include <glm/glm.hpp>
 
 /**
@@ -53,10 +54,16 @@ public:
      *
      * @param vertexPath   Path to the vertex shader file.
      * @param fragmentPath Path to the fragment shader file.
+     * @param defines      Extra source lines (e.g. "#define FOO 1\n") inserted
+     *                     after the #version line of both stages.
+     * @param feedback     Vertex outputs captured by transform feedback, in
+     *                     buffer order (interleaved; "gl_NextBuffer" moves
+     *                     on to the next binding). Empty for none.
      *
      * The constructor loads, compiles, links, and validates the program.
      */
-    Shader(const char *vertexPath, const char *fragmentPath);
+    Shader(const char *vertexPath, const char *fragmentPath, const std::string &defines = {},
+           const std::vector<const char *> &feedback = {});
 
     /**
      * @brief Destructor releases the GL program if valid.
@@ -109,6 +116,11 @@ public:
      */
     void setVec2(const std::string &name, const glm::vec2 &value) const;
 
+    /**
+     * @brief Sets an ivec3 uniform.
+     */
+    void setIVec3(const std::string &name, const glm::ivec3 &value) const;
+
 private:
     // -------------------------------------------------------------------------
     // Internal utilities
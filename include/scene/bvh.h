@@ -1,9 +1,14 @@
 #pragma once
+#include <cstdint>
+#include <functional>
 #include <vector>
 #include <memory>
+#include <string>
+#include <glm/glm.hpp>
 #include <glad/gl.h>
 
 class Model; // forward decl to avoid include-order brittleness
+class BVHCacheFile; // see bvh_cache.h
 
 /**
  * @struct CPU_Triangle
@@ -23,22 +28,140 @@ struct CPU_Triangle {
     glm::vec3 e2; ///< Edge from v0 to v2.
 };
 
+/**
+ * @struct BVHTriQuant
+ * @brief Lattice used by the compressed triangle encoding.
+ *
+ * Vertices are snapped to multiples of scale (a power of two) and stored
+ * as 21-bit cell offsets from origin, 3 x 63 bits packed into two RGB32UI
+ * texels (24 bytes instead of 48). The lattice is global, not per leaf, so
+ * a vertex shared by several triangles always lands on the same cell and
+ * decodes to bit-identical coordinates: quantization cannot open cracks.
+ * Decoding is exact on both sides ((origin + cell) * scale with fewer
+ * than 2^24 cells), so the CPU-side snapped triangles, their BVH bounds
+ * and the shader's view of them agree exactly.
+ */
+struct BVHTriQuant {
+    static constexpr int kBits = 21; ///< Bits per axis.
+    static constexpr int kFloatBytes = 48; ///< Bytes per uncompressed triangle (3 texels of float bits).
+    static constexpr int kQuantBytes = 24; ///< Bytes per compressed triangle (2 RGB32UI texels).
+
+    glm::ivec3 origin{0}; ///< Lattice cell of the frame's minimum corner.
+    float scale = 0.0f; ///< Cell size; 0 means triangles are stored as floats.
+
+    /// @return True if triangles use the compressed encoding.
+    [[nodiscard]] bool enabled() const {
+        return scale > 0.0f;
+    }
+
+    /// @return Bytes one triangle occupies in the triangle buffer.
+    [[nodiscard]] int bytesPerTri() const {
+        return enabled() ? kQuantBytes : kFloatBytes;
+    }
+
+    /// @return True if every point of [lo, hi] can be encoded without clamping.
+    [[nodiscard]] bool covers(const glm::vec3 &lo, const glm::vec3 &hi) const;
+};
+
+/**
+ * @brief Ray–triangle test run by the shader, and the triangle encoding it reads.
+ *
+ * MollerTrumbore and Watertight read (v0, e1, e2). Watertight (Woop,
+ * Benthin and Wald 2013) shears the vertices into ray space and evaluates
+ * the three edge functions there, so a ray through an edge shared by two
+ * triangles hits at least one of them. Shared vertices must be bit-identical
+ * for that: always true with compressed and indexed triangles, and true up
+ * to the rounding of v0 + e1 with direct float ones.
+ *
+ * Affine (Woop 2004) stores each triangle as the rows of its world-to-
+ * unit-triangle transform in the same 3 texels: a test is six dot
+ * products and one division, and the third row is the normal. Compressed
+ * and indexed triangles keep their own encoding, so Affine falls back to
+ * MollerTrumbore for them.
+ */
+enum class BVHTriTest {
+    MollerTrumbore, ///< Möller–Trumbore on (v0, e1, e2).
+    Watertight, ///< Watertight edge-function test on the vertices.
+    Affine, ///< Precomputed affine transform per triangle.
+};
+
+/// Texture buffers one paged BVH stream (nodes or triangles) may span.
+constexpr int kBvhMaxPages = 4;
+
+/**
+ * @struct BVHPages
+ * @brief One BVH stream split over up to kBvhMaxPages texture buffers.
+ *
+ * Texel i of the stream is texel i % bvh_page_texels() of page
+ * i / bvh_page_texels(). The page size is a power of two, so the shader
+ * splits indices with a shift and a mask; an item (node, triangle) may
+ * straddle two pages. Streams that fit in one page only use page 0.
+ */
+struct BVHPages {
+    GLuint tex[kBvhMaxPages] = {}; ///< Texture buffer of each page (0 = unused).
+    GLuint buf[kBvhMaxPages] = {}; ///< Raw GL buffer of each page.
+    int count = 0; ///< Pages in use.
+    size_t pageBytes = 0; ///< Bytes of a full page (bvh_page_texels() texels of the stream's format).
+
+    /// Releases every page. Safe to call if none were created.
+    void release() {
+        for (int p = 0; p < kBvhMaxPages; ++p) {
+            if (tex[p]) {
+                glDeleteTextures(1, &tex[p]);
+                tex[p] = 0;
+            }
+            if (buf[p]) {
+                glDeleteBuffers(1, &buf[p]);
+                buf[p] = 0;
+            }
+        }
+        count = 0;
+        pageBytes = 0;
+    }
+};
+
 /**
  * @struct BVHHandle
  * @brief Holds GPU-side buffers/textures for a BVH.
  *
- * The BVH is uploaded as two texture buffers (TBOs):
- *  - nodeTex : flattened BVH node array
- *  - triTex  : triangle data for leaf nodes
+ * The BVH is uploaded as texture buffers (TBOs):
+ *  - nodePages : flattened BVH node array (2 RGBA32I texels per node)
+ *  - skipTex   : per-node skip links for the stackless traversal (R32I)
+ *  - triPages  : triangle data for leaf nodes
+ * Two-level scenes (BVHScene) add a third one:
+ *  - instTex : per-instance world-to-object transform and BLAS root
+ * Collapsed BVH4/BVH8 layouts replace nodePages and skipTex with:
+ *  - wideTex : quantized wide nodes (RGBA32UI)
+ * Float triangles are stored as RGBA32UI texels holding float bits
+ * (v0, e1, e2, or per-triangle transforms with triTest ==
+ * BVHTriTest::Affine); compressed triangles (triQuant enabled) as RGB32UI
+ * lattice coordinates. Indexed float triangles (indexedTris) add one more:
+ *  - vertTex : shared vertex positions (RGB32F), which triPages then
+ *              addresses with three RGB32UI indices per triangle
+ *
+ * Nodes and triangles grow with the model and are paged (BVHPages) past
+ * GL_MAX_TEXTURE_BUFFER_SIZE; every other buffer must fit in one texture
+ * buffer (see bvh_fits_texture_limits()).
  *
  * The raw buffer objects are also kept so they can be deleted explicitly
  * at shutdown without risking dangling textures.
  */
 struct BVHHandle {
-    GLuint nodeTex = 0; ///< Texture buffer containing BVH nodes.
-    GLuint nodeBuf = 0; ///< Raw GL buffer for node data.
-    GLuint triTex = 0; ///< Texture buffer containing triangles.
-    GLuint triBuf = 0; ///< Raw GL buffer for triangle data.
+    BVHPages nodePages; ///< Binary BVH nodes (TLAS first, if any).
+    GLuint skipTex = 0; ///< Texture buffer containing skip links (binary layout only).
+    GLuint skipBuf = 0; ///< Raw GL buffer for skip links.
+    BVHPages triPages; ///< Triangle data, in the encoding described above.
+    GLuint instTex = 0; ///< Texture buffer containing instances (two-level scenes only).
+    GLuint instBuf = 0; ///< Raw GL buffer for instance data.
+    GLuint wideTex = 0; ///< Texture buffer containing collapsed wide nodes (BVH4/BVH8 only).
+    GLuint wideBuf = 0; ///< Raw GL buffer for wide node data.
+    int wideStackSize = 0; ///< Stack entries the wide traversal needs (see wide_bvh_stack_size(); set by the upload).
+    GLuint vertTex = 0; ///< Texture buffer containing shared vertex positions (indexed triangles only).
+    GLuint vertBuf = 0; ///< Raw GL buffer for vertex data.
+    BVHTriQuant triQuant; ///< Encoding of triPages: compressed when enabled, float bits otherwise.
+    BVHTriTest triTest = BVHTriTest::MollerTrumbore; ///< Test the float triangles are packed for (set before uploading).
+    bool indexedTris = false; ///< Store float triangles as vertex indices into vertTex (set before uploading).
+    size_t triBytes = 0; ///< Size of the triangle data in triPages and vertBuf (set by the upload).
 
     /**
      * @brief Releases all GPU resources related to the BVH.
@@ -46,28 +169,205 @@ struct BVHHandle {
      * Safe to call even if some objects were never created.
      */
     void release() {
-        if (nodeTex) {
-            glDeleteTextures(1, &nodeTex);
-            nodeTex = 0;
+        releaseNodes();
+        releaseWide();
+        triPages.release();
+        releaseVerts();
+        triQuant = BVHTriQuant{};
+        triTest = BVHTriTest::MollerTrumbore;
+        indexedTris = false;
+        triBytes = 0;
+        if (instTex) {
+            glDeleteTextures(1, &instTex);
+            instTex = 0;
         }
-        if (triTex) {
-            glDeleteTextures(1, &triTex);
-            triTex = 0;
+        if (instBuf) {
+            glDeleteBuffers(1, &instBuf);
+            instBuf = 0;
         }
-        if (nodeBuf) {
-            glDeleteBuffers(1, &nodeBuf);
-            nodeBuf = 0;
+    }
+
+    /// Releases only the binary node and skip buffers (when switching to a wide layout).
+    void releaseNodes() {
+        nodePages.release();
+        if (skipTex) {
+            glDeleteTextures(1, &skipTex);
+            skipTex = 0;
         }
-        if (triBuf) {
-            glDeleteBuffers(1, &triBuf);
-            triBuf = 0;
+        if (skipBuf) {
+            glDeleteBuffers(1, &skipBuf);
+            skipBuf = 0;
         }
     }
+
+    /// Releases only the shared vertex buffer (when switching back to direct triangles).
+    void releaseVerts() {
+        if (vertTex) {
+            glDeleteTextures(1, &vertTex);
+            vertTex = 0;
+        }
+        if (vertBuf) {
+            glDeleteBuffers(1, &vertBuf);
+            vertBuf = 0;
+        }
+    }
+
+    /// Releases only the wide node buffer (when switching back to binary).
+    void releaseWide() {
+        if (wideTex) {
+            glDeleteTextures(1, &wideTex);
+            wideTex = 0;
+        }
+        if (wideBuf) {
+            glDeleteBuffers(1, &wideBuf);
+            wideBuf = 0;
+        }
+        wideStackSize = 0;
+    }
+};
+
+/**
+ * @enum BVHBuildMethod
+ * @brief Split strategy used by build_bvh().
+ *
+ * All strategies emit the same flattened BVHNode layout, so the upload
+ * path and the GLSL traversal are unaffected by the choice.
+ */
+enum class BVHBuildMethod {
+    Median, ///< Centroid median along the longest axis, fixed leaf size.
+    BinnedSAH, ///< Binned surface area heuristic with SAH-driven leaf termination.
+    LBVH ///< Linear BVH: Morton-code radix sort, fastest build, lower quality.
+};
+
+/**
+ * @enum BVHLayout
+ * @brief Order of the binary nodes in memory, applied at the end of build_bvh().
+ *
+ * The tree itself is the same for every layout: only the positions of the
+ * nodes change, and triangles are re-emitted in the order their leaves
+ * appear so leaf-to-triangle fetches follow the node order. Every layout
+ * keeps children after their parent, which skip links, refits and the
+ * cache check rely on. Collapsed BVH4/BVH8 uploads keep their own order.
+ */
+enum class BVHLayout {
+    DepthFirst, ///< Pre-order, left child right after its parent (the builder's own order).
+    SiblingPairs, ///< Depth-first, but both children stored next to each other.
+    BreadthFirst, ///< Level by level.
+    VanEmdeBoas, ///< Recursive split at half height: top subtree first, then the ones below it.
+    Clustered, ///< Clusters of kBvhClusterNodes nodes grown by surface area (likeliest visits first).
+};
+
+/// Nodes per BVHLayout::Clustered cluster: 16 * 32 bytes, four 128-byte cache lines.
+inline constexpr int kBvhClusterNodes = 16;
+
+/**
+ * @struct BVHBuildSettings
+ * @brief Tunables for the CPU BVH builder.
+ *
+ * The SAH cost model follows the usual convention:
+ *   cost(split) = traversalCost + intersectCost * (A_L * N_L + A_R * N_R) / A
+ *   cost(leaf)  = intersectCost * N
+ * A node becomes a leaf when splitting is not cheaper than intersecting
+ * all of its triangles, as long as it does not exceed leafMax.
+ *
+ * threadCount only affects build time: the node array and triangle order
+ * are identical for every thread count.
+ */
+struct BVHBuildSettings {
+    BVHBuildMethod method = BVHBuildMethod::BinnedSAH; ///< Split strategy.
+    int leafMax = 8; ///< Median: leaf size. SAH: upper bound on leaf size.
+    int sahBins = 16; ///< Number of centroid bins per axis for the SAH sweep.
+    int mortonBits = 30; ///< LBVH Morton code width: 30 (10 bits/axis) or 63 (21 bits/axis).
+    float traversalCost = 1.0f; ///< Relative cost of visiting one inner node.
+    float intersectCost = 1.0f; ///< Relative cost of one ray–triangle test.
+    int threadCount = 0; ///< Worker threads for the build (0 = all hardware threads).
+    float refitRebuildRatio = 1.5f; ///< Refit: rebuild once SAH cost exceeds this multiple of the built tree's.
+    int gpuWidth = 2; ///< Node width uploaded for traversal: 2 (binary), 4 or 8 (collapsed, quantized).
+    bool compressTris = false; ///< Snap vertices to a BVHTriQuant lattice and upload 24 bytes per triangle.
+    BVHTriTest triTest = BVHTriTest::MollerTrumbore; ///< Shader triangle test; like gpuWidth, only affects the upload.
+    bool indexedTris = false; ///< Upload float triangles as indices into shared vertices; only affects the upload.
+    float splitBudget = 0.0f; ///< Spatial pre-splits: extra references allowed, as a fraction of the triangle count.
+    float optimizeMs = 0.0f; ///< Time budget for optimize_bvh() at the end of build_bvh() (0 = off).
+    BVHLayout layout = BVHLayout::DepthFirst; ///< Node order of the finished tree.
+    bool gpuBuild = false; ///< Build a one-triangle-per-leaf LBVH on the GPU at upload (see bvh_gpu_build_applies()).
+};
+
+/**
+ * @brief Whether settings ask for a GPU build the builder can produce.
+ *
+ * The GPU writes binary nodes and uncompressed, directly stored triangles,
+ * so gpuWidth must be 2 and compressTris off. method, leafMax, mortonBits,
+ * splitBudget, optimizeMs and layout do not apply: the result is always a
+ * 30-bit LBVH with one triangle per leaf (see BVHGpuBuilder).
+ */
+bool bvh_gpu_build_applies(const BVHBuildSettings &settings);
+
+/**
+ * @brief Whether BVHGpuBuilder::build() accepts a model of triCount triangles.
+ *
+ * The passes read their scratch streams through one texture buffer each
+ * and write nodes and triangles into the first page, so everything must
+ * fit in bvh_page_texels(). Reads only the limits set by
+ * set_bvh_texel_limit(), so it may run on a worker thread.
+ *
+ * @param triCount  Triangles of the model.
+ * @param outReason Optional output: why the model does not fit.
+ */
+bool bvh_gpu_build_fits(size_t triCount, std::string *outReason = nullptr);
+
+/**
+ * @struct BVHBuildStats
+ * @brief Diagnostics filled in by build_bvh() for logging and the UI.
+ */
+struct BVHBuildStats {
+    double buildMs = 0.0; ///< Wall-clock time spent inside build_bvh().
+    float sahCost = 0.0f; ///< SAH cost of the finished tree (lower is better).
+    int leafCount = 0; ///< Number of leaf nodes.
+    int threadCount = 1; ///< Threads the build was allowed to use.
+    size_t nodeBytes = 0; ///< Size of the uploaded node buffer (set by upload_bvh()).
+    size_t triBytes = 0; ///< Size of the uploaded triangle data (indices and vertices when indexed).
+    float dupFactor = 1.0f; ///< Output triangles per input triangle (> 1 after spatial splits).
+    double optimizeMs = 0.0; ///< Part of buildMs spent in optimize_bvh().
+    float unoptimizedSahCost = 0.0f; ///< SAH cost before optimize_bvh() (equals sahCost when it did not run).
+    bool fromCache = false; ///< Loaded from the on-disk cache; the fields above describe the original build.
+    double loadMs = 0.0; ///< Cache hit: time to hash, map and upload the file.
+    bool cacheWritten = false; ///< Cache miss: the new tree was stored in the cache.
+    bool gpuBuilt = false; ///< Built on the GPU at upload (BVHGpuBuilder); buildMs is its time, no SAH cost.
+};
+
+/**
+ * @struct BVHOptimizeStats
+ * @brief Diagnostics filled in by optimize_bvh().
+ */
+struct BVHOptimizeStats {
+    double optimizeMs = 0.0; ///< Wall-clock time spent inside optimize_bvh().
+    float sahBefore = 0.0f; ///< SAH cost of the input tree.
+    float sahAfter = 0.0f; ///< SAH cost of the optimized tree.
+    int passes = 0; ///< Complete bottom-up passes over the tree.
+    int treelets = 0; ///< Treelets that were restructured.
+};
+
+/**
+ * @struct BVHRefitStats
+ * @brief Diagnostics filled in by refit_bvh().
+ *
+ * The dirty ranges are half-open [begin, end) and cover every node and
+ * triangle whose data changed, so update_bvh_tbo() can upload only those.
+ * Empty ranges (begin == end) mean nothing changed.
+ */
+struct BVHRefitStats {
+    double refitMs = 0.0; ///< Wall-clock time spent inside refit_bvh().
+    float sahCost = 0.0f; ///< SAH cost of the refitted tree.
+    float sahRatio = 1.0f; ///< sahCost relative to the tree right after its last full build.
+    int dirtyNodeBegin = 0; ///< First node whose bounds changed.
+    int dirtyNodeEnd = 0; ///< One past the last node whose bounds changed.
+    int dirtyTriBegin = 0; ///< First triangle whose vertices changed.
+    int dirtyTriEnd = 0; ///< One past the last triangle whose vertices changed.
 };
 
 /**
  * @struct BVHNode
- * @brief Node structure for a median-split BVH.
+ * @brief Node structure for the flattened binary BVH.
  *
  * Internal nodes store a bounding box and indices of their children.
  * Leaf nodes store the starting triangle index and the number of triangles.
@@ -91,15 +391,431 @@ struct BVHNode {
 };
 
 /**
- * @brief Builds a simple median-split BVH from CPU triangles.
+ * @brief Builds a BVH from CPU triangles.
  *
- * The resulting BVH uses a binary tree with splitting based on the
- * longest axis of the node bounding box, partitioned by median position.
+ * The split strategy is chosen at runtime through settings.method:
+ *  - Median:    split the longest axis at the centroid median, leaves of
+ *               at most leafMax triangles.
+ *  - BinnedSAH: evaluate sahBins candidate planes per axis and keep the
+ *               cheapest one; stop when a leaf is cheaper than any split.
+ *  - LBVH:      sort triangles by the Morton code of their centroid and
+ *               emit the implied radix tree; subtrees of at most leafMax
+ *               triangles become leaves. Near-instant, but lower quality.
  *
- * @param tris Input/output triangle list. Order may be modified.
+ * Construction is task-parallel: independent subtrees are built on separate
+ * threads, and large nodes are bounded, binned and partitioned in parallel
+ * chunks. The output does not depend on settings.threadCount.
+ *
+ * With settings.optimizeMs > 0, optimize_bvh() runs on the result before
+ * returning (included in outStats->buildMs).
+ *
+ * With settings.splitBudget > 0, triangles whose boxes are much larger than
+ * the triangle are first cut into several references with tighter boxes
+ * (spatial pre-splits, any method). A triangle may then appear in several
+ * leaves, so the output list can be longer than the input; the ratio is
+ * reported as outStats->dupFactor.
+ *
+ * @param tris     Input/output triangle list. Order may be modified, and
+ *                 triangles may be duplicated by spatial splits.
+ * @param settings Builder configuration.
+ * @param outStats Optional build diagnostics (timing, SAH cost).
+ * @param outSourceIndex Optional output: for each output triangle, its index in the input list.
  * @return Linear array of BVHNode, representing the flattened tree.
  */
-std::vector<BVHNode> build_bvh(std::vector<CPU_Triangle> &tris);
+std::vector<BVHNode> build_bvh(std::vector<CPU_Triangle> &tris, const BVHBuildSettings &settings = {},
+                               BVHBuildStats *outStats = nullptr, std::vector<int> *outSourceIndex = nullptr);
+
+/**
+ * @brief Lowers the SAH cost of a finished BVH by treelet restructuring.
+ *
+ * Bottom-up passes visit every inner node, grow a treelet of up to 7
+ * subtrees below it (always opening the largest) and replace the treelet's
+ * inner nodes by the SAH-optimal topology over those subtrees. Passes
+ * repeat until one brings no improvement or budgetMs runs out; the tree is
+ * valid at any point, so the budget only limits how much is gained. Leaves
+ * are never split or merged.
+ *
+ * The result is re-emitted in pre-order and triangles are reordered to
+ * match, so it can be uploaded, refitted or collapsed like build_bvh()
+ * output. With a budget that cuts the last pass short the result depends
+ * on machine speed.
+ *
+ * @param nodes       Tree from build_bvh(), replaced in place.
+ * @param tris        Its triangles in leaf order, reordered in place.
+ * @param settings    Cost constants (traversalCost, intersectCost).
+ * @param budgetMs    Time budget in milliseconds.
+ * @param outStats    Optional diagnostics.
+ * @param sourceIndex Optional source indices from build_bvh(), reordered with tris.
+ * @return True if at least one treelet was restructured.
+ */
+bool optimize_bvh(std::vector<BVHNode> &nodes, std::vector<CPU_Triangle> &tris, const BVHBuildSettings &settings,
+                  double budgetMs, BVHOptimizeStats *outStats = nullptr, std::vector<int> *sourceIndex = nullptr);
+
+/**
+ * @brief Permutes the nodes of a binary BVH into another memory layout.
+ *
+ * Child links are remapped and triangles are re-emitted in the order their
+ * leaves appear in the new node array. Bounds, topology and leaf contents
+ * are unchanged, so traversal results are identical for every layout.
+ *
+ * @param nodes       Tree from build_bvh(), replaced in place.
+ * @param tris        Its triangles in leaf order, reordered in place.
+ * @param layout      Target layout.
+ * @param sourceIndex Optional source indices from build_bvh(), reordered with tris.
+ */
+void reorder_bvh(std::vector<BVHNode> &nodes, std::vector<CPU_Triangle> &tris, BVHLayout layout,
+                 std::vector<int> *sourceIndex = nullptr);
+
+/**
+ * @struct BVHGeometry
+ * @brief CPU copy of an uploaded BVH, kept around so it can be refitted.
+ *
+ * sourceIndex maps each triangle in leaf order back to its position in
+ * the list originally passed to build_bvh(), which lets refit_bvh() pick
+ * up new vertex positions given in that original order.
+ */
+struct BVHGeometry {
+    std::vector<BVHNode> nodes; ///< Flattened tree, as uploaded.
+    std::vector<CPU_Triangle> tris; ///< Triangles in leaf order, as uploaded.
+    std::vector<int> sourceIndex; ///< tris[i] is source triangle sourceIndex[i].
+    float builtSahCost = 0.0f; ///< SAH cost right after the last full build.
+
+    /// Drops all CPU data.
+    void clear() {
+        nodes.clear();
+        tris.clear();
+        sourceIndex.clear();
+        builtSahCost = 0.0f;
+    }
+};
+
+/**
+ * @struct BVHWideNode
+ * @brief Node of a collapsed BVH4/BVH8 with quantized child boxes.
+ *
+ * Child boxes are stored relative to the node's own box with 8 bits per
+ * coordinate: box = origin + q * 2^exponent, with qMin rounded down and
+ * qMax rounded up so the decoded box always contains the exact one.
+ *
+ * A child is either an inner node (count == 0, index = wide node index),
+ * a leaf (count > 0, index = first triangle), or unused (count == 0,
+ * index == -1).
+ */
+struct BVHWideNode {
+    static constexpr int kMaxWidth = 8; ///< Largest supported width.
+
+    /// One quantized child slot.
+    struct Child {
+        uint8_t qMin[3] = {0, 0, 0}; ///< Quantized lower corner.
+        uint8_t qMax[3] = {0, 0, 0}; ///< Quantized upper corner.
+        uint8_t count = 0; ///< Triangle count for leaves, 0 otherwise.
+        int index = -1; ///< Wide node index, first triangle, or -1 if unused.
+    };
+
+    glm::vec3 origin{0.0f}; ///< Quantization origin (min corner of the node box).
+    int8_t exponent[3] = {0, 0, 0}; ///< Per-axis quantization step 2^exponent.
+    uint8_t childCount = 0; ///< Number of used child slots.
+    Child children[kMaxWidth]; ///< Child slots; only the first `width` are uploaded.
+};
+
+/**
+ * @struct BVHBlas
+ * @brief Bottom-level BVH over one mesh, in the mesh's object space.
+ *
+ * Node and triangle indices are local to this BLAS; upload_bvh_scene()
+ * rebases them when it concatenates all BLASes into the shared TBOs.
+ */
+struct BVHBlas {
+    std::vector<BVHNode> nodes; ///< Object-space tree.
+    std::vector<CPU_Triangle> tris; ///< Object-space triangles in leaf order.
+};
+
+/**
+ * @struct BVHInstance
+ * @brief One placement of a BLAS in the world.
+ */
+struct BVHInstance {
+    glm::mat4 transform{1.0f}; ///< Object-to-world transform.
+    int blas = 0; ///< Index into BVHScene::blas.
+};
+
+/**
+ * @struct BVHScene
+ * @brief Two-level acceleration structure: a TLAS over instances of shared BLASes.
+ *
+ * The TLAS is a regular flattened BVH over the world-space bounds of the
+ * instances, with exactly one instance per leaf; a leaf's `first` indexes
+ * instanceOrder. Moving instances only requires build_tlas() and
+ * update_bvh_tlas_tbo(), the BLASes are never touched.
+ *
+ * GPU layout (see upload_bvh_scene()):
+ *  - nodes : [TLAS, padded to tlasCapacity()] [BLAS 0] [BLAS 1] ...
+ *  - tris  : [BLAS 0] [BLAS 1] ...
+ *  - inst  : one entry per instance, in instanceOrder
+ */
+struct BVHScene {
+    std::vector<BVHBlas> blas; ///< Shared bottom-level trees.
+    std::vector<BVHInstance> instances; ///< Placements of the BLASes.
+    std::vector<BVHNode> tlas; ///< Top-level tree over instance bounds.
+    std::vector<int> instanceOrder; ///< Instance indices in TLAS leaf order.
+
+    /// @return Node slots reserved for the TLAS (a binary tree with one instance per leaf).
+    [[nodiscard]] int tlasCapacity() const {
+        return instances.empty() ? 0 : static_cast<int>(instances.size()) * 2 - 1;
+    }
+
+    /// @return Total number of nodes in the uploaded node buffer.
+    [[nodiscard]] int nodeCount() const {
+        int count = tlasCapacity();
+        for (const auto &b: blas) count += static_cast<int>(b.nodes.size());
+        return count;
+    }
+
+    /// @return Total number of unique (non-instanced) triangles.
+    [[nodiscard]] int triCount() const {
+        int count = 0;
+        for (const auto &b: blas) count += static_cast<int>(b.tris.size());
+        return count;
+    }
+
+    /// Drops all CPU data.
+    void clear() {
+        blas.clear();
+        instances.clear();
+        tlas.clear();
+        instanceOrder.clear();
+    }
+};
+
+/**
+ * @brief Computes the SAH cost of a flattened BVH.
+ *
+ * Sums the traversal cost of every inner node and the intersection cost of
+ * every leaf, each weighted by its surface area relative to the root. This
+ * is the expected cost of a random ray and is the standard way to compare
+ * trees built by different strategies over the same triangles.
+ *
+ * @param nodes    Flattened BVH node array.
+ * @param settings Cost constants (traversalCost, intersectCost).
+ * @return SAH cost, or 0 for an empty tree.
+ */
+float bvh_sah_cost(const std::vector<BVHNode> &nodes, const BVHBuildSettings &settings = {});
+
+/**
+ * @brief Refits a BVH to moved triangles, keeping its topology.
+ *
+ * Copies the new triangle data into leaf order and recomputes every node's
+ * bounds bottom-up. This is much cheaper than a rebuild and suits vertex
+ * animation, but boxes grow looser as triangles drift away from where the
+ * tree was built; compare stats.sahRatio with settings.refitRebuildRatio
+ * to decide when a full rebuild is due. Leaves of a spatially split tree
+ * are refitted to whole triangles, so the benefit of the splits is lost
+ * until the next rebuild.
+ *
+ * @param geom       Tree to refit (nodes and tris are updated in place).
+ * @param sourceTris New triangles, in the order originally given to build_bvh().
+ * @param settings   Cost constants and thread count.
+ * @param outStats   Optional diagnostics, including the dirty ranges.
+ * @return False if sourceTris is too short for the tree's source indices.
+ */
+bool refit_bvh(BVHGeometry &geom, const std::vector<CPU_Triangle> &sourceTris, const BVHBuildSettings &settings = {},
+               BVHRefitStats *outStats = nullptr);
+
+/**
+ * @brief Builds one object-space BLAS per mesh of a model.
+ *
+ * @param model    Source model; each mesh becomes one BLAS.
+ * @param settings Builder configuration forwarded to build_bvh().
+ * @param outBlas  Output BLAS list, one entry per non-empty mesh.
+ * @param outStats Optional combined diagnostics: total time and leaves,
+ *                 SAH cost averaged over BLASes weighted by triangle count.
+ */
+void build_blas_from_model(const Model &model, const BVHBuildSettings &settings, std::vector<BVHBlas> &outBlas,
+                           BVHBuildStats *outStats = nullptr);
+
+/**
+ * @brief Rebuilds the TLAS of a scene over its instances' world bounds.
+ *
+ * Always uses binned SAH with one instance per leaf, so the tree has
+ * exactly tlasCapacity() nodes. Cheap enough to run every frame for a few
+ * hundred instances.
+ *
+ * @param scene    Scene whose tlas and instanceOrder are rebuilt.
+ * @param settings Cost constants (method and leaf size are ignored).
+ * @param outStats Optional diagnostics.
+ */
+void build_tlas(BVHScene &scene, const BVHBuildSettings &settings = {}, BVHBuildStats *outStats = nullptr);
+
+/**
+ * @brief Uploads a two-level scene into the BVH texture buffers.
+ *
+ * Creates or replaces the node, skip, triangle and instance buffers of
+ * handle. Each instance is packed as 4 RGBA32F texels: the three rows of
+ * its world-to-object matrix, then the BLAS root node split into its low
+ * and high 16 bits. BLAS triangles are never compressed; they are packed
+ * for handle.triTest, or indexed if handle.indexedTris is set.
+ *
+ * @param scene  Scene with built BLASes and TLAS.
+ * @param handle Output handle; instTex/instBuf are created as needed.
+ * @return Size of the node and skip buffers in bytes.
+ */
+size_t upload_bvh_scene(const BVHScene &scene, BVHHandle &handle);
+
+/**
+ * @brief Re-uploads only the TLAS nodes and the instance buffer.
+ *
+ * Used after build_tlas() when instances moved; the BLAS part of the node
+ * and skip buffers and the triangle buffer are left untouched.
+ *
+ * @param scene  Scene whose TLAS was rebuilt.
+ * @param handle Handle previously filled by upload_bvh_scene().
+ */
+void update_bvh_tlas_tbo(const BVHScene &scene, const BVHHandle &handle);
+
+/**
+ * @brief Collapses a binary BVH into a BVH4 or BVH8.
+ *
+ * Each wide node starts from a binary node's two children and repeatedly
+ * replaces the inner child with the largest surface area by its own two
+ * children until `width` slots are filled. Leaves and triangle order are
+ * unchanged, so the result uses the same triangle buffer.
+ *
+ * @param nodes Binary BVH produced by build_bvh().
+ * @param width 4 or 8.
+ * @return Wide nodes; element 0 is the root.
+ */
+std::vector<BVHWideNode> collapse_bvh(const std::vector<BVHNode> &nodes, int width);
+
+/**
+ * @brief Uploads wide nodes into handle.wideTex (RGBA32UI).
+ *
+ * Each node uses 1 + 3 * width / 4 texels:
+ *   texel 0: origin.xyz (float bits), w = exponents (3 x 8 bits, biased
+ *            by 128) | childCount << 24
+ *   then 3 words per child:
+ *     qMin.xyz | qMax.x << 24,  qMax.yz | count << 16,  index
+ *
+ * @param wide  Wide nodes from collapse_bvh().
+ * @param width Width the nodes were collapsed with (4 or 8).
+ * @param handle Handle whose wide buffer is created or replaced.
+ * @return Size of the wide node buffer in bytes.
+ */
+size_t upload_bvh_wide_tbo(const std::vector<BVHWideNode> &wide, int width, BVHHandle &handle);
+
+/**
+ * @brief Worst-case stack depth of the wide traversal over a collapsed tree.
+ *
+ * The shader pops a node and pushes its hit inner children, so a node with
+ * k inner children needs max(k, k - 1 + deepest child need) entries. The
+ * result sizes BVH_WIDE_STACK in rt_bvh.glsl.
+ *
+ * @param wide Wide nodes from collapse_bvh().
+ * @return Stack entries needed (at least 1 for a non-empty tree).
+ */
+int wide_bvh_stack_size(const std::vector<BVHWideNode> &wide);
+
+/**
+ * @brief Builds the compression lattice for geometry inside [lo, hi].
+ *
+ * The cell size is the smallest power of two that spans the box in
+ * BVHTriQuant::kBits bits and keeps every absolute cell index below 2^22,
+ * so decoded vertices and the edges between them are exact floats.
+ */
+BVHTriQuant make_bvh_tri_quant(const glm::vec3 &lo, const glm::vec3 &hi);
+
+/**
+ * @brief Snaps a point to the nearest lattice cell.
+ * @return The decoded position the shader will see for this point.
+ */
+glm::vec3 quantize_bvh_point(const BVHTriQuant &quant, const glm::vec3 &p);
+
+/**
+ * @brief Snaps every triangle to the lattice, in place.
+ *
+ * Vertices are rebuilt from (v0, e1, e2). Use the snap argument of
+ * gather_model_triangles() instead when the source vertices are at hand,
+ * so shared vertices are snapped from identical inputs.
+ */
+void quantize_bvh_triangles(std::vector<CPU_Triangle> &tris, const BVHTriQuant &quant);
+
+/**
+ * @brief Computes the bounds of all triangle vertices.
+ */
+void bvh_triangle_bounds(const std::vector<CPU_Triangle> &tris, glm::vec3 &outMin, glm::vec3 &outMax);
+
+/**
+ * @brief Sets the texel limit of one texture buffer, and with it the BVH page size.
+ *
+ * Call once the GL context exists, before the first upload. The page
+ * size is the largest power of two not above the limit, capped at 2^28
+ * texels so every texel of kBvhMaxPages pages has an int index. Until
+ * this is called the limit is 2^27 texels.
+ *
+ * @param maxTexels Limit to use; 0 queries GL_MAX_TEXTURE_BUFFER_SIZE.
+ *                  Smaller values force paging of small models (testing).
+ */
+void set_bvh_texel_limit(int64_t maxTexels = 0);
+
+/// @return Texels one texture buffer may hold (see set_bvh_texel_limit()).
+int64_t bvh_texel_limit();
+
+/// @return Texels per page of a paged stream (a power of two).
+int bvh_page_texels();
+
+/// @return log2 of bvh_page_texels(), the shift the shader splits stream indices with.
+int bvh_page_shift();
+
+/**
+ * @brief Allocates uninitialized pages for a stream of bytes in format.
+ *
+ * For streams written on the GPU (BVHGpuBuilder); the upload functions
+ * allocate their own pages.
+ *
+ * @return False, leaving no pages, if the stream needs more than kBvhMaxPages pages.
+ */
+bool alloc_bvh_pages(BVHPages &pages, size_t bytes, GLenum format);
+
+/**
+ * @brief Checks whether a BVH fits the texture buffer limits, before building buffers for it.
+ *
+ * Nodes and triangles may span kBvhMaxPages pages; skip links, wide nodes
+ * and instances must each fit in one texture buffer. Indexed triangles
+ * are checked as direct ones, which they fall back to when their shared
+ * vertices do not fit in one buffer.
+ *
+ * @param nodeCount     Binary nodes (for two-level scenes, BVHScene::nodeCount()).
+ * @param triCount      Triangles.
+ * @param width         Node layout to upload: 2, 4 or 8.
+ * @param compressTris  Triangles are uploaded compressed (2 texels instead of 3).
+ * @param instanceCount Instances of a two-level scene (0 = single-level).
+ * @param outReason     Optional output: which buffer does not fit, for the log.
+ * @return True if the upload fits.
+ */
+bool bvh_fits_texture_limits(size_t nodeCount, size_t triCount, int width, bool compressTris,
+                             size_t instanceCount = 0, std::string *outReason = nullptr);
+
+/**
+ * @brief Uploads a single-level BVH in the layout selected by width.
+ *
+ * width == 2 uploads binary nodes and their skip links; 4 or 8 collapses
+ * the tree and uploads wide nodes instead, dropping the binary node
+ * buffer. Triangles are uploaded in both cases (see upload_bvh_triangles()).
+ *
+ * @param nodes  Binary BVH.
+ * @param tris   Triangles in leaf order.
+ * @param width  2, 4 or 8.
+ * @param handle Handle whose buffers are created or replaced.
+ * @param outNodeCount Optional output: number of uploaded nodes (binary or wide).
+ * @return Size of the node buffers (nodes + skip links, or wide nodes) in bytes.
+ */
+size_t upload_bvh(const std::vector<BVHNode> &nodes, const std::vector<CPU_Triangle> &tris, int width,
+                  BVHHandle &handle, int *outNodeCount = nullptr);
+
+/**
+ * @brief upload_bvh() over raw arrays, e.g. a memory-mapped BVH cache file.
+ */
+size_t upload_bvh(const BVHNode *nodes, size_t nodeCount, const CPU_Triangle *tris, size_t triCount, int width,
+                  BVHHandle &handle, int *outNodeCount = nullptr);
 
 /**
  * @brief Uploads BVH nodes and triangles to GPU texture buffers (TBOs).
@@ -107,6 +823,10 @@ std::vector<BVHNode> build_bvh(std::vector<CPU_Triangle> &tris);
  * Two pairs of objects are created:
  *  - outNodeBuf + outNodeTex
  *  - outTriBuf  + outTriTex
+ * Skip links are not uploaded: use upload_bvh() for trees walked by the
+ * stackless traversal. Neither buffer is paged, so each must fit in
+ * bvh_texel_limit() texels; triangles are RGBA32UI float bits, like the
+ * direct triangles of upload_bvh().
  *
  * This design allows shutting down cleanly by deleting buffers while
  * the TBO textures reference them indirectly.
@@ -121,18 +841,163 @@ std::vector<BVHNode> build_bvh(std::vector<CPU_Triangle> &tris);
 void upload_bvh_tbo(const std::vector<BVHNode> &nodes, const std::vector<CPU_Triangle> &tris, GLuint &outNodeTex,
                     GLuint &outNodeBuf, GLuint &outTriTex, GLuint &outTriBuf);
 
+/**
+ * @brief Re-uploads part of an existing BVH into its texture buffers.
+ *
+ * Uses glBufferSubData on the node range [nodeBegin, nodeEnd) and the
+ * triangle range [triBegin, triEnd). The buffers must already hold a tree
+ * of the same size, uploaded by upload_bvh(); ranges may straddle pages.
+ * Triangles are packed in the encoding given by handle.triQuant and
+ * handle.triTest. Indexed triangles share vertices across the whole
+ * range, so any triangle update re-indexes and re-uploads all of them
+ * (handle.triBytes may change).
+ *
+ * Skip links are kept as uploaded, which is right for refits. Edits that
+ * change the topology (BVHDynamic) pass their links for the node range.
+ *
+ * @param nodes     Flattened BVH node array.
+ * @param tris      Triangle list associated with the BVH.
+ * @param handle    BVH whose buffers are updated.
+ * @param nodeBegin First node to upload.
+ * @param nodeEnd   One past the last node to upload.
+ * @param triBegin  First triangle to upload.
+ * @param triEnd    One past the last triangle to upload.
+ * @param skips     Optional skip link of every node; [nodeBegin, nodeEnd) is uploaded too.
+ */
+void update_bvh_tbo(const std::vector<BVHNode> &nodes, const std::vector<CPU_Triangle> &tris, BVHHandle &handle,
+                    int nodeBegin, int nodeEnd, int triBegin, int triEnd, const std::vector<int> *skips = nullptr);
+
+/**
+ * @brief Uploads the triangles of a single-level BVH in the encoding selected by handle.
+ *
+ * Compressed if handle.triQuant is enabled (the triangles must already be
+ * snapped to it), otherwise indexed if handle.indexedTris is set, and
+ * otherwise packed directly for handle.triTest. Settings that do not
+ * apply to the chosen encoding are cleared: indexedTris for compressed
+ * triangles, an Affine triTest for compressed and indexed ones.
+ *
+ * Indexed triangles weld the corners v0, v0 + e1 and v0 + e2 into shared
+ * vertices (RGB32F, numbered in order of first use so the vertices of a
+ * leaf sit together) and store three RGB32UI indices per triangle: about
+ * 12 + 12 * V / T bytes per triangle instead of 48, V / T being about 0.5
+ * on closed meshes, at the price of a dependent fetch per vertex.
+ *
+ * Replaces the triangle buffers of handle, so the encoding may change;
+ * the nodes are untouched.
+ *
+ * @param tris   Triangles in leaf order.
+ * @param handle Handle whose triangle (and vertex) buffers are created or replaced.
+ * @return Size of the triangle data in bytes, also stored in handle.triBytes.
+ */
+size_t upload_bvh_triangles(const std::vector<CPU_Triangle> &tris, BVHHandle &handle);
+
 /**
  * @brief Extracts triangles from a Model into CPU triangle format.
  *
  * The function reads vertex/index buffers from a LearnOpenGL-style
  * Model class, converts triangles into CPU_Triangle format, and
  * applies a model transformation matrix to the vertex positions.
+ * Meshes whose CPU arrays were released contribute nothing: call
+ * Model::reloadCpuData() first.
  *
  * @param model     Source Model containing positions and indices.
  * @param M         Transform to apply to all triangle vertices.
  * @param outTris   Output vector of CPU_Triangle structures.
+ * @param snap      Optional lattice the transformed vertices are snapped to.
+ */
+void gather_model_triangles(const Model &model, const glm::mat4 &M, std::vector<CPU_Triangle> &outTris,
+                            const BVHTriQuant *snap = nullptr);
+
+/**
+ * @struct BVHPrepared
+ * @brief CPU half of a model load: the imported model and the finished tree, not uploaded yet.
+ *
+ * Produced by prepare_bvh_from_model_path(), which touches no GL state and
+ * may run on a worker thread, and consumed by upload_prepared_bvh() on the
+ * thread that owns the GL context.
+ */
+struct BVHPrepared {
+    std::unique_ptr<Model> model; ///< Imported model, GPU objects not created yet (null after a cache hit).
+    std::shared_ptr<const BVHCacheFile> cache; ///< Mapped cache file to upload from (cache hit without geometry).
+    BVHGeometry geometry; ///< Built tree, or a copy of the cached one when geometry was asked for.
+    BVHTriQuant triQuant; ///< Lattice of compressed triangles (disabled if none).
+    BVHBuildStats stats; ///< Build or cache diagnostics; GPU sizes are filled in on upload.
+    bool gpuDeferred = false; ///< The build is left to the GPU: geometry holds the source triangles, no nodes.
+
+    BVHPrepared();
+    ~BVHPrepared();
+    BVHPrepared(BVHPrepared &&) noexcept;
+    BVHPrepared &operator=(BVHPrepared &&) noexcept;
+};
+
+/**
+ * @brief Simplified stand-in for a triangle soup, used as a progressive preview.
+ *
+ * Vertex clustering: vertices are snapped to the centres of a uniform grid
+ * sized so that about targetTris triangles survive, and triangles that
+ * collapse or repeat are dropped. Runs in one linear pass, much faster
+ * than building a BVH over the input.
+ *
+ * @param tris       Input triangles.
+ * @param targetTris Desired proxy size (the result may be up to twice that).
+ * @return Proxy triangles; empty if the input is empty or has no extent.
+ */
+std::vector<CPU_Triangle> simplify_bvh_proxy(const std::vector<CPU_Triangle> &tris, size_t targetTris);
+
+/// Receives the preview of a progressive load (see prepare_bvh_from_model_path()).
+using BVHPreviewFn = std::function<void(BVHPrepared &preview)>;
+
+/**
+ * @brief Imports a model and builds its BVH without touching GL.
+ *
+ * Same steps as rebuild_bvh_from_model_path() up to the upload: cache
+ * lookup, import (meshes created without GPU objects), triangle
+ * gathering, build and cache write.
+ *
+ * Progressive mode: with previewTris > 0 and a model of more than
+ * 4 * previewTris triangles, a BVH over simplify_bvh_proxy() is built first
+ * and passed to onPreview (geometry and stats only, no model), before the
+ * full build starts. Cache hits have no preview.
+ *
+ * When bvh_gpu_build_applies(settings), nothing is cached: if the model
+ * also passes bvh_gpu_build_fits(), nothing is built either and
+ * out.gpuDeferred is set, for the caller to build with BVHGpuBuilder on
+ * the GL thread; otherwise the tree is built on the CPU here.
+ *
+ * @param path            File path to the model to load.
+ * @param modelTransform  Transform applied to the model geometry.
+ * @param settings        Builder configuration forwarded to build_bvh().
+ * @param out             Output; replaced.
+ * @param wantGeometry    Fill out.geometry with the tree and source indices
+ *                        even on a cache hit (needed for refits and metrics).
+ * @param cacheDir        Optional directory of the on-disk BVH cache (nullptr = no caching).
+ * @param previewTris     Proxy size of the progressive preview (0 = no preview).
+ * @param onPreview       Called on the calling thread with the preview; may move from it.
+ * @return True on success, false if the model failed to load.
  */
-void gather_model_triangles(const Model &model, const glm::mat4 &M, std::vector<CPU_Triangle> &outTris);
+bool prepare_bvh_from_model_path(const char *path, const glm::mat4 &modelTransform, const BVHBuildSettings &settings,
+                                 BVHPrepared &out, bool wantGeometry, const char *cacheDir = nullptr,
+                                 size_t previewTris = 0, const BVHPreviewFn &onPreview = {});
+
+/**
+ * @brief Uploads a prepared BVH and creates the model's GPU objects.
+ *
+ * Must run on the thread that owns the GL context. A tree that exceeds
+ * the texture buffer limits (bvh_fits_texture_limits()) is not uploaded:
+ * handle and the model are left untouched. A deferred GPU build
+ * (prepared.gpuDeferred) is built on the CPU here instead.
+ *
+ * @param prepared     Result of prepare_bvh_from_model_path(); its stats
+ *                     receive the GPU sizes (and the upload time on a cache hit).
+ * @param settings     Node layout (gpuWidth), triangle test (triTest) and storage (indexedTris) to upload.
+ * @param handle       Output BVHHandle whose textures/buffers will be filled.
+ * @param outNodeCount Output number of uploaded nodes.
+ * @param outTriCount  Output number of triangles.
+ * @param outReason    Optional output: why the tree was refused.
+ * @return False if the tree does not fit the texture buffer limits.
+ */
+bool upload_prepared_bvh(BVHPrepared &prepared, const BVHBuildSettings &settings, BVHHandle &handle,
+                         int &outNodeCount, int &outTriCount, std::string *outReason = nullptr);
 
 /**
  * @brief High-level helper for loading a model and building its BVH.
@@ -141,15 +1006,32 @@ void gather_model_triangles(const Model &model, const glm::mat4 &M, std::vector<
  * uploads the resulting nodes and triangle data into GPU buffers/TBOs.
  *
  * Old BVH data and the previous model (if any) are deleted and replaced.
+ * With settings.compressTris the vertices are snapped to a lattice fitted
+ * to the model (handle.triQuant) before the build.
+ *
+ * With a cache directory, the tree is first looked up by
+ * bvh_cache_key(). A hit maps the file and uploads it directly: the model
+ * is not imported (bvhModel is left empty) and nothing is built. A miss
+ * builds as usual and stores the result for the next load.
+ *
+ * Equivalent to prepare_bvh_from_model_path() followed by
+ * upload_prepared_bvh() on the calling thread.
  *
  * @param path            File path to the model to load.
  * @param modelTransform  Transform applied to the model geometry.
+ * @param settings        Builder configuration forwarded to build_bvh().
  * @param bvhModel        Output unique_ptr containing the loaded model.
  * @param outNodeCount    Output number of BVH nodes.
  * @param outTriCount     Output number of triangles.
  * @param handle          Output BVHHandle whose textures/buffers will be filled.
+ * @param outStats        Optional build diagnostics.
+ * @param outGeometry     Optional output: CPU copy of the tree, for later refits.
+ * @param cacheDir        Optional directory of the on-disk BVH cache (nullptr = no caching).
  *
- * @return True on success, false if the model failed to load.
+ * @return True on success, false if the model failed to load or its BVH exceeds the
+ *         texture buffer limits.
  */
-bool rebuild_bvh_from_model_path(const char *path, const glm::mat4 &modelTransform, std::unique_ptr<Model> &bvhModel,
-                                 int &outNodeCount, int &outTriCount, BVHHandle &handle);
+bool rebuild_bvh_from_model_path(const char *path, const glm::mat4 &modelTransform, const BVHBuildSettings &settings,
+                                 std::unique_ptr<Model> &bvhModel, int &outNodeCount, int &outTriCount,
+                                 BVHHandle &handle, BVHBuildStats *outStats = nullptr,
+                                 BVHGeometry *outGeometry = nullptr, const char *cacheDir = nullptr);
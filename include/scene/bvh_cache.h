@@ -0,0 +1,104 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <glm/glm.hpp>
+#include "scene/bvh.h"
+
+/**
+ * @brief Hash of the model transform and of the settings that change the finished tree.
+ *
+ * Covers method, leaf size, bins, Morton width, costs, compression, split
+ * and optimize budgets, node layout and GPU building (only when
+ * bvh_gpu_build_applies(), since the flag is ignored otherwise). Thread
+ * count and GPU width are left out: the build is deterministic and the
+ * width is chosen at upload time.
+ *
+ * @param modelTransform Transform applied when gathering triangles.
+ * @param settings       Builder configuration.
+ * @param seed           Hash to continue from (0 = start a new one).
+ * @return A non-zero 64-bit FNV-1a hash.
+ */
+uint64_t bvh_settings_hash(const glm::mat4 &modelTransform, const BVHBuildSettings &settings, uint64_t seed = 0);
+
+/**
+ * @brief Cache key of a model's BVH.
+ *
+ * 64-bit FNV-1a hash over the bytes of the model file, continued with
+ * bvh_settings_hash().
+ *
+ * @param path           Model file.
+ * @param modelTransform Transform applied when gathering triangles.
+ * @param settings       Builder configuration.
+ * @return The key, or 0 if the file cannot be read.
+ */
+uint64_t bvh_cache_key(const char *path, const glm::mat4 &modelTransform, const BVHBuildSettings &settings);
+
+/**
+ * @brief Path of the cache file for a key: <dir>/<16 hex digits>.bvh.
+ */
+std::string bvh_cache_file(const std::string &dir, uint64_t key);
+
+/**
+ * @brief Writes a finished BVH to a cache file.
+ *
+ * The file holds a versioned header (key, counts, lattice, build stats)
+ * followed by the node, triangle and source-index arrays exactly as they
+ * are laid out in memory. It is written to a temporary name and renamed,
+ * so a concurrent reader never maps a half-written file.
+ *
+ * @param file     Destination path; its directory is created if needed.
+ * @param key      Key from bvh_cache_key().
+ * @param geometry Nodes, triangles (leaf order) and source indices.
+ * @param triQuant Lattice the triangles were snapped to (disabled if none).
+ * @param stats    Stats of the build, returned again on load.
+ * @return True on success.
+ */
+bool write_bvh_cache(const std::string &file, uint64_t key, const BVHGeometry &geometry, const BVHTriQuant &triQuant,
+                     const BVHBuildStats &stats);
+
+/**
+ * @class BVHCacheFile
+ * @brief Read-only memory mapping of a BVH cache file.
+ *
+ * open() maps the file and checks magic, version, key, struct sizes,
+ * section sizes and child/triangle indices; the arrays are then used in
+ * place (no copy) until the object is destroyed or reopened.
+ */
+class BVHCacheFile {
+public:
+    BVHCacheFile() = default;
+    ~BVHCacheFile();
+    BVHCacheFile(const BVHCacheFile &) = delete;
+    BVHCacheFile &operator=(const BVHCacheFile &) = delete;
+
+    /**
+     * @brief Maps a cache file.
+     *
+     * @param file Path from bvh_cache_file().
+     * @param key  Expected key; a file written for another key is rejected.
+     * @return True if the file exists and is valid for key.
+     */
+    bool open(const std::string &file, uint64_t key);
+
+    /// Unmaps the file.
+    void close();
+
+    [[nodiscard]] const BVHNode *nodes() const { return nodePtr; }
+    [[nodiscard]] const CPU_Triangle *tris() const { return triPtr; }
+    [[nodiscard]] const int *sourceIndex() const { return sourcePtr; }
+    [[nodiscard]] size_t nodeCount() const { return nodeCnt; }
+    [[nodiscard]] size_t triCount() const { return triCnt; }
+    [[nodiscard]] const BVHTriQuant &triQuant() const { return quant; }
+    [[nodiscard]] const BVHBuildStats &stats() const { return buildStats; }
+
+private:
+    const void *mapping = nullptr; ///< Start of the mapped view.
+    size_t mappingBytes = 0; ///< Size of the mapped view.
+    const BVHNode *nodePtr = nullptr; ///< Node array inside the view.
+    const CPU_Triangle *triPtr = nullptr; ///< Triangle array inside the view.
+    const int *sourcePtr = nullptr; ///< Source-index array inside the view.
+    size_t nodeCnt = 0; ///< Nodes in the file.
+    size_t triCnt = 0; ///< Triangles in the file.
+    BVHTriQuant quant; ///< Lattice stored in the header.
+    BVHBuildStats buildStats; ///< Stats stored in the header.
+};
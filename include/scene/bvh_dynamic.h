@@ -0,0 +1,140 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "scene/bvh.h"
+
+/**
+ * @struct BVHEditStats
+ * @brief Diagnostics of the last BVHDynamic edit and its upload.
+ */
+struct BVHEditStats {
+    double editMs = 0.0; ///< Build of the inserted range, insertion or removal, refits and rotations.
+    double uploadMs = 0.0; ///< Time spent in BVHDynamic::upload().
+    int rotations = 0; ///< Tree rotations applied on the refitted paths.
+    int nodesUploaded = 0; ///< Nodes (and skip links) re-uploaded.
+    int trisUploaded = 0; ///< Triangles re-uploaded.
+    size_t bytesUploaded = 0; ///< Bytes written to the texture buffers.
+    bool fullUpload = false; ///< Capacity grew: every buffer was reallocated and uploaded.
+};
+
+/**
+ * @class BVHDynamic
+ * @brief Binary BVH that triangle ranges can be inserted into and removed from.
+ *
+ * Each insert() builds a small tree over the new triangles with
+ * build_bvh() and links its root in next to the node that increases the
+ * SAH cost least, found by branch and bound (Bittner et al. 2012). Every
+ * node on the path back to the root is refitted and may swap a child with
+ * a grandchild when that shrinks the swapped-in node (Kopta et al. 2012),
+ * which keeps the quality of a full build over many edits. remove() unlinks
+ * the leaves of a range the same way.
+ *
+ * Node and triangle slots never move once assigned, so an edit only dirties
+ * the slots it touched and upload() re-sends just those, skip links
+ * included. Freed slots are reused; the arrays carry spare capacity and
+ * only a full upload happens when it runs out. Because reused slots can
+ * lie before their parent, nodes() does not keep build_bvh()'s "children
+ * after parent" order: refit_bvh(), compute_bvh_metrics() and the BVH
+ * cache do not accept it. The root always stays at node 0.
+ */
+class BVHDynamic {
+public:
+    /**
+     * @brief Takes over a tree from build_bvh() as range 0.
+     *
+     * @param nodes Binary tree, children after their parent.
+     * @param tris  Its triangles in leaf order.
+     */
+    void assign(std::vector<BVHNode> nodes, std::vector<CPU_Triangle> tris);
+
+    /**
+     * @brief Builds a tree over tris and inserts it.
+     *
+     * @param tris     Triangles of the new range (world space), consumed.
+     * @param settings Builder for the range; layout, optimizeMs and splitBudget are ignored.
+     * @param outStats Optional diagnostics (upload fields are left alone).
+     * @return Id of the new range, or -1 if tris is empty or nothing was assigned.
+     */
+    int insert(std::vector<CPU_Triangle> tris, const BVHBuildSettings &settings, BVHEditStats *outStats = nullptr);
+
+    /**
+     * @brief Removes a range inserted by insert() (or range 0).
+     *
+     * @return False if id is not a live range or is the last one.
+     */
+    bool remove(int id, BVHEditStats *outStats = nullptr);
+
+    /**
+     * @brief Sends the edits since the last call to handle.
+     *
+     * Dirty node and triangle slots are coalesced into runs and written with
+     * update_bvh_tbo(); after a capacity change everything is uploaded with
+     * upload_bvh() instead.
+     *
+     * @param handle   Binary BVH uploaded from this tree.
+     * @param outStats Optional: upload fields are filled in.
+     */
+    void upload(BVHHandle &handle, BVHEditStats *outStats = nullptr);
+
+    /**
+     * @brief Node and triangle capacity an insert of triCount triangles may grow to.
+     *
+     * Lets callers check bvh_fits_texture_limits() before editing.
+     */
+    [[nodiscard]] std::pair<size_t, size_t> capacityAfterInsert(size_t triCount) const;
+
+    /// Drops the tree and every range.
+    void clear();
+
+    [[nodiscard]] bool active() const { return !nodeArray.empty(); }
+    [[nodiscard]] bool needsFullUpload() const { return fullUpload; }
+    [[nodiscard]] const std::vector<BVHNode> &nodes() const { return nodeArray; }
+    [[nodiscard]] const std::vector<CPU_Triangle> &tris() const { return triArray; }
+    [[nodiscard]] const std::vector<int> &skips() const { return skipArray; }
+    [[nodiscard]] int liveNodes() const { return liveNodeCount; }
+    [[nodiscard]] int liveTris() const { return liveTriCount; }
+    [[nodiscard]] int rangeCount() const { return liveRangeCount; }
+
+private:
+    struct Range {
+        int first = 0; ///< First triangle slot.
+        int count = 0; ///< Triangle slots (0 = removed).
+        std::vector<int> leaves; ///< Leaf nodes holding its triangles.
+    };
+
+    int allocNode();
+    int allocTris(int count);
+    void freeTris(int first, int count);
+    void growNodes(size_t capacity);
+    void growTris(size_t capacity);
+    void markNode(int n);
+    void replaceChild(int parent, int oldChild, int newChild);
+    void moveNode(int from, int to);
+    void setSkip(int n, int value);
+    void relink(int n);
+    int findSibling(const glm::vec3 &bMin, const glm::vec3 &bMax) const;
+    bool rotate(int n);
+    int refitUp(int n);
+    int removeLeaf(int leaf);
+
+    std::vector<BVHNode> nodeArray; ///< Node slots (size = capacity).
+    std::vector<int> parentArray; ///< Parent of every node slot, -1 for the root and free slots.
+    std::vector<int> skipArray; ///< Skip link of every node slot, as the stackless shader expects.
+    std::vector<int> ownerArray; ///< Range of every leaf slot, -1 for inner and free slots.
+    std::vector<CPU_Triangle> triArray; ///< Triangle slots (size = capacity).
+    std::vector<int> freeNodes; ///< Node slots available for reuse.
+    std::vector<std::pair<int, int>> freeTriRuns; ///< Free triangle slots as (first, count), sorted.
+    int nodeEnd = 0; ///< Node slots ever used.
+    int triEnd = 0; ///< Triangle slots ever used.
+    std::vector<Range> ranges; ///< Indexed by range id.
+    int liveNodeCount = 0; ///< Nodes reachable from the root.
+    int liveTriCount = 0; ///< Triangles in live ranges.
+    int liveRangeCount = 0; ///< Ranges not removed.
+
+    std::vector<int> dirtyNodes; ///< Node slots changed since the last upload (unsorted, unique).
+    std::vector<uint8_t> nodeDirty; ///< Per node slot: listed in dirtyNodes.
+    std::vector<std::pair<int, int>> dirtyTris; ///< Triangle runs written since the last upload.
+    bool fullUpload = false; ///< Capacity changed since the last upload.
+};
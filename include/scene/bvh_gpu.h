@@ -0,0 +1,131 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include "render/Shader.h"
+#include "scene/bvh.h"
+
+/**
+ * @struct BVHGpuBuildStats
+ * @brief Diagnostics of one BVHGpuBuilder::build().
+ */
+struct BVHGpuBuildStats {
+    double buildMs = 0.0; ///< Wall-clock time of build(), including the source upload.
+    double gpuMs = 0.0; ///< GPU time of the passes (timer query; 0 if unavailable).
+    int passes = 0; ///< Draw calls issued; the bitonic sort accounts for most of them.
+    int nodeCount = 0; ///< Nodes written (2 n - 1 for n triangles).
+    size_t uploadBytes = 0; ///< Bytes sent to the GPU: the source triangles, nothing else.
+    size_t nodeBytes = 0; ///< Size of the node and skip-link buffers.
+};
+
+/**
+ * @struct BVHGpuValidation
+ * @brief Comparison of a GPU-built tree with the CPU LBVH over the same triangles.
+ */
+struct BVHGpuValidation {
+    int nodeCount = 0; ///< Nodes compared.
+    int nodeMismatches = 0; ///< Nodes whose bounds or shape differ from the CPU tree.
+    int triMismatches = 0; ///< Leaves holding a different source triangle.
+    int skipMismatches = 0; ///< Skip links that differ from a walk of the GPU tree.
+    float gpuSahCost = 0.0f; ///< SAH cost of the GPU tree.
+    float cpuSahCost = 0.0f; ///< SAH cost of the CPU reference.
+    double cpuBuildMs = 0.0; ///< Time the CPU reference took to build.
+
+    /// @return True if the GPU tree matches the CPU reference exactly.
+    [[nodiscard]] bool ok() const {
+        return nodeCount > 0 && nodeMismatches == 0 && triMismatches == 0 && skipMismatches == 0;
+    }
+};
+
+/**
+ * @class BVHGpuBuilder
+ * @brief Builds a linear BVH on the GPU with transform feedback (OpenGL 4.1).
+ *
+ * Only the source triangles cross the bus. Vertex passes with the
+ * rasterizer discarded compute Morton codes of the centroids, sort them
+ * with a bitonic network, build a segment tree over the sorted triangle
+ * boxes and emit every node of the Karras radix tree, skip link included,
+ * straight into the node pages rt_bvh.glsl reads; triangles are written
+ * to the triangle pages in leaf order. See shaders/bvh/lbvh.vert.
+ *
+ * The tree is the one build_bvh() makes with BVHBuildMethod::LBVH,
+ * 30-bit codes and leafMax 1, but with inner nodes first (node i is radix
+ * tree node i, the root is node 0) and leaves after them. validate()
+ * reads it back and compares it with that CPU build.
+ *
+ * Runs on the thread that owns the GL context.
+ */
+class BVHGpuBuilder {
+public:
+    BVHGpuBuilder();
+    ~BVHGpuBuilder();
+    BVHGpuBuilder(const BVHGpuBuilder &) = delete;
+    BVHGpuBuilder &operator=(const BVHGpuBuilder &) = delete;
+
+    /**
+     * @brief Compiles the passes.
+     *
+     * @param vertPath Path of shaders/bvh/lbvh.vert.
+     * @param fragPath Path of shaders/bvh/lbvh.frag.
+     * @return False if a pass failed to compile or link.
+     */
+    bool init(const std::string &vertPath, const std::string &fragPath);
+
+    /// @return True once init() succeeded.
+    [[nodiscard]] bool ready() const { return initialized; }
+
+    /**
+     * @brief Builds a BVH over tris into handle's node, skip-link and triangle buffers.
+     *
+     * Triangles are packed for handle.triTest (Möller-Trumbore, watertight
+     * or affine); handle.triQuant and handle.indexedTris are cleared. The
+     * sorted order is kept for validate() until the next build.
+     *
+     * @param tris      Source triangles, in any order.
+     * @param handle    Binary BVH whose buffers are created or replaced.
+     * @param outStats  Optional diagnostics.
+     * @param outReason Optional output: why the build was refused.
+     * @return False if the builder is not ready, tris is empty or the
+     *         scratch buffers or outputs exceed one page (bvh_page_texels());
+     *         handle is left untouched then. If allocating its pages fails
+     *         anyway, its nodes and triangles are released.
+     */
+    bool build(const std::vector<CPU_Triangle> &tris, BVHHandle &handle, BVHGpuBuildStats *outStats = nullptr,
+               std::string *outReason = nullptr);
+
+    /**
+     * @brief Reads the last build back and compares it with the CPU LBVH over tris.
+     *
+     * @param tris   Triangles passed to the last build().
+     * @param handle Handle it wrote.
+     */
+    BVHGpuValidation validate(const std::vector<CPU_Triangle> &tris, const BVHHandle &handle) const;
+
+    /// Frees the programs and scratch buffers.
+    void release();
+
+private:
+    struct Scratch {
+        GLuint buf = 0;
+        GLuint tex = 0;
+        size_t bytes = 0;
+    };
+
+    void reserve(Scratch &s, size_t bytes, GLenum format);
+    void freeScratch(Scratch &s);
+    void draw(GLuint out, size_t bytes, int count);
+
+    bool initialized = false;
+    GLuint vao = 0;
+    GLuint timer = 0;
+    int passCount = 0;
+    std::unique_ptr<Shader> centroidPass, reducePass, mortonPass, sortPass, leafPass, levelPass, nodePass, triPass;
+
+    Scratch srcTris; ///< Source triangles (RGBA32F, 3 texels each).
+    Scratch boxes[2]; ///< Reduction ping-pong (RGBA32F box pairs).
+    Scratch keys[2]; ///< Sort ping-pong (RG32UI).
+    Scratch tree; ///< Segment tree over the sorted leaf boxes (heap order, RGBA32F pairs).
+    Scratch level; ///< One segment tree level, copied into tree.
+    int sortedKeys = 0; ///< keys[] entry holding the last sorted order.
+    int lastCount = 0; ///< Triangles of the last build.
+};
@@ -0,0 +1,174 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <glm/glm.hpp>
+#include "scene/bvh.h"
+#include "scene/bvh_metrics.h"
+#include "scene/keyframes.h"
+
+/**
+ * @struct BVHLoadRequest
+ * @brief Everything a background load needs, copied at submit time.
+ */
+struct BVHLoadRequest {
+    std::string path; ///< Model file.
+    glm::mat4 modelTransform{1.0f}; ///< Transform applied when gathering triangles.
+    BVHBuildSettings settings; ///< Builder configuration, including the GPU layout.
+    std::string cacheDir; ///< On-disk BVH cache directory (empty = no caching).
+    bool twoLevel = false; ///< Build per-mesh BLASes for a two-level scene instead of one BVH.
+    size_t previewTris = 0; ///< Progressive preview proxy size (0 = off; see prepare_bvh_from_model_path()).
+};
+
+/// What the loader thread is doing, for the progress display.
+enum class BVHLoadStage {
+    Idle, ///< Nothing queued.
+    Queued, ///< Submitted, waiting for the previous load to finish.
+    Building, ///< Cache lookup, import, triangle gathering and build.
+    Refining, ///< Preview delivered, building the full tree.
+    Keyframes, ///< Importing the sibling keyframes of a sequence.
+    Metrics, ///< Computing shape metrics of the finished tree.
+};
+
+/**
+ * @struct BVHLoadProgress
+ * @brief Snapshot of the loader state.
+ */
+struct BVHLoadProgress {
+    BVHLoadStage stage = BVHLoadStage::Idle; ///< Current step of the newest request.
+    std::string path; ///< Model of the newest request.
+    double seconds = 0.0; ///< Time since the newest request was submitted.
+
+    /// @return True while a request is queued or being processed.
+    [[nodiscard]] bool busy() const {
+        return stage != BVHLoadStage::Idle;
+    }
+
+    /// @return Fraction of the steps already done, for a progress bar.
+    [[nodiscard]] float fraction() const {
+        if (!busy()) return 0.0f;
+        return static_cast<float>(static_cast<int>(stage) - 1) / static_cast<float>(BVHLoadStage::Metrics);
+    }
+};
+
+/**
+ * @brief Human-readable name of a load stage.
+ */
+const char *bvh_load_stage_name(BVHLoadStage stage);
+
+/**
+ * @struct BVHLoadResult
+ * @brief CPU-side output of a background load, ready to be uploaded.
+ *
+ * Single-level loads fill prepared (tree, model, stats), anim and metrics;
+ * two-level loads fill prepared.model, prepared.stats and blas. The model
+ * has no GPU objects yet, so a discarded result can be destroyed on any
+ * thread.
+ *
+ * A progressive load delivers a preview first (prepared.geometry and
+ * prepared.stats only) and the full result later, both with the same id.
+ */
+struct BVHLoadResult {
+    uint64_t id = 0; ///< Value returned by BVHLoader::submit().
+    BVHLoadRequest request; ///< What was loaded.
+    bool ok = false; ///< False if the model failed to load.
+    bool preview = false; ///< Coarse stand-in of a progressive load; the full result follows.
+    BVHPrepared prepared; ///< Imported model and finished tree.
+    std::vector<BVHBlas> blas; ///< Object-space BLASes (two-level loads).
+    KeyframeSequence anim; ///< Keyframes of a sequence (empty if path is not one).
+    int keyframeFiles = 0; ///< Sibling keyframe files found (0 if none, > frameCount() if they did not load).
+    BVHMetrics metrics; ///< Shape metrics without end-point overlap (single-level loads).
+    double seconds = 0.0; ///< Time spent on the loader thread.
+};
+
+/**
+ * @class BVHLoader
+ * @brief Imports models and builds their BVHs on a background thread.
+ *
+ * The render thread submits requests and polls for finished results,
+ * which it then uploads (upload_prepared_bvh()) and swaps in. Only the
+ * newest request matters: a request still waiting is replaced by the next
+ * submit, and results of superseded requests are dropped by poll().
+ *
+ * The worker never touches GL. A load that has started cannot be
+ * interrupted; stop() and the destructor wait for it.
+ */
+class BVHLoader {
+public:
+    BVHLoader() = default;
+    ~BVHLoader();
+    BVHLoader(const BVHLoader &) = delete;
+    BVHLoader &operator=(const BVHLoader &) = delete;
+
+    /**
+     * @brief Queues a load, replacing any request that has not started yet.
+     *
+     * @return Id of the request, echoed in its BVHLoadResult.
+     */
+    uint64_t submit(BVHLoadRequest request);
+
+    /**
+     * @brief Takes the result of the newest request if it is finished.
+     *
+     * Never blocks. Results of older requests are discarded.
+     *
+     * @return True if out was filled.
+     */
+    bool poll(BVHLoadResult &out);
+
+    /**
+     * @brief Blocks until the newest request is finished and takes its result.
+     *
+     * Previews are skipped: out is always a full result.
+     *
+     * @return False if nothing was submitted since the last result was taken.
+     */
+    bool wait(BVHLoadResult &out);
+
+    /**
+     * @brief Supersedes every request: the queued one is dropped and the
+     * result of the running one will be discarded.
+     */
+    void cancel();
+
+    /// @return What the loader is doing for the newest request.
+    [[nodiscard]] BVHLoadProgress progress() const;
+
+    /// Drops the queued request, waits for the running one and joins the thread.
+    void stop();
+
+private:
+    /// Worker thread: takes requests one at a time until stopped.
+    void run();
+
+    /// Runs one request on the worker thread.
+    void process(uint64_t id, const BVHLoadRequest &request, BVHLoadResult &out);
+
+    /// Publishes the current step of request id. @return False if it was superseded: stop working on it.
+    bool setStage(uint64_t id, BVHLoadStage stage);
+
+    /// Queues a progressive preview of request id (dropped if it was superseded).
+    void publishPreview(uint64_t id, const BVHLoadRequest &request, BVHPrepared &preview, double seconds);
+
+    /// Drops finished results older than the newest request. Expects mutex held.
+    void dropStale();
+
+    std::thread worker; ///< Started by the first submit().
+    mutable std::mutex mutex; ///< Guards everything below.
+    std::condition_variable wake; ///< Signals the worker: new request or stop.
+    std::condition_variable finished; ///< Signals wait(): a result was queued.
+    bool stopping = false; ///< Set by stop().
+    bool hasPending = false; ///< True if pending holds a request not started yet.
+    BVHLoadRequest pending; ///< Request waiting for the worker.
+    uint64_t pendingId = 0; ///< Id of pending.
+    uint64_t latestId = 0; ///< Id of the newest submitted request.
+    std::deque<BVHLoadResult> completed; ///< Finished results, oldest first.
+    BVHLoadStage stage = BVHLoadStage::Idle; ///< Step of the newest request.
+    std::string latestPath; ///< Model of the newest request.
+    std::chrono::steady_clock::time_point latestStart; ///< Submit time of the newest request.
+};
@@ -0,0 +1,115 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "scene/bvh.h"
+
+/**
+ * @struct BVHMetrics
+ * @brief Quality and shape statistics of a finished binary BVH.
+ *
+ * All costs use the constants of the BVHBuildSettings passed to
+ * compute_bvh_metrics() and are normalized by the root surface area, so
+ * trees over the same triangles can be compared directly.
+ */
+struct BVHMetrics {
+    /// Size of the fixed traversal stacks in rt_bvh.glsl (int stack[64]).
+    static constexpr int kGpuStackSize = 64;
+    /// Leaf-size histogram bins; the last one collects larger leaves.
+    static constexpr int kLeafHistogramBins = 17;
+
+    int nodeCount = 0; ///< Nodes in the binary tree.
+    int leafCount = 0; ///< Leaf nodes.
+    int triCount = 0; ///< Triangle entries referenced by leaves.
+    float sahCost = 0.0f; ///< SAH cost (bvh_sah_cost()).
+    float epo = 0.0f; ///< End-point overlap: cost-weighted triangle area inside unrelated nodes, per unit area.
+    int maxDepth = 0; ///< Depth of the deepest leaf (root = 0).
+    float avgDepth = 0.0f; ///< Average leaf depth.
+    float avgLeafSize = 0.0f; ///< Average triangles per leaf.
+    float emptySpace = 0.0f; ///< Area-weighted share of inner-node volume not covered by either child.
+    int leafSizes[kLeafHistogramBins] = {}; ///< leafSizes[k]: leaves with k triangles (k = 0 unused).
+    int gpuWidth = 2; ///< Node width the stack estimate refers to.
+    int stackHighWater = 0; ///< Worst-case traversal stack depth for that layout.
+
+    /// @return True if some ray could push more entries than the shader's stack holds.
+    [[nodiscard]] bool stackOverflows() const {
+        return stackHighWater > kGpuStackSize;
+    }
+};
+
+/**
+ * @brief Computes quality metrics of a BVH.
+ *
+ * The stack estimate follows the shader's traversal order: every visited
+ * inner node pushes all of its children (binary) or all of its inner
+ * children (collapsed BVH4/BVH8), so along a root-to-leaf path the stack
+ * holds the not-yet-visited siblings of every ancestor. The maximum of
+ * that over all paths is what a worst-case ray would reach.
+ *
+ * End-point overlap (Aila et al. 2013) clips every triangle against every
+ * node box outside its own subtree, weighting inner nodes by traversalCost
+ * and leaves by intersectCost times their size. It is the most expensive
+ * metric and can be skipped.
+ *
+ * @param nodes    Binary tree from build_bvh().
+ * @param tris     Its triangles in leaf order.
+ * @param settings Cost constants.
+ * @param gpuWidth Layout to estimate the stack for: 2, 4 or 8.
+ * @param withEpo  Compute end-point overlap.
+ * @return The metrics; all zero for an empty tree.
+ */
+BVHMetrics compute_bvh_metrics(const std::vector<BVHNode> &nodes, const std::vector<CPU_Triangle> &tris,
+                               const BVHBuildSettings &settings, int gpuWidth = 2, bool withEpo = true);
+
+/**
+ * @struct BVHLocality
+ * @brief Texel-fetch locality of binary traversal, measured by measure_bvh_locality().
+ *
+ * Fetches go through a simulated texture cache (kCacheBytes, kWays-way
+ * set associative, LRU, kLineBytes lines) shared by nodes, skip links and
+ * triangles, in the order the shader issues them. Hit rates are per
+ * fetched line; lines per ray count the misses, i.e. the memory traffic.
+ */
+struct BVHLocality {
+    static constexpr int kLineBytes = 128; ///< Cache line size.
+    static constexpr int kCacheBytes = 16 << 10; ///< Cache capacity.
+    static constexpr int kWays = 4; ///< Associativity.
+
+    int rays = 0; ///< Rays traced.
+    float nodeFetchesPerRay = 0.0f; ///< Node fetches (2 texels each) per ray.
+    float nodeLinesPerRay = 0.0f; ///< Node and skip-link lines missed per ray.
+    float triLinesPerRay = 0.0f; ///< Triangle lines missed per ray.
+    float nodeHitRate = 0.0f; ///< Share of node and skip-link line accesses that hit.
+    float triHitRate = 0.0f; ///< Share of triangle line accesses that hit.
+    double ms = 0.0; ///< Time spent in the measurement.
+};
+
+/**
+ * @brief Traces rays through a binary BVH on the CPU and measures fetch locality.
+ *
+ * The traversal mirrors a closest-hit blasTrace() in rt_bvh.glsl: the
+ * stack variant fetches a popped node and then both of its children, the
+ * stackless one fetches each node it steps to plus its skip link. Rays run in the
+ * given order through one cache, so passing them in screen tiles
+ * approximates neighbouring pixels sharing the texture cache.
+ *
+ * @param nodes     Binary tree (any BVHLayout).
+ * @param tris      Its triangles.
+ * @param origins   Ray origins.
+ * @param dirs      Ray directions, one per origin.
+ * @param triBytes  Bytes per entry of the triangle stream (48 direct, 24 compressed, 12 indexed).
+ * @param stackless Mirror the skip-link traversal instead of the stack one.
+ * @return The measurement; all zero for an empty tree or no rays.
+ */
+BVHLocality measure_bvh_locality(const std::vector<BVHNode> &nodes, const std::vector<CPU_Triangle> &tris,
+                                 const std::vector<glm::vec3> &origins, const std::vector<glm::vec3> &dirs,
+                                 int triBytes, bool stackless);
+
+/**
+ * @brief Serializes metrics (plus the build that produced them) as JSON.
+ *
+ * @param metrics   Metrics from compute_bvh_metrics().
+ * @param stats     Build diagnostics of the same tree.
+ * @param modelPath Model the tree was built from (stored as-is).
+ * @return A self-contained JSON object.
+ */
+std::string bvh_metrics_to_json(const BVHMetrics &metrics, const BVHBuildStats &stats, const std::string &modelPath);
@@ -0,0 +1,131 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <string>
+#include <glm/glm.hpp>
+#include "scene/bvh.h"
+#include "scene/bvh_metrics.h"
+#include "scene/keyframes.h"
+
+/**
+ * @struct BVHResidentKey
+ * @brief Identifies a built BVH: model file, transform, build settings and GPU encoding.
+ *
+ * The file is identified by path and last write time rather than by
+ * content, so looking a key up never reads the model.
+ */
+struct BVHResidentKey {
+    std::string path; ///< Model path as selected in the picker.
+    std::filesystem::file_time_type writeTime{}; ///< Last write time of the model file.
+    uint64_t settingsHash = 0; ///< bvh_settings_hash() of transform and builder settings (0 = no BVH).
+    int gpuWidth = 2; ///< Uploaded node layout.
+    BVHTriTest triTest = BVHTriTest::MollerTrumbore; ///< Triangle test the upload was packed for.
+    bool indexedTris = false; ///< Triangles were uploaded as indices into shared vertices.
+
+    /// @return True if this key describes a BVH.
+    [[nodiscard]] bool valid() const {
+        return settingsHash != 0;
+    }
+
+    bool operator==(const BVHResidentKey &other) const {
+        return settingsHash == other.settingsHash && gpuWidth == other.gpuWidth && triTest == other.triTest &&
+               indexedTris == other.indexedTris && writeTime == other.writeTime && path == other.path;
+    }
+};
+
+/**
+ * @brief Key of the BVH rebuild_bvh_from_model_path() would produce.
+ *
+ * @param path           Model file.
+ * @param modelTransform Transform applied when gathering triangles.
+ * @param settings       Builder configuration (including gpuWidth, triTest and indexedTris).
+ * @return The key; invalid if the file does not exist.
+ */
+BVHResidentKey make_bvh_resident_key(const char *path, const glm::mat4 &modelTransform,
+                                     const BVHBuildSettings &settings);
+
+/**
+ * @struct BVHResident
+ * @brief A built and uploaded single-level BVH, with everything the UI shows about it.
+ */
+struct BVHResident {
+    BVHResidentKey key; ///< What this BVH was built from.
+    BVHHandle handle; ///< GPU buffers, still uploaded.
+    BVHGeometry geometry; ///< CPU copy (refits, metrics).
+    BVHBuildStats stats; ///< Diagnostics of the build.
+    BVHMetrics metrics; ///< Shape metrics of the tree.
+    KeyframeSequence anim; ///< Keyframes if the model is part of a sequence.
+    int nodeCount = 0; ///< Uploaded nodes (binary or wide).
+    int triCount = 0; ///< Uploaded triangles.
+
+    /// @return GPU memory held by handle.
+    [[nodiscard]] size_t gpuBytes() const {
+        return stats.nodeBytes + stats.triBytes;
+    }
+
+    /// @return CPU memory held by geometry and keyframes.
+    [[nodiscard]] size_t cpuBytes() const {
+        size_t bytes = geometry.nodes.size() * sizeof(BVHNode) + geometry.tris.size() * sizeof(CPU_Triangle) +
+                       geometry.sourceIndex.size() * sizeof(int);
+        for (const auto &frame: anim.frames) bytes += frame.size() * sizeof(CPU_Triangle);
+        return bytes;
+    }
+};
+
+/**
+ * @class BVHResidencyCache
+ * @brief Least-recently-used set of BVHs kept resident after switching away from them.
+ *
+ * Switching back to a resident BVH is a handle swap: no import, no build,
+ * no upload. Entries are evicted oldest first whenever the GPU or the CPU
+ * budget is exceeded, releasing their GL buffers.
+ *
+ * Like BVHHandle, the cache does not release anything on destruction:
+ * clear() must be called while the GL context is still alive.
+ */
+class BVHResidencyCache {
+public:
+    /**
+     * @brief Sets the memory budgets and evicts entries that no longer fit.
+     *
+     * @param gpuLimit Bytes of TBO data the resident BVHs may hold.
+     * @param cpuLimit Bytes of CPU geometry the resident BVHs may hold.
+     */
+    void setBudget(size_t gpuLimit, size_t cpuLimit);
+
+    /**
+     * @brief Adds a BVH as the most recently used entry.
+     *
+     * An entry with the same key is replaced. If the new entry alone
+     * exceeds a budget it is released right away.
+     */
+    void put(BVHResident &&entry);
+
+    /**
+     * @brief Removes the entry for key and hands it to the caller.
+     *
+     * @return True if the BVH was resident; out then owns its GPU buffers.
+     */
+    bool take(const BVHResidentKey &key, BVHResident &out);
+
+    /// @return True if the BVH for key is resident.
+    [[nodiscard]] bool contains(const BVHResidentKey &key) const;
+
+    /// Releases every entry.
+    void clear();
+
+    [[nodiscard]] int size() const { return static_cast<int>(entries.size()); }
+    [[nodiscard]] size_t gpuBytes() const { return gpuUsed; }
+    [[nodiscard]] size_t cpuBytes() const { return cpuUsed; }
+
+private:
+    /// Drops least recently used entries until both budgets are met.
+    void evict();
+
+    std::list<BVHResident> entries; ///< Most recently used first.
+    size_t gpuBudget = 256u << 20; ///< See setBudget().
+    size_t cpuBudget = 512u << 20; ///< See setBudget().
+    size_t gpuUsed = 0; ///< Sum of gpuBytes() over entries.
+    size_t cpuUsed = 0; ///< Sum of cpuBytes() over entries.
+};
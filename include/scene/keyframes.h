@@ -0,0 +1,79 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "scene/bvh.h"
+
+/**
+ * @struct KeyframeSequence
+ * @brief Vertex-animated geometry stored as one triangle list per keyframe.
+ *
+ * Each keyframe is a separate OBJ file with identical topology (same
+ * triangle count and order), e.g. wave_0000.obj, wave_0001.obj, ...
+ * Triangles are stored already transformed into BVH space and in the
+ * gather_model_triangles() order, so a sampled frame can be fed straight
+ * to refit_bvh().
+ */
+struct KeyframeSequence {
+    std::vector<std::vector<CPU_Triangle>> frames; ///< Triangles of every keyframe.
+    float fps = 24.0f; ///< Playback rate in keyframes per second.
+
+    /// @return Number of keyframes.
+    [[nodiscard]] int frameCount() const {
+        return static_cast<int>(frames.size());
+    }
+
+    /// @return True if there is nothing to animate (fewer than two keyframes).
+    [[nodiscard]] bool empty() const {
+        return frames.size() < 2;
+    }
+
+    /// Drops all keyframes.
+    void clear() {
+        frames.clear();
+    }
+};
+
+/**
+ * @brief Finds the keyframe files belonging to the same sequence as path.
+ *
+ * A file is part of a sequence when its stem ends in a separator ('_',
+ * '-' or '.') and a zero-padded frame number of at least two digits
+ * (name_0001.obj, name-12.obj, ...). All siblings with the same prefix,
+ * number width and extension are returned, sorted by frame number; they
+ * must form a contiguous run, so model1.obj and model2.obj, or a few
+ * unrelated numbered exports, are not taken for a sequence.
+ *
+ * @param path Any frame of the sequence.
+ * @return Sorted frame paths, or an empty list if path is not part of a
+ *         contiguous sequence of at least two files.
+ */
+std::vector<std::string> find_keyframe_files(const std::string &path);
+
+/**
+ * @brief Loads every keyframe and extracts its triangles.
+ *
+ * Frames whose triangle count differs from the first frame are rejected,
+ * since refitting requires a fixed topology. No GL objects are created,
+ * so this may run on a worker thread.
+ *
+ * @param paths          Keyframe files, in playback order.
+ * @param modelTransform Transform applied to every frame (same as the BVH).
+ * @param out            Output sequence; cleared on failure.
+ * @return True if at least two consistent keyframes were loaded.
+ */
+bool load_keyframe_sequence(const std::vector<std::string> &paths, const glm::mat4 &modelTransform,
+                            KeyframeSequence &out);
+
+/**
+ * @brief Samples the looping sequence at a given time.
+ *
+ * Linearly interpolates between the two surrounding keyframes. Since
+ * CPU_Triangle stores v0 and two edges, all of which are linear in the
+ * vertex positions, interpolating them directly is exact.
+ *
+ * @param seq     Sequence to sample (must not be empty()).
+ * @param seconds Playback time; wraps around at the end of the sequence.
+ * @param outTris Output triangles, resized to the sequence's triangle count.
+ */
+void sample_keyframe_sequence(const KeyframeSequence &seq, double seconds, std::vector<CPU_Triangle> &outTris);
@@ -67,6 +67,9 @@ public:
     /// Triangle index buffer.
     std::vector<GLuint> indices;
 
+    /// Number of indices uploaded to the EBO (kept after releaseCpuData()).
+    GLsizei indexCount = 0;
+
     /// Vertex Array Object used to render the mesh.
     GLuint VAO{};
 
@@ -84,14 +87,19 @@ public:
      *
      * @param verticesIn Vertex attribute list (moved).
      * @param indicesIn  Index buffer (moved).
+     * @param uploadNow  Create the GPU objects right away. Pass false to
+     *                   build the mesh on a thread without a GL context,
+     *                   then call upload() on the render thread.
      *
      * The constructor takes ownership and initializes VAO, VBO, and EBO.
      */
     Mesh(std::vector<Vertex> verticesIn,
-         std::vector<GLuint> indicesIn) noexcept
+         std::vector<GLuint> indicesIn,
+         const bool uploadNow = true) noexcept
         : vertices(std::move(verticesIn)),
-          indices(std::move(indicesIn)) {
-        setupMesh();
+          indices(std::move(indicesIn)),
+          indexCount(static_cast<GLsizei>(indices.size())) {
+        if (uploadNow) setupMesh();
     }
 
     /**
@@ -104,6 +112,7 @@ public:
     Mesh(Mesh &&move) noexcept
         : vertices(std::move(move.vertices)),
           indices(std::move(move.indices)),
+          indexCount(move.indexCount),
           VAO(move.VAO), VBO(move.VBO), EBO(move.EBO) {
         move.VAO = 0; // moved-from state
     }
@@ -115,16 +124,13 @@ public:
         if (this == &move) return *this;
 
         freeGPUResources();
-        if (move.VAO) {
-            vertices = std::move(move.vertices);
-            indices = std::move(move.indices);
-            VAO = move.VAO;
-            VBO = move.VBO;
-            EBO = move.EBO;
-            move.VAO = 0;
-        } else {
-            VAO = 0;
-        }
+        vertices = std::move(move.vertices);
+        indices = std::move(move.indices);
+        indexCount = move.indexCount;
+        VAO = move.VAO;
+        VBO = move.VBO;
+        EBO = move.EBO;
+        move.VAO = 0;
         return *this;
     }
 
@@ -146,10 +152,41 @@ public:
      */
     void Draw() const {
         glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(indices.size()), GL_UNSIGNED_INT, nullptr);
+        glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, nullptr);
         glBindVertexArray(0);
     }
 
+    /**
+     * @brief Creates the GPU objects of a mesh constructed with uploadNow = false.
+     *
+     * Does nothing if they exist already. Needs the CPU arrays.
+     */
+    void upload() {
+        if (!VAO) setupMesh();
+    }
+
+    /**
+     * @brief Frees the CPU copies of vertices and indices.
+     *
+     * The GPU buffers are untouched, so Draw() keeps working. Code that
+     * reads the arrays afterwards sees an empty mesh until they are
+     * refilled (see Model::reloadCpuData()).
+     */
+    void releaseCpuData() {
+        std::vector<Vertex>().swap(vertices);
+        std::vector<GLuint>().swap(indices);
+    }
+
+    /// @return True if the vertex and index arrays are held on the CPU.
+    [[nodiscard]] bool hasCpuData() const {
+        return indexCount == 0 || !indices.empty();
+    }
+
+    /// @return Host memory held by the vertex and index arrays.
+    [[nodiscard]] size_t cpuBytes() const {
+        return vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(GLuint);
+    }
+
 private:
     /// Vertex Buffer Object (stores vertex attributes).
     GLuint VBO{};
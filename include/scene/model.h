@@ -15,6 +15,8 @@
     2) Copying is disabled — this is a move-only class to avoid duplicating GPU resources.
     3) This version does not support textures.
     4) Based on LearnOpenGL’s model loading example by Joey de Vries.
+    5) The CPU vertex/index arrays can be released after upload (lean memory
+       mode) and re-read from the source file on demand.
 
     Authors: Davide Gadia, Michael Marchesan
     Real-Time Graphics Programming – 2024/2025
@@ -69,12 +71,22 @@ public:
     /**
      * @brief Constructs a model by loading it from disk.
      *
-     * @param path Path to the model file (OBJ, FBX, etc. supported by Assimp).
+     * @param path      Path to the model file (OBJ, FBX, etc. supported by Assimp).
+     * @param uploadNow Create the meshes' GPU objects right away. Pass false
+     *                  to import on a thread without a GL context (or when
+     *                  only the CPU geometry is needed), then call upload()
+     *                  on the render thread before drawing.
      *
      * The constructor immediately calls loadModel() and populates the `meshes` vector.
      */
-    explicit Model(const std::string &path) {
-        loadModel(path);
+    explicit Model(const std::string &path, const bool uploadNow = true) : sourcePath(path) {
+        loadModel(path, uploadNow);
+    }
+
+    /// Creates the GPU objects of meshes imported with uploadNow = false.
+    void upload() {
+        for (auto &mesh: meshes)
+            mesh.upload();
     }
 
     /**
@@ -87,7 +99,70 @@ public:
             mesh.Draw();
     }
 
+    // -------------------------------------------------------------------------
+    // CPU geometry (lean memory mode)
+    // -------------------------------------------------------------------------
+
+    /**
+     * @brief Frees the CPU vertex/index arrays of every mesh.
+     *
+     * Drawing is unaffected; CPU readers must call reloadCpuData() first.
+     */
+    void releaseCpuData() {
+        for (auto &mesh: meshes)
+            mesh.releaseCpuData();
+    }
+
+    /**
+     * @brief Re-reads the CPU vertex/index arrays from the model file.
+     *
+     * Does nothing if they are still present. The GPU buffers are not
+     * touched.
+     *
+     * @return True if every mesh has its CPU arrays afterwards; false if
+     *         the file can no longer be read or no longer matches.
+     */
+    bool reloadCpuData() {
+        if (hasCpuData()) return true;
+
+        Assimp::Importer importer;
+        const aiScene *scene = importScene(importer, sourcePath);
+        if (!scene) return false;
+
+        std::vector<const aiMesh *> sources;
+        collectMeshes(scene->mRootNode, scene, sources);
+        if (sources.size() != meshes.size()) return false;
+
+        for (size_t i = 0; i < meshes.size(); ++i) {
+            Mesh &mesh = meshes[i];
+            readMesh(sources[i], mesh.vertices, mesh.indices);
+            if (static_cast<GLsizei>(mesh.indices.size()) != mesh.indexCount) {
+                releaseCpuData();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /// @return True if every mesh holds its CPU arrays.
+    [[nodiscard]] bool hasCpuData() const {
+        for (const auto &mesh: meshes)
+            if (!mesh.hasCpuData()) return false;
+        return true;
+    }
+
+    /// @return Host memory held by the CPU arrays of all meshes.
+    [[nodiscard]] size_t cpuBytes() const {
+        size_t bytes = 0;
+        for (const auto &mesh: meshes)
+            bytes += mesh.cpuBytes();
+        return bytes;
+    }
+
 private:
+    /// File the model was loaded from, re-read by reloadCpuData().
+    std::string sourcePath;
+
     // -------------------------------------------------------------------------
     // Import pipeline
     // -------------------------------------------------------------------------
@@ -95,16 +170,28 @@ private:
     /**
      * @brief Loads a model file using Assimp and processes its entire node hierarchy.
      *
-     * @param path Filesystem path to the model being loaded.
+     * @param path      Filesystem path to the model being loaded.
+     * @param uploadNow Forwarded to every Mesh.
      *
      * The function:
      *  - reads the file via Assimp::Importer
      *  - validates the scene
      *  - recursively processes all nodes and meshes
      */
-    void loadModel(const std::string &path) {
+    void loadModel(const std::string &path, const bool uploadNow) {
         Assimp::Importer importer;
+        const aiScene *scene = importScene(importer, path);
+        if (!scene) return;
 
+        processNode(scene->mRootNode, scene, uploadNow);
+    }
+
+    /**
+     * @brief Reads a model file with the import flags used by this class.
+     *
+     * @return The scene (owned by importer), or nullptr on failure.
+     */
+    static const aiScene *importScene(Assimp::Importer &importer, const std::string &path) {
         const aiScene *scene = importer.ReadFile(
             path,
             aiProcess_Triangulate |
@@ -116,46 +203,76 @@ private:
 
         if (!scene || (scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE) || !scene->mRootNode) {
             std::cerr << "ERROR::ASSIMP:: " << importer.GetErrorString() << '\n';
-            return;
+            return nullptr;
         }
+        return scene;
+    }
 
-        processNode(scene->mRootNode, scene);
+    /**
+     * @brief Lists the meshes referenced by the node hierarchy, in the order processNode() creates them.
+     */
+    static void collectMeshes(const aiNode *node, const aiScene *scene, std::vector<const aiMesh *> &out) {
+        for (unsigned int i = 0; i < node->mNumMeshes; ++i)
+            out.push_back(scene->mMeshes[node->mMeshes[i]]);
+
+        for (unsigned int i = 0; i < node->mNumChildren; ++i)
+            collectMeshes(node->mChildren[i], scene, out);
     }
 
     /**
      * @brief Recursively walks the Assimp scene graph and processes each mesh.
      *
-     * @param node  Current node in the scene hierarchy.
-     * @param scene Full Assimp scene containing mesh references.
+     * @param node      Current node in the scene hierarchy.
+     * @param scene     Full Assimp scene containing mesh references.
+     * @param uploadNow Forwarded to every Mesh.
      *
      * Each referenced aiMesh is converted into a Mesh instance and stored
      * in the `meshes` vector.
      */
-    void processNode(const aiNode *node, const aiScene *scene) {
+    void processNode(const aiNode *node, const aiScene *scene, const bool uploadNow) {
         for (unsigned int i = 0; i < node->mNumMeshes; ++i) {
             aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.emplace_back(processMesh(mesh));
+            meshes.emplace_back(processMesh(mesh, uploadNow));
         }
 
         for (unsigned int i = 0; i < node->mNumChildren; ++i)
-            processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, uploadNow);
     }
 
     /**
      * @brief Converts an Assimp aiMesh into a Mesh object.
      *
+     * Reads the CPU arrays with readMesh(), then constructs a Mesh object
+     * (which uploads the data to the GPU unless uploadNow is false).
+     *
+     * @param mesh      Assimp mesh structure containing raw mesh data.
+     * @param uploadNow Forwarded to the Mesh constructor.
+     * @return Mesh converted to the internal format.
+     */
+    static Mesh processMesh(const aiMesh *mesh, const bool uploadNow) {
+        std::vector<Vertex> vertices;
+        std::vector<GLuint> indices;
+        readMesh(mesh, vertices, indices);
+
+        // Ownership and GPU upload occur inside Mesh
+        return Mesh{std::move(vertices), std::move(indices), uploadNow};
+    }
+
+    /**
+     * @brief Reads the vertex and index arrays of an Assimp aiMesh.
+     *
      * This function:
      *  - reads vertex attributes (pos, normal, UV, tangent, bitangent)
      *  - extracts triangle indices
      *  - fills std::vector<Vertex> and std::vector<GLuint>
-     *  - constructs a Mesh object (which uploads the data to the GPU)
      *
-     * @param mesh Assimp mesh structure containing raw mesh data.
-     * @return Mesh converted to the internal format.
+     * @param mesh     Assimp mesh structure containing raw mesh data.
+     * @param vertices Replaced by the vertex attributes.
+     * @param indices  Replaced by the triangle indices.
      */
-    static Mesh processMesh(aiMesh *mesh) {
-        std::vector<Vertex> vertices;
-        std::vector<GLuint> indices;
+    static void readMesh(const aiMesh *mesh, std::vector<Vertex> &vertices, std::vector<GLuint> &indices) {
+        vertices.clear();
+        indices.clear();
 
         bool warnedNoUV = false;
 
@@ -218,12 +335,9 @@ private:
         // Read all face indices
         indices.reserve(mesh->mNumFaces * 3);
         for (unsigned int i = 0; i < mesh->mNumFaces; ++i) {
-            aiFace &face = mesh->mFaces[i];
+            const aiFace &face = mesh->mFaces[i];
             for (unsigned int j = 0; j < face.mNumIndices; ++j)
                 indices.emplace_back(face.mIndices[j]);
         }
-
-        // Ownership and GPU upload occur inside Mesh
-        return Mesh{std::move(vertices), std::move(indices)};
     }
 };
@@ -4,6 +4,11 @@
 #include "render/RenderParams.h"
 #include "render/frame_state.h"
 #include "io/input.h"
+#include "scene/bvh.h"
+#include "scene/bvh_dynamic.h"
+#include "scene/bvh_gpu.h"
+#include "scene/bvh_loader.h"
+#include "scene/bvh_metrics.h"
 
 /// ImGui user interface layer: control panels, pickers, HUD elements, and debug console.
 namespace ui {
@@ -45,14 +50,70 @@ namespace ui {
      * @struct BvhModelPickerState
      * @brief Stores UI state for selecting BVH models.
      *
-     * Tracks the current file path, selected index in the dropdown, and
-     * a flag requesting a BVH reload. Used by the control panel when BVH
-     * mode is enabled.
+     * Tracks the current file path, selected index in the dropdown, the
+     * builder configuration, keyframe playback controls, and a flag
+     * requesting a BVH reload. Used by the control panel when BVH mode is
+     * enabled. The statistics fields are written by the application after
+     * each rebuild or refit and only displayed here.
      */
     struct BvhModelPickerState {
         bool reloadRequested = false; ///< True if the user requested to reload the BVH model.
         int selectedIndex = 0; ///< Index of the model selected in the UI dropdown.
         char currentPath[256] = "../models/bunny_lp.obj"; ///< Current path to the BVH model file.
+        bool benchmarkRequested = false; ///< True if the user requested a thread-scaling build benchmark.
+        BVHBuildSettings build; ///< Builder used for the next reload.
+        bool useCache = true; ///< Load and store finished BVHs in the on-disk cache.
+        bool leanMemory = false; ///< Drop CPU mesh arrays after upload and BVH build; re-read them on demand.
+        bool leanMemoryChanged = false; ///< True if leanMemory was toggled: release or re-read the arrays.
+        size_t meshCpuBytes = 0; ///< Host memory held by the CPU arrays of the loaded models.
+        bool progressive = true; ///< Show a BVH over a simplified proxy while a large model is built.
+        int previewTrisK = 500; ///< Proxy size of the progressive preview, in thousands of triangles.
+        bool stacklessTraversal = false; ///< Walk binary trees along skip links instead of a stack.
+        bool traversalChanged = false; ///< True if the traversal mode changed: recompile the ray shader.
+        bool traversalBenchmarkRequested = false; ///< True if the user asked to time both traversal modes.
+        bool triPackingChanged = false; ///< True if build.triTest or build.indexedTris changed: repack the current triangles.
+        bool triTestBenchmarkRequested = false; ///< True if the user asked to time every triangle test.
+        bool triStorageBenchmarkRequested = false; ///< True if the user asked to time direct and indexed triangles.
+        static constexpr int kLayoutCount = 5; ///< Values of BVHLayout.
+        bool layoutBenchmarkRequested = false; ///< True if the user asked to measure fetch locality of every node layout.
+        BVHLocality layoutLocality[kLayoutCount]; ///< Measured locality per BVHLayout (rays == 0 = not measured).
+        size_t triStorageBytes[2] = {0, 0}; ///< Benchmarked triangle data of direct [0] and indexed [1] storage.
+        double triStorageMs[2] = {0.0, 0.0}; ///< Benchmarked GPU time per frame of each storage (0 = not measured).
+        int residentGpuBudgetMB = 256; ///< GPU memory for recently used BVHs kept resident.
+        int residentCpuBudgetMB = 512; ///< CPU memory for recently used BVHs kept resident.
+        bool residentBudgetChanged = false; ///< True if a budget changed: evict what no longer fits.
+        int residentCount = 0; ///< BVHs currently resident (besides the active one).
+        size_t residentGpuBytes = 0; ///< GPU memory held by resident BVHs.
+        size_t residentCpuBytes = 0; ///< CPU memory held by resident BVHs.
+        BVHBuildStats stats; ///< Diagnostics of the last successful build.
+        bool gpuValidate = false; ///< Compare every GPU build with the CPU LBVH (reads the tree back).
+        BVHGpuBuildStats gpuBuild; ///< Diagnostics of the last GPU build (passes == 0 if none).
+        BVHGpuValidation gpuValidation; ///< Result of the last validation (nodeCount == 0 if none).
+        int nodeCount = 0; ///< Node count of the current BVH.
+        int triCount = 0; ///< Triangle count of the current BVH.
+        int animFrameCount = 0; ///< Keyframes found next to the current model (0 if it is not a sequence).
+        bool animPlay = false; ///< Play the keyframe sequence, refitting the BVH every frame.
+        float animFps = 24.0f; ///< Keyframe playback rate.
+        BVHRefitStats refit; ///< Diagnostics of the last refit.
+        int refitRebuilds = 0; ///< Full rebuilds triggered by SAH degradation since the model was loaded.
+        bool instancing = false; ///< Build a two-level scene (TLAS over per-mesh BLAS) instead of one BVH.
+        int instanceCopies = 16; ///< Copies of the model placed on a grid (instancing only).
+        float instanceSpacing = 2.0f; ///< Grid spacing between copies, in world units.
+        bool animateInstances = false; ///< Spin the copies every frame (TLAS-only updates).
+        bool instancesChanged = false; ///< True if copies/spacing changed: re-place instances, keep BLASes.
+        int instanceCount = 0; ///< Instances in the current scene.
+        int blasCount = 0; ///< Bottom-level BVHs in the current scene.
+        BVHBuildStats tlasStats; ///< Diagnostics of the last TLAS build.
+        int propIndex = 0; ///< Entry of the model list selected as prop.
+        char propPath[256] = ""; ///< Model inserted by the next "Insert prop" (empty = the current model).
+        bool propInsertRequested = false; ///< True if the user asked to insert a prop in front of the camera.
+        bool propRemoveRequested = false; ///< True if the user asked to remove the last inserted prop.
+        int propCount = 0; ///< Props inserted into the current BVH.
+        BVHEditStats edit; ///< Diagnostics of the last prop insertion or removal.
+        BVHMetrics metrics; ///< Shape metrics of the current single-level BVH (nodeCount == 0 if none).
+        bool epoValid = false; ///< True once metrics.epo has been computed for the current BVH.
+        bool epoRequested = false; ///< True if the user asked for the (slow) end-point overlap.
+        BVHLoadProgress load; ///< State of the background load (mirrored from the loader every frame).
     };
 
     /**
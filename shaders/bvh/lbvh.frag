@@ -0,0 +1,12 @@
+#version 410 core
+
+/*
+    lbvh.frag – never runs: the LBVH passes draw with GL_RASTERIZER_DISCARD
+    and only use transform feedback. Present so every program has both stages.
+*/
+
+out vec4 FragColor;
+
+void main() {
+    FragColor = vec4(0.0);
+}
@@ -0,0 +1,305 @@
+#version 410 core
+
+/*
+    lbvh.vert – GPU linear BVH construction (Karras 2012)
+
+    Every pass is one glDrawArrays(GL_POINTS) with the rasterizer
+    discarded: vertex gl_VertexID computes one item and transform feedback
+    writes it out. Inputs are texture buffers, so no compute shaders,
+    image stores or atomics are needed (OpenGL 4.1). The host selects a
+    pass with one of these defines (see BVHGpuBuilder):
+
+    - LBVH_CENTROID_BOUNDS : bounds of 16 triangle centroids per vertex
+    - LBVH_REDUCE          : union of 16 boxes per vertex
+    - LBVH_MORTON          : (30-bit Morton code, triangle) key per triangle,
+                             padded to a power of two with keys that sort last
+    - LBVH_SORT            : one compare-exchange step of a bitonic sort
+    - LBVH_LEAF_BOXES      : box of the triangle behind each sorted key
+    - LBVH_BOX_LEVEL       : one level of a segment tree over those boxes
+    - LBVH_NODES           : every node of the radix tree, in the GPU node
+                             format, plus its skip link
+    - LBVH_TRIS            : triangles in sorted order, in the GPU format
+
+    Node i < n - 1 is inner node i of the radix tree (the root is node 0);
+    node n - 1 + k is the leaf of sorted triangle k. Boxes are read from the
+    segment tree, so a node's bounds are the exact union of its triangles'
+    boxes, as on the CPU. The arithmetic up to the Morton codes mirrors the
+    CPU LBVH operation by operation ("precise" keeps the compiler from
+    fusing it), so both builders produce the same tree.
+*/
+
+uniform samplerBuffer uTris;   // source triangles: v0, e1, e2 (3 RGBA32F texels each)
+uniform samplerBuffer uBoxes;  // boxes as (min, max) RGBA32F texel pairs
+uniform usamplerBuffer uKeys;  // sorted (code, triangle) keys, RG32UI
+uniform int uCount;            // triangles
+
+struct Box {
+    vec3 lo;
+    vec3 hi;
+};
+
+Box emptyBox() {
+    return Box(vec3(1e30), vec3(-1e30));
+}
+
+Box fetchBox(int i) {
+    return Box(texelFetch(uBoxes, 2 * i).xyz, texelFetch(uBoxes, 2 * i + 1).xyz);
+}
+
+Box unite(Box a, Box b) {
+    return Box(min(a.lo, b.lo), max(a.hi, b.hi));
+}
+
+void fetchTri(int t, out vec3 v0, out vec3 e1, out vec3 e2) {
+    v0 = texelFetch(uTris, 3 * t).xyz;
+    e1 = texelFetch(uTris, 3 * t + 1).xyz;
+    e2 = texelFetch(uTris, 3 * t + 2).xyz;
+}
+
+Box triBox(int t) {
+    vec3 v0, e1, e2;
+    fetchTri(t, v0, e1, e2);
+    precise vec3 v1 = v0 + e1;
+    precise vec3 v2 = v0 + e2;
+    return Box(min(v0, min(v1, v2)), max(v0, max(v1, v2)));
+}
+
+vec3 triCentroid(int t) {
+    vec3 v0, e1, e2;
+    fetchTri(t, v0, e1, e2);
+    precise vec3 v1 = v0 + e1;
+    precise vec3 v2 = v0 + e2;
+    precise vec3 sum = v0 + v1 + v2;
+    precise vec3 c = sum * 0.333333343; // float(1.0 / 3.0), as on the CPU
+    return c;
+}
+
+#if defined(LBVH_CENTROID_BOUNDS) || defined(LBVH_REDUCE) || defined(LBVH_LEAF_BOXES) || defined(LBVH_BOX_LEVEL)
+out vec4 oMin;
+out vec4 oMax;
+
+void emitBox(Box b) {
+    oMin = vec4(b.lo, 0.0);
+    oMax = vec4(b.hi, 0.0);
+}
+#endif
+
+#if defined(LBVH_MORTON) || defined(LBVH_SORT)
+flat out uvec2 oKey;
+#endif
+
+// -------- Bounds ----------
+#ifdef LBVH_CENTROID_BOUNDS
+void main() {
+    Box b = emptyBox();
+    int end = min(16 * gl_VertexID + 16, uCount);
+    for (int t = 16 * gl_VertexID; t < end; ++t) {
+        vec3 c = triCentroid(t);
+        b = Box(min(b.lo, c), max(b.hi, c));
+    }
+    emitBox(b);
+}
+#endif
+
+#ifdef LBVH_REDUCE
+void main() {
+    Box b = emptyBox();
+    int end = min(16 * gl_VertexID + 16, uCount);
+    for (int i = 16 * gl_VertexID; i < end; ++i) b = unite(b, fetchBox(i));
+    emitBox(b);
+}
+#endif
+
+// -------- Morton codes and sort ----------
+#ifdef LBVH_MORTON
+uniform vec3 uCentroidMin;
+uniform vec3 uInvExtent;
+
+// Spreads the low 10 bits of v so that two zero bits separate each of them.
+uint expandBits10(uint v) {
+    uint x = v & 0x3ffu;
+    x = (x | (x << 16)) & 0x030000FFu;
+    x = (x | (x << 8)) & 0x0300F00Fu;
+    x = (x | (x << 4)) & 0x030C30C3u;
+    x = (x | (x << 2)) & 0x09249249u;
+    return x;
+}
+
+void main() {
+    int t = gl_VertexID;
+    if (t >= uCount) {
+        oKey = uvec2(0xFFFFFFFFu, uint(t)); // padding: above every 30-bit code
+        return;
+    }
+    precise vec3 p = (triCentroid(t) - uCentroidMin) * uInvExtent;
+    precise vec3 q = clamp(p * 1023.0, 0.0, 1023.0);
+    uvec3 u = uvec3(q);
+    oKey = uvec2((expandBits10(u.x) << 2) | (expandBits10(u.y) << 1) | expandBits10(u.z), uint(t));
+}
+#endif
+
+#ifdef LBVH_SORT
+uniform int uStage;  // size of the bitonic sequences being merged
+uniform int uStride; // distance of the compared keys
+
+bool keyLess(uvec2 a, uvec2 b) {
+    return a.x < b.x || (a.x == b.x && a.y < b.y);
+}
+
+void main() {
+    int i = gl_VertexID;
+    uvec2 a = texelFetch(uKeys, i).xy;
+    uvec2 b = texelFetch(uKeys, i ^ uStride).xy;
+    bool ascending = (i & uStage) == 0;
+    bool lower = (i & uStride) == 0;
+    bool takeMin = lower == ascending;
+    oKey = (keyLess(a, b) == takeMin) ? a : b;
+}
+#endif
+
+// -------- Leaf boxes ----------
+#ifdef LBVH_LEAF_BOXES
+void main() {
+    int s = gl_VertexID;
+    emitBox(s < uCount ? triBox(int(texelFetch(uKeys, s).y)) : emptyBox());
+}
+#endif
+
+#ifdef LBVH_BOX_LEVEL
+uniform int uLevel; // first heap index of the level written
+
+void main() {
+    int h = uLevel + gl_VertexID;
+    emitBox(unite(fetchBox(2 * h), fetchBox(2 * h + 1)));
+}
+#endif
+
+// -------- Radix tree ----------
+#ifdef LBVH_NODES
+uniform int uLeafBase; // heap index of the first leaf box (a power of two)
+
+flat out ivec4 oNode0;
+flat out ivec4 oNode1;
+flat out int oSkip;
+
+// Length of the common prefix of sorted keys i and j; equal codes are
+// told apart by position, so the radix tree stays well-formed.
+int delta(int i, int j) {
+    if (j < 0 || j >= uCount) return -1;
+    uint ci = texelFetch(uKeys, i).x;
+    uint cj = texelFetch(uKeys, j).x;
+    if (ci == cj) return 32 + (31 - findMSB(uint(i ^ j)));
+    return 31 - findMSB(ci ^ cj);
+}
+
+int direction(int i) {
+    return (delta(i, i + 1) - delta(i, i - 1)) >= 0 ? 1 : -1;
+}
+
+// Union of the leaf boxes of sorted triangles [first, last].
+Box rangeBox(int first, int last) {
+    Box b = emptyBox();
+    int l = first + uLeafBase;
+    int r = last + uLeafBase + 1;
+    while (l < r) {
+        if ((l & 1) != 0) b = unite(b, fetchBox(l++));
+        if ((r & 1) != 0) b = unite(b, fetchBox(--r));
+        l >>= 1;
+        r >>= 1;
+    }
+    return b;
+}
+
+int leafNode(int k) {
+    return uCount - 1 + k;
+}
+
+void main() {
+    int v = gl_VertexID;
+    int inner = uCount - 1;
+    int first, last;
+    Box b;
+    if (v < inner) {
+        // Direction of the range and the minimum prefix shared inside it.
+        int i = v;
+        int d = direction(i);
+        int deltaMin = delta(i, i - d);
+
+        // Upper bound on the range length, then binary search the other end.
+        int lMax = 2;
+        while (delta(i, i + lMax * d) > deltaMin) lMax *= 2;
+        int l = 0;
+        for (int t = lMax / 2; t >= 1; t /= 2) {
+            if (delta(i, i + (l + t) * d) > deltaMin) l += t;
+        }
+        int j = i + l * d;
+
+        // Binary search the split position inside [i, j].
+        int deltaNode = delta(i, j);
+        int s = 0;
+        for (int div = 2;; div *= 2) {
+            int t = (l + div - 1) / div;
+            if (delta(i, i + (s + t) * d) > deltaNode) s += t;
+            if (t <= 1) break;
+        }
+        int gamma = i + s * d + min(d, 0);
+
+        first = min(i, j);
+        last = max(i, j);
+        int left = first == gamma ? leafNode(gamma) : gamma;
+        int right = last == gamma + 1 ? leafNode(gamma + 1) : gamma + 1;
+        b = rangeBox(first, last);
+        oNode0 = ivec4(floatBitsToInt(b.lo), left);
+        oNode1 = ivec4(floatBitsToInt(b.hi), right);
+    } else {
+        first = last = v - inner;
+        b = fetchBox(uLeafBase + first);
+        oNode0 = ivec4(floatBitsToInt(b.lo), first);
+        oNode1 = ivec4(floatBitsToInt(b.hi), -1);
+    }
+
+    // The node after this subtree in left-first order is the right child
+    // of the inner node splitting at last: inner node last + 1 if that
+    // one's range starts at last + 1, otherwise the leaf of last + 1.
+    int next = last + 1;
+    if (next >= uCount) oSkip = -1;
+    else if (next < inner && direction(next) > 0) oSkip = next;
+    else oSkip = leafNode(next);
+}
+#endif
+
+// -------- Triangles ----------
+#ifdef LBVH_TRIS
+uniform int uAffine; // 1: pack world-to-unit-triangle transforms (BVHTriTest::Affine)
+
+out vec4 oTex0;
+out vec4 oTex1;
+out vec4 oTex2;
+
+void main() {
+    vec3 v0, e1, e2;
+    fetchTri(int(texelFetch(uKeys, gl_VertexID).y), v0, e1, e2);
+    if (uAffine == 0) {
+        oTex0 = vec4(v0, 0.0);
+        oTex1 = vec4(e1, 0.0);
+        oTex2 = vec4(e2, 0.0);
+        return;
+    }
+
+    // Rows of [e1 e2 n]^-1 in double precision, as on the CPU; degenerate
+    // triangles pack zeros.
+    dvec3 dv0 = dvec3(v0), de1 = dvec3(e1), de2 = dvec3(e2);
+    dvec3 n = cross(de1, de2);
+    double det = dot(n, n);
+    if (det <= 0.0lf) {
+        oTex0 = oTex1 = oTex2 = vec4(0.0);
+        return;
+    }
+    dvec3 r0 = cross(de2, n) / det;
+    dvec3 r1 = cross(n, de1) / det;
+    dvec3 r2 = n / det;
+    oTex0 = vec4(vec3(r0), float(-dot(r0, dv0)));
+    oTex1 = vec4(vec3(r1), float(-dot(r1, dv0)));
+    oTex2 = vec4(vec3(r2), float(-dot(r2, dv0)));
+}
+#endif
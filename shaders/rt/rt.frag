@@ -81,9 +81,7 @@ void main()
 
         // Choose scene
         Hit h;
-        bool hitAny = (uUseBVH == 1)
-        ? traceBVH(uCamPos, dir, h)
-        : traceAnalytic(uCamPos, dir, h);
+        bool hitAny = traceRay(rayQuery(uCamPos, dir, uEPS, uINF, 0, 0), h);
 
         vec3 radiance;
 
@@ -9,23 +9,87 @@
     - GPU-side representations of triangles (TriSOA) and BVH nodes (NodeSOA),
       mirroring the CPU-side layout uploaded via texture buffers (TBOs).
     - Helper functions to fetch triangle and node data from texture buffers.
-    - AABB intersection tests (aabbHit) using slab-based ray-box intersection.
-    - Triangle intersection (triHit) using the Möller–Trumbore algorithm with
-      precomputed (v0, e1, e2) for each triangle.
-    - Two traversal routines:
-        * traceBVH       – full closest-hit traversal, returning a Hit struct
-        * traceBVHShadow – shadow traversal with early-out when occluded
+    - AABB intersection tests (aabbHit, aabbHitRange) using slab-based
+      ray-box intersection.
+    - Triangle intersection (triIntersect), selected by uBvhTriTest:
+        * Möller–Trumbore on precomputed (v0, e1, e2)   (triHit)
+        * watertight edge functions in ray space        (triHitWatertight)
+        * precomputed world-to-unit-triangle transforms (triHitAffine)
+      Traversal only tracks the best triangle; its normal is computed
+      once afterwards (triNormal).
+    - traceBVHRay(), which traces a RayQuery (see rt_common.glsl): one
+      traversal per tree layout serves closest-hit and any-hit queries,
+      prunes everything outside [tMin, tMax] and can cull back faces. It
+      handles single-level trees, collapsed BVH4/BVH8 trees with
+      quantized child boxes, and two-level scenes (a TLAS over instances
+      whose rays are transformed into each BLAS's object space).
+    - With BVH_STACKLESS defined, binary trees (TLAS and BLAS) are walked
+      along per-node skip links (uBvhNodeSkips) instead of a stack: no per-ray stack
+      storage, at the price of a fixed left-first child order. The wide
+      layout always keeps its stack, BVH_WIDE_STACK entries deep (the
+      application sizes it from the collapsed tree, see wide_bvh_stack_size).
 
     The BVH is stored as:
-    - uBvhTris  : texture buffer containing triangle data (v0, e1, e2)
-    - uBvhNodes : texture buffer containing BVH nodes
-    and is accessed via integer indices (triIdx, nodeIdx).
+    - uBvhTris  : paged triangle data: float bits of (v0, e1, e2), affine
+                  transforms when uBvhTriTest == TRI_TEST_AFFINE, lattice
+                  coordinates when uBvhTriQuantScale > 0, or vertex indices
+                  into uBvhVerts when uBvhTriIndexed != 0
+    - uBvhNodes : paged BVH nodes (TLAS first, if any)
+    - uBvhNodeSkips : skip link of every node in uBvhNodes (stackless only)
+    - uBvhInstances : texture buffer containing instances (two-level only)
+    - uBvhWideNodes : texture buffer containing wide nodes (BVH4/BVH8 only)
+    and is accessed via integer indices (triIdx, nodeIdx). Paged buffers
+    are read through bvhNodeTexel / bvhTriTexel, which map a stream index
+    to its page.
 
     The layout and encodings must match the CPU-side BVH builder.
 */
 
+/// Stack entries of the wide traversal (overridden by the application for deep trees).
+#ifndef BVH_WIDE_STACK
+#define BVH_WIDE_STACK 64
+#endif
+
 // -------- BVH fetch helpers ----------
 
+// Values of uBvhTriTest (BVHTriTest on the CPU).
+const int TRI_TEST_MOLLER_TRUMBORE = 0;
+const int TRI_TEST_WATERTIGHT = 1;
+const int TRI_TEST_AFFINE = 2;
+
+/**
+ * @brief Texel i of the paged node stream.
+ *
+ * Sampler arrays may only be indexed with dynamically uniform values and
+ * neighbouring rays may read different pages, so the page is picked by
+ * branches. With a single page the first one is always taken.
+ */
+ivec4 bvhNodeTexel(int i) {
+    int page = i >> uBvhPageShift;
+    int j = i & ((1 << uBvhPageShift) - 1);
+    if (page == 0) return texelFetch(uBvhNodes[0], j);
+    if (page == 1) return texelFetch(uBvhNodes[1], j);
+    if (page == 2) return texelFetch(uBvhNodes[2], j);
+    return texelFetch(uBvhNodes[3], j);
+}
+
+/**
+ * @brief Texel i of the paged triangle stream (see bvhNodeTexel).
+ */
+uvec4 bvhTriTexel(int i) {
+    int page = i >> uBvhPageShift;
+    int j = i & ((1 << uBvhPageShift) - 1);
+    if (page == 0) return texelFetch(uBvhTris[0], j);
+    if (page == 1) return texelFetch(uBvhTris[1], j);
+    if (page == 2) return texelFetch(uBvhTris[2], j);
+    return texelFetch(uBvhTris[3], j);
+}
+
+/// Float texel i of the triangle stream (direct or affine triangles).
+vec4 bvhTriTexelF(int i) {
+    return uintBitsToFloat(bvhTriTexel(i));
+}
+
 /**
  * @brief Triangle in SOA-style layout (matches CPU_Triangle).
  *
@@ -41,22 +105,79 @@ struct TriSOA {
     vec3 e2;
 };
 
+/**
+ * @brief Decodes one vertex of a compressed triangle.
+ *
+ * Each vertex is two words holding 21-bit cells: x | y << 21 and
+ * y >> 11 | z << 10. The result is exact, so vertices shared between
+ * triangles decode to identical positions.
+ */
+vec3 triQuantVertex(uint w0, uint w1) {
+    ivec3 cell = ivec3(int(w0 & 0x1FFFFFu),
+                       int((w0 >> 21) | ((w1 & 0x3FFu) << 11)),
+                       int(w1 >> 10));
+    return vec3(uBvhTriQuantOrigin + cell) * uBvhTriQuantScale;
+}
+
+/**
+ * @brief Fetches the three vertices of a triangle.
+ *
+ * Indexed triangles read one RGB32UI texel of vertex indices and then the
+ * shared vertices; compressed ones decode 2 RGB32UI texels of lattice
+ * coordinates (see triQuantVertex). Both give bit-identical positions for
+ * a vertex shared by several triangles. Direct float triangles rebuild
+ * the vertices as v0 + e1 and v0 + e2.
+ *
+ * @param triIdx Index of the triangle in the flattened array.
+ */
+void triFetchVertices(int triIdx, out vec3 p0, out vec3 p1, out vec3 p2) {
+    if (uBvhTriIndexed != 0) {
+        uvec3 i = bvhTriTexel(triIdx).xyz;
+        p0 = texelFetch(uBvhVerts, int(i.x)).xyz;
+        p1 = texelFetch(uBvhVerts, int(i.y)).xyz;
+        p2 = texelFetch(uBvhVerts, int(i.z)).xyz;
+    } else if (uBvhTriQuantScale > 0.0) {
+        uvec3 q0 = bvhTriTexel(triIdx * 2 + 0).xyz;
+        uvec3 q1 = bvhTriTexel(triIdx * 2 + 1).xyz;
+        p0 = triQuantVertex(q0.x, q0.y);
+        p1 = triQuantVertex(q0.z, q1.x);
+        p2 = triQuantVertex(q1.y, q1.z);
+    } else {
+        int base = triIdx * 3;
+        p0 = bvhTriTexelF(base + 0).xyz;
+        p1 = p0 + bvhTriTexelF(base + 1).xyz;
+        p2 = p0 + bvhTriTexelF(base + 2).xyz;
+    }
+}
+
 /**
  * @brief Fetches a triangle from the triangle texture buffer.
  *
- * The CPU packs each triangle into 3 texels:
+ * The CPU packs each direct float triangle into 3 texels:
  *   base     : v0.xyz
  *   base + 1 : e1.xyz
  *   base + 2 : e2.xyz
+ * Indexed and compressed triangles store vertices instead (see
+ * triFetchVertices); their edges are rebuilt here.
  *
  * @param triIdx Index of the triangle in the flattened array.
  * @return TriSOA containing v0, e1, e2.
  */
 TriSOA triFetch(int triIdx) {
+    if (uBvhTriIndexed != 0 || uBvhTriQuantScale > 0.0) {
+        vec3 p0, p1, p2;
+        triFetchVertices(triIdx, p0, p1, p2);
+        TriSOA Q;
+        Q.v0 = p0;
+        Q.e1 = p1 - p0;
+        Q.e2 = p2 - p0;
+        return Q;
+    }
+
     int base = triIdx * 3;
-    vec4 t0 = texelFetch(uBvhTris, base + 0);
-    vec4 t1 = texelFetch(uBvhTris, base + 1);
-    vec4 t2 = texelFetch(uBvhTris, base + 2);
+    vec4 t0 = bvhTriTexelF(base + 0);
+    vec4 t1 = bvhTriTexelF(base + 1);
+    vec4 t2 = bvhTriTexelF(base + 2);
     TriSOA T;
     T.v0 = t0.xyz;
     T.e1 = t1.xyz;
@@ -67,12 +188,12 @@ TriSOA triFetch(int triIdx) {
 /**
  * @brief BVH node layout (matches BVHNode on the CPU).
  *
- * Each node is stored as 3 texels:
- *   texel 0: bmin.xyz, left
- *   texel 1: bmax.xyz, right
- *   texel 2: first, count, (z,w unused)
+ * Each node is stored as 2 RGBA32I texels, bounds as float bits:
+ *   texel 0: bmin.xyz, inner ? left  : first
+ *   texel 1: bmax.xyz, inner ? right : -count
  *
- * Children indices < 0 indicate leaf/internal conventions defined on the CPU.
+ * A negative texel 1 .w marks a leaf. left/right are only meaningful for
+ * inner nodes (count == 0), first only for leaves.
  */
 struct NodeSOA {
     vec3 bmin; int left;
@@ -83,24 +204,32 @@ struct NodeSOA {
 /**
  * @brief Fetches a BVH node from the node texture buffer.
  *
- * Integer data is encoded in the .w components and reconstructed here.
+ * Indices are stored as integers, so decoding is a reinterpretation of
+ * the bounds plus one max(); no float-to-int rounding.
  *
  * @param nodeIdx Index of the node in the flattened node array.
  * @return NodeSOA with bounding box and child/leaf info.
  */
 NodeSOA nodeFetch(int nodeIdx) {
-    int base = nodeIdx * 3;
-    vec4 n0 = texelFetch(uBvhNodes, base + 0);
-    vec4 n1 = texelFetch(uBvhNodes, base + 1);
-    vec4 n2 = texelFetch(uBvhNodes, base + 2);
+    int base = nodeIdx * 2;
+    ivec4 n0 = bvhNodeTexel(base + 0);
+    ivec4 n1 = bvhNodeTexel(base + 1);
     NodeSOA N;
-    N.bmin = n0.xyz; N.left = int(n0.w + 0.5);
-    N.bmax = n1.xyz; N.right = int(n1.w + 0.5);
-    N.first = int(n2.x + 0.5);
-    N.count = int(n2.y + 0.5);
+    N.bmin = intBitsToFloat(n0.xyz); N.left = n0.w;
+    N.bmax = intBitsToFloat(n1.xyz); N.right = n1.w;
+    N.first = n0.w;
+    N.count = max(-n1.w, 0);
     return N;
 }
 
+/**
+ * @brief Skip link of a node: the node that follows its subtree in a
+ * left-first walk, or -1 at the end of the tree.
+ */
+int nodeSkip(int nodeIdx) {
+    return texelFetch(uBvhNodeSkips, nodeIdx).x;
+}
+
 // -----------------------------------------------------------------------------
 // Ray–AABB intersection
 // -----------------------------------------------------------------------------
@@ -133,101 +262,369 @@ bool aabbHit(vec3 ro, vec3 rdInv, vec3 bmin, vec3 bmax, out float tminOut, out f
     return tmax >= tmin;
 }
 
+/**
+ * @brief Box test against a ray interval.
+ *
+ * @param tMin   Closest distance accepted; boxes that end before it are missed.
+ * @param tMax   Farthest distance accepted; boxes that start after it are missed.
+ * @param tEntry Output entry distance (clamped to t ≥ 0, see aabbHit()).
+ * @return True if the box overlaps [tMin, tMax] along the ray.
+ */
+bool aabbHitRange(vec3 ro, vec3 rdInv, vec3 bmin, vec3 bmax, float tMin, float tMax, out float tEntry) {
+    float tExit;
+    return aabbHit(ro, rdInv, bmin, bmax, tEntry, tExit) && tEntry <= tMax && tExit >= tMin;
+}
+
 // -----------------------------------------------------------------------------
-// Ray–Triangle intersection (Möller–Trumbore)
+// Ray–Triangle intersection
 // -----------------------------------------------------------------------------
 
+/**
+ * @brief Ray set up once per traversal for the triangle tests.
+ *
+ * tMin is the closest distance accepted and cull rejects back faces
+ * (dot(cross(e1, e2), d) > 0). The watertight test works in a frame where
+ * the ray runs along +z: k permutes the axes so that z is the dominant
+ * direction component (x and y swapped if it is negative, which keeps the
+ * winding), and s holds the shear (d.x / d.z, d.y / d.z) and the scale
+ * 1 / d.z of that frame.
+ */
+struct TriRay {
+    vec3 o;
+    vec3 d;
+    float tMin;
+    bool cull;
+    ivec3 k;
+    vec3 s;
+};
+
+/**
+ * @brief Prepares a ray for triIntersect().
+ *
+ * @param ro   Ray origin.
+ * @param rd   Ray direction (need not be normalized).
+ * @param tMin Closest distance accepted.
+ * @param cull True to ignore back faces.
+ */
+TriRay triRayInit(vec3 ro, vec3 rd, float tMin, bool cull) {
+    TriRay R;
+    R.o = ro;
+    R.d = rd;
+    R.tMin = tMin;
+    R.cull = cull;
+    R.k = ivec3(0, 1, 2);
+    R.s = vec3(0.0);
+    if (uBvhTriTest == TRI_TEST_WATERTIGHT) {
+        vec3 a = abs(rd);
+        int kz = a.x > a.y ? (a.x > a.z ? 0 : 2) : (a.y > a.z ? 1 : 2);
+        int kx = kz == 2 ? 0 : kz + 1;
+        int ky = kx == 2 ? 0 : kx + 1;
+        R.k = rd[kz] < 0.0 ? ivec3(ky, kx, kz) : ivec3(kx, ky, kz);
+        R.s = vec3(rd[R.k.x], rd[R.k.y], 1.0) / rd[kz];
+    }
+    return R;
+}
+
 /**
  * @brief Ray–triangle intersection using Möller–Trumbore.
  *
  * Triangle data is provided via TriSOA with precomputed (v0, e1, e2).
- * Returns true on a valid hit in front of the ray origin and within [uEPS, tMax].
+ * Returns true on a valid hit within [R.tMin, tMax]. det is
+ * -dot(cross(e1, e2), d), so back faces have det < 0.
  *
- * @param ro   Ray origin.
- * @param rd   Ray direction (normalized).
+ * @param R    Ray from triRayInit().
  * @param T    Triangle data (v0, e1, e2).
  * @param tMax Maximum distance to consider a valid hit.
  * @param t    Output hit distance.
- * @param n    Output shading normal (unnormalized cross of edges, normalized here).
  * @return True if the triangle is hit, false otherwise.
  */
-bool triHit(vec3 ro, vec3 rd, TriSOA T, float tMax, out float t, out vec3 n) {
-    vec3 pvec = cross(rd, T.e2);
+bool triHit(TriRay R, TriSOA T, float tMax, out float t) {
+    vec3 pvec = cross(R.d, T.e2);
     float det = dot(T.e1, pvec);
-    if (abs(det) < 1e-8) return false;
+    if (abs(det) < 1e-8 || (R.cull && det < 0.0)) return false;
     float invDet = 1.0 / det;
-    vec3 tvec = ro - T.v0;
+    vec3 tvec = R.o - T.v0;
     float u = dot(tvec, pvec) * invDet;
     if (u < 0.0 || u > 1.0) return false;
     vec3 qvec = cross(tvec, T.e1);
-    float v = dot(rd, qvec) * invDet;
+    float v = dot(R.d, qvec) * invDet;
     if (v < 0.0 || u + v > 1.0) return false;
     float tt = dot(T.e2, qvec) * invDet;
-    if (tt < uEPS || tt > tMax) return false;
+    if (tt < R.tMin || tt > tMax) return false;
+    t = tt;
+    return true;
+}
+
+/**
+ * @brief Watertight ray–triangle intersection (Woop, Benthin, Wald 2013).
+ *
+ * The vertices are moved to the ray origin, permuted and sheared so the
+ * ray runs along +z, and the 2D edge functions U, V, W are evaluated
+ * there. An edge shared by two triangles yields the same edge function
+ * with opposite signs in both (precise keeps the compiler from fusing it
+ * differently), and zero counts as inside, so rays through shared edges
+ * and vertices cannot slip between triangles. Their sum has the sign of
+ * -dot(cross(e1, e2), d), as det in triHit().
+ *
+ * @param R    Ray from triRayInit().
+ * @param p0   First vertex.
+ * @param p1   Second vertex.
+ * @param p2   Third vertex.
+ * @param tMax Maximum distance to consider a valid hit.
+ * @param t    Output hit distance.
+ * @return True if the triangle is hit, false otherwise.
+ */
+bool triHitWatertight(TriRay R, vec3 p0, vec3 p1, vec3 p2, float tMax, out float t) {
+    vec3 A = p0 - R.o;
+    vec3 B = p1 - R.o;
+    vec3 C = p2 - R.o;
+
+    float Az = A[R.k.z];
+    float Bz = B[R.k.z];
+    float Cz = C[R.k.z];
+    float Ax = A[R.k.x] - R.s.x * Az;
+    float Ay = A[R.k.y] - R.s.y * Az;
+    float Bx = B[R.k.x] - R.s.x * Bz;
+    float By = B[R.k.y] - R.s.y * Bz;
+    float Cx = C[R.k.x] - R.s.x * Cz;
+    float Cy = C[R.k.y] - R.s.y * Cz;
+
+    precise float U = Cx * By - Cy * Bx;
+    precise float V = Ax * Cy - Ay * Cx;
+    precise float W = Bx * Ay - By * Ax;
+    if ((U < 0.0 || V < 0.0 || W < 0.0) && (U > 0.0 || V > 0.0 || W > 0.0)) return false;
+
+    float det = U + V + W;
+    if (det == 0.0 || (R.cull && det < 0.0)) return false;
+    float tt = (U * Az + V * Bz + W * Cz) * R.s.z / det;
+    if (!(tt >= R.tMin && tt <= tMax)) return false;
+    t = tt;
+    return true;
+}
+
+/**
+ * @brief Ray–triangle intersection through a precomputed affine transform (Woop 2004).
+ *
+ * The triangle is stored as the three rows of its world-to-unit-triangle
+ * transform, in which it becomes (0,0,0), (1,0,0), (0,1,0) in the z = 0
+ * plane. Row 2 gives the distance to that plane, rows 0 and 1 the
+ * barycentrics at the crossing; they are fetched only once the previous
+ * check has passed. Row 2 is cross(e1, e2) scaled, so back faces have
+ * dot(row 2, d) > 0. Degenerate triangles are stored as zeros and fail the
+ * distance check (NaN).
+ *
+ * @param R      Ray from triRayInit().
+ * @param triIdx Index of the triangle.
+ * @param tMax   Maximum distance to consider a valid hit.
+ * @param t      Output hit distance.
+ * @return True if the triangle is hit, false otherwise.
+ */
+bool triHitAffine(TriRay R, int triIdx, float tMax, out float t) {
+    int base = triIdx * 3;
+    vec4 r2 = bvhTriTexelF(base + 2);
+    float dz = dot(r2.xyz, R.d);
+    if (R.cull && dz > 0.0) return false;
+    float tt = -(dot(r2.xyz, R.o) + r2.w) / dz;
+    if (!(tt >= R.tMin && tt <= tMax)) return false;
+
+    vec4 r0 = bvhTriTexelF(base + 0);
+    float u = dot(r0.xyz, R.o) + r0.w + tt * dot(r0.xyz, R.d);
+    if (u < 0.0 || u > 1.0) return false;
+    vec4 r1 = bvhTriTexelF(base + 1);
+    float v = dot(r1.xyz, R.o) + r1.w + tt * dot(r1.xyz, R.d);
+    if (v < 0.0 || u + v > 1.0) return false;
     t = tt;
-    n = normalize(cross(T.e1, T.e2));
     return true;
 }
 
+/**
+ * @brief Intersects triangle triIdx with the test selected by uBvhTriTest.
+ *
+ * @param R      Ray from triRayInit().
+ * @param triIdx Index of the triangle.
+ * @param tMax   Maximum distance to consider a valid hit.
+ * @param t      Output hit distance.
+ * @return True if the triangle is hit within [R.tMin, tMax].
+ */
+bool triIntersect(TriRay R, int triIdx, float tMax, out float t) {
+    if (uBvhTriTest == TRI_TEST_AFFINE) return triHitAffine(R, triIdx, tMax, t);
+    if (uBvhTriTest == TRI_TEST_WATERTIGHT) {
+        vec3 p0, p1, p2;
+        triFetchVertices(triIdx, p0, p1, p2);
+        return triHitWatertight(R, p0, p1, p2, tMax, t);
+    }
+    return triHit(R, triFetch(triIdx), tMax, t);
+}
+
+/**
+ * @brief Geometric normal of a triangle, computed for the reported hit only.
+ *
+ * @param triIdx Index of the triangle.
+ * @return Unit normal, oriented as cross(e1, e2).
+ */
+vec3 triNormal(int triIdx) {
+    if (uBvhTriTest == TRI_TEST_AFFINE) return normalize(bvhTriTexelF(triIdx * 3 + 2).xyz);
+    TriSOA T = triFetch(triIdx);
+    return normalize(cross(T.e1, T.e2));
+}
+
+// -----------------------------------------------------------------------------
+// Instances (two-level scenes)
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief One placement of a bottom-level BVH (matches the CPU packing).
+ *
+ * Each instance is stored as 4 texels:
+ *   texel 0..2: rows of the world-to-object matrix (xyz linear, w translation)
+ *   texel 3   : blasRoot low 16 bits, high 16 bits, (z,w unused)
+ *
+ * The root is split so both halves stay exact as floats past 2^24 nodes.
+ */
+struct InstanceSOA {
+    vec4 r0;
+    vec4 r1;
+    vec4 r2;
+    int blasRoot;
+};
+
+/**
+ * @brief Fetches an instance from the instance texture buffer.
+ *
+ * @param instIdx Index of the instance (TLAS leaf order).
+ * @return InstanceSOA with world-to-object rows and BLAS root node.
+ */
+InstanceSOA instanceFetch(int instIdx) {
+    int base = instIdx * 4;
+    InstanceSOA I;
+    I.r0 = texelFetch(uBvhInstances, base + 0);
+    I.r1 = texelFetch(uBvhInstances, base + 1);
+    I.r2 = texelFetch(uBvhInstances, base + 2);
+    vec2 root = texelFetch(uBvhInstances, base + 3).xy;
+    I.blasRoot = int(root.x) | (int(root.y) << 16);
+    return I;
+}
+
+/**
+ * @brief Object-space normal to world space.
+ *
+ * The normal matrix is the transpose of the world-to-object matrix, so the
+ * world normal is the rows weighted by the object-space components.
+ */
+vec3 instanceNormalToWorld(InstanceSOA I, vec3 n) {
+    return normalize(I.r0.xyz * n.x + I.r1.xyz * n.y + I.r2.xyz * n.z);
+}
+
 // -----------------------------------------------------------------------------
-// BVH traversal (closest-hit)
+// BLAS traversal
 // -----------------------------------------------------------------------------
 
+#ifdef BVH_STACKLESS
 /**
- * @brief Traverses the BVH to find the closest triangle hit.
+ * @brief Traversal of one tree rooted at node root (stackless).
+ *
+ * Descends into left children and follows skip links past missed
+ * subtrees and finished leaves, so no stack is needed. Children are
+ * always visited left first; rd does not need to be normalized (see the
+ * stack variant below).
+ *
+ * @param root    Root node index of the tree.
+ * @param ro      Ray origin.
+ * @param rd      Ray direction.
+ * @param tMin    Closest distance accepted.
+ * @param flags   RAY_FLAG_* bits (any-hit, back-face culling).
+ * @param tBest   In: farthest distance accepted. Out: distance of the hit found.
+ * @param triBest Out: triangle of that hit (unchanged if none).
+ * @return True if a hit within [tMin, tBest] was found.
+ */
+bool blasTrace(int root, vec3 ro, vec3 rd, float tMin, int flags, inout float tBest, inout int triBest) {
+    bool anyHit = (flags & RAY_FLAG_ANY_HIT) != 0;
+    bool found = false;
+    float tminBox;
+    vec3 rdInv = 1.0 / rd;
+    TriRay R = triRayInit(ro, rd, tMin, (flags & RAY_FLAG_CULL_BACK) != 0);
+
+    int ni = root;
+    while (ni >= 0) {
+        NodeSOA N = nodeFetch(ni);
+        if (!aabbHitRange(ro, rdInv, N.bmin, N.bmax, tMin, tBest, tminBox)) {
+            ni = nodeSkip(ni);
+            continue;
+        }
+
+        if (N.count > 0) {
+            for (int i = 0; i < N.count; ++i) {
+                float t;
+                if (triIntersect(R, N.first + i, tBest, t)) {
+                    tBest = t;
+                    triBest = N.first + i;
+                    found = true;
+                    if (anyHit) return true;
+                }
+            }
+            ni = nodeSkip(ni);
+        } else {
+            ni = N.left;
+        }
+    }
+    return found;
+}
+#else
+/**
+ * @brief Traversal of one tree rooted at node root.
  *
  * Uses an explicit stack-based traversal (no recursion) and tests nodes
  * front-to-back with simple near-ordering between left/right children.
+ * Closest-hit queries shrink tBest with every hit; any-hit queries
+ * (RAY_FLAG_ANY_HIT) return on the first one. rd does not need to be
+ * normalized: t is parametric, so hits found in object space
+ * (transformed, unnormalized ray) compare directly with world-space
+ * distances, and so does the facing used for culling.
  *
- * On success, hitOut is filled with:
- *  - t: closest hit distance
- *  - p: hit position
- *  - n: shading normal
- *  - mat: material index (triangles currently treated as diffuse = 1)
- *
- * @param ro      Ray origin in world space.
- * @param rd      Ray direction (normalized).
- * @param hitOut  Output Hit structure.
- * @return True if any triangle was hit, false otherwise.
+ * @param root    Root node index of the tree.
+ * @param ro      Ray origin.
+ * @param rd      Ray direction.
+ * @param tMin    Closest distance accepted.
+ * @param flags   RAY_FLAG_* bits (any-hit, back-face culling).
+ * @param tBest   In: farthest distance accepted. Out: distance of the hit found.
+ * @param triBest Out: triangle of that hit (unchanged if none).
+ * @return True if a hit within [tMin, tBest] was found.
  */
-bool traceBVH(vec3 ro, vec3 rd, out Hit hitOut) {
-    if (uNodeCount <= 0 || uTriCount <= 0) return false;
-    hitOut.t = uINF;
-    hitOut.n = vec3(0);
-    hitOut.mat = 1; // diffuse default
-    float tminBox, tmaxBox;
+bool blasTrace(int root, vec3 ro, vec3 rd, float tMin, int flags, inout float tBest, inout int triBest) {
+    bool anyHit = (flags & RAY_FLAG_ANY_HIT) != 0;
+    bool found = false;
+    float tminBox;
     vec3 rdInv = 1.0 / rd;
+    TriRay R = triRayInit(ro, rd, tMin, (flags & RAY_FLAG_CULL_BACK) != 0);
 
     int stack[64];
     int sp = 0;
-    stack[sp++] = 0;
+    stack[sp++] = root;
 
     while (sp > 0) {
         int ni = stack[--sp];
         NodeSOA N = nodeFetch(ni);
-        if (!aabbHit(ro, rdInv, N.bmin, N.bmax, tminBox, tmaxBox) || tminBox > hitOut.t) continue;
+        if (!aabbHitRange(ro, rdInv, N.bmin, N.bmax, tMin, tBest, tminBox)) continue;
 
         if (N.count > 0) {
             // Leaf: test all triangles in [first, first + count)
             for (int i = 0; i < N.count; ++i) {
                 int triIdx = N.first + i;
-                TriSOA T = triFetch(triIdx);
                 float t;
-                vec3 n;
-                if (triHit(ro, rd, T, hitOut.t, t, n)) {
-                    hitOut.t = t;
-                    hitOut.p = ro + rd * t;
-                    hitOut.n = n;
-                    hitOut.mat = 1; // triangles = diffuse
+                if (triIntersect(R, triIdx, tBest, t)) {
+                    tBest = t;
+                    triBest = triIdx;
+                    found = true;
+                    if (anyHit) return true;
                 }
             }
         } else {
             // Inner node: test children, push them in near/far order
             NodeSOA L = nodeFetch(N.left);
             NodeSOA R = nodeFetch(N.right);
-            float tminL, tmaxL, tminR, tmaxR;
-            bool hitL = aabbHit(ro, rdInv, L.bmin, L.bmax, tminL, tmaxL) && tminL <= hitOut.t;
-            bool hitR = aabbHit(ro, rdInv, R.bmin, R.bmax, tminR, tmaxR) && tminR <= hitOut.t;
+            float tminL, tminR;
+            bool hitL = aabbHitRange(ro, rdInv, L.bmin, L.bmax, tMin, tBest, tminL);
+            bool hitR = aabbHitRange(ro, rdInv, R.bmin, R.bmax, tMin, tBest, tminR);
             if (hitL && hitR) {
                 bool leftFirst = tminL < tminR;
                 stack[sp++] = leftFirst ? N.right : N.left;
@@ -239,68 +636,302 @@ bool traceBVH(vec3 ro, vec3 rd, out Hit hitOut) {
             }
         }
     }
-    return hitOut.t < uINF;
+    return found;
 }
+#endif // BVH_STACKLESS
 
 // -----------------------------------------------------------------------------
-// BVH traversal (shadow ray, early-out)
+// Wide BVH traversal (BVH4/BVH8, uBvhWidth > 2)
 // -----------------------------------------------------------------------------
 
 /**
- * @brief Shadow ray traversal with early-out.
+ * @brief Decoded header of a wide node (matches BVHWideNode on the CPU).
  *
- * Similar to traceBVH(), but only checks whether **any** triangle is hit
- * before a maximum distance tMax. Used for hard shadow tests against the BVH.
+ * Each node is stored as 1 + 3 * uBvhWidth / 4 RGBA32UI texels:
+ *   texel 0 : origin.xyz (float bits), w = exponents (3 x 8 bits, +128) | childCount << 24
+ *   then 3 words per child:
+ *     qMin.xyz | qMax.x << 24,  qMax.yz | count << 16,  index
  *
- * @param ro   Ray origin.
- * @param rd   Ray direction (normalized).
- * @param tMax Maximum distance (e.g., distance to light).
- * @return True if the ray is occluded by any triangle before tMax.
+ * A child box decodes as origin + q * scale with 8-bit q, so one wide node
+ * step costs 4 (BVH4) or 7 (BVH8) fetches instead of 9 per binary step.
+ */
+struct WideNodeSOA {
+    vec3 origin;
+    vec3 scale;
+    int childCount;
+    uvec4 words[6]; // 3 words per child, up to 8 children
+};
+
+/**
+ * @brief Fetches and partially decodes a wide node.
+ *
+ * @param nodeIdx Index of the wide node.
+ * @return WideNodeSOA with quantization frame and raw child words.
+ */
+WideNodeSOA wideNodeFetch(int nodeIdx) {
+    int stride = 1 + 3 * uBvhWidth / 4;
+    int base = nodeIdx * stride;
+    uvec4 h = texelFetch(uBvhWideNodes, base);
+    WideNodeSOA W;
+    W.origin = uintBitsToFloat(h.xyz);
+    ivec3 e = ivec3(h.w & 0xFFu, (h.w >> 8) & 0xFFu, (h.w >> 16) & 0xFFu) - 128;
+    W.scale = ldexp(vec3(1.0), e);
+    W.childCount = int(h.w >> 24);
+    for (int i = 0; i < stride - 1; ++i) {
+        W.words[i] = texelFetch(uBvhWideNodes, base + 1 + i);
+    }
+    return W;
+}
+
+/// Returns 32-bit word w of the node's child data.
+uint wideWord(WideNodeSOA W, int w) {
+    return W.words[w >> 2][w & 3];
+}
+
+/**
+ * @brief Decodes child k of a wide node.
+ *
+ * @param W     Wide node.
+ * @param k     Child slot.
+ * @param bmin  Output dequantized (conservative) box minimum.
+ * @param bmax  Output dequantized box maximum.
+ * @param count Output triangle count (> 0 for leaves, 0 for inner nodes).
+ * @return Child index: wide node index for inner nodes, first triangle for leaves.
+ */
+int wideChild(WideNodeSOA W, int k, out vec3 bmin, out vec3 bmax, out int count) {
+    uint a = wideWord(W, k * 3 + 0);
+    uint b = wideWord(W, k * 3 + 1);
+    vec3 qlo = vec3(float(a & 0xFFu), float((a >> 8) & 0xFFu), float((a >> 16) & 0xFFu));
+    vec3 qhi = vec3(float(a >> 24), float(b & 0xFFu), float((b >> 8) & 0xFFu));
+    bmin = W.origin + qlo * W.scale;
+    bmax = W.origin + qhi * W.scale;
+    count = int((b >> 16) & 0xFFu);
+    return int(wideWord(W, k * 3 + 2));
+}
+
+/**
+ * @brief Traversal of the collapsed wide BVH.
+ *
+ * Leaf children are intersected as soon as their box is hit; inner
+ * children are pushed far-to-near with their entry distance, so nodes
+ * that end up behind a closer hit are skipped without being fetched.
+ *
+ * @param ro      Ray origin.
+ * @param rd      Ray direction.
+ * @param tMin    Closest distance accepted.
+ * @param flags   RAY_FLAG_* bits (any-hit, back-face culling).
+ * @param tBest   In: farthest distance accepted. Out: distance of the hit found.
+ * @param triBest Out: triangle of that hit.
+ * @return True if a hit within [tMin, tBest] was found.
  */
-bool traceBVHShadow(vec3 ro, vec3 rd, float tMax) {
-    if (uNodeCount <= 0 || uTriCount <= 0) return false; // no occluders
-    float tminBox, tmaxBox;
+bool wideTrace(vec3 ro, vec3 rd, float tMin, int flags, inout float tBest, inout int triBest) {
+    bool anyHit = (flags & RAY_FLAG_ANY_HIT) != 0;
+    bool found = false;
     vec3 rdInv = 1.0 / rd;
+    TriRay R = triRayInit(ro, rd, tMin, (flags & RAY_FLAG_CULL_BACK) != 0);
 
-    int stack[64];
+    int stack[BVH_WIDE_STACK];
+    float stackT[BVH_WIDE_STACK];
     int sp = 0;
-    stack[sp++] = 0;
+    stack[sp] = 0;
+    stackT[sp] = 0.0;
+    ++sp;
 
     while (sp > 0) {
-        int ni = stack[--sp];
+        --sp;
+        if (stackT[sp] > tBest) continue;
+        WideNodeSOA W = wideNodeFetch(stack[sp]);
+
+        // Inner children hit by the ray, sorted by entry distance (near first).
+        int hitIdx[8];
+        float hitT[8];
+        int hitCount = 0;
+
+        for (int k = 0; k < W.childCount; ++k) {
+            vec3 bmin, bmax;
+            int count;
+            int idx = wideChild(W, k, bmin, bmax, count);
+            float tmin;
+            if (!aabbHitRange(ro, rdInv, bmin, bmax, tMin, tBest, tmin)) continue;
+
+            if (count > 0) {
+                for (int i = 0; i < count; ++i) {
+                    float t;
+                    if (triIntersect(R, idx + i, tBest, t)) {
+                        tBest = t;
+                        triBest = idx + i;
+                        found = true;
+                        if (anyHit) return true;
+                    }
+                }
+            } else {
+                int j = hitCount++;
+                while (j > 0 && hitT[j - 1] > tmin) {
+                    hitIdx[j] = hitIdx[j - 1];
+                    hitT[j] = hitT[j - 1];
+                    --j;
+                }
+                hitIdx[j] = idx;
+                hitT[j] = tmin;
+            }
+        }
+
+        // Push far-to-near so the nearest child is popped first. Should the
+        // stack ever be too shallow, the farthest children are the ones dropped.
+        int keep = min(hitCount, BVH_WIDE_STACK - sp);
+        for (int j = keep - 1; j >= 0; --j) {
+            stack[sp] = hitIdx[j];
+            stackT[sp] = hitT[j];
+            ++sp;
+        }
+    }
+    return found;
+}
+
+// -----------------------------------------------------------------------------
+// TLAS traversal (two-level scenes, uTlasNodeCount > 0)
+// -----------------------------------------------------------------------------
+
+#ifdef BVH_STACKLESS
+/**
+ * @brief Traversal of the TLAS (stackless, see the stack variant below).
+ *
+ * @param ro       World-space ray origin.
+ * @param rd       World-space ray direction (normalized).
+ * @param tMin     Closest distance accepted.
+ * @param flags    RAY_FLAG_* bits (any-hit, back-face culling).
+ * @param tBest    In: farthest distance accepted. Out: distance of the hit found.
+ * @param triBest  Out: triangle of that hit.
+ * @param instBest Out: instance of that hit.
+ * @return True if any instance was hit within [tMin, tBest].
+ */
+bool tlasTrace(vec3 ro, vec3 rd, float tMin, int flags, inout float tBest, inout int triBest, inout int instBest) {
+    bool anyHit = (flags & RAY_FLAG_ANY_HIT) != 0;
+    bool found = false;
+    float tminBox;
+    vec3 rdInv = 1.0 / rd;
+
+    int ni = 0;
+    while (ni >= 0) {
         NodeSOA N = nodeFetch(ni);
-        if (!aabbHit(ro, rdInv, N.bmin, N.bmax, tminBox, tmaxBox) || tminBox > tMax) continue;
+        if (!aabbHitRange(ro, rdInv, N.bmin, N.bmax, tMin, tBest, tminBox)) {
+            ni = nodeSkip(ni);
+            continue;
+        }
 
         if (N.count > 0) {
-            // Leaf: any triangle hit before tMax means occlusion.
-            for (int i = 0; i < N.count; ++i) {
-                int triIdx = N.first + i;
-                TriSOA T = triFetch(triIdx);
-                float t;
-                vec3 n;
-                if (triHit(ro, rd, T, tMax, t, n)) {
-                    return true; // any hit before light → occluded
-                }
+            InstanceSOA I = instanceFetch(N.first);
+            vec3 roObj = vec3(dot(I.r0, vec4(ro, 1.0)), dot(I.r1, vec4(ro, 1.0)), dot(I.r2, vec4(ro, 1.0)));
+            vec3 rdObj = vec3(dot(I.r0.xyz, rd), dot(I.r1.xyz, rd), dot(I.r2.xyz, rd));
+            if (blasTrace(I.blasRoot, roObj, rdObj, tMin, flags, tBest, triBest)) {
+                instBest = N.first;
+                found = true;
+                if (anyHit) return true;
             }
+            ni = nodeSkip(ni);
         } else {
-            // Inner node: visit potentially intersected children.
-            NodeSOA L = nodeFetch(N.left);
-            NodeSOA R = nodeFetch(N.right);
-            float tminL, tmaxL, tminR, tmaxR;
-            bool hitL = aabbHit(ro, rdInv, L.bmin, L.bmax, tminL, tmaxL) && tminL <= tMax;
-            bool hitR = aabbHit(ro, rdInv, R.bmin, R.bmax, tminR, tmaxR) && tminR <= tMax;
-            if (hitL && hitR) {
-                bool leftFirst = tminL < tminR;
-                stack[sp++] = leftFirst ? N.right : N.left;
-                stack[sp++] = leftFirst ? N.left : N.right;
-            } else if (hitL) {
-                stack[sp++] = N.left;
-            } else if (hitR) {
-                stack[sp++] = N.right;
+            ni = N.left;
+        }
+    }
+    return found;
+}
+#else
+/**
+ * @brief Traversal of the TLAS.
+ *
+ * TLAS leaves hold one instance each (first = instance index). The ray is
+ * moved into the instance's object space and its BLAS is traversed; the
+ * hit's instance is returned so traceBVHRay() can bring its normal back
+ * to world space.
+ *
+ * @param ro       World-space ray origin.
+ * @param rd       World-space ray direction (normalized).
+ * @param tMin     Closest distance accepted.
+ * @param flags    RAY_FLAG_* bits (any-hit, back-face culling).
+ * @param tBest    In: farthest distance accepted. Out: distance of the hit found.
+ * @param triBest  Out: triangle of that hit.
+ * @param instBest Out: instance of that hit.
+ * @return True if any instance was hit within [tMin, tBest].
+ */
+bool tlasTrace(vec3 ro, vec3 rd, float tMin, int flags, inout float tBest, inout int triBest, inout int instBest) {
+    bool anyHit = (flags & RAY_FLAG_ANY_HIT) != 0;
+    bool found = false;
+    float tminBox;
+    vec3 rdInv = 1.0 / rd;
+
+    int stack[64];
+    int sp = 0;
+    stack[sp++] = 0;
+
+    while (sp > 0) {
+        NodeSOA N = nodeFetch(stack[--sp]);
+        if (!aabbHitRange(ro, rdInv, N.bmin, N.bmax, tMin, tBest, tminBox)) continue;
+
+        if (N.count > 0) {
+            InstanceSOA I = instanceFetch(N.first);
+            vec3 roObj = vec3(dot(I.r0, vec4(ro, 1.0)), dot(I.r1, vec4(ro, 1.0)), dot(I.r2, vec4(ro, 1.0)));
+            vec3 rdObj = vec3(dot(I.r0.xyz, rd), dot(I.r1.xyz, rd), dot(I.r2.xyz, rd));
+            if (blasTrace(I.blasRoot, roObj, rdObj, tMin, flags, tBest, triBest)) {
+                instBest = N.first;
+                found = true;
+                if (anyHit) return true;
             }
+        } else {
+            stack[sp++] = N.right;
+            stack[sp++] = N.left;
         }
     }
-    return false;
+    return found;
+}
+#endif // BVH_STACKLESS
+
+// -----------------------------------------------------------------------------
+// BVH ray query
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Traces a ray query against the BVH.
+ *
+ * Single-level scenes traverse the tree at node 0 directly (binary or
+ * collapsed wide layout, see uBvhWidth); two-level scenes
+ * (uTlasNodeCount > 0) go through the TLAS and its instances. Every
+ * traversal starts with q.tMax as its farthest distance, so boxes past
+ * it are never entered, and RAY_FLAG_ANY_HIT stops at the first hit.
+ *
+ * On success, hitOut is filled with:
+ *  - t: hit distance (the closest one unless RAY_FLAG_ANY_HIT)
+ *  - p: hit position
+ *  - n: shading normal
+ *  - mat: material index (triangles currently treated as diffuse = 1,
+ *         so masking that bit skips the whole BVH)
+ *
+ * @param q      Ray query (direction normalized).
+ * @param hitOut Output Hit structure.
+ * @return True if any triangle was hit within [q.tMin, q.tMax].
+ */
+bool traceBVHRay(RayQuery q, out Hit hitOut) {
+    hitOut.t = q.tMax;
+    hitOut.n = vec3(0);
+    hitOut.mat = 1; // triangles = diffuse
+    if (uNodeCount <= 0 || uTriCount <= 0 || raySkips(q, hitOut.mat)) return false;
+
+    int triBest = -1;
+    int instBest = -1;
+    bool hit;
+    if (uTlasNodeCount > 0) {
+        hit = tlasTrace(q.o, q.d, q.tMin, q.flags, hitOut.t, triBest, instBest);
+    } else if (uBvhWidth > 2) {
+        hit = wideTrace(q.o, q.d, q.tMin, q.flags, hitOut.t, triBest);
+    } else {
+        hit = blasTrace(0, q.o, q.d, q.tMin, q.flags, hitOut.t, triBest);
+    }
+    if (hit) {
+        // Only the reported triangle's normal is ever computed.
+        hitOut.p = q.o + q.d * hitOut.t;
+        hitOut.n = triNormal(triBest);
+        if (instBest >= 0) hitOut.n = instanceNormalToWorld(instanceFetch(instBest), hitOut.n);
+    }
+    return hit;
 }
 
-#endif // RT_BVH_GLSL
\ No newline at end of file
+#endif // RT_BVH_GLSL
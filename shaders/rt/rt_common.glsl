@@ -8,6 +8,8 @@
     This module provides:
     - Core constants and small configuration macros.
     - Hit payload structure used by all ray/path tracing routines.
+    - The RayQuery description (interval, any-hit / cull flags, material
+      skip mask) that traceRay() takes in both scene modes.
     - Hash-based RNG utilities (rand) for per-pixel / per-frame sampling.
     - Halton-based low-discrepancy sequence (ld2) used for jitter.
     - Concentric disk sampling for soft shadows / area lights.
@@ -43,6 +45,50 @@ struct Hit {
     int mat;
 };
 
+// ---------------- Ray queries ----------------
+
+/// RayQuery.flags: accept the first hit found in the interval, not the closest.
+const int RAY_FLAG_ANY_HIT = 1;
+
+/// RayQuery.flags: ignore back faces, i.e. hits whose normal n has dot(n, d) > 0.
+const int RAY_FLAG_CULL_BACK = 2;
+
+/**
+ * @brief One ray query, traced by traceRay() against the active scene.
+ *
+ * Fields:
+ *  - o, d     : origin and direction (normalized, so t is a distance)
+ *  - tMin     : closest distance accepted (usually uEPS)
+ *  - tMax     : farthest distance accepted; the traversal prunes everything past it
+ *  - flags    : RAY_FLAG_* bits
+ *  - skipMask : materials to ignore, bit m skipping material ID m
+ */
+struct RayQuery {
+    vec3 o;
+    vec3 d;
+    float tMin;
+    float tMax;
+    int flags;
+    int skipMask;
+};
+
+/// Builds a RayQuery (see the struct for the fields).
+RayQuery rayQuery(vec3 o, vec3 d, float tMin, float tMax, int flags, int skipMask) {
+    RayQuery q;
+    q.o = o;
+    q.d = d;
+    q.tMin = tMin;
+    q.tMax = tMax;
+    q.flags = flags;
+    q.skipMask = skipMask;
+    return q;
+}
+
+/// True if the query skips material mat.
+bool raySkips(RayQuery q, int mat) {
+    return (q.skipMask & (1 << mat)) != 0;
+}
+
 // -------- Random & helpers ----------
 
 /**
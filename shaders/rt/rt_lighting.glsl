@@ -7,7 +7,8 @@
 
     This module defines:
     - A simple disk area light (kLightCenter, kLightN, kLightRadius, kLightCol).
-    - Unified occlusion tests that work in both analytic and BVH modes.
+    - traceRay(), the single ray query entry point for both analytic and
+      BVH modes, and the occlusion tests built on it.
     - A shared Lambert + Phong BRDF helper.
     - Sun, sky, and point lights (hybrid analytic lights shared across scenes).
     - Direct lighting evaluators:
@@ -18,10 +19,13 @@
     - Mirror shading using analytic scene traces.
     - Ambient occlusion (AO) using cosine-weighted hemisphere sampling.
 
+    Every ray asks for the narrowest query it can use: shadow and AO rays
+    are any-hit queries ending at the light or the AO radius, and glass
+    and point-light rays skip the materials they must not see.
+
     All routines assume the presence of:
     - uUseBVH, uAO_* uniforms.
-    - traceAnalytic(), traceAnalyticIgnoreGlass(), traceAnalyticIgnorePointLight().
-    - traceBVH(), traceBVHShadow().
+    - RayQuery, traceAnalyticRay(), traceBVHRay().
     - MaterialProps, sky(), sampleHemisphereCosine(), etc.
 */
 
@@ -32,15 +36,41 @@ const float kLightRadius = 1.2;
 const vec3 kLightCol = vec3(18.0);
 
 // ---------------------------------------------------------------------------
-// Unified shadow test for both modes
+// Ray queries and the unified shadow test for both modes
 // ---------------------------------------------------------------------------
 
+/**
+ * @brief Traces a ray query against the active scene.
+ *
+ * BVH scenes go through traceBVHRay(), analytic ones through
+ * traceAnalyticRay(); both honour the interval, the flags and the
+ * material skip mask of q.
+ *
+ * @param q Ray query.
+ * @param h Output hit (valid only if the function returns true).
+ * @return True if anything was hit within [q.tMin, q.tMax].
+ */
+bool traceRay(RayQuery q, out Hit h) {
+    return (uUseBVH == 1) ? traceBVHRay(q, h) : traceAnalyticRay(q, h);
+}
+
+/**
+ * @brief Any-hit version of traceRay() for visibility tests.
+ *
+ * @param q Ray query; RAY_FLAG_ANY_HIT is added.
+ * @return True if anything blocks the ray within [q.tMin, q.tMax].
+ */
+bool traceOcclusion(RayQuery q) {
+    q.flags |= RAY_FLAG_ANY_HIT;
+    Hit h;
+    return traceRay(q, h);
+}
+
 /**
  * @brief Tests whether the segment between p and q is occluded.
  *
- * Builds a shadow ray from p toward q and checks:
- *  - BVH scene via traceBVHShadow, or
- *  - Analytic scene via traceAnalytic.
+ * The shadow ray is an any-hit query ending just before q, so neither
+ * scene is searched past the target.
  *
  * @param p Start position (usually a surface point).
  * @param q Target point (e.g., area-light point).
@@ -50,13 +80,7 @@ bool occludedToward(vec3 p, vec3 q) {
     vec3 rd = normalize(q - p);
     float maxT = length(q - p);
     float eps = epsForDist(maxT);
-    if (uUseBVH == 1) {
-        return traceBVHShadow(p + rd * eps, rd, maxT - eps);
-    } else {
-        Hit h;
-        if (traceAnalytic(p + rd * eps, rd, h) && h.t < maxT - eps) return true;
-        return false;
-    }
+    return traceOcclusion(rayQuery(p + rd * eps, rd, uEPS, maxT - eps, 0, 0));
 }
 
 // ---------------------------------------------------------------------------
@@ -127,14 +151,7 @@ vec3 sunDirect(Hit h, MaterialProps mat, vec3 Vdir)
     float eps = epsForDist(maxT);
     vec3 origin = h.p + N * eps;
 
-    bool blocked;
-    if (uUseBVH == 1) {
-        blocked = traceBVHShadow(origin, L, maxT - eps);
-    } else {
-        Hit tmp;
-        blocked = traceAnalytic(origin, L, tmp);
-    }
-    if (blocked) return vec3(0.0);
+    if (traceOcclusion(rayQuery(origin, L, uEPS, maxT - eps, 0, 0))) return vec3(0.0);
 
     vec3 Li = uSunColor * uSunIntensity;
 
@@ -175,8 +192,8 @@ vec3 skyDirect(Hit h, MaterialProps mat, vec3 Vdir)
 /**
  * @brief Point light contribution with inverse-square falloff and shadows.
  *
- * For the analytic scene, the emissive point-light marker sphere is excluded
- * from shadow tests via traceAnalyticIgnorePointLight().
+ * For the analytic scene, the emissive point-light marker sphere is masked
+ * out of the shadow query.
  */
 vec3 pointDirect(Hit h, MaterialProps mat, vec3 Vdir)
 {
@@ -196,15 +213,9 @@ vec3 pointDirect(Hit h, MaterialProps mat, vec3 Vdir)
     float eps = epsForDist(dist);
     vec3 origin = h.p + L * eps;
 
-    bool blocked;
-    if (uUseBVH == 1) {
-        blocked = traceBVHShadow(origin, L, dist - eps);
-    } else {
-        Hit tmp;
-        // IMPORTANT: do NOT let the marker sphere shadow its own light
-        blocked = traceAnalyticIgnorePointLight(origin, L, tmp) && tmp.t < dist - eps;
-    }
-    if (blocked) return vec3(0.0);
+    // IMPORTANT: do NOT let the marker sphere shadow its own light
+    RayQuery shadow = rayQuery(origin, L, uEPS, dist - eps, 0, 1 << MAT_POINTLIGHT_SPHERE);
+    if (traceOcclusion(shadow)) return vec3(0.0);
 
     // Inverse-square falloff
     vec3 Li = uPointLightColor * (uPointLightIntensity / max(dist2, 1e-4));
@@ -490,7 +501,7 @@ vec3 oneBounceGIAnalytic(Hit h0, int frame, int seed) {
     vec3 origin = h0.p + N0 * uEPS;
 
     Hit h1;
-    bool hit1 = traceAnalytic(origin, wi, h1);
+    bool hit1 = traceAnalyticRay(rayQuery(origin, wi, uEPS, uINF, 0, 0), h1);
 
     vec3 Li;
     if (hit1) {
@@ -536,7 +547,7 @@ vec3 oneBounceGIBVH(Hit h0, int frame, int seed) {
     vec3 origin = h0.p + N0 * uEPS;
 
     Hit h1;
-    bool hit1 = traceBVH(origin, wi, h1);
+    bool hit1 = traceBVHRay(rayQuery(origin, wi, uEPS, uINF, 0, 0), h1);
 
     vec3 Li;
     if (hit1) {
@@ -585,6 +596,9 @@ vec3 shadeGlass(const Hit h, const vec3 wo, const MaterialProps mat, int frame)
     // 1.0 = fully physical refraction
     const float distortionStrength = 0.45;
 
+    // Secondary rays look past the glass sphere itself.
+    const int skipGlass = 1 << MAT_GLASS_SPHERE;
+
     // ------------------------------------------------------------------------
     // REFLECTION: env + local scene
     // ------------------------------------------------------------------------
@@ -597,7 +611,7 @@ vec3 shadeGlass(const Hit h, const vec3 wo, const MaterialProps mat, int frame)
     vec3 reflectLocal = reflectEnv;
     {
         Hit hRefl;
-        if (traceAnalyticIgnoreGlass(h.p + R * uEPS, R, hRefl)) {
+        if (traceAnalyticRay(rayQuery(h.p + R * uEPS, R, uEPS, uINF, 0, skipGlass), hRefl)) {
             vec3 V2 = normalize(uCamPos - hRefl.p);   // hit -> camera
             reflectLocal = directLight(hRefl, frame, V2);
         }
@@ -616,7 +630,7 @@ vec3 shadeGlass(const Hit h, const vec3 wo, const MaterialProps mat, int frame)
     vec3 straightCol = vec3(0.0);
     {
         Hit hStraight;
-        if (traceAnalyticIgnoreGlass(h.p + I * uEPS, I, hStraight)) {
+        if (traceAnalyticRay(rayQuery(h.p + I * uEPS, I, uEPS, uINF, 0, skipGlass), hStraight)) {
             vec3 V2 = normalize(uCamPos - hStraight.p);  // from hit -> camera
             straightCol = directLight(hStraight, frame, V2);
         } else {
@@ -639,7 +653,7 @@ vec3 shadeGlass(const Hit h, const vec3 wo, const MaterialProps mat, int frame)
 
         Hit hRefr;
         vec3 bentCol;
-        if (traceAnalyticIgnoreGlass(h.p + T * uEPS, T, hRefr)) {
+        if (traceAnalyticRay(rayQuery(h.p + T * uEPS, T, uEPS, uINF, 0, skipGlass), hRefr)) {
             vec3 V2 = normalize(uCamPos - hRefr.p);
             bentCol = directLight(hRefr, frame, V2);
         } else {
@@ -679,7 +693,7 @@ vec3 shadeMirror(const Hit h, const vec3 wo, const MaterialProps mat, int frame)
     vec3 org = h.p + R * uEPS;
 
     Hit h2;
-    bool hit2 = traceAnalytic(org, R, h2);
+    bool hit2 = traceAnalyticRay(rayQuery(org, R, uEPS, uINF, 0, 0), h2);
 
     vec3 col;
     if (hit2) {
@@ -715,8 +729,9 @@ vec3 shadeMirror(const Hit h, const vec3 wo, const MaterialProps mat, int frame)
  * @brief Computes ambient occlusion factor around a hit point.
  *
  * Shoots several hemisphere rays around the normal and counts the fraction
- * of rays that quickly hit geometry within a radius. The final AO factor
- * is clamped and remapped to avoid fully black regions.
+ * of rays that hit geometry within uAO_RADIUS; each is an any-hit query
+ * ending at that radius. The final AO factor is clamped and remapped to
+ * avoid fully black regions.
  */
 float computeAO(Hit h, int frame) {
     vec3 N = normalize(h.n);
@@ -735,14 +750,8 @@ float computeAO(Hit h, int frame) {
         // ray origin slightly above the surface (offset along normal for robustness)
         vec3 org = h.p + N * uAO_BIAS;
 
-        Hit tmp;
-        bool hitAny =
-        (uUseBVH == 1)
-        ? traceBVH(org, dir, tmp)
-        : traceAnalytic(org, dir, tmp);
-
         // count as occluded only if something is reasonably close
-        if (hitAny && tmp.t < uAO_RADIUS) {
+        if (traceOcclusion(rayQuery(org, dir, uEPS, uAO_RADIUS, 0, 0))) {
             occludedCount++;
         }
     }
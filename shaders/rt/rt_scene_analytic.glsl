@@ -16,13 +16,12 @@
 
     It provides:
       - Basic plane and sphere intersection routines.
-      - A traceAnalyticCore() function that can optionally ignore:
-          * the glass sphere (for glass rays),
-          * the point-light marker sphere (for shadow rays to the bulb).
-      - Three public trace functions:
-          * traceAnalytic()                → full scene
-          * traceAnalyticIgnoreGlass()     → no glass sphere
-          * traceAnalyticIgnorePointLight()→ no point-light marker sphere
+      - traceAnalyticRay(), which traces a RayQuery (see rt_common.glsl):
+        hits are limited to [tMin, tMax], can be culled on back faces or
+        accepted on the first hit, and materials can be skipped by mask
+        (e.g. the glass sphere for glass rays, the point-light marker for
+        shadow rays to the bulb). traceRay() in rt_lighting.glsl calls it
+        in analytic mode.
       - A sky() function that samples either:
           * an environment cubemap (if enabled), or
           * a simple analytic gradient sky (fallback).
@@ -60,21 +59,22 @@ const float kPointLightRadius = 0.15;
  *
  * Plane equation: dot(n, x) + d = 0
  *
- * @param ro    Ray origin.
- * @param rd    Ray direction (assumed normalized).
+ * @param q     Ray query (origin, direction, tMin, cull flag).
+ * @param tMax  Farthest distance accepted (the closest hit so far).
  * @param n     Plane normal (normalized).
  * @param d     Plane offset.
  * @param h     Output hit record (filled on success).
  * @param matId Material ID to assign if hit.
- * @return True if the ray hits the plane at t >= uEPS.
+ * @return True if the ray hits the plane within [q.tMin, tMax].
  */
-bool intersectPlane(vec3 ro, vec3 rd, vec3 n, float d, out Hit h, int matId) {
-    float denom = dot(n, rd);
+bool intersectPlane(RayQuery q, float tMax, vec3 n, float d, out Hit h, int matId) {
+    float denom = dot(n, q.d);
     if (abs(denom) < 1e-6) return false;
-    float t = -(dot(n, ro) + d) / denom;
-    if (t < uEPS) return false;
+    if ((q.flags & RAY_FLAG_CULL_BACK) != 0 && denom > 0.0) return false;
+    float t = -(dot(n, q.o) + d) / denom;
+    if (t < q.tMin || t > tMax) return false;
     h.t = t;
-    h.p = ro + rd * t;
+    h.p = q.o + q.d * t;
     h.n = n;
     h.mat = matId;
     return true;
@@ -85,115 +85,91 @@ bool intersectPlane(vec3 ro, vec3 rd, vec3 n, float d, out Hit h, int matId) {
  *
  * Sphere equation: |x - c|^2 = r^2
  *
- * @param ro    Ray origin.
- * @param rd    Ray direction (assumed normalized).
+ * The far root is where the ray leaves the sphere, a back face, so it is
+ * not considered when culling.
+ *
+ * @param q     Ray query (origin, direction, tMin, cull flag).
+ * @param tMax  Farthest distance accepted (the closest hit so far).
  * @param c     Sphere center.
  * @param r     Sphere radius.
  * @param h     Output hit record (filled on success).
  * @param matId Material ID to assign if hit.
- * @return True if the ray hits the sphere at t >= uEPS.
+ * @return True if the ray hits the sphere within [q.tMin, tMax].
  */
-bool intersectSphere(vec3 ro, vec3 rd, vec3 c, float r, out Hit h, int matId) {
-    vec3 oc = ro - c;
-    float b = dot(oc, rd);
+bool intersectSphere(RayQuery q, float tMax, vec3 c, float r, out Hit h, int matId) {
+    vec3 oc = q.o - c;
+    float b = dot(oc, q.d);
     float c2 = dot(oc, oc) - r * r;
     float disc = b * b - c2;
     if (disc < 0.0) return false;
     float s = sqrt(disc);
     float t = -b - s;
-    if (t < uEPS) t = -b + s;
-    if (t < uEPS) return false;
+    if (t < q.tMin && (q.flags & RAY_FLAG_CULL_BACK) == 0) t = -b + s;
+    if (t < q.tMin || t > tMax) return false;
     h.t = t;
-    h.p = ro + rd * t;
+    h.p = q.o + q.d * t;
     h.n = normalize(h.p - c);
     h.mat = matId;
     return true;
 }
 
 /**
- * @brief Core analytic scene tracer with optional inclusion flags.
- *
- * This function traces against:
- *  - Floor (always)
- *  - Left diffuse sphere (always)
- *  - Glass sphere (controlled by includeGlass)
- *  - Mirror sphere (always)
- *  - Point-light marker sphere (controlled by includePointLightSphere & uPointLightEnabled)
+ * @brief Traces a ray query against the analytic scene.
  *
- * It returns the closest hit in @p hit if any intersection is found.
+ * Tests the floor, the left diffuse sphere, the glass sphere, the mirror
+ * sphere and (if uPointLightEnabled) the point-light marker sphere, minus
+ * the materials in q.skipMask. Each test only accepts hits closer than
+ * the best one so far, starting from q.tMax; with RAY_FLAG_ANY_HIT the
+ * first hit is returned.
  *
- * @param ro                      Ray origin.
- * @param rd                      Ray direction.
- * @param includeGlass            Include the glass sphere in intersection tests.
- * @param includePointLightSphere Include the point-light marker sphere.
- * @param hit                     Output closest hit (valid only if function returns true).
- * @return True if any object was hit; false otherwise.
+ * @param q   Ray query.
+ * @param hit Output hit (valid only if the function returns true).
+ * @return True if any object was hit within [q.tMin, q.tMax].
  */
-bool traceAnalyticCore(vec3 ro, vec3 rd, bool includeGlass, bool includePointLightSphere, out Hit hit) {
-    hit.t = uINF;
+bool traceAnalyticRay(RayQuery q, out Hit hit) {
+    bool anyHit = (q.flags & RAY_FLAG_ANY_HIT) != 0;
+    bool found = false;
+    hit.t = q.tMax;
     Hit h;
 
     // Floor
-    if (intersectPlane(ro, rd, kFloorNormal, kFloorD, h, MAT_FLOOR) && h.t < hit.t) {
+    if (!raySkips(q, MAT_FLOOR) && intersectPlane(q, hit.t, kFloorNormal, kFloorD, h, MAT_FLOOR)) {
         hit = h;
+        found = true;
+        if (anyHit) return true;
     }
 
     // Left albedo sphere
-    if (intersectSphere(ro, rd, kSphereLeftCenter, kSphereLeftRadius, h, MAT_ALBEDO_SPHERE) && h.t < hit.t) {
+    if (!raySkips(q, MAT_ALBEDO_SPHERE)
+        && intersectSphere(q, hit.t, kSphereLeftCenter, kSphereLeftRadius, h, MAT_ALBEDO_SPHERE)) {
         hit = h;
+        found = true;
+        if (anyHit) return true;
     }
 
-    // Glass sphere (optionally ignored)
-    if (includeGlass) {
-        if (intersectSphere(ro, rd, kGlassCenter, kGlassRadius, h, MAT_GLASS_SPHERE) && h.t < hit.t) {
-            hit = h;
-        }
+    // Glass sphere
+    if (!raySkips(q, MAT_GLASS_SPHERE) && intersectSphere(q, hit.t, kGlassCenter, kGlassRadius, h, MAT_GLASS_SPHERE)) {
+        hit = h;
+        found = true;
+        if (anyHit) return true;
     }
 
     // Mirror sphere
-    if (intersectSphere(ro, rd, kMirrorCenter, kMirrorRadius, h, MAT_MIRROR_SPHERE) && h.t < hit.t) {
+    if (!raySkips(q, MAT_MIRROR_SPHERE)
+        && intersectSphere(q, hit.t, kMirrorCenter, kMirrorRadius, h, MAT_MIRROR_SPHERE)) {
         hit = h;
+        found = true;
+        if (anyHit) return true;
     }
 
-    // Point-light marker sphere (optional)
-    if (includePointLightSphere && uPointLightEnabled == 1) {
-        // Center is the actual point light position
-        if (intersectSphere(ro, rd, uPointLightPos, kPointLightRadius, h, MAT_POINTLIGHT_SPHERE) && h.t < hit.t) {
-            hit = h;
-        }
+    // Point-light marker sphere, centered on the actual point light
+    if (uPointLightEnabled == 1 && !raySkips(q, MAT_POINTLIGHT_SPHERE)
+        && intersectSphere(q, hit.t, uPointLightPos, kPointLightRadius, h, MAT_POINTLIGHT_SPHERE)) {
+        hit = h;
+        found = true;
     }
 
-    return hit.t < uINF;
-}
-
-/**
- * @brief Full analytic scene ray trace (floor + all spheres + marker).
- *
- * This is the general-purpose analytic tracing function used for primary
- * rays and most shading paths.
- */
-bool traceAnalytic(vec3 ro, vec3 rd, out Hit hit) {
-    return traceAnalyticCore(ro, rd, true, true, hit);
-}
-
-/**
- * @brief Analytic scene trace that ignores the glass sphere.
- *
- * Useful for refraction/glass paths where we want to see what lies
- * behind the glass without intersecting the glass surface itself.
- */
-bool traceAnalyticIgnoreGlass(vec3 ro, vec3 rd, out Hit hit) {
-    return traceAnalyticCore(ro, rd, false, true, hit);
-}
-
-/**
- * @brief Analytic scene trace that ignores the point-light marker sphere.
- *
- * Used for shadow rays toward the point light so that the emissive
- * marker sphere does not shadow its own light.
- */
-bool traceAnalyticIgnorePointLight(vec3 ro, vec3 rd, out Hit hit) {
-    return traceAnalyticCore(ro, rd, true, false, hit);
+    return found;
 }
 
 // -------- Sky ----------
@@ -68,10 +68,28 @@ uniform int uUseBVH;
 // BVH statistics (for debug / sanity)
 uniform int uNodeCount;     // Number of BVH nodes
 uniform int uTriCount;      // Number of triangles in BVH scene
-
-// BVH data, bound as texture buffers (used when uUseBVH == 1)
-uniform samplerBuffer uBvhNodes; // Packed BVH nodes
-uniform samplerBuffer uBvhTris;  // Packed triangle data
+uniform int uTlasNodeCount; // TLAS nodes at the start of uBvhNodes (0 = single-level BVH)
+uniform int uBvhWidth;      // 2 = binary nodes in uBvhNodes, 4/8 = collapsed nodes in uBvhWideNodes
+uniform int uBvhTriTest;    // 0 = Möller–Trumbore, 1 = watertight, 2 = affine transforms in uBvhTris
+
+// BVH data, bound as texture buffers (used when uUseBVH == 1). Nodes and
+// triangles are split into pages of 1 << uBvhPageShift texels so they can
+// exceed GL_MAX_TEXTURE_BUFFER_SIZE (see bvhNodeTexel / bvhTriTexel).
+const int BVH_MAX_PAGES = 4;
+uniform int uBvhPageShift;                       // log2 of the texels per page
+uniform isamplerBuffer uBvhNodes[BVH_MAX_PAGES]; // Packed BVH nodes (bounds as float bits)
+uniform isamplerBuffer uBvhNodeSkips; // Per-node skip links (stackless traversal)
+uniform usamplerBuffer uBvhTris[BVH_MAX_PAGES];  // Packed triangle data (float bits, lattice coordinates or indices)
+uniform samplerBuffer uBvhInstances; // Packed instances (used when uTlasNodeCount > 0)
+uniform usamplerBuffer uBvhWideNodes; // Quantized BVH4/BVH8 nodes (used when uBvhWidth > 2)
+
+// Compressed triangles: 21-bit lattice cells, decoded as (origin + cell) * scale
+uniform ivec3 uBvhTriQuantOrigin;   // Lattice cell of the frame origin
+uniform float uBvhTriQuantScale;    // Cell size (0 = triangles are floats in uBvhTris)
+
+// Indexed triangles: three indices per triangle into a shared vertex buffer
+uniform int uBvhTriIndexed;      // 1 = uBvhTris holds vertex indices into uBvhVerts, one texel per triangle
+uniform samplerBuffer uBvhVerts; // Shared vertex positions (RGB32F)
 
 // ------------------------------------------------------------
 // Motion vectors & reprojection (for TAA / motion debug)
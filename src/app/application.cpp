@@ -5,6 +5,9 @@
 #include "render/cubemap.h"
 #include "render/render.h"
 #include "scene/bvh.h"
+#include "scene/bvh_dynamic.h"
+#include "scene/bvh_metrics.h"
+#include "scene/keyframes.h"
 #include "ui/gui.h"
 
 #include <GLFW/glfw3.h>
@@ -14,8 +17,15 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
 #include <filesystem>
+#include <fstream>
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 // ============================================================================
 // Application namespace – local helpers
@@ -143,13 +153,1167 @@ namespace app_detail {
 
         return false;
     }
+
+    // Human-readable name of a BVH build method, for logs.
+    const char *buildMethodName(const BVHBuildMethod method) {
+        switch (method) {
+            case BVHBuildMethod::Median: return "median";
+            case BVHBuildMethod::BinnedSAH: return "binned SAH";
+            case BVHBuildMethod::LBVH: return "LBVH";
+        }
+        return "unknown";
+    }
+
+    // Human-readable name of a triangle test, for logs.
+    const char *triTestName(const BVHTriTest test) {
+        switch (test) {
+            case BVHTriTest::MollerTrumbore: return "Moller-Trumbore";
+            case BVHTriTest::Watertight: return "watertight";
+            case BVHTriTest::Affine: return "affine";
+        }
+        return "unknown";
+    }
+
+    // Human-readable name of a node layout, for logs.
+    const char *layoutName(const BVHLayout layout) {
+        switch (layout) {
+            case BVHLayout::DepthFirst: return "depth-first";
+            case BVHLayout::SiblingPairs: return "sibling pairs";
+            case BVHLayout::BreadthFirst: return "breadth-first";
+            case BVHLayout::VanEmdeBoas: return "van Emde Boas";
+            case BVHLayout::Clustered: return "clustered";
+        }
+        return "unknown";
+    }
+
+    // Human-readable name of the triangle encoding of a handle, for logs and the picker.
+    const char *triStorageName(const BVHHandle &handle) {
+        return handle.triQuant.enabled() ? "compressed" : handle.indexedTris ? "indexed" : "direct";
+    }
+
+    // Identifies the traced surface independently of the tree built over it.
+    // Rebuilds that keep it (other builder, layout, leaf size, ...) hit the
+    // same triangles, so the accumulated image stays valid.
+    std::string bvhSurfaceId(const std::string &path, const bool compressTris, const bool preview) {
+        return path + (compressTris ? "|lattice" : "") + (preview ? "|preview" : "");
+    }
+
+    // Places picker.instanceCopies copies of the model on a square grid
+    // around bvhTransform, one instance per (copy, BLAS). With animation
+    // enabled every copy spins about its own vertical axis.
+    void placeInstances(AppState &app) {
+        const ui::BvhModelPickerState &picker = app.bvhPicker;
+        BVHScene &scene = app.bvhScene;
+        scene.instances.clear();
+
+        const int copies = std::max(picker.instanceCopies, 1);
+        const int side = static_cast<int>(std::ceil(std::sqrt(static_cast<float>(copies))));
+        const float half = 0.5f * static_cast<float>(side - 1);
+        for (int c = 0; c < copies; ++c) {
+            const glm::vec3 offset((static_cast<float>(c % side) - half) * picker.instanceSpacing,
+                                   0.0f,
+                                   (static_cast<float>(c / side) - half) * picker.instanceSpacing);
+            const float angle = static_cast<float>(app.bvhInstanceTime) * (0.5f + 0.1f * static_cast<float>(c % 7));
+
+            glm::mat4 M = glm::translate(glm::mat4(1.0f), offset) * app.bvhTransform;
+            M = glm::rotate(M, angle, glm::vec3(0.0f, 1.0f, 0.0f));
+            for (int b = 0; b < static_cast<int>(scene.blas.size()); ++b) {
+                scene.instances.push_back({M, b});
+            }
+        }
+    }
+
+    // Re-places the instances and rebuilds only the TLAS. A full upload is
+    // used when the instance count changed (the TLAS region is resized),
+    // otherwise only the TLAS nodes and instance buffer are re-uploaded.
+    void updateInstances(AppState &app) {
+        ui::BvhModelPickerState &picker = app.bvhPicker;
+        BVHScene &scene = app.bvhScene;
+        std::vector<BVHInstance> previous = scene.instances;
+
+        placeInstances(app);
+        build_tlas(scene, picker.build, &picker.tlasStats);
+
+        std::string reason;
+        if (scene.instances.size() == previous.size()) {
+            update_bvh_tlas_tbo(scene, app.bvh);
+        } else if (!bvh_fits_texture_limits(static_cast<size_t>(scene.nodeCount()),
+                                            static_cast<size_t>(scene.triCount()), 2, false,
+                                            scene.instances.size(), &reason)) {
+            ui::Log("[BVH] %zu instances exceed GPU texture buffer limits (%s); keeping %zu\n",
+                    scene.instances.size(),
+                    reason.c_str(),
+                    previous.size());
+            picker.instanceCopies = picker.instanceCount / std::max(static_cast<int>(scene.blas.size()), 1);
+            scene.instances = std::move(previous);
+            build_tlas(scene, picker.build, &picker.tlasStats);
+        } else {
+            picker.stats.nodeBytes = upload_bvh_scene(scene, app.bvh);
+            app.bvhNodeCount = scene.nodeCount();
+            picker.nodeCount = app.bvhNodeCount;
+            picker.instanceCount = static_cast<int>(scene.instances.size());
+        }
+        app.bvhTlasNodeCount = static_cast<int>(scene.tlas.size());
+    }
+
+    // Mirrors the residency cache usage into the picker.
+    void updateResidentStats(AppState &app) {
+        ui::BvhModelPickerState &picker = app.bvhPicker;
+        picker.residentCount = app.bvhResident.size();
+        picker.residentGpuBytes = app.bvhResident.gpuBytes();
+        picker.residentCpuBytes = app.bvhResident.cpuBytes();
+    }
+
+    // Forgets the inserted props; called whenever another BVH replaces the edited one.
+    void discardBvhEdits(AppState &app) {
+        app.bvhEdit.clear();
+        app.bvhProps.clear();
+        app.bvhPicker.propCount = 0;
+        app.bvhPicker.edit = BVHEditStats{};
+    }
+
+    // Moves the current single-level BVH (GPU buffers included) into the
+    // residency cache, so switching back to it needs no import or upload.
+    void stashBvh(AppState &app) {
+        const ui::BvhModelPickerState &picker = app.bvhPicker;
+        if (!app.bvhKey.valid() || app.bvhTlasNodeCount > 0 || app.bvhNodeCount == 0) return;
+
+        BVHResident resident;
+        resident.key = app.bvhKey;
+        resident.handle = app.bvh;
+        resident.geometry = std::move(app.bvhGeometry);
+        resident.stats = picker.stats;
+        resident.metrics = picker.metrics;
+        resident.anim = std::move(app.bvhAnim);
+        resident.nodeCount = app.bvhNodeCount;
+        resident.triCount = app.bvhTriCount;
+
+        app.bvh = BVHHandle{};
+        app.bvhGeometry.clear();
+        app.bvhAnim.clear();
+        app.bvhKey = BVHResidentKey{};
+        app.bvhModel.reset();
+        app.bvhResident.put(std::move(resident));
+        updateResidentStats(app);
+    }
+
+    // Makes a resident BVH current again: a handle swap, nothing is uploaded.
+    // Returns true if the traced surface changed.
+    bool swapInResidentBvh(AppState &app, const BVHResidentKey &key) {
+        ui::BvhModelPickerState &picker = app.bvhPicker;
+        BVHResident resident;
+        if (!key.valid() || !app.bvhResident.take(key, resident)) return false;
+
+        discardBvhEdits(app);
+        app.bvh.release();
+        app.bvh = resident.handle;
+        app.bvhGeometry = std::move(resident.geometry);
+        app.bvhAnim = std::move(resident.anim);
+        app.bvhScene.clear();
+        app.bvhTlasNodeCount = 0;
+        app.bvhGpuWidth = key.gpuWidth;
+        app.bvhNodeCount = resident.nodeCount;
+        app.bvhTriCount = resident.triCount;
+        app.bvhKey = key;
+        app.bvhIsPreview = false;
+        app.bvhBeforePreview = BVHResidentKey{};
+        app.bvhAnimTime = 0.0;
+        picker.stats = resident.stats;
+        picker.metrics = resident.metrics;
+        picker.epoValid = false;
+        picker.nodeCount = app.bvhNodeCount;
+        picker.triCount = app.bvhTriCount;
+        picker.instanceCount = 0;
+        picker.blasCount = 0;
+        picker.refit = BVHRefitStats{};
+        picker.refitRebuilds = 0;
+        picker.animFrameCount = app.bvhAnim.frameCount();
+        updateResidentStats(app);
+        ui::Log("[BVH] Switched to resident BVH for '%s': nodes=%d, tris=%d (%d still resident)\n",
+                picker.currentPath,
+                app.bvhNodeCount,
+                app.bvhTriCount,
+                picker.residentCount);
+
+        const std::string surface = bvhSurfaceId(key.path, app.bvh.triQuant.enabled(), false);
+        const bool changed = surface != app.bvhSurface;
+        app.bvhSurface = surface;
+        return changed;
+    }
+
+    // A load whose preview is current failed or was refused: the coarse
+    // proxy must not stay in place, since nothing will replace it. The BVH
+    // it replaced comes back if it is still resident; otherwise the BVH is
+    // cleared. Returns true if the traced surface changed.
+    bool dropBvhPreview(AppState &app) {
+        if (!app.bvhIsPreview) return false;
+        const BVHResidentKey key = app.bvhBeforePreview;
+        if (key.valid() && app.bvhResident.contains(key)) {
+            ui::Log("[BVH] Restoring the BVH the preview replaced\n");
+            swapInResidentBvh(app, key);
+            return true;
+        }
+
+        ui::BvhModelPickerState &picker = app.bvhPicker;
+        discardBvhEdits(app);
+        app.bvh.release();
+        app.bvhModel.reset();
+        app.bvhGeometry.clear();
+        app.bvhAnim.clear();
+        app.bvhNodeCount = 0;
+        app.bvhTriCount = 0;
+        app.bvhKey = BVHResidentKey{};
+        app.bvhSurface.clear();
+        app.bvhIsPreview = false;
+        app.bvhBeforePreview = BVHResidentKey{};
+        picker.stats = BVHBuildStats{};
+        picker.metrics = BVHMetrics{};
+        picker.nodeCount = 0;
+        picker.triCount = 0;
+        picker.animFrameCount = 0;
+        ui::Log("[BVH] Dropped the preview; no BVH loaded\n");
+        return true;
+    }
+
+    // Two-level load finished: the loader built one object-space BLAS per
+    // mesh, shared by every copy; the TLAS over the instances is built here.
+    // Everything is uploaded into a back handle that replaces the current
+    // BVH only once it is complete. Returns false, keeping the current BVH,
+    // if the scene exceeds the texture buffer limits.
+    bool finishBvhInstanced(AppState &app, BVHLoadResult &result) {
+        ui::BvhModelPickerState &picker = app.bvhPicker;
+        const BVHLoadRequest &request = result.request;
+        const BVHBuildStats stats = result.prepared.stats;
+
+        BVHScene &scene = app.bvhScene;
+        BVHScene previous = std::move(scene);
+        const double previousTime = app.bvhInstanceTime;
+        scene.clear();
+        scene.blas = std::move(result.blas);
+        app.bvhInstanceTime = 0.0;
+        placeInstances(app);
+        build_tlas(scene, request.settings, &picker.tlasStats);
+
+        std::string reason;
+        if (!bvh_fits_texture_limits(static_cast<size_t>(scene.nodeCount()), static_cast<size_t>(scene.triCount()),
+                                     2, false, scene.instances.size(), &reason)) {
+            ui::Log("[BVH] Two-level BVH of '%s' exceeds GPU texture buffer limits (%s); keeping the current BVH\n",
+                    request.path.c_str(),
+                    reason.c_str());
+            scene = std::move(previous);
+            app.bvhInstanceTime = previousTime;
+            return dropBvhPreview(app);
+        }
+
+        BVHHandle next;
+        next.triTest = picker.build.triTest; // upload-only, may have changed while loading
+        next.indexedTris = picker.build.indexedTris;
+        const size_t nodeBytes = upload_bvh_scene(scene, next);
+        result.prepared.model->upload();
+
+        stashBvh(app);
+        discardBvhEdits(app);
+        app.bvh.release();
+        app.bvh = next;
+        app.bvhModel = std::move(result.prepared.model);
+        app.bvhGeometry.clear();
+        app.bvhAnim.clear();
+        app.bvhKey = BVHResidentKey{};
+        app.bvhSurface.clear();
+        app.bvhIsPreview = false;
+        app.bvhBeforePreview = BVHResidentKey{};
+
+        app.bvhNodeCount = scene.nodeCount();
+        app.bvhTriCount = scene.triCount();
+        app.bvhTlasNodeCount = static_cast<int>(scene.tlas.size());
+        app.bvhGpuWidth = 2; // BLASes are traversed in the binary layout
+        picker.stats = stats;
+        picker.stats.nodeBytes = nodeBytes;
+        picker.stats.triBytes = app.bvh.triBytes;
+        picker.triStorageMs[0] = picker.triStorageMs[1] = 0.0;
+        picker.nodeCount = app.bvhNodeCount;
+        picker.triCount = app.bvhTriCount;
+        picker.instanceCount = static_cast<int>(scene.instances.size());
+        picker.blasCount = static_cast<int>(scene.blas.size());
+        picker.animFrameCount = 0;
+        picker.metrics = BVHMetrics{};
+        picker.epoValid = false;
+        ui::Log("[BVH] Built two-level BVH from '%s' (%s): %d BLAS, %d instances, tris=%d, "
+                "BLAS build=%.2f ms, TLAS build=%.3f ms\n",
+                request.path.c_str(),
+                buildMethodName(request.settings.method),
+                picker.blasCount,
+                picker.instanceCount,
+                app.bvhTriCount,
+                stats.buildMs,
+                picker.tlasStats.buildMs);
+        return true;
+    }
+
+    // Builds the deferred tree of prepared on the GPU into handle and fills
+    // prepared.stats; checks it against the CPU LBVH if the picker asks to.
+    // Returns false if the builder is unavailable or refuses the model, for
+    // the caller to have it built on the CPU by the loader thread instead.
+    bool buildBvhOnGpu(AppState &app, BVHPrepared &prepared, BVHHandle &handle) {
+        ui::BvhModelPickerState &picker = app.bvhPicker;
+        BVHGpuBuilder &builder = app.bvhGpuBuilder;
+        if (!builder.ready() &&
+            !builder.init(util::resolve_path("shaders/bvh/lbvh.vert"), util::resolve_path("shaders/bvh/lbvh.frag"))) {
+            ui::Log("[BVH] GPU builder shaders failed to compile; building on the CPU in the background\n");
+            return false;
+        }
+
+        const std::vector<CPU_Triangle> &tris = prepared.geometry.tris;
+        BVHGpuBuildStats gpuStats;
+        std::string reason;
+        if (!builder.build(tris, handle, &gpuStats, &reason)) {
+            ui::Log("[BVH] GPU build refused (%s); building on the CPU in the background\n", reason.c_str());
+            return false;
+        }
+        picker.gpuBuild = gpuStats;
+        picker.gpuValidation = picker.gpuValidate ? builder.validate(tris, handle) : BVHGpuValidation{};
+
+        BVHBuildStats &stats = prepared.stats;
+        stats = BVHBuildStats{};
+        stats.gpuBuilt = true;
+        stats.buildMs = gpuStats.buildMs;
+        stats.leafCount = static_cast<int>(tris.size());
+        stats.nodeBytes = gpuStats.nodeBytes;
+        stats.triBytes = handle.triBytes;
+
+        const BVHGpuValidation &check = picker.gpuValidation;
+        if (check.nodeCount > 0) {
+            stats.sahCost = check.gpuSahCost;
+            ui::Log("[BVH] GPU build %s the CPU LBVH: %d node, %d leaf, %d skip-link mismatches; "
+                    "SAH %.2f vs %.2f, CPU build=%.2f ms\n",
+                    check.ok() ? "matches" : "differs from",
+                    check.nodeMismatches,
+                    check.triMismatches,
+                    check.skipMismatches,
+                    check.gpuSahCost,
+                    check.cpuSahCost,
+                    check.cpuBuildMs);
+        }
+        return true;
+    }
+
+    // Single-level load finished: uploads the tree into a back handle, then
+    // swaps it in. The outgoing BVH stays resident (unless it was a preview).
+    // A refused tree leaves the current BVH in place, unless that is a
+    // preview (see dropBvhPreview()). Returns true if the traced surface changed.
+    bool finishBvhSingle(AppState &app, BVHLoadResult &result) {
+        ui::BvhModelPickerState &picker = app.bvhPicker;
+        const BVHLoadRequest &request = result.request;
+        BVHPrepared &prepared = result.prepared;
+
+        // The triangle test and storage only affect the upload: use the ones selected now.
+        BVHBuildSettings settings = request.settings;
+        settings.triTest = picker.build.triTest;
+        settings.indexedTris = picker.build.indexedTris;
+
+        BVHHandle next;
+        next.triTest = settings.triTest;
+        int nodeCount = 0;
+        int triCount = 0;
+        std::string reason;
+        const bool gpuBuilt = prepared.gpuDeferred && buildBvhOnGpu(app, prepared, next);
+        if (prepared.gpuDeferred && !gpuBuilt) {
+            // Building here would stall the frame: hand it back to the loader thread.
+            next.release();
+            BVHLoadRequest retry = request;
+            retry.settings.gpuBuild = false;
+            retry.previewTris = 0;
+            app.bvhLoader.submit(std::move(retry));
+            return false;
+        }
+        if (gpuBuilt) {
+            // Triangles in source order cannot serve refits or repacks: like
+            // a cache hit, the tree has no CPU copy.
+            if (prepared.model) prepared.model->upload();
+            nodeCount = app.bvhPicker.gpuBuild.nodeCount;
+            triCount = static_cast<int>(prepared.geometry.tris.size());
+            prepared.geometry.clear();
+            result.anim.clear();
+        } else if (!upload_prepared_bvh(prepared, settings, next, nodeCount, triCount, &reason)) {
+            ui::Log("[BVH] Failed to load '%s': its BVH exceeds GPU texture buffer limits (%s)\n",
+                    request.path.c_str(),
+                    reason.c_str());
+            return dropBvhPreview(app);
+        }
+        if (!gpuBuilt && settings.indexedTris && !next.indexedTris) {
+            ui::Log("[BVH] Shared vertices of '%s' exceed the texture buffer limit; triangles stored directly\n",
+                    request.path.c_str());
+        }
+
+        // A preview stands in for the BVH it stashes until the full tree arrives.
+        if (result.preview && !app.bvhIsPreview) app.bvhBeforePreview = app.bvhKey;
+        if (!result.preview) app.bvhBeforePreview = BVHResidentKey{};
+        app.bvhIsPreview = result.preview;
+        stashBvh(app);
+        discardBvhEdits(app);
+        app.bvh.release();
+        app.bvh = next;
+        app.bvhModel = std::move(prepared.model);
+        app.bvhGeometry = std::move(prepared.geometry);
+        app.bvhAnim = std::move(result.anim);
+        app.bvhScene.clear();
+        app.bvhTlasNodeCount = 0;
+        app.bvhGpuWidth = settings.gpuWidth;
+        app.bvhNodeCount = nodeCount;
+        app.bvhTriCount = triCount;
+        app.bvhKey = result.preview ? BVHResidentKey{}
+                                    : make_bvh_resident_key(request.path.c_str(), request.modelTransform, settings);
+
+        const std::string surface = bvhSurfaceId(request.path, settings.compressTris, result.preview);
+        const bool changed = surface != app.bvhSurface;
+        app.bvhSurface = surface;
+
+        const BVHBuildStats &stats = prepared.stats;
+        picker.stats = stats;
+        picker.triStorageMs[0] = picker.triStorageMs[1] = 0.0;
+        picker.nodeCount = app.bvhNodeCount;
+        picker.triCount = app.bvhTriCount;
+        picker.instanceCount = 0;
+        picker.blasCount = 0;
+        if (result.preview) {
+            // Coarse stand-in: no metrics or keyframes until the full tree arrives.
+            picker.metrics = BVHMetrics{};
+            picker.epoValid = false;
+            picker.animFrameCount = 0;
+            ui::Log("[BVH] Preview of '%s' after %.2f s: %d proxy triangles, build=%.2f ms; refining\n",
+                    request.path.c_str(),
+                    result.seconds,
+                    app.bvhTriCount,
+                    stats.buildMs);
+            return changed;
+        }
+        if (stats.fromCache) {
+            ui::Log("[BVH] Loaded BVH for '%s' from cache in %.2f ms (build took %.2f ms)\n",
+                    request.path.c_str(),
+                    stats.loadMs,
+                    stats.buildMs);
+        }
+        if (stats.gpuBuilt) {
+            ui::Log("[BVH] Built BVH from '%s' on the GPU (LBVH): nodes=%d, tris=%d, build=%.2f ms "
+                    "(GPU %.2f ms, %d passes, %.1f KB uploaded)\n",
+                    request.path.c_str(),
+                    app.bvhNodeCount,
+                    app.bvhTriCount,
+                    stats.buildMs,
+                    picker.gpuBuild.gpuMs,
+                    picker.gpuBuild.passes,
+                    static_cast<double>(picker.gpuBuild.uploadBytes) / 1024.0);
+        } else {
+            ui::Log("[BVH] %s BVH from '%s' (%s): nodes=%d, tris=%d (dup x%.2f), build=%.2f ms on %d thread(s), "
+                    "SAH=%.2f\n",
+                    stats.fromCache ? "Cached" : "Rebuilt",
+                    request.path.c_str(),
+                    buildMethodName(settings.method),
+                    app.bvhNodeCount,
+                    app.bvhTriCount,
+                    stats.dupFactor,
+                    stats.buildMs,
+                    stats.threadCount,
+                    stats.sahCost);
+        }
+        if (stats.optimizeMs > 0.0) {
+            ui::Log("[BVH] Treelet optimization: %.2f ms, SAH %.2f -> %.2f\n",
+                    stats.optimizeMs,
+                    stats.unoptimizedSahCost,
+                    stats.sahCost);
+        }
+        ui::Log("[BVH] Node layout: %s, %.1f KB; triangles: %s, %.1f KB (%.1f B/tri)\n",
+                app.bvhGpuWidth == 8 ? "BVH8" : app.bvhGpuWidth == 4 ? "BVH4" : "binary",
+                static_cast<double>(stats.nodeBytes) / 1024.0,
+                triStorageName(app.bvh),
+                static_cast<double>(stats.triBytes) / 1024.0,
+                app.bvhTriCount > 0 ? static_cast<double>(stats.triBytes) / app.bvhTriCount : 0.0);
+
+        // Shape metrics without end-point overlap, which is computed on request.
+        picker.metrics = result.metrics;
+        picker.epoValid = false;
+        if (picker.metrics.stackOverflows()) {
+            ui::Log("[BVH] Warning: traversal stack may reach %d entries, shader stack holds %d\n",
+                    picker.metrics.stackHighWater,
+                    BVHMetrics::kGpuStackSize);
+        }
+
+        // Sibling frames (name_0000.obj, name_0001.obj, ...) make this a keyframe sequence.
+        app.bvhAnimTime = 0.0;
+        picker.refit = BVHRefitStats{};
+        picker.refitRebuilds = 0;
+        if (!app.bvhAnim.empty()) {
+            ui::Log("[BVH] Loaded %d keyframes for '%s'\n", app.bvhAnim.frameCount(), request.path.c_str());
+        } else if (result.keyframeFiles > 0 && stats.gpuBuilt) {
+            ui::Log("[BVH] Ignoring keyframe sequence for '%s': refits need a tree built on the CPU\n",
+                    request.path.c_str());
+        } else if (result.keyframeFiles > 0) {
+            ui::Log("[BVH] Ignoring keyframe sequence for '%s': frames failed to load or differ in topology\n",
+                    request.path.c_str());
+        }
+        picker.animFrameCount = app.bvhAnim.frameCount();
+        return changed;
+    }
+
+    // Starts switching to the picker's model and settings. A resident BVH is
+    // swapped in right away (returns true if that changed the traced
+    // surface). Anything else is imported and built on the loader thread
+    // while the current BVH keeps being drawn; finishBvhLoad() swaps it in
+    // once it is ready. Large models show a proxy preview first.
+    bool requestBvhLoad(AppState &app) {
+        ui::BvhModelPickerState &picker = app.bvhPicker;
+        app.bvhResident.setBudget(static_cast<size_t>(picker.residentGpuBudgetMB) << 20,
+                                  static_cast<size_t>(picker.residentCpuBudgetMB) << 20);
+
+        if (!picker.instancing) {
+            const BVHResidentKey key = make_bvh_resident_key(picker.currentPath, app.bvhTransform, picker.build);
+            if (key.valid() && app.bvhResident.contains(key)) {
+                app.bvhLoader.cancel(); // an older load must not replace it later
+                stashBvh(app);
+                return swapInResidentBvh(app, key);
+            }
+        }
+
+        BVHLoadRequest request;
+        request.path = picker.currentPath;
+        request.modelTransform = app.bvhTransform;
+        request.settings = picker.build;
+        request.cacheDir = picker.useCache ? app.bvhCacheDir : std::string();
+        request.twoLevel = picker.instancing;
+        request.previewTris = picker.progressive ? static_cast<size_t>(picker.previewTrisK) * 1000 : 0;
+        app.bvhLoader.submit(std::move(request));
+        return false;
+    }
+
+    // Uploads and swaps in a finished background load (or its preview). If
+    // the model failed to load, the current BVH is kept unless it is a
+    // preview (see dropBvhPreview()). Returns true if the
+    // traced surface changed, i.e. accumulation must restart.
+    bool finishBvhLoad(AppState &app, BVHLoadResult &result) {
+        if (!result.ok) {
+            ui::Log("[BVH] Failed to build BVH from '%s'\n", result.request.path.c_str());
+            return dropBvhPreview(app);
+        }
+        if (result.preview) return finishBvhSingle(app, result);
+
+        const bool changed = result.request.twoLevel ? finishBvhInstanced(app, result)
+                                                     : finishBvhSingle(app, result);
+        ui::Log("[BVH] Background load of '%s' took %.2f s\n", result.request.path.c_str(), result.seconds);
+        return changed;
+    }
+
+    // Advances the keyframe sequence and refits the BVH to the new pose,
+    // re-uploading only the node/triangle ranges that changed. Falls back to
+    // a full rebuild (without re-importing) once refitting has degraded the
+    // SAH cost past picker.build.refitRebuildRatio. Returns true if the
+    // geometry changed.
+    bool animateBvh(AppState &app) {
+        ui::BvhModelPickerState &picker = app.bvhPicker;
+        if (!picker.animPlay || app.bvhAnim.empty() || app.bvhGeometry.nodes.empty()) return false;
+
+        app.bvhAnim.fps = picker.animFps;
+        app.bvhAnimTime += app.deltaTime;
+        sample_keyframe_sequence(app.bvhAnim, app.bvhAnimTime, app.bvhAnimTris);
+
+        // Compressed triangles: snap the pose to the lattice, moving the lattice
+        // (and re-uploading every triangle) only when the pose leaves it.
+        bool allTris = false;
+        if (app.bvh.triQuant.enabled()) {
+            glm::vec3 lo, hi;
+            bvh_triangle_bounds(app.bvhAnimTris, lo, hi);
+            if (!app.bvh.triQuant.covers(lo, hi)) {
+                app.bvh.triQuant = make_bvh_tri_quant(lo, hi);
+                allTris = true;
+            }
+            quantize_bvh_triangles(app.bvhAnimTris, app.bvh.triQuant);
+        }
+
+        BVHRefitStats refit;
+        if (!refit_bvh(app.bvhGeometry, app.bvhAnimTris, picker.build, &refit)) {
+            ui::Log("[BVH] Refit failed: keyframes do not match the BVH, stopping playback\n");
+            picker.animPlay = false;
+            return false;
+        }
+        picker.refit = refit;
+
+        // Tree got too loose: rebuild from the current pose, unless the result
+        // no longer fits the texture buffers (spatial splits add triangles).
+        BVHGeometry rebuilt;
+        BVHBuildStats stats;
+        BVHBuildSettings settings = picker.build;
+        settings.optimizeMs = 0.0f; // treelet optimization is for offline builds, not per-frame ones
+        bool rebuild = refit.sahRatio > picker.build.refitRebuildRatio;
+        if (rebuild) {
+            rebuilt.tris = app.bvhAnimTris;
+            rebuilt.nodes = build_bvh(rebuilt.tris, settings, &stats, &rebuilt.sourceIndex);
+            rebuilt.builtSahCost = stats.sahCost;
+            std::string reason;
+            if (!bvh_fits_texture_limits(rebuilt.nodes.size(), rebuilt.tris.size(), app.bvhGpuWidth,
+                                         app.bvh.triQuant.enabled(), 0, &reason)) {
+                ui::Log("[BVH] Rebuilt tree exceeds GPU texture buffer limits (%s); keeping the refitted tree "
+                        "and stopping playback\n",
+                        reason.c_str());
+                picker.animPlay = false;
+                rebuild = false;
+            }
+        }
+
+        if (!rebuild) {
+            // Collapsed layouts re-collapse the refitted tree (same shape, new boxes).
+            const bool wide = app.bvhGpuWidth > 2;
+            update_bvh_tbo(app.bvhGeometry.nodes,
+                           app.bvhGeometry.tris,
+                           app.bvh,
+                           wide ? 0 : refit.dirtyNodeBegin,
+                           wide ? 0 : refit.dirtyNodeEnd,
+                           allTris ? 0 : refit.dirtyTriBegin,
+                           allTris ? app.bvhTriCount : refit.dirtyTriEnd);
+            if (wide && refit.dirtyNodeEnd > refit.dirtyNodeBegin) {
+                upload_bvh_wide_tbo(collapse_bvh(app.bvhGeometry.nodes, app.bvhGpuWidth), app.bvhGpuWidth, app.bvh);
+            }
+            picker.stats.triBytes = app.bvh.triBytes; // indexed triangles are re-welded
+            return true;
+        }
+
+        BVHGeometry &geom = app.bvhGeometry;
+        geom = std::move(rebuilt);
+        stats.nodeBytes = upload_bvh(geom.nodes, geom.tris, app.bvhGpuWidth, app.bvh, &app.bvhNodeCount);
+        stats.triBytes = app.bvh.triBytes;
+        app.bvhTriCount = static_cast<int>(geom.tris.size()); // spatial splits may change it
+
+        picker.nodeCount = app.bvhNodeCount;
+        picker.triCount = app.bvhTriCount;
+        picker.stats = stats;
+        ++picker.refitRebuilds;
+        ui::Log("[BVH] Refit SAH x%.2f exceeded x%.2f, rebuilt in %.2f ms (SAH=%.2f)\n",
+                refit.sahRatio,
+                picker.build.refitRebuildRatio,
+                stats.buildMs,
+                stats.sahCost);
+        return true;
+    }
+
+    // Rebuilds the current model's BVH with 1, 2, 4, ... hardware threads and
+    // logs the build time of each run. Every result is compared against the
+    // single-threaded tree to confirm the parallel build is deterministic.
+    void benchmarkBvhThreads(AppState &app) {
+        // A cache hit skips the import, so the model may still have to be loaded.
+        if (!app.bvhModel && app.bvhPicker.nodeCount > 0 && app.bvhTlasNodeCount == 0) {
+            app.bvhModel = std::make_unique<Model>(app.bvhPicker.currentPath);
+        }
+        if (!app.bvhModel || app.bvhModel->meshes.empty()) {
+            ui::Log("[BVH] Thread benchmark skipped: no BVH model loaded\n");
+            return;
+        }
+        // Lean memory mode: the vertex arrays were dropped after upload.
+        if (!app.bvhModel->reloadCpuData()) {
+            ui::Log("[BVH] Thread benchmark skipped: could not re-read '%s'\n", app.bvhPicker.currentPath);
+            return;
+        }
+
+        std::vector<CPU_Triangle> sourceTris;
+        gather_model_triangles(*app.bvhModel, app.bvhTransform, sourceTris);
+        if (app.bvhPicker.leanMemory) app.bvhModel->releaseCpuData();
+
+        const int hw = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+        std::vector<int> threadCounts;
+        for (int t = 1; t < hw; t *= 2) threadCounts.push_back(t);
+        threadCounts.push_back(hw);
+
+        auto sameNode = [](const BVHNode &a, const BVHNode &b) {
+            return a.bMin == b.bMin && a.bMax == b.bMax && a.left == b.left &&
+                   a.right == b.right && a.first == b.first && a.count == b.count;
+        };
+
+        std::vector<BVHNode> reference;
+        double referenceMs = 0.0;
+        for (const int threads: threadCounts) {
+            BVHBuildSettings settings = app.bvhPicker.build;
+            settings.threadCount = threads;
+            settings.optimizeMs = 0.0f; // time-bounded, so not comparable across runs
+
+            std::vector<CPU_Triangle> tris = sourceTris;
+            BVHBuildStats stats;
+            const std::vector<BVHNode> nodes = build_bvh(tris, settings, &stats);
+
+            if (reference.empty()) {
+                reference = nodes;
+                referenceMs = stats.buildMs;
+            }
+            const bool identical = nodes.size() == reference.size() &&
+                                   std::equal(nodes.begin(), nodes.end(), reference.begin(), sameNode);
+
+            ui::Log("[BVH] %s build, %2d thread(s): %.2f ms (x%.2f)%s\n",
+                    buildMethodName(settings.method),
+                    threads,
+                    stats.buildMs,
+                    stats.buildMs > 0.0 ? referenceMs / stats.buildMs : 0.0,
+                    identical ? "" : "  MISMATCH vs 1 thread");
+        }
+    }
+
+    // Lean memory mode drops the CPU vertex/index arrays of every loaded
+    // model once it is uploaded and its BVH built; the GPU buffers stay, so
+    // raster drawing is unaffected. Switching the mode off re-reads them.
+    void applyLeanMemory(AppState &app) {
+        ui::BvhModelPickerState &picker = app.bvhPicker;
+        Model *models[] = {app.ground.get(), app.bunny.get(), app.sphere.get(), app.bvhModel.get()};
+
+        size_t before = 0;
+        size_t after = 0;
+        for (Model *model: models) {
+            if (!model) continue;
+            before += model->cpuBytes();
+            if (picker.leanMemory) model->releaseCpuData();
+            else model->reloadCpuData();
+            after += model->cpuBytes();
+        }
+
+        picker.meshCpuBytes = after;
+        if (before != after) {
+            ui::Log("[BVH] Mesh CPU data: %.2f MB -> %.2f MB\n",
+                    static_cast<double>(before) / (1024.0 * 1024.0),
+                    static_cast<double>(after) / (1024.0 * 1024.0));
+        }
+    }
+
+    // Fills in the end-point overlap of the current single-level BVH. It
+    // clips every triangle against the boxes it touches, which takes
+    // seconds on large models, so it only runs when asked for.
+    void computeBvhEpo(AppState &app) {
+        ui::BvhModelPickerState &picker = app.bvhPicker;
+        if (picker.metrics.nodeCount == 0) return;
+
+        const auto t0 = std::chrono::steady_clock::now();
+        const BVHMetrics full = compute_bvh_metrics(app.bvhGeometry.nodes,
+                                                    app.bvhGeometry.tris,
+                                                    picker.build,
+                                                    app.bvhGpuWidth,
+                                                    true);
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        picker.metrics.epo = full.epo;
+        picker.epoValid = true;
+        ui::Log("[BVH] End-point overlap: %.3f (%.0f ms)\n", full.epo, ms);
+    }
+
+    // Compiles the ray tracing program. With stackless set, binary trees are
+    // walked along skip links instead of a stack; wideStack sizes the stack of
+    // the wide traversal (see rt_bvh.glsl).
+    std::unique_ptr<Shader> makeRtShader(const bool stackless, const int wideStack) {
+        const std::string vertPath = util::resolve_path("shaders/rt/rt_fullscreen.vert");
+        const std::string fragPath = util::resolve_path("shaders/rt/rt.frag");
+        std::string defines = "#define BVH_WIDE_STACK " + std::to_string(wideStack) + "\n";
+        if (stackless) defines += "#define BVH_STACKLESS 1\n";
+        return std::make_unique<Shader>(vertPath.c_str(), fragPath.c_str(), defines);
+    }
+
+    // Recompiles the ray shader when the uploaded wide tree needs another
+    // stack depth than it was compiled with: deeper when a collapsed tree
+    // outgrows it, back to the default otherwise.
+    void fitWideStack(AppState &app) {
+        constexpr int kDefaultWideStack = 64;
+        const int need = std::max(kDefaultWideStack, (app.bvh.wideStackSize + 15) / 16 * 16);
+        if (need == app.rtWideStack) return;
+
+        std::unique_ptr<Shader> shader = makeRtShader(app.bvhPicker.stacklessTraversal, need);
+        if (shader->isValid()) {
+            app.rtShader = std::move(shader);
+            ui::Log("[BVH] Wide traversal stack resized to %d entries\n", need);
+        } else {
+            // Not retried every frame; an overflowing stack drops the farthest children.
+            ui::Log("[BVH] Ray shader with a %d-entry wide stack failed to compile, keeping the current one\n",
+                    need);
+        }
+        app.rtWideStack = need;
+    }
+
+    // Switches the ray shader to the traversal mode selected in the picker.
+    // The current shader is kept if the other variant fails to compile.
+    bool applyTraversalMode(AppState &app) {
+        ui::BvhModelPickerState &picker = app.bvhPicker;
+        std::unique_ptr<Shader> shader = makeRtShader(picker.stacklessTraversal, app.rtWideStack);
+        if (!shader->isValid()) {
+            ui::Log("[BVH] %s traversal shader failed to compile, keeping the current one\n",
+                    picker.stacklessTraversal ? "Stackless" : "Stack");
+            picker.stacklessTraversal = !picker.stacklessTraversal;
+            return false;
+        }
+        app.rtShader = std::move(shader);
+        return true;
+    }
+
+    // Repacks the current triangles for another triangle test and storage;
+    // the tree is untouched. Returns false if there are no CPU triangles to
+    // repack from.
+    bool repackBvhTris(AppState &app, const BVHTriTest test, const bool indexed) {
+        const bool twoLevel = app.bvhTlasNodeCount > 0;
+        const std::vector<CPU_Triangle> &tris = app.bvhEdit.active() ? app.bvhEdit.tris() : app.bvhGeometry.tris;
+        if (!twoLevel && tris.empty()) return false;
+
+        // The upload drops what the encoding cannot do (see BVHTriTest).
+        app.bvh.triTest = test;
+        app.bvh.indexedTris = indexed;
+        if (twoLevel) {
+            upload_bvh_scene(app.bvhScene, app.bvh);
+        } else {
+            upload_bvh_triangles(tris, app.bvh);
+            if (app.bvhKey.valid()) {
+                app.bvhKey.triTest = test;
+                app.bvhKey.indexedTris = indexed;
+            }
+        }
+        app.bvhPicker.stats.triBytes = app.bvh.triBytes;
+        return true;
+    }
+
+    // Switches the current BVH to the triangle test and storage selected in the picker.
+    bool applyTriPacking(AppState &app) {
+        ui::BvhModelPickerState &picker = app.bvhPicker;
+        if (app.bvhNodeCount == 0) return false;
+        if (!repackBvhTris(app, picker.build.triTest, picker.build.indexedTris)) {
+            picker.reloadRequested = true;
+            return false;
+        }
+        ui::Log("[BVH] Triangle test: %s; storage: %s, %.1f KB\n",
+                triTestName(app.bvh.triTest),
+                triStorageName(app.bvh),
+                static_cast<double>(app.bvh.triBytes) / 1024.0);
+        return true;
+    }
+
+    // Renders kTimedFrames frames of the current view after a short warm-up
+    // and returns the GPU time per frame, in milliseconds.
+    double timeRayFrames(AppState &app, const int fbw, const int fbh, const glm::mat4 &view,
+                         const glm::mat4 &proj, const GLuint query) {
+        constexpr int kWarmupFrames = 4;
+        constexpr int kTimedFrames = 32;
+        for (int i = 0; i < kWarmupFrames; ++i) renderRay(app, fbw, fbh, true, view, proj);
+        glFinish();
+
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        for (int i = 0; i < kTimedFrames; ++i) renderRay(app, fbw, fbh, true, view, proj);
+        glEndQuery(GL_TIME_ELAPSED);
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+        return static_cast<double>(ns) * 1e-6 / kTimedFrames;
+    }
+
+    // Renders the current view with the stack and the stackless ray shader
+    // and logs the GPU time per frame of each. The whole ray pass is timed,
+    // shading and shadow rays included, so the ratio is what the user sees.
+    void benchmarkBvhTraversal(AppState &app, const int fbw, const int fbh,
+                               const glm::mat4 &view, const glm::mat4 &proj) {
+        if (app.bvhNodeCount == 0) {
+            ui::Log("[BVH] Traversal benchmark skipped: no BVH loaded\n");
+            return;
+        }
+
+        const bool prevUseBVH = app.useBVH;
+        app.useBVH = true;
+
+        GLuint query = 0;
+        glGenQueries(1, &query);
+        double frameMs[2] = {0.0, 0.0};
+        for (int mode = 0; mode < 2; ++mode) {
+            std::unique_ptr<Shader> shader = makeRtShader(mode == 1, app.rtWideStack);
+            if (!shader->isValid()) continue;
+            std::swap(app.rtShader, shader);
+            frameMs[mode] = timeRayFrames(app, fbw, fbh, view, proj, query);
+            std::swap(app.rtShader, shader); // back to the selected mode
+        }
+        glDeleteQueries(1, &query);
+        app.useBVH = prevUseBVH;
+        app.accum.reset();
+
+        if (app.bvhGpuWidth > 2 && app.bvhTlasNodeCount == 0)
+            ui::Log("[BVH] Note: the %d-wide layout always uses its stack\n", app.bvhGpuWidth);
+        ui::Log("[BVH] Traversal %dx%d: stack %.3f ms/frame, stackless %.3f ms/frame (x%.2f)\n",
+                fbw, fbh, frameMs[0], frameMs[1], frameMs[1] > 0.0 ? frameMs[0] / frameMs[1] : 0.0);
+    }
+
+    // Renders the current view with each triangle test, repacking the
+    // triangles in between, and logs the GPU time per frame of each. The
+    // whole ray pass is timed, like benchmarkBvhTraversal(); the differences
+    // are the triangle tests' share of it.
+    void benchmarkTriTests(AppState &app, const int fbw, const int fbh, const glm::mat4 &view,
+                           const glm::mat4 &proj) {
+        if (app.bvhNodeCount == 0) {
+            ui::Log("[BVH] Triangle test benchmark skipped: no BVH loaded\n");
+            return;
+        }
+        const std::vector<CPU_Triangle> &tris = app.bvhEdit.active() ? app.bvhEdit.tris() : app.bvhGeometry.tris;
+        if (app.bvhTlasNodeCount == 0 && tris.empty()) {
+            ui::Log("[BVH] Triangle test benchmark skipped: no CPU triangles to repack\n");
+            return;
+        }
+
+        const BVHTriTest selected = app.bvhPicker.build.triTest;
+        const bool indexed = app.bvhPicker.build.indexedTris;
+        const bool prevUseBVH = app.useBVH;
+        app.useBVH = true;
+
+        GLuint query = 0;
+        glGenQueries(1, &query);
+        constexpr BVHTriTest kTests[] = {BVHTriTest::MollerTrumbore, BVHTriTest::Watertight, BVHTriTest::Affine};
+        double frameMs[3] = {0.0, 0.0, 0.0};
+        for (int k = 0; k < 3; ++k) {
+            repackBvhTris(app, kTests[k], indexed);
+            if (app.bvh.triTest != kTests[k]) continue; // no affine form of compressed or indexed triangles
+            frameMs[k] = timeRayFrames(app, fbw, fbh, view, proj, query);
+        }
+        glDeleteQueries(1, &query);
+        repackBvhTris(app, selected, indexed);
+        app.useBVH = prevUseBVH;
+        app.accum.reset();
+
+        for (int k = 0; k < 3; ++k) {
+            if (frameMs[k] <= 0.0) continue;
+            ui::Log("[BVH] Triangle test %dx%d: %s %.3f ms/frame (x%.2f vs Moller-Trumbore)\n",
+                    fbw, fbh, triTestName(kTests[k]), frameMs[k],
+                    frameMs[0] > 0.0 ? frameMs[0] / frameMs[k] : 0.0);
+        }
+    }
+
+    // Renders the current view with direct and with indexed triangles, both
+    // packed for the selected test, and stores the triangle memory and GPU
+    // time per frame of each in the picker's stats.
+    void benchmarkTriStorage(AppState &app, const int fbw, const int fbh, const glm::mat4 &view,
+                             const glm::mat4 &proj) {
+        ui::BvhModelPickerState &picker = app.bvhPicker;
+        if (app.bvhNodeCount == 0) {
+            ui::Log("[BVH] Triangle storage benchmark skipped: no BVH loaded\n");
+            return;
+        }
+        if (app.bvh.triQuant.enabled()) {
+            ui::Log("[BVH] Triangle storage benchmark skipped: compressed triangles are never indexed\n");
+            return;
+        }
+        const std::vector<CPU_Triangle> &tris = app.bvhEdit.active() ? app.bvhEdit.tris() : app.bvhGeometry.tris;
+        if (app.bvhTlasNodeCount == 0 && tris.empty()) {
+            ui::Log("[BVH] Triangle storage benchmark skipped: no CPU triangles to repack\n");
+            return;
+        }
+
+        const BVHTriTest selected = picker.build.triTest;
+        const bool prevUseBVH = app.useBVH;
+        app.useBVH = true;
+
+        GLuint query = 0;
+        glGenQueries(1, &query);
+        for (int k = 0; k < 2; ++k) {
+            repackBvhTris(app, selected, k == 1);
+            picker.triStorageBytes[k] = app.bvh.triBytes;
+            picker.triStorageMs[k] = timeRayFrames(app, fbw, fbh, view, proj, query);
+        }
+        glDeleteQueries(1, &query);
+        repackBvhTris(app, selected, picker.build.indexedTris);
+        app.useBVH = prevUseBVH;
+        app.accum.reset();
+
+        static const char *kStorage[] = {"direct", "indexed"};
+        for (int k = 0; k < 2; ++k) {
+            ui::Log("[BVH] Triangle storage %dx%d: %s %.1f KB (%.1f B/tri), %.3f ms/frame\n",
+                    fbw, fbh, kStorage[k],
+                    static_cast<double>(picker.triStorageBytes[k]) / 1024.0,
+                    app.bvhTriCount > 0 ? static_cast<double>(picker.triStorageBytes[k]) / app.bvhTriCount : 0.0,
+                    picker.triStorageMs[k]);
+        }
+    }
+
+    // Reorders a copy of the current binary BVH into every node layout and
+    // measures the texel-fetch locality of primary rays from the current
+    // camera. Rays are issued in 8x4 screen tiles, like GPU warps, through
+    // the traversal mode selected in the picker.
+    void measureBvhLayouts(AppState &app, const glm::mat4 &view) {
+        ui::BvhModelPickerState &picker = app.bvhPicker;
+        if (app.bvhEdit.active()) {
+            ui::Log("[BVH] Layout measurement skipped: edited trees are not reordered\n");
+            return;
+        }
+        if (app.bvhTlasNodeCount > 0 || app.bvhGeometry.nodes.empty()) {
+            ui::Log("[BVH] Layout measurement skipped: needs a single-level BVH with CPU geometry\n");
+            return;
+        }
+
+        constexpr int kWidth = 128, kHeight = 72, kTileW = 8, kTileH = 4;
+        const glm::vec3 right = glm::normalize(glm::vec3(view[0][0], view[1][0], view[2][0]));
+        const glm::vec3 up = glm::normalize(glm::vec3(view[0][1], view[1][1], view[2][1]));
+        const glm::vec3 fwd = -glm::normalize(glm::vec3(view[0][2], view[1][2], view[2][2]));
+        const float tanHalfFov = std::tan(glm::radians(app.camera.Fov) * 0.5f);
+        std::vector<glm::vec3> origins, dirs;
+        origins.reserve(kWidth * kHeight);
+        dirs.reserve(kWidth * kHeight);
+        for (int ty = 0; ty < kHeight; ty += kTileH) {
+            for (int tx = 0; tx < kWidth; tx += kTileW) {
+                for (int y = ty; y < ty + kTileH; ++y) {
+                    for (int x = tx; x < tx + kTileW; ++x) {
+                        const float nx = (static_cast<float>(x) + 0.5f) / kWidth * 2.0f - 1.0f;
+                        const float ny = (static_cast<float>(y) + 0.5f) / kHeight * 2.0f - 1.0f;
+                        origins.push_back(app.camera.Position);
+                        dirs.push_back(glm::normalize(fwd + nx * right * (tanHalfFov * app.camera.AspectRatio) +
+                                                      ny * up * tanHalfFov));
+                    }
+                }
+            }
+        }
+
+        const int triBytes = app.bvh.triQuant.enabled() ? 24 : app.bvh.indexedTris ? 12 : 48;
+        std::vector<BVHNode> nodes = app.bvhGeometry.nodes;
+        std::vector<CPU_Triangle> tris = app.bvhGeometry.tris;
+        for (int k = 0; k < ui::BvhModelPickerState::kLayoutCount; ++k) {
+            const auto layout = static_cast<BVHLayout>(k);
+            reorder_bvh(nodes, tris, layout);
+            const BVHLocality loc = measure_bvh_locality(nodes, tris, origins, dirs, triBytes,
+                                                         picker.stacklessTraversal);
+            picker.layoutLocality[k] = loc;
+            ui::Log("[BVH] Layout %-13s: %.1f node fetches/ray, node lines %.2f/ray (%.1f%% hit), "
+                    "tri lines %.2f/ray (%.1f%% hit), %.0f ms\n",
+                    layoutName(layout), loc.nodeFetchesPerRay, loc.nodeLinesPerRay, loc.nodeHitRate * 100.0f,
+                    loc.triLinesPerRay, loc.triHitRate * 100.0f, loc.ms);
+        }
+    }
+
+    // Inserts a prop (the picker's prop model, or the current one) a short
+    // way in front of the camera into the current single-level BVH. The
+    // first edit moves the CPU tree into app.bvhEdit; from then on only the
+    // touched nodes and triangles are uploaded. Returns true if the BVH
+    // changed.
+    bool insertProp(AppState &app) {
+        ui::BvhModelPickerState &picker = app.bvhPicker;
+        const char *refusal = nullptr;
+        if (app.bvhTlasNodeCount > 0) refusal = "two-level scenes are rebuilt, not edited";
+        else if (app.bvhGpuWidth != 2) refusal = "only the binary GPU layout can be edited";
+        else if (app.bvh.triQuant.enabled()) refusal = "compressed triangles are tied to the model's bounds";
+        else if (app.bvh.indexedTris) refusal = "indexed triangles are re-welded on every edit";
+        else if (!app.bvhAnim.empty()) refusal = "keyframe sequences refit the whole tree";
+        else if (!app.bvhEdit.active() && app.bvhGeometry.nodes.empty()) refusal = "no CPU copy of the BVH";
+        if (refusal) {
+            ui::Log("[BVH] Cannot insert a prop: %s\n", refusal);
+            return false;
+        }
+
+        const std::string path = picker.propPath[0] ? picker.propPath : picker.currentPath;
+        const Model prop(path, false);
+        std::vector<CPU_Triangle> tris;
+        gather_model_triangles(prop, app.bvhTransform, tris);
+        if (tris.empty()) {
+            ui::Log("[BVH] Cannot insert a prop: no triangles in '%s'\n", path.c_str());
+            return false;
+        }
+
+        // Centre the prop on a point in front of the camera, clear of the near plane.
+        glm::vec3 lo(FLT_MAX);
+        glm::vec3 hi(-FLT_MAX);
+        for (const CPU_Triangle &t: tris) {
+            lo = glm::min(lo, glm::min(t.v0, glm::min(t.v0 + t.e1, t.v0 + t.e2)));
+            hi = glm::max(hi, glm::max(t.v0, glm::max(t.v0 + t.e1, t.v0 + t.e2)));
+        }
+        const glm::mat4 view = app.camera.GetViewMatrix();
+        const glm::vec3 front(-view[0][2], -view[1][2], -view[2][2]);
+        const float radius = 0.5f * glm::length(hi - lo);
+        const glm::vec3 offset = app.camera.Position + front * (radius + 1.0f) - 0.5f * (lo + hi);
+        for (CPU_Triangle &t: tris) t.v0 += offset;
+
+        if (!app.bvhEdit.active()) {
+            // Leaves the paths that need "children after parent" order: cache, metrics, refit.
+            app.bvhEdit.assign(std::move(app.bvhGeometry.nodes), std::move(app.bvhGeometry.tris));
+            app.bvhGeometry.clear();
+            app.bvhKey = BVHResidentKey{};
+            picker.metrics = BVHMetrics{};
+            picker.epoValid = false;
+        }
+
+        const auto [nodeCapacity, triCapacity] = app.bvhEdit.capacityAfterInsert(tris.size());
+        std::string reason;
+        if (!bvh_fits_texture_limits(nodeCapacity, triCapacity, 2, false, 0, &reason)) {
+            ui::Log("[BVH] Cannot insert a prop: BVH would exceed GPU texture buffer limits (%s)\n",
+                    reason.c_str());
+            return false;
+        }
+
+        const size_t count = tris.size();
+        BVHEditStats &edit = picker.edit;
+        edit = BVHEditStats{};
+        const int id = app.bvhEdit.insert(std::move(tris), picker.build, &edit);
+        app.bvhEdit.upload(app.bvh, &edit);
+        app.bvhProps.push_back(id);
+
+        app.bvhNodeCount = app.bvhEdit.liveNodes();
+        app.bvhTriCount = app.bvhEdit.liveTris();
+        picker.nodeCount = app.bvhNodeCount;
+        picker.triCount = app.bvhTriCount;
+        picker.propCount = static_cast<int>(app.bvhProps.size());
+        ui::Log("[BVH] Inserted prop '%s' (%zu tris): edit=%.2f ms, upload=%.2f ms, %d rotations, "
+                "%d nodes + %d tris uploaded (%.1f KB%s)\n",
+                path.c_str(),
+                count,
+                edit.editMs,
+                edit.uploadMs,
+                edit.rotations,
+                edit.nodesUploaded,
+                edit.trisUploaded,
+                static_cast<double>(edit.bytesUploaded) / 1024.0,
+                edit.fullUpload ? ", capacity grown" : "");
+        return true;
+    }
+
+    // Removes the most recently inserted prop. Returns true if the BVH changed.
+    bool removeProp(AppState &app) {
+        ui::BvhModelPickerState &picker = app.bvhPicker;
+        if (app.bvhProps.empty()) return false;
+        if (app.bvh.indexedTris) {
+            ui::Log("[BVH] Cannot remove a prop: indexed triangles are re-welded on every edit\n");
+            return false;
+        }
+
+        BVHEditStats &edit = picker.edit;
+        edit = BVHEditStats{};
+        if (!app.bvhEdit.remove(app.bvhProps.back(), &edit)) return false;
+        app.bvhProps.pop_back();
+        app.bvhEdit.upload(app.bvh, &edit);
+
+        app.bvhNodeCount = app.bvhEdit.liveNodes();
+        app.bvhTriCount = app.bvhEdit.liveTris();
+        picker.nodeCount = app.bvhNodeCount;
+        picker.triCount = app.bvhTriCount;
+        picker.propCount = static_cast<int>(app.bvhProps.size());
+        ui::Log("[BVH] Removed prop: edit=%.2f ms, upload=%.2f ms, %d rotations, %d nodes uploaded\n",
+                edit.editMs,
+                edit.uploadMs,
+                edit.rotations,
+                edit.nodesUploaded);
+        return true;
+    }
+
+    // Writes the full metrics of the current BVH to a JSON file (--bvh-metrics).
+    bool writeBvhMetrics(const AppState &app, const std::string &path) {
+        const ui::BvhModelPickerState &picker = app.bvhPicker;
+        if (app.bvhGeometry.nodes.empty()) {
+            ui::Log("[BVH] No BVH to report metrics for\n");
+            return false;
+        }
+
+        const BVHMetrics metrics = compute_bvh_metrics(app.bvhGeometry.nodes,
+                                                       app.bvhGeometry.tris,
+                                                       picker.build,
+                                                       app.bvhGpuWidth,
+                                                       true);
+        std::ofstream out(path);
+        out << bvh_metrics_to_json(metrics, picker.stats, picker.currentPath);
+        if (!out) {
+            ui::Log("[BVH] Failed to write metrics to '%s'\n", path.c_str());
+            return false;
+        }
+        ui::Log("[BVH] Wrote metrics to '%s'\n", path.c_str());
+        return true;
+    }
 } // namespace app_detail
 
 // ============================================================================
 // Application lifecycle
 // ============================================================================
 
-Application::Application() = default;
+Application::Application(LaunchOptions launchOptions) : options(std::move(launchOptions)) {}
 
 Application::~Application() {
     // Make sure we always clean up GL + GLFW on destruction.
@@ -234,17 +1398,19 @@ void Application::initState() {
     const GLubyte *glVer = glGetString(GL_VERSION);
     ui::Log("[INIT] OpenGL version: %s\n",
             glVer ? reinterpret_cast<const char *>(glVer) : "unknown");
+    set_bvh_texel_limit(options.bvhPageTexels);
+    ui::Log("[INIT] Texture buffer limit: %lld texels, BVH pages of %d texels (up to %d)\n",
+            static_cast<long long>(bvh_texel_limit()), bvh_page_texels(), kBvhMaxPages);
     ui::Init(window);
 
     // Shaders -----------------------------------------------------------------
     // Resolve paths depending on whether we are running from the build or source tree.
     const std::string rtVertPath = util::resolve_path("shaders/rt/rt_fullscreen.vert");
-    const std::string rtFragPath = util::resolve_path("shaders/rt/rt.frag");
     const std::string presentFragPath = util::resolve_path("shaders/rt/rt_present.frag");
     const std::string rasterVertPath = util::resolve_path("shaders/basic.vert");
     const std::string rasterFragPath = util::resolve_path("shaders/basic.frag");
 
-    app.rtShader = std::make_unique<Shader>(rtVertPath.c_str(), rtFragPath.c_str());
+    app.rtShader = app_detail::makeRtShader(app.bvhPicker.stacklessTraversal, app.rtWideStack);
     app.presentShader = std::make_unique<Shader>(rtVertPath.c_str(), presentFragPath.c_str());
     app.rasterShader = std::make_unique<Shader>(rasterVertPath.c_str(), rasterFragPath.c_str());
 
@@ -262,19 +1428,22 @@ void Application::initState() {
     app.sphere = std::make_unique<Model>(util::resolve_path("models/sphere.obj"));
     app.bvhModel = std::make_unique<Model>(util::resolve_path("models/bunny_lp.obj"));
 
-    const std::string initModelPath = util::resolve_path("models/bunny_lp.obj");
+    const std::string initModelPath =
+            options.modelPath.empty() ? util::resolve_path("models/bunny_lp.obj") : options.modelPath;
     std::snprintf(app.bvhPicker.currentPath,
                   sizeof(app.bvhPicker.currentPath),
                   "%s",
                   initModelPath.c_str());
 
     // Build an initial BVH from the default bunny model.
-    rebuild_bvh_from_model_path(app.bvhPicker.currentPath,
-                                app.bvhTransform,
-                                app.bvhModel,
-                                app.bvhNodeCount,
-                                app.bvhTriCount,
-                                app.bvh);
+    // The first load blocks: there is no previous BVH to draw meanwhile.
+    app.bvhPicker.leanMemory = options.leanMemory;
+    if (!app_detail::requestBvhLoad(app)) {
+        // A refused GPU build is queued again for the CPU, so wait for that too.
+        BVHLoadResult loaded;
+        while (app.bvhLoader.wait(loaded)) app_detail::finishBvhLoad(app, loaded);
+    }
+    app_detail::applyLeanMemory(app);
 
     // Environment map ---------------------------------------------------------
     // Start with a dummy cubemap so shaders always have a valid texture bound.
@@ -451,6 +1620,7 @@ void Application::mainLoop() {
 
         // Choose between the ray/path tracer and the simple raster path.
         if (app.rayMode) {
+            app_detail::fitWideStack(app);
             renderRay(app, fbw, fbh, cameraMoved, currView, currProj);
         } else {
             renderRaster(app, fbw, fbh, currView, currProj);
@@ -477,28 +1647,105 @@ void Application::mainLoop() {
         ui::EndFrame();
 
         // --------------------------------------------------------------------
-        // 7. Async reloads (BVH, environment map)
+        // 7. BVH animation + async reloads (BVH, environment map)
         // --------------------------------------------------------------------
+        if (app.useBVH && app_detail::animateBvh(app)) {
+            app.accum.reset();
+        }
+
+        if (app.bvhTlasNodeCount > 0 && (app.bvhPicker.instancesChanged || app.bvhPicker.animateInstances)) {
+            app.bvhPicker.instancesChanged = false;
+            if (app.bvhPicker.animateInstances) app.bvhInstanceTime += app.deltaTime;
+            app_detail::updateInstances(app);
+            app.accum.reset();
+        }
+
         if (app.bvhPicker.reloadRequested) {
             app.bvhPicker.reloadRequested = false;
 
-            if (rebuild_bvh_from_model_path(app.bvhPicker.currentPath,
-                                            app.bvhTransform,
-                                            app.bvhModel,
-                                            app.bvhNodeCount,
-                                            app.bvhTriCount,
-                                            app.bvh)) {
-                ui::Log("[BVH] Rebuilt BVH from '%s': nodes=%d, tris=%d\n",
-                        app.bvhPicker.currentPath,
-                        app.bvhNodeCount,
-                        app.bvhTriCount);
+            if (app_detail::requestBvhLoad(app)) {
                 app.accum.reset();
-            } else {
-                ui::Log("[BVH] Failed to build BVH from '%s'\n",
-                        app.bvhPicker.currentPath);
             }
         }
 
+        // Background loads: upload and swap in on this thread once finished.
+        BVHLoadResult loaded;
+        if (app.bvhLoader.poll(loaded)) {
+            if (app_detail::finishBvhLoad(app, loaded)) {
+                app.accum.reset();
+            }
+            app_detail::applyLeanMemory(app);
+        }
+        app.bvhPicker.load = app.bvhLoader.progress();
+
+        if (app.bvhPicker.leanMemoryChanged) {
+            app.bvhPicker.leanMemoryChanged = false;
+            app_detail::applyLeanMemory(app);
+        }
+
+        if (app.bvhPicker.benchmarkRequested) {
+            app.bvhPicker.benchmarkRequested = false;
+            app_detail::benchmarkBvhThreads(app);
+        }
+
+        if (app.bvhPicker.residentBudgetChanged) {
+            app.bvhPicker.residentBudgetChanged = false;
+            app.bvhResident.setBudget(static_cast<size_t>(app.bvhPicker.residentGpuBudgetMB) << 20,
+                                      static_cast<size_t>(app.bvhPicker.residentCpuBudgetMB) << 20);
+            app_detail::updateResidentStats(app);
+        }
+
+        if (app.bvhPicker.traversalChanged) {
+            app.bvhPicker.traversalChanged = false;
+            if (app_detail::applyTraversalMode(app)) {
+                app.accum.reset();
+            }
+        }
+
+        if (app.bvhPicker.traversalBenchmarkRequested) {
+            app.bvhPicker.traversalBenchmarkRequested = false;
+            app_detail::benchmarkBvhTraversal(app, fbw, fbh, currView, currProj);
+        }
+
+        if (app.bvhPicker.triPackingChanged) {
+            app.bvhPicker.triPackingChanged = false;
+            app_detail::applyTriPacking(app);
+        }
+
+        if (app.bvhPicker.triTestBenchmarkRequested) {
+            app.bvhPicker.triTestBenchmarkRequested = false;
+            app_detail::benchmarkTriTests(app, fbw, fbh, currView, currProj);
+        }
+
+        if (app.bvhPicker.triStorageBenchmarkRequested) {
+            app.bvhPicker.triStorageBenchmarkRequested = false;
+            app_detail::benchmarkTriStorage(app, fbw, fbh, currView, currProj);
+        }
+
+        if (app.bvhPicker.layoutBenchmarkRequested) {
+            app.bvhPicker.layoutBenchmarkRequested = false;
+            app_detail::measureBvhLayouts(app, currView);
+        }
+
+        if (app.bvhPicker.propInsertRequested) {
+            app.bvhPicker.propInsertRequested = false;
+            if (app_detail::insertProp(app)) {
+                app.accum.reset();
+            }
+        }
+
+        if (app.bvhPicker.propRemoveRequested) {
+            app.bvhPicker.propRemoveRequested = false;
+            if (app_detail::removeProp(app)) {
+                app.accum.reset();
+            }
+        }
+
+        if (app.bvhPicker.epoRequested) {
+            app.bvhPicker.epoRequested = false;
+            app_detail::computeBvhEpo(app);
+        }
+
         if (app.envPicker.reloadRequested) {
             app.envPicker.reloadRequested = false;
 
@@ -568,6 +1815,9 @@ void Application::shutdown() {
         return;
     }
 
+    // Waits for a running background load; its result holds no GL objects.
+    app.bvhLoader.stop();
+
     // Destroy CPU-side wrappers before killing GL objects.
     app.rtShader.reset();
     app.presentShader.reset();
@@ -591,6 +1841,8 @@ void Application::shutdown() {
 
     // GPU-side BVH + GBuffer + accumulation textures.
     app.bvh.release();
+    app.bvhResident.clear();
+    app.bvhGpuBuilder.release();
     app.gBuffer.release();
     app.accum.release();
 
@@ -612,6 +1864,12 @@ int Application::run() {
     initGLResources();
     initState();
     initialized = true;
+
+    // Report-only run: the BVH was built by initState(), skip the main loop.
+    if (!options.bvhMetricsPath.empty()) {
+        return app_detail::writeBvhMetrics(app, options.bvhMetricsPath) ? 0 : 1;
+    }
+
     mainLoop();
     return 0;
 }
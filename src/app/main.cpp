@@ -1,8 +1,36 @@
 #include "app/application.h"
 
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
 // Simple entry point that delegates to the Application class.
 // All setup, main loop, and cleanup live inside Application::run().
-int main() {
-    Application app;
+//
+// Options:
+//   --model <path>          BVH model to load instead of the default bunny.
+//   --bvh-metrics <out>     Write BVH metrics of that model as JSON and exit.
+//   --lean-memory           Drop CPU mesh arrays once they are uploaded.
+//   --bvh-page-texels <n>   Cap BVH texture buffers at n texels (forces paging; testing).
+int main(int argc, char **argv) {
+    LaunchOptions options;
+    for (int i = 1; i < argc; ++i) {
+        const bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "--model") == 0 && hasValue) {
+            options.modelPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--bvh-metrics") == 0 && hasValue) {
+            options.bvhMetricsPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--lean-memory") == 0) {
+            options.leanMemory = true;
+        } else if (std::strcmp(argv[i], "--bvh-page-texels") == 0 && hasValue) {
+            options.bvhPageTexels = std::strtoll(argv[++i], nullptr, 10);
+        } else {
+            std::fprintf(stderr, "Usage: %s [--model <path>] [--bvh-metrics <out.json>] [--lean-memory]\n"
+                         "       [--bvh-page-texels <n>]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    Application app(options);
     return app.run();
 }
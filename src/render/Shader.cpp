@@ -79,6 +79,16 @@ namespace shader_detail {
         }
         return output.str();
     }
+
+    // Insert extra lines right after #version, which must stay first.
+    std::string injectDefines(const std::string &source, const std::string &defines) {
+        if (defines.empty()) return source;
+        const size_t version = source.find("#version");
+        if (version == std::string::npos) return defines + source;
+        const size_t eol = source.find('\n', version);
+        if (eol == std::string::npos) return source + '\n' + defines;
+        return source.substr(0, eol + 1) + defines + source.substr(eol + 1);
+    }
 } // namespace shader_detail
 
 // Move constructor: steal GL program handle from other.
@@ -103,7 +113,8 @@ Shader &Shader::operator=(Shader &&o) noexcept {
 }
 
 // Construct shader from vertex + fragment paths and build the GL program.
-Shader::Shader(const char *vertexPath, const char *fragmentPath) {
+Shader::Shader(const char *vertexPath, const char *fragmentPath, const std::string &defines,
+               const std::vector<const char *> &feedback) {
     std::ifstream vFile(vertexPath);
     std::ifstream fFile(fragmentPath);
 
@@ -126,6 +137,8 @@ Shader::Shader(const char *vertexPath, const char *fragmentPath) {
     // Expand #include "..." directives relative to each shader's directory.
     std::string vCode = shader_detail::preprocessShaderSource(vRaw, shader_detail::getDirectory(vertexPath));
     std::string fCode = shader_detail::preprocessShaderSource(fRaw, shader_detail::getDirectory(fragmentPath));
+    vCode = shader_detail::injectDefines(vCode, defines);
+    fCode = shader_detail::injectDefines(fCode, defines);
 
     const char *vShaderCode = vCode.c_str();
     const char *fShaderCode = fCode.c_str();
@@ -146,6 +159,11 @@ Shader::Shader(const char *vertexPath, const char *fragmentPath) {
     ID = glCreateProgram();
     glAttachShader(ID, vertex);
     glAttachShader(ID, fragment);
+    if (!feedback.empty()) {
+        // Must be declared before linking.
+        glTransformFeedbackVaryings(ID, static_cast<GLsizei>(feedback.size()), feedback.data(),
+                                    GL_INTERLEAVED_ATTRIBS);
+    }
     glLinkProgram(ID);
     checkCompileErrors(ID, "PROGRAM");
 
@@ -199,6 +217,10 @@ void Shader::setVec2(const std::string &name, const glm::vec2 &value) const {
     glUniform2fv(uniformLocation(name), 1, glm::value_ptr(value));
 }
 
+void Shader::setIVec3(const std::string &name, const glm::ivec3 &value) const {
+    glUniform3i(uniformLocation(name), value.x, value.y, value.z);
+}
+
 // Cached uniform location lookup. Returns -1 if program is invalid.
 int Shader::uniformLocation(const std::string &name) const {
     if (ID == 0) return -1;
@@ -111,6 +111,9 @@ void renderRay(AppState &app, const int fbw, const int fbh, const bool cameraMov
     rt.setInt("uUseBVH", app.useBVH ? 1 : 0);
     rt.setInt("uNodeCount", app.bvhNodeCount);
     rt.setInt("uTriCount", app.bvhTriCount);
+    rt.setInt("uTlasNodeCount", app.bvhTlasNodeCount);
+    rt.setInt("uBvhWidth", app.bvhGpuWidth);
+    rt.setInt("uBvhTriTest", static_cast<int>(app.bvh.triTest));
 
     // TAA parameters
     rt.setFloat("uTaaStillThresh", app.params.taaStillThresh);
@@ -173,15 +176,43 @@ void renderRay(AppState &app, const int fbw, const int fbh, const bool cameraMov
     glBindTexture(GL_TEXTURE_2D, app.accum.readTex());
     rt.setInt("uPrevAccum", 0);
 
-    // BVH node buffer
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_BUFFER, app.bvh.nodeTex);
-    rt.setInt("uBvhNodes", 1);
+    // BVH node pages on units 1, 11, 12, 13, and the skip links on unit 7 (stackless traversal only)
+    static const int kNodePageUnits[kBvhMaxPages] = {1, 11, 12, 13};
+    static const int kTriPageUnits[kBvhMaxPages] = {2, 6, 8, 10};
+    for (int p = 0; p < kBvhMaxPages; ++p) {
+        glActiveTexture(GL_TEXTURE0 + kNodePageUnits[p]);
+        glBindTexture(GL_TEXTURE_BUFFER, app.bvh.nodePages.tex[p]);
+        rt.setInt("uBvhNodes[" + std::to_string(p) + "]", kNodePageUnits[p]);
+    }
+    glActiveTexture(GL_TEXTURE7);
+    glBindTexture(GL_TEXTURE_BUFFER, app.bvh.skipTex);
+    rt.setInt("uBvhNodeSkips", 7);
+    rt.setInt("uBvhPageShift", bvh_page_shift());
+
+    // BVH triangle pages on units 2, 6, 8, 10: float bits, compressed lattice coordinates or vertex indices
+    for (int p = 0; p < kBvhMaxPages; ++p) {
+        glActiveTexture(GL_TEXTURE0 + kTriPageUnits[p]);
+        glBindTexture(GL_TEXTURE_BUFFER, app.bvh.triPages.tex[p]);
+        rt.setInt("uBvhTris[" + std::to_string(p) + "]", kTriPageUnits[p]);
+    }
+    rt.setIVec3("uBvhTriQuantOrigin", app.bvh.triQuant.origin);
+    rt.setFloat("uBvhTriQuantScale", app.bvh.triQuant.scale);
 
-    // BVH triangle buffer
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_BUFFER, app.bvh.triTex);
-    rt.setInt("uBvhTris", 2);
+    // Indexed triangles: shared vertices on unit 9
+    glActiveTexture(GL_TEXTURE9);
+    glBindTexture(GL_TEXTURE_BUFFER, app.bvh.vertTex);
+    rt.setInt("uBvhVerts", 9);
+    rt.setInt("uBvhTriIndexed", app.bvh.indexedTris ? 1 : 0);
+
+    // BVH instance buffer (two-level scenes only; 0 otherwise)
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_BUFFER, app.bvh.instTex);
+    rt.setInt("uBvhInstances", 3);
+
+    // Collapsed BVH4/BVH8 node buffer (0 when the binary layout is used)
+    glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_BUFFER, app.bvh.wideTex);
+    rt.setInt("uBvhWideNodes", 4);
 
     // Environment cubemap
     glActiveTexture(GL_TEXTURE5);
@@ -1,9 +1,19 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include "scene/model.h"
 #include "scene/bvh.h"
+#include "scene/bvh_cache.h"
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <thread>
 #include <vector>
 #include <memory>
+#include <queue>
+#include <unordered_map>
+#include <unordered_set>
 
 // -------- AABB helpers -----------
 // Compute axis-aligned bounds and centroid for a CPU triangle in world space.
@@ -25,63 +35,376 @@ static glm::vec3 tri_centroid(const CPU_Triangle &t) {
     return (t.v0 + v1 + v2) * (1.0f / 3.0f);
 }
 
-// -------- BVH builder (median split) -----------
-// BuildRef keeps track of which triangle and its centroid for sorting/splitting.
+// Surface area of an AABB, halved (the factor 2 cancels out in SAH ratios).
+static float half_area(const glm::vec3 &bMin, const glm::vec3 &bMax) {
+    const glm::vec3 e = glm::max(bMax - bMin, glm::vec3(0.0f));
+    return e.x * e.y + e.y * e.z + e.z * e.x;
+}
+
+// -------- Parallel helpers -----------
+// Ranges smaller than this are binned / partitioned / reduced on the calling thread.
+static constexpr int kParallelRangeMin = 1 << 15;
+// Subtrees smaller than this are never handed to another thread.
+static constexpr int kParallelSubtreeMin = 1 << 12;
+
+// Resolves settings.threadCount (0 = all hardware threads) to a usable count.
+static int resolve_thread_count(const BVHBuildSettings &settings) {
+    if (settings.threadCount > 0) return settings.threadCount;
+    const unsigned hw = std::thread::hardware_concurrency();
+    return hw > 0 ? static_cast<int>(hw) : 1;
+}
+
+// Runs fn(chunk, chunkBegin, chunkEnd) over [begin, end) cut into `chunks`
+// contiguous pieces, on at most `threads` threads (0 = one per chunk):
+// thread t runs chunks t, t + threads, ... and thread 0 is the caller.
+// Chunk boundaries only depend on the range and chunk count, so reductions
+// merged in chunk order are deterministic however many threads ran them.
+template<typename Fn>
+static void parallel_chunks(const int begin, const int end, const int chunks, Fn &&fn, int threads = 0) {
+    const int n = end - begin;
+    if (chunks <= 1 || n <= 1) {
+        fn(0, begin, end);
+        return;
+    }
+    if (threads <= 0 || threads > chunks) threads = chunks;
+
+    auto chunkStart = [&](const int c) {
+        return begin + static_cast<int>(static_cast<long long>(n) * c / chunks);
+    };
+    auto runChunks = [&](const int t) {
+        for (int c = t; c < chunks; c += threads) fn(c, chunkStart(c), chunkStart(c + 1));
+    };
+
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+    for (int t = 1; t < threads; ++t) workers.emplace_back(runChunks, t);
+    runChunks(0);
+    for (auto &w: workers) w.join();
+}
+
+// -------- BVH builder (median split / binned SAH) -----------
+// BuildRef keeps track of which triangle, its bounds and centroid for sorting/splitting.
 struct BuildRef {
     int triIndex;
+    glm::vec3 bMin; // triangle bounds
+    glm::vec3 bMax;
     glm::vec3 c; // centroid
 };
 
-// Recursive median-split BVH builder.
-// - nodes: output BVH nodes
-// - tris:  CPU triangle array
-// - refs:  references into tris, sorted by centroid along split axis
+// Bin accumulated during the SAH sweep.
+struct SahBin {
+    glm::vec3 bMin{1e30f};
+    glm::vec3 bMax{-1e30f};
+    int count = 0;
+};
+
+// Best SAH split found for a node (axis < 0 means no valid split).
+struct SahSplit {
+    int axis = -1;
+    int bin = -1; // refs in bins [0, bin] go left
+    float cost = 1e30f;
+};
+
+// Shared state of one build_bvh() call.
+struct BuildContext {
+    const BVHBuildSettings &settings;
+    int threadCount = 1;
+    std::atomic<int> extraThreads{0}; // subtree tasks currently running besides the caller
+
+    // Number of chunks to use for a data-parallel pass over `count` refs.
+    [[nodiscard]] int chunksFor(const int count) const {
+        return count >= kParallelRangeMin ? threadCount : 1;
+    }
+
+    // Reserves a thread for a subtree task; false if all threads are busy.
+    bool tryAcquireThread(const int count) {
+        if (threadCount <= 1 || count < kParallelSubtreeMin) return false;
+        if (extraThreads.fetch_add(1) < threadCount - 1) return true;
+        extraThreads.fetch_sub(1);
+        return false;
+    }
+
+    void releaseThread() {
+        extraThreads.fetch_sub(1);
+    }
+
+    // parallel_chunks() on the caller plus the threads no subtree task or
+    // other pass holds, so nested passes never run more than threadCount
+    // threads in total. The chunk count, and so the result, is unchanged.
+    template<typename Fn>
+    void parallelChunks(const int begin, const int end, const int chunks, Fn &&fn) {
+        int extra = 0;
+        if (chunks > 1) {
+            int busy = extraThreads.load();
+            do {
+                extra = std::min(chunks - 1, threadCount - 1 - busy);
+            } while (extra > 0 && !extraThreads.compare_exchange_weak(busy, busy + extra));
+            extra = std::max(extra, 0);
+        }
+        parallel_chunks(begin, end, chunks, fn, 1 + extra);
+        if (extra > 0) extraThreads.fetch_sub(extra);
+    }
+};
+
+// Turns node into a leaf over refs [begin, begin + count).
+static void make_leaf(BVHNode &node, const int begin, const int count) {
+    node.left = -1;
+    node.right = -1;
+    node.first = begin;
+    node.count = count;
+}
+
+// Maps a centroid coordinate to its bin along one axis.
+static int bin_index(const float c, const float cMin, const float scale, const int binCount) {
+    const int b = static_cast<int>((c - cMin) * scale);
+    return std::clamp(b, 0, binCount - 1);
+}
+
+// Sweeps sahBins candidate planes on each axis and returns the cheapest one.
+// Large ranges are binned in parallel; per-chunk bins are merged in chunk order.
+static SahSplit find_sah_split(const std::vector<BuildRef> &refs,
+                               const int begin,
+                               const int end,
+                               const glm::vec3 &cMin,
+                               const glm::vec3 &cMax,
+                               const float nodeArea,
+                               BuildContext &ctx) {
+    const BVHBuildSettings &settings = ctx.settings;
+    const int binCount = std::max(settings.sahBins, 2);
+
+    glm::vec3 scale(0.0f);
+    for (int axis = 0; axis < 3; ++axis) {
+        const float extent = cMax[axis] - cMin[axis];
+        scale[axis] = extent > 0.0f ? static_cast<float>(binCount) / extent : 0.0f;
+    }
+
+    // bins[(chunk * 3 + axis) * binCount + bin]
+    const int chunks = ctx.chunksFor(end - begin);
+    std::vector<SahBin> bins(static_cast<size_t>(chunks) * 3 * binCount);
+    ctx.parallelChunks(begin, end, chunks, [&](const int chunk, const int cb, const int ce) {
+        SahBin *local = &bins[static_cast<size_t>(chunk) * 3 * binCount];
+        for (int i = cb; i < ce; ++i) {
+            const BuildRef &r = refs[i];
+            for (int axis = 0; axis < 3; ++axis) {
+                SahBin &b = local[axis * binCount + bin_index(r.c[axis], cMin[axis], scale[axis], binCount)];
+                b.bMin = glm::min(b.bMin, r.bMin);
+                b.bMax = glm::max(b.bMax, r.bMax);
+                ++b.count;
+            }
+        }
+    });
+    for (int chunk = 1; chunk < chunks; ++chunk) {
+        for (int i = 0; i < 3 * binCount; ++i) {
+            SahBin &dst = bins[i];
+            const SahBin &src = bins[static_cast<size_t>(chunk) * 3 * binCount + i];
+            dst.bMin = glm::min(dst.bMin, src.bMin);
+            dst.bMax = glm::max(dst.bMax, src.bMax);
+            dst.count += src.count;
+        }
+    }
+
+    SahSplit best;
+    std::vector<float> rightCost(binCount);
+    for (int axis = 0; axis < 3; ++axis) {
+        if (scale[axis] <= 0.0f) continue;
+        const SahBin *axisBins = &bins[static_cast<size_t>(axis) * binCount];
+
+        // Right-to-left sweep: area * count of everything right of each plane.
+        glm::vec3 rMin(1e30f), rMax(-1e30f);
+        int rCount = 0;
+        for (int b = binCount - 1; b > 0; --b) {
+            rMin = glm::min(rMin, axisBins[b].bMin);
+            rMax = glm::max(rMax, axisBins[b].bMax);
+            rCount += axisBins[b].count;
+            rightCost[b - 1] = rCount ? half_area(rMin, rMax) * static_cast<float>(rCount) : 0.0f;
+        }
+
+        // Left-to-right sweep: combine with the right side and keep the minimum.
+        glm::vec3 lMin(1e30f), lMax(-1e30f);
+        int lCount = 0;
+        for (int b = 0; b < binCount - 1; ++b) {
+            lMin = glm::min(lMin, axisBins[b].bMin);
+            lMax = glm::max(lMax, axisBins[b].bMax);
+            lCount += axisBins[b].count;
+            if (lCount == 0 || lCount == end - begin) continue;
+
+            const float leftCost = half_area(lMin, lMax) * static_cast<float>(lCount);
+            const float cost = settings.traversalCost +
+                               settings.intersectCost * (leftCost + rightCost[b]) / nodeArea;
+            if (cost < best.cost) {
+                best.axis = axis;
+                best.bin = b;
+                best.cost = cost;
+            }
+        }
+    }
+    return best;
+}
+
+// Stable partition of refs [begin, end) by pred; returns the first "false" index.
+// The parallel path produces exactly the same order as std::stable_partition.
+template<typename Pred>
+static int partition_refs(std::vector<BuildRef> &refs, const int begin, const int end, Pred pred,
+                          BuildContext &ctx) {
+    const int chunks = ctx.chunksFor(end - begin);
+    if (chunks <= 1) {
+        const auto it = std::stable_partition(refs.begin() + begin, refs.begin() + end, pred);
+        return static_cast<int>(it - refs.begin());
+    }
+
+    // Count "left" refs per chunk, then scatter both sides at their prefix offsets.
+    std::vector<int> leftCounts(chunks, 0);
+    ctx.parallelChunks(begin, end, chunks, [&](const int chunk, const int cb, const int ce) {
+        int n = 0;
+        for (int i = cb; i < ce; ++i) n += pred(refs[i]) ? 1 : 0;
+        leftCounts[chunk] = n;
+    });
+
+    int totalLeft = 0;
+    for (const int n: leftCounts) totalLeft += n;
+
+    std::vector<BuildRef> tmp(end - begin);
+    ctx.parallelChunks(begin, end, chunks, [&](const int chunk, const int cb, const int ce) {
+        int leftOut = 0;
+        for (int c = 0; c < chunk; ++c) leftOut += leftCounts[c];
+        int rightOut = totalLeft + (cb - begin) - leftOut;
+        for (int i = cb; i < ce; ++i) {
+            if (pred(refs[i])) tmp[leftOut++] = refs[i];
+            else tmp[rightOut++] = refs[i];
+        }
+    });
+    ctx.parallelChunks(begin, end, chunks, [&](int, const int cb, const int ce) {
+        std::copy(tmp.begin() + (cb - begin), tmp.begin() + (ce - begin), refs.begin() + cb);
+    });
+    return begin + totalLeft;
+}
+
+// Recursive BVH builder.
+// - nodes: output BVH nodes (pre-order: node, left subtree, right subtree)
+// - refs:  references into the triangle array, reordered in place
 // - [begin, end): range of refs this node owns
-// - leafMax: max triangles per leaf
+// - ctx: settings + thread budget
+//
+// When a thread is free, the right subtree is built concurrently into its own
+// array and appended after the left one with its child indices shifted. This
+// yields exactly the node order of a serial build regardless of thread count.
 static int build_recursive(std::vector<BVHNode> &nodes,
-                           const std::vector<CPU_Triangle> &tris,
                            std::vector<BuildRef> &refs,
                            const int begin,
                            const int end,
-                           const int leafMax = 8) {
-    // Compute bounding box over this node's triangle range.
+                           BuildContext &ctx) {
+    const BVHBuildSettings &settings = ctx.settings;
+
+    // Compute bounding box (and centroid bounds for binning) over this node's range.
+    const int count = end - begin;
+    const int chunks = ctx.chunksFor(count);
+    std::vector<glm::vec3> partial(static_cast<size_t>(chunks) * 4);
+    ctx.parallelChunks(begin, end, chunks, [&](const int chunk, const int cb, const int ce) {
+        glm::vec3 bMin(1e30f), bMax(-1e30f);
+        glm::vec3 cMin(1e30f), cMax(-1e30f);
+        for (int i = cb; i < ce; ++i) {
+            bMin = glm::min(bMin, refs[i].bMin);
+            bMax = glm::max(bMax, refs[i].bMax);
+            cMin = glm::min(cMin, refs[i].c);
+            cMax = glm::max(cMax, refs[i].c);
+        }
+        partial[chunk * 4 + 0] = bMin;
+        partial[chunk * 4 + 1] = bMax;
+        partial[chunk * 4 + 2] = cMin;
+        partial[chunk * 4 + 3] = cMax;
+    });
     glm::vec3 bMin(1e30f), bMax(-1e30f);
-    for (int i = begin; i < end; ++i) {
-        const auto &T = tris[refs[i].triIndex];
-        bMin = glm::min(bMin, tri_min(T));
-        bMax = glm::max(bMax, tri_max(T));
+    glm::vec3 cMin(1e30f), cMax(-1e30f);
+    for (int chunk = 0; chunk < chunks; ++chunk) {
+        bMin = glm::min(bMin, partial[chunk * 4 + 0]);
+        bMax = glm::max(bMax, partial[chunk * 4 + 1]);
+        cMin = glm::min(cMin, partial[chunk * 4 + 2]);
+        cMax = glm::max(cMax, partial[chunk * 4 + 3]);
     }
 
-    const int count = end - begin;
+    const int leafMax = std::max(settings.leafMax, 1);
     const int myIndex = static_cast<int>(nodes.size());
     nodes.push_back({});
     nodes[myIndex].bMin = bMin;
     nodes[myIndex].bMax = bMax;
 
-    // Leaf: store range and triangle count, no children.
-    if (count <= leafMax) {
-        nodes[myIndex].left = -1;
-        nodes[myIndex].right = -1;
-        nodes[myIndex].first = begin;
-        nodes[myIndex].count = count;
+    int mid = -1;
+    if (settings.method == BVHBuildMethod::BinnedSAH) {
+        if (count == 1) {
+            make_leaf(nodes[myIndex], begin, count);
+            return myIndex;
+        }
+
+        const SahSplit split = find_sah_split(refs, begin, end, cMin, cMax,
+                                              std::max(half_area(bMin, bMax), 1e-30f), ctx);
+        const float leafCost = settings.intersectCost * static_cast<float>(count);
+
+        // Leaf: splitting does not pay off and the leaf is small enough.
+        if (count <= leafMax && (split.axis < 0 || split.cost >= leafCost)) {
+            make_leaf(nodes[myIndex], begin, count);
+            return myIndex;
+        }
+
+        if (split.axis >= 0) {
+            const int axis = split.axis;
+            const int binCount = std::max(settings.sahBins, 2);
+            const float scale = static_cast<float>(binCount) / (cMax[axis] - cMin[axis]);
+            const float axisMin = cMin[axis];
+            const int splitBin = split.bin;
+            mid = partition_refs(refs, begin, end,
+                                 [=](const BuildRef &r) {
+                                     return bin_index(r.c[axis], axisMin, scale, binCount) <= splitBin;
+                                 },
+                                 ctx);
+        }
+        // No usable plane (all centroids coincide): fall through to an even split.
+    } else if (count <= leafMax) {
+        // Leaf: store range and triangle count, no children.
+        make_leaf(nodes[myIndex], begin, count);
         return myIndex;
     }
 
-    // Choose split axis by largest extent.
-    const glm::vec3 e = bMax - bMin;
-    int axis = (e.x > e.y) ? ((e.x > e.z) ? 0 : 2) : ((e.y > e.z) ? 1 : 2);
+    if (mid <= begin || mid >= end) {
+        // Choose split axis by largest extent.
+        const glm::vec3 e = bMax - bMin;
+        int axis = (e.x > e.y) ? ((e.x > e.z) ? 0 : 2) : ((e.y > e.z) ? 1 : 2);
 
-    // Median split along chosen axis (by centroid).
-    const int mid = (begin + end) / 2;
-    std::nth_element(refs.begin() + begin,
-                     refs.begin() + mid,
-                     refs.begin() + end,
-                     [axis](const BuildRef &a, const BuildRef &b) {
-                         return a.c[axis] < b.c[axis];
-                     });
+        // Median split along chosen axis (by centroid).
+        mid = (begin + end) / 2;
+        std::nth_element(refs.begin() + begin,
+                         refs.begin() + mid,
+                         refs.begin() + end,
+                         [axis](const BuildRef &a, const BuildRef &b) {
+                             return a.c[axis] < b.c[axis];
+                         });
+    }
+
+    int leftIdx, rightIdx;
+    if (ctx.tryAcquireThread(end - mid)) {
+        // Right subtree on a worker thread, left subtree here.
+        std::vector<BVHNode> rightNodes;
+        std::thread worker([&] {
+            rightNodes.reserve(static_cast<size_t>(end - mid) * 2);
+            build_recursive(rightNodes, refs, mid, end, ctx);
+        });
+        leftIdx = build_recursive(nodes, refs, begin, mid, ctx);
+        worker.join();
+        ctx.releaseThread();
 
-    const int leftIdx = build_recursive(nodes, tris, refs, begin, mid, leafMax);
-    const int rightIdx = build_recursive(nodes, tris, refs, mid, end, leafMax);
+        // Splice the right subtree after the left one, shifting its child links.
+        const int offset = static_cast<int>(nodes.size());
+        for (BVHNode &n: rightNodes) {
+            if (!n.isLeaf()) {
+                n.left += offset;
+                n.right += offset;
+            }
+        }
+        nodes.insert(nodes.end(), rightNodes.begin(), rightNodes.end());
+        rightIdx = offset;
+    } else {
+        leftIdx = build_recursive(nodes, refs, begin, mid, ctx);
+        rightIdx = build_recursive(nodes, refs, mid, end, ctx);
+    }
 
     nodes[myIndex].left = leftIdx;
     nodes[myIndex].right = rightIdx;
@@ -90,28 +413,441 @@ static int build_recursive(std::vector<BVHNode> &nodes,
     return myIndex;
 }
 
+// -------- Linear BVH (Morton codes + radix sort) -----------
+// Spreads the low 10 bits of v so that two zero bits separate each of them.
+static uint64_t expand_bits_10(const uint32_t v) {
+    uint64_t x = v & 0x3ffu;
+    x = (x | (x << 16)) & 0x030000FFull;
+    x = (x | (x << 8)) & 0x0300F00Full;
+    x = (x | (x << 4)) & 0x030C30C3ull;
+    x = (x | (x << 2)) & 0x09249249ull;
+    return x;
+}
+
+// Spreads the low 21 bits of v so that two zero bits separate each of them.
+static uint64_t expand_bits_21(const uint32_t v) {
+    uint64_t x = v & 0x1fffffu;
+    x = (x | (x << 32)) & 0x001F00000000FFFFull;
+    x = (x | (x << 16)) & 0x001F0000FF0000FFull;
+    x = (x | (x << 8)) & 0x100F00F00F00F00Full;
+    x = (x | (x << 4)) & 0x10C30C30C30C30C3ull;
+    x = (x | (x << 2)) & 0x1249249249249249ull;
+    return x;
+}
+
+// Morton code of a point already normalized to [0,1]^3 (30 or 63 bits).
+static uint64_t morton_code(const glm::vec3 &p, const bool wide) {
+    const float res = wide ? 2097151.0f : 1023.0f; // 2^21 - 1 or 2^10 - 1
+    const glm::vec3 q = glm::clamp(p * res, 0.0f, res);
+    const auto x = static_cast<uint32_t>(q.x);
+    const auto y = static_cast<uint32_t>(q.y);
+    const auto z = static_cast<uint32_t>(q.z);
+    if (wide)
+        return (expand_bits_21(x) << 2) | (expand_bits_21(y) << 1) | expand_bits_21(z);
+    return (expand_bits_10(x) << 2) | (expand_bits_10(y) << 1) | expand_bits_10(z);
+}
+
+// Number of leading zero bits of a 64-bit value (64 for zero).
+static int clz64(uint64_t x) {
+    if (x == 0) return 64;
+    int n = 0;
+    if (x <= 0x00000000FFFFFFFFull) { n += 32; x <<= 32; }
+    if (x <= 0x0000FFFFFFFFFFFFull) { n += 16; x <<= 16; }
+    if (x <= 0x00FFFFFFFFFFFFFFull) { n += 8; x <<= 8; }
+    if (x <= 0x0FFFFFFFFFFFFFFFull) { n += 4; x <<= 4; }
+    if (x <= 0x3FFFFFFFFFFFFFFFull) { n += 2; x <<= 2; }
+    if (x <= 0x7FFFFFFFFFFFFFFFull) { n += 1; }
+    return n;
+}
+
+// Stable LSD radix sort of (code, id) pairs, 8 bits per pass. Each pass
+// builds per-chunk digit histograms in parallel and scatters in chunk order,
+// so the result is identical to a serial stable sort.
+static void radix_sort_codes(std::vector<uint64_t> &codes, std::vector<int> &ids, const int bits,
+                             const BuildContext &ctx) {
+    const int n = static_cast<int>(codes.size());
+    const int chunks = ctx.chunksFor(n);
+    std::vector<uint64_t> codesTmp(n);
+    std::vector<int> idsTmp(n);
+    std::vector<int> offsets(static_cast<size_t>(chunks) * 256);
+
+    for (int shift = 0; shift < bits; shift += 8) {
+        std::fill(offsets.begin(), offsets.end(), 0);
+        parallel_chunks(0, n, chunks, [&](const int chunk, const int cb, const int ce) {
+            int *hist = &offsets[static_cast<size_t>(chunk) * 256];
+            for (int i = cb; i < ce; ++i) ++hist[(codes[i] >> shift) & 0xffu];
+        });
+
+        // Exclusive prefix sum in (digit, chunk) order.
+        int sum = 0;
+        for (int d = 0; d < 256; ++d) {
+            for (int chunk = 0; chunk < chunks; ++chunk) {
+                int &slot = offsets[static_cast<size_t>(chunk) * 256 + d];
+                const int h = slot;
+                slot = sum;
+                sum += h;
+            }
+        }
+
+        parallel_chunks(0, n, chunks, [&](const int chunk, const int cb, const int ce) {
+            int *offs = &offsets[static_cast<size_t>(chunk) * 256];
+            for (int i = cb; i < ce; ++i) {
+                const int dst = offs[(codes[i] >> shift) & 0xffu]++;
+                codesTmp[dst] = codes[i];
+                idsTmp[dst] = ids[i];
+            }
+        });
+        codes.swap(codesTmp);
+        ids.swap(idsTmp);
+    }
+}
+
+// Inner node of the Karras radix tree over the sorted codes. Children are
+// either inner nodes or single sorted primitives; [first, last] is the
+// contiguous range of sorted primitives below the node.
+struct LbvhInner {
+    int left, right;
+    bool leftIsPrim, rightIsPrim;
+    int first, last;
+};
+
+// Builds a linear BVH (Karras 2012): sort refs by the Morton code of their
+// centroid, derive every inner node of the radix tree independently from the
+// sorted codes, then emit it in pre-order into `nodes`. Subtrees covering at
+// most leafMax primitives are collapsed into one leaf. Leaf ranges index
+// into the sorted refs, which is what build_bvh()'s remap pass expects.
+static void build_lbvh(std::vector<BVHNode> &nodes, std::vector<BuildRef> &refs, const BuildContext &ctx) {
+    const int n = static_cast<int>(refs.size());
+    const bool wide = ctx.settings.mortonBits > 30;
+    const int chunks = ctx.chunksFor(n);
+
+    // Centroid bounds define the Morton grid.
+    std::vector<glm::vec3> partial(static_cast<size_t>(chunks) * 2);
+    parallel_chunks(0, n, chunks, [&](const int chunk, const int cb, const int ce) {
+        glm::vec3 cMin(1e30f), cMax(-1e30f);
+        for (int i = cb; i < ce; ++i) {
+            cMin = glm::min(cMin, refs[i].c);
+            cMax = glm::max(cMax, refs[i].c);
+        }
+        partial[chunk * 2 + 0] = cMin;
+        partial[chunk * 2 + 1] = cMax;
+    });
+    glm::vec3 cMin(1e30f), cMax(-1e30f);
+    for (int chunk = 0; chunk < chunks; ++chunk) {
+        cMin = glm::min(cMin, partial[chunk * 2 + 0]);
+        cMax = glm::max(cMax, partial[chunk * 2 + 1]);
+    }
+    const glm::vec3 extent = cMax - cMin;
+    const glm::vec3 invExtent(extent.x > 0.0f ? 1.0f / extent.x : 0.0f,
+                              extent.y > 0.0f ? 1.0f / extent.y : 0.0f,
+                              extent.z > 0.0f ? 1.0f / extent.z : 0.0f);
+
+    // Morton codes + parallel radix sort.
+    std::vector<uint64_t> codes(n);
+    std::vector<int> order(n);
+    parallel_chunks(0, n, chunks, [&](int, const int cb, const int ce) {
+        for (int i = cb; i < ce; ++i) {
+            codes[i] = morton_code((refs[i].c - cMin) * invExtent, wide);
+            order[i] = i;
+        }
+    });
+    radix_sort_codes(codes, order, wide ? 63 : 30, ctx);
+
+    std::vector<BuildRef> sorted(n);
+    parallel_chunks(0, n, chunks, [&](int, const int cb, const int ce) {
+        for (int i = cb; i < ce; ++i) sorted[i] = refs[order[i]];
+    });
+    refs.swap(sorted);
+
+    // Length of the common prefix of codes i and j; duplicate codes are
+    // disambiguated by their index so the radix tree stays well-formed.
+    auto delta = [&](const int i, const int j) {
+        if (j < 0 || j >= n) return -1;
+        if (codes[i] == codes[j])
+            return 64 + clz64(static_cast<uint64_t>(i ^ j));
+        return clz64(codes[i] ^ codes[j]);
+    };
+
+    // Every inner node is computed independently from the sorted codes.
+    std::vector<LbvhInner> inner(std::max(n - 1, 0));
+    parallel_chunks(0, n - 1, ctx.chunksFor(n - 1), [&](int, const int cb, const int ce) {
+        for (int i = cb; i < ce; ++i) {
+            // Direction of the range and the minimum prefix shared inside it.
+            const int d = (delta(i, i + 1) - delta(i, i - 1)) >= 0 ? 1 : -1;
+            const int deltaMin = delta(i, i - d);
+
+            // Upper bound on the range length, then binary search the other end.
+            int lMax = 2;
+            while (delta(i, i + lMax * d) > deltaMin) lMax *= 2;
+            int l = 0;
+            for (int t = lMax / 2; t >= 1; t /= 2) {
+                if (delta(i, i + (l + t) * d) > deltaMin) l += t;
+            }
+            const int j = i + l * d;
+
+            // Binary search the split position inside [i, j].
+            const int deltaNode = delta(i, j);
+            int s = 0;
+            for (int div = 2;; div *= 2) {
+                const int t = (l + div - 1) / div;
+                if (delta(i, i + (s + t) * d) > deltaNode) s += t;
+                if (t <= 1) break;
+            }
+            const int gamma = i + s * d + std::min(d, 0);
+
+            LbvhInner &node = inner[i];
+            node.first = std::min(i, j);
+            node.last = std::max(i, j);
+            node.left = gamma;
+            node.leftIsPrim = (node.first == gamma);
+            node.right = gamma + 1;
+            node.rightIsPrim = (node.last == gamma + 1);
+        }
+    });
+
+    // Pre-order emission (left child right after its parent, as in build_recursive).
+    struct EmitItem {
+        int ref; // inner node index, or sorted primitive index when isPrim
+        bool isPrim;
+        int parent; // emitted parent index, -1 for the root
+        bool isRight;
+    };
+    const int leafMax = std::max(ctx.settings.leafMax, 1);
+    std::vector<EmitItem> stack;
+    stack.push_back({0, n == 1, -1, false});
+
+    while (!stack.empty()) {
+        const EmitItem item = stack.back();
+        stack.pop_back();
+
+        const int myIndex = static_cast<int>(nodes.size());
+        nodes.push_back({});
+        if (item.parent >= 0) {
+            if (item.isRight) nodes[item.parent].right = myIndex;
+            else nodes[item.parent].left = myIndex;
+        }
+
+        const int first = item.isPrim ? item.ref : inner[item.ref].first;
+        const int last = item.isPrim ? item.ref : inner[item.ref].last;
+        if (last - first + 1 <= leafMax) {
+            make_leaf(nodes[myIndex], first, last - first + 1);
+            continue;
+        }
+
+        const LbvhInner &in = inner[item.ref];
+        nodes[myIndex].first = -1;
+        nodes[myIndex].count = 0;
+        stack.push_back({in.right, in.rightIsPrim, myIndex, true});
+        stack.push_back({in.left, in.leftIsPrim, myIndex, false});
+    }
+
+    // Bounds bottom-up: in pre-order every child comes after its parent.
+    for (int i = static_cast<int>(nodes.size()) - 1; i >= 0; --i) {
+        BVHNode &node = nodes[i];
+        node.bMin = glm::vec3(1e30f);
+        node.bMax = glm::vec3(-1e30f);
+        if (node.isLeaf()) {
+            for (int k = node.first; k < node.first + node.count; ++k) {
+                node.bMin = glm::min(node.bMin, refs[k].bMin);
+                node.bMax = glm::max(node.bMax, refs[k].bMax);
+            }
+        } else {
+            node.bMin = glm::min(nodes[node.left].bMin, nodes[node.right].bMin);
+            node.bMax = glm::max(nodes[node.left].bMax, nodes[node.right].bMax);
+        }
+    }
+}
+
+// -------- Spatial pre-splits -----------
+// Long diagonal triangles get boxes far larger than the triangle itself.
+// Before the build, the worst references are cut along planes of a global
+// power-of-two grid over the scene box (the same planes a top-down build
+// tends to pick), each piece keeping only the bounds of its part of the
+// triangle. Leaves then store whole triangles, so duplicates are allowed
+// and traversal is unchanged.
+
+// Candidate split of one reference (gain = box area saved by the cut).
+struct PreSplit {
+    float gain = 0.0f;
+    int ref = -1;
+    int axis = -1;
+    float pos = 0.0f;
+
+    // Max-heap order; ties broken by index so the result is deterministic.
+    bool operator<(const PreSplit &o) const {
+        return gain < o.gain || (gain == o.gain && ref > o.ref);
+    }
+};
+
+// Splits the part of t inside ref's box at axis = pos. Edges crossing the
+// plane contribute their intersection point to both sides; both boxes are
+// then clipped to the parent box. Returns false if a side ends up empty.
+static bool split_ref(const CPU_Triangle &t, const BuildRef &ref, const int axis, const float pos,
+                      BuildRef &outLeft, BuildRef &outRight) {
+    const glm::vec3 v[3] = {t.v0, t.v0 + t.e1, t.v0 + t.e2};
+    glm::vec3 lMin(1e30f), lMax(-1e30f), rMin(1e30f), rMax(-1e30f);
+    for (int i = 0; i < 3; ++i) {
+        const glm::vec3 &a = v[i];
+        const glm::vec3 &b = v[(i + 1) % 3];
+        if (a[axis] <= pos) {
+            lMin = glm::min(lMin, a);
+            lMax = glm::max(lMax, a);
+        }
+        if (a[axis] >= pos) {
+            rMin = glm::min(rMin, a);
+            rMax = glm::max(rMax, a);
+        }
+        if ((a[axis] < pos && b[axis] > pos) || (a[axis] > pos && b[axis] < pos)) {
+            glm::vec3 x = glm::mix(a, b, (pos - a[axis]) / (b[axis] - a[axis]));
+            x[axis] = pos;
+            lMin = glm::min(lMin, x);
+            lMax = glm::max(lMax, x);
+            rMin = glm::min(rMin, x);
+            rMax = glm::max(rMax, x);
+        }
+    }
+
+    outLeft = ref;
+    outRight = ref;
+    outLeft.bMin = glm::max(lMin, ref.bMin);
+    outLeft.bMax = glm::min(lMax, ref.bMax);
+    outLeft.bMax[axis] = std::min(outLeft.bMax[axis], pos);
+    outRight.bMin = glm::max(rMin, ref.bMin);
+    outRight.bMax = glm::min(rMax, ref.bMax);
+    outRight.bMin[axis] = std::max(outRight.bMin[axis], pos);
+    for (int a = 0; a < 3; ++a) {
+        if (outLeft.bMin[a] > outLeft.bMax[a] || outRight.bMin[a] > outRight.bMax[a]) return false;
+    }
+    outLeft.c = (outLeft.bMin + outLeft.bMax) * 0.5f;
+    outRight.c = (outRight.bMin + outRight.bMax) * 0.5f;
+    return true;
+}
+
+// Best cut for refs[r]: the coarsest grid plane strictly inside its box,
+// on the axis that saves the most area.
+static PreSplit find_pre_split(const std::vector<CPU_Triangle> &tris, const std::vector<BuildRef> &refs,
+                               const int r, const glm::vec3 &sceneMin, const glm::vec3 &sceneMax) {
+    const BuildRef &ref = refs[r];
+    const float area = half_area(ref.bMin, ref.bMax);
+    PreSplit best;
+    best.ref = r;
+    for (int axis = 0; axis < 3; ++axis) {
+        const float extent = sceneMax[axis] - sceneMin[axis];
+        if (extent <= 0.0f || ref.bMax[axis] <= ref.bMin[axis]) continue;
+
+        float pos = 0.0f;
+        bool found = false;
+        for (int level = 1; level <= 24 && !found; ++level) {
+            const float cell = std::ldexp(extent, -level);
+            pos = sceneMin[axis] + std::ceil((ref.bMin[axis] - sceneMin[axis]) / cell) * cell;
+            if (pos <= ref.bMin[axis]) pos += cell;
+            found = pos < ref.bMax[axis];
+        }
+        if (!found) continue;
+
+        BuildRef left, right;
+        if (!split_ref(tris[ref.triIndex], ref, axis, pos, left, right)) continue;
+        const float gain = area - half_area(left.bMin, left.bMax) - half_area(right.bMin, right.bMax);
+        if (gain > best.gain) {
+            best.gain = gain;
+            best.axis = axis;
+            best.pos = pos;
+        }
+    }
+    return best;
+}
+
+// Splits the highest-gain references until budget extra references exist.
+static void pre_split_refs(const std::vector<CPU_Triangle> &tris, std::vector<BuildRef> &refs, const float budget) {
+    const int extra = static_cast<int>(static_cast<double>(budget) * static_cast<double>(refs.size()));
+    if (extra <= 0 || refs.empty()) return;
+
+    glm::vec3 sceneMin(1e30f), sceneMax(-1e30f);
+    for (const auto &r: refs) {
+        sceneMin = glm::min(sceneMin, r.bMin);
+        sceneMax = glm::max(sceneMax, r.bMax);
+    }
+
+    // Splits that save less than this share of the scene box are not worth a reference.
+    const float minGain = 1e-6f * half_area(sceneMin, sceneMax);
+
+    std::priority_queue<PreSplit> queue;
+    for (int r = 0; r < static_cast<int>(refs.size()); ++r) {
+        const PreSplit split = find_pre_split(tris, refs, r, sceneMin, sceneMax);
+        if (split.gain > minGain) queue.push(split);
+    }
+
+    refs.reserve(refs.size() + extra);
+    const size_t limit = refs.size() + extra;
+    while (!queue.empty() && refs.size() < limit) {
+        const PreSplit split = queue.top();
+        queue.pop();
+
+        BuildRef left, right;
+        if (!split_ref(tris[refs[split.ref].triIndex], refs[split.ref], split.axis, split.pos, left, right))
+            continue;
+        refs[split.ref] = left;
+        refs.push_back(right);
+
+        for (const int r: {split.ref, static_cast<int>(refs.size()) - 1}) {
+            const PreSplit next = find_pre_split(tris, refs, r, sceneMin, sceneMax);
+            if (next.gain > minGain) queue.push(next);
+        }
+    }
+}
+
 // Entry point: build BVH over tris, then remap them for cache-friendly leaves.
-std::vector<BVHNode> build_bvh(std::vector<CPU_Triangle> &tris) {
+std::vector<BVHNode> build_bvh(std::vector<CPU_Triangle> &tris,
+                               const BVHBuildSettings &settings,
+                               BVHBuildStats *outStats,
+                               std::vector<int> *outSourceIndex) {
+    const auto t0 = std::chrono::steady_clock::now();
+
     std::vector<BVHNode> nodes;
-    if (tris.empty()) return nodes;
+    if (tris.empty()) {
+        if (outStats) *outStats = BVHBuildStats{};
+        if (outSourceIndex) outSourceIndex->clear();
+        return nodes;
+    }
+
+    BuildContext ctx{settings};
+    ctx.threadCount = resolve_thread_count(settings);
 
-    // Build initial refs with centroids for splitting.
+    // Build initial refs with bounds and centroids for splitting.
+    const int triCount = static_cast<int>(tris.size());
     std::vector<BuildRef> refs(tris.size());
-    for (size_t i = 0; i < tris.size(); ++i) {
-        refs[i].triIndex = static_cast<int>(i);
-        refs[i].c = tri_centroid(tris[i]);
-    }
+    parallel_chunks(0, triCount, ctx.chunksFor(triCount), [&](int, const int cb, const int ce) {
+        for (int i = cb; i < ce; ++i) {
+            refs[i].triIndex = i;
+            refs[i].bMin = tri_min(tris[i]);
+            refs[i].bMax = tri_max(tris[i]);
+            refs[i].c = tri_centroid(tris[i]);
+        }
+    });
 
-    nodes.reserve(tris.size() * 2);
-    build_recursive(nodes, tris, refs, 0, static_cast<int>(refs.size()), 8);
+    const bool presplit = settings.splitBudget > 0.0f;
+    if (presplit) pre_split_refs(tris, refs, settings.splitBudget);
+    const int refCount = static_cast<int>(refs.size());
+
+    nodes.reserve(refs.size() * 2);
+    if (settings.method == BVHBuildMethod::LBVH)
+        build_lbvh(nodes, refs, ctx);
+    else
+        build_recursive(nodes, refs, 0, refCount, ctx);
 
     // Reorder triangles to match leaf ranges for better locality.
     std::vector<CPU_Triangle> remapped;
-    remapped.reserve(tris.size());
+    remapped.reserve(refs.size());
+    std::vector<int> leafTris;
+    if (outSourceIndex) {
+        outSourceIndex->clear();
+        outSourceIndex->reserve(refs.size());
+    }
 
     // Simple DFS stack to iterate nodes without recursion.
     std::vector<int> stack;
     stack.push_back(0);
+    int leafCount = 0;
 
     while (!stack.empty()) {
         const int n = stack.back();
@@ -119,13 +855,21 @@ std::vector<BVHNode> build_bvh(std::vector<CPU_Triangle> &tris) {
         const auto &node = nodes[n];
 
         if (node.isLeaf()) {
-            // Pack this leaf's triangles contiguously.
+            // Pack this leaf's triangles contiguously; pieces of one split
+            // triangle that ended up in the same leaf are stored once.
+            leafTris.clear();
             for (int i = 0; i < node.count; ++i) {
-                remapped.push_back(tris[refs[node.first + i].triIndex]);
+                const int triIndex = refs[node.first + i].triIndex;
+                if (presplit && std::find(leafTris.begin(), leafTris.end(), triIndex) != leafTris.end()) continue;
+                leafTris.push_back(triIndex);
+                remapped.push_back(tris[triIndex]);
+                if (outSourceIndex) outSourceIndex->push_back(triIndex);
             }
-            const int base = static_cast<int>(remapped.size()) - node.count;
+            const int count = static_cast<int>(leafTris.size());
             // Store the base index into the remapped array.
-            nodes[n].first = base;
+            nodes[n].first = static_cast<int>(remapped.size()) - count;
+            nodes[n].count = count;
+            ++leafCount;
         } else {
             stack.push_back(node.left);
             stack.push_back(node.right);
@@ -133,144 +877,1785 @@ std::vector<BVHNode> build_bvh(std::vector<CPU_Triangle> &tris) {
     }
 
     tris = std::move(remapped);
+
+    // Optional post-build restructuring, within its own time budget.
+    BVHOptimizeStats optimize;
+    if (settings.optimizeMs > 0.0f) optimize_bvh(nodes, tris, settings, settings.optimizeMs, &optimize, outSourceIndex);
+
+    // Both of the above emit depth-first order; other layouts are a final permutation.
+    if (settings.layout != BVHLayout::DepthFirst) reorder_bvh(nodes, tris, settings.layout, outSourceIndex);
+
+    if (outStats) {
+        const auto t1 = std::chrono::steady_clock::now();
+        outStats->buildMs = std::chrono::duration<double, std::milli>(t1 - t0).count();
+        outStats->sahCost = bvh_sah_cost(nodes, settings);
+        outStats->leafCount = leafCount;
+        outStats->threadCount = ctx.threadCount;
+        outStats->dupFactor = static_cast<float>(tris.size()) / static_cast<float>(triCount);
+        outStats->optimizeMs = optimize.optimizeMs;
+        outStats->unoptimizedSahCost = settings.optimizeMs > 0.0f ? optimize.sahBefore : outStats->sahCost;
+    }
     return nodes;
 }
 
-// -------- Upload to TBOs (GL_TEXTURE_BUFFER) -----------
-// Upload BVH nodes + triangles into texture buffers for use in GLSL.
-void upload_bvh_tbo(const std::vector<BVHNode> &nodes,
-                    const std::vector<CPU_Triangle> &tris,
-                    GLuint &outNodeTex,
-                    GLuint &outNodeBuf,
-                    GLuint &outTriTex,
-                    GLuint &outTriBuf) {
-    // Pack nodes: 3 texels per node (RGBA32F each)
-    //  tex0 = [bMin.x, bMin.y, bMin.z, left]
-    //  tex1 = [bMax.x, bMax.y, bMax.z, right]
-    //  tex2 = [first,  count,  0,       0]
-    std::vector<float> nodeData;
-    nodeData.reserve(nodes.size() * 12);
+// SAH cost of a finished tree, normalized by the root surface area.
+float bvh_sah_cost(const std::vector<BVHNode> &nodes, const BVHBuildSettings &settings) {
+    if (nodes.empty()) return 0.0f;
+    const float rootArea = std::max(half_area(nodes[0].bMin, nodes[0].bMax), 1e-30f);
+
+    double cost = 0.0;
     for (const auto &n: nodes) {
-        nodeData.push_back(n.bMin.x);
-        nodeData.push_back(n.bMin.y);
-        nodeData.push_back(n.bMin.z);
-        nodeData.push_back(static_cast<float>(n.left));
-
-        nodeData.push_back(n.bMax.x);
-        nodeData.push_back(n.bMax.y);
-        nodeData.push_back(n.bMax.z);
-        nodeData.push_back(static_cast<float>(n.right));
-
-        nodeData.push_back(static_cast<float>(n.first));
-        nodeData.push_back(static_cast<float>(n.count));
-        nodeData.push_back(0.0f);
-        nodeData.push_back(0.0f);
-    }
-
-    if (!outNodeBuf)
-        glGenBuffers(1, &outNodeBuf);
-    glBindBuffer(GL_TEXTURE_BUFFER, outNodeBuf);
-    glBufferData(GL_TEXTURE_BUFFER,
-                 static_cast<GLsizeiptr>(nodeData.size() * sizeof(float)),
-                 nodeData.data(),
-                 GL_STATIC_DRAW);
-
-    if (!outNodeTex)
-        glGenTextures(1, &outNodeTex);
-    glBindTexture(GL_TEXTURE_BUFFER, outNodeTex);
-    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, outNodeBuf);
-
-    // Pack triangles: 3 texels per tri
-    //  tex0 = [v0.x, v0.y, v0.z, 0]
-    //  tex1 = [e1.x, e1.y, e1.z, 0]
-    //  tex2 = [e2.x, e2.y, e2.z, 0]
-    std::vector<float> triData;
-    triData.reserve(tris.size() * 12);
-    for (const auto &t: tris) {
-        triData.push_back(t.v0.x);
-        triData.push_back(t.v0.y);
-        triData.push_back(t.v0.z);
-        triData.push_back(0.0f);
-
-        triData.push_back(t.e1.x);
-        triData.push_back(t.e1.y);
-        triData.push_back(t.e1.z);
-        triData.push_back(0.0f);
-
-        triData.push_back(t.e2.x);
-        triData.push_back(t.e2.y);
-        triData.push_back(t.e2.z);
-        triData.push_back(0.0f);
-    }
-
-    if (!outTriBuf)
-        glGenBuffers(1, &outTriBuf);
-    glBindBuffer(GL_TEXTURE_BUFFER, outTriBuf);
-    glBufferData(GL_TEXTURE_BUFFER,
-                 static_cast<GLsizeiptr>(triData.size() * sizeof(float)),
-                 triData.data(),
-                 GL_STATIC_DRAW);
-
-    if (!outTriTex)
-        glGenTextures(1, &outTriTex);
-    glBindTexture(GL_TEXTURE_BUFFER, outTriTex);
-    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, outTriBuf);
+        const double rel = half_area(n.bMin, n.bMax) / rootArea;
+        if (n.isLeaf())
+            cost += rel * settings.intersectCost * n.count;
+        else
+            cost += rel * settings.traversalCost;
+    }
+    return static_cast<float>(cost);
+}
 
-    glBindBuffer(GL_TEXTURE_BUFFER, 0);
-    glBindTexture(GL_TEXTURE_BUFFER, 0);
+// -------- Treelet optimization -----------
+// Karras & Aila style restructuring: around every inner node, grow a treelet
+// of up to kTreeletLeaves subtrees (always opening the largest one) and
+// replace its inner nodes by the SAH-optimal topology over those subtrees,
+// found by dynamic programming over all subsets. Subtree costs are kept
+// up to date in post-order, so a pass never makes the tree worse.
+static constexpr int kTreeletLeaves = 7;
+
+// Index of the only set bit of a treelet leaf mask.
+static int treelet_leaf(const int mask) {
+    int i = 0;
+    while (!(mask & (1 << i))) ++i;
+    return i;
 }
 
-// -------- Extract triangles from Model -----------
-// Flattens a LearnOpenGL-style Model into CPU_Triangle list, applying M.
-void gather_model_triangles(const Model &model,
-                            const glm::mat4 &M,
-                            std::vector<CPU_Triangle> &outTris) {
-    // Assumes:
-    //  mesh.vertices[i].Position (glm::vec3)
-    //  mesh.indices (uint32_t triplets)
-    for (const auto &mesh: model.meshes) {
-        const auto &V = mesh.vertices;
-        const auto &I = mesh.indices;
-        for (size_t k = 0; k + 2 < I.size(); k += 3) {
-            auto p0 = glm::vec3(M * glm::vec4(V[I[k]].Position, 1.0f));
-            auto p1 = glm::vec3(M * glm::vec4(V[I[k + 1]].Position, 1.0f));
-            auto p2 = glm::vec3(M * glm::vec4(V[I[k + 2]].Position, 1.0f));
+// Pointer view of the tree being optimized; node indices are stable until
+// the final re-linearization.
+struct TreeletTree {
+    std::vector<BVHNode> &nodes;
+    std::vector<float> cost; // SAH cost of each subtree (unnormalized)
+    float traversalCost;
+    float intersectCost;
+
+    void updateCost(const int n) {
+        const BVHNode &node = nodes[n];
+        const float area = half_area(node.bMin, node.bMax);
+        cost[n] = node.isLeaf()
+                      ? intersectCost * area * static_cast<float>(node.count)
+                      : traversalCost * area + cost[node.left] + cost[node.right];
+    }
+};
+
+// Restructures the treelet rooted at root. Returns true if it got cheaper.
+static bool optimize_treelet(TreeletTree &tree, const int root) {
+    std::vector<BVHNode> &nodes = tree.nodes;
+
+    // Grow the treelet: repeatedly open the largest inner subtree.
+    int leaves[kTreeletLeaves] = {nodes[root].left, nodes[root].right};
+    int leafCount = 2;
+    int inner[kTreeletLeaves - 1] = {root};
+    int innerCount = 1;
+    while (leafCount < kTreeletLeaves) {
+        int pick = -1;
+        float pickArea = -1.0f;
+        for (int i = 0; i < leafCount; ++i) {
+            const BVHNode &n = nodes[leaves[i]];
+            const float area = half_area(n.bMin, n.bMax);
+            if (!n.isLeaf() && area > pickArea) {
+                pick = i;
+                pickArea = area;
+            }
+        }
+        if (pick < 0) break;
+        const int opened = leaves[pick];
+        inner[innerCount++] = opened;
+        leaves[pick] = nodes[opened].left;
+        leaves[leafCount++] = nodes[opened].right;
+    }
+    if (leafCount < 3) return false;
+
+    // Optimal cost of every subset of treelet leaves.
+    const int subsets = 1 << leafCount;
+    std::vector<glm::vec3> sMin(subsets, glm::vec3(1e30f)), sMax(subsets, glm::vec3(-1e30f));
+    std::vector<float> best(subsets, 0.0f);
+    std::vector<int> partition(subsets, 0);
+    for (int s = 1; s < subsets; ++s) {
+        const int low = s & -s;
+        if (s == low) {
+            const int i = treelet_leaf(s);
+            sMin[s] = nodes[leaves[i]].bMin;
+            sMax[s] = nodes[leaves[i]].bMax;
+            best[s] = tree.cost[leaves[i]];
+            continue;
+        }
+        sMin[s] = glm::min(sMin[low], sMin[s ^ low]);
+        sMax[s] = glm::max(sMax[low], sMax[s ^ low]);
 
-            CPU_Triangle T{};
-            T.v0 = p0;
-            T.e1 = p1 - p0;
-            T.e2 = p2 - p0;
-            outTris.push_back(T);
+        // Each unordered split once: the side holding the lowest leaf.
+        float bestSplit = 1e30f;
+        for (int p = (s - 1) & s; p > 0; p = (p - 1) & s) {
+            if (!(p & low)) continue;
+            const float c = best[p] + best[s ^ p];
+            if (c < bestSplit) {
+                bestSplit = c;
+                partition[s] = p;
+            }
         }
+        best[s] = tree.traversalCost * half_area(sMin[s], sMax[s]) + bestSplit;
     }
+
+    const int all = subsets - 1;
+    if (best[all] >= tree.cost[root] * (1.0f - 1e-5f)) return false;
+
+    // Rebuild the treelet top-down, reusing its inner nodes (root stays put).
+    int nextInner = 1;
+    auto emit = [&](auto &self, const int s, const int slot) -> int {
+        if ((s & (s - 1)) == 0) return leaves[treelet_leaf(s)];
+        const int n = slot >= 0 ? slot : inner[nextInner++];
+        const int left = self(self, partition[s], -1);
+        const int right = self(self, s ^ partition[s], -1);
+        nodes[n].left = left;
+        nodes[n].right = right;
+        nodes[n].first = -1;
+        nodes[n].count = 0;
+        nodes[n].bMin = sMin[s];
+        nodes[n].bMax = sMax[s];
+        tree.updateCost(n);
+        return n;
+    };
+    emit(emit, all, root);
+    return true;
 }
 
-// High-level helper: load a model, build its BVH, and upload to GPU.
-bool rebuild_bvh_from_model_path(const char *path, const glm::mat4 &modelTransform, std::unique_ptr<Model> &bvhModel,
-                                 int &outNodeCount, int &outTriCount, BVHHandle &handle) {
-    // Drop previous GPU resources (if any).
-    handle.release();
+// -------- Node layouts -----------
+// Node order of each layout, as old indices. Every order lists a parent
+// before its children.
+static void depth_first_order(const std::vector<BVHNode> &nodes, std::vector<int> &order) {
+    std::vector<int> stack{0};
+    while (!stack.empty()) {
+        const int n = stack.back();
+        stack.pop_back();
+        order.push_back(n);
+        if (!nodes[n].isLeaf()) {
+            stack.push_back(nodes[n].right);
+            stack.push_back(nodes[n].left);
+        }
+    }
+}
 
-    // Reload model from disk.
-    bvhModel = std::make_unique<Model>(path);
-    if (!bvhModel || bvhModel->meshes.empty()) {
-        bvhModel.reset();
-        outNodeCount = 0;
-        outTriCount = 0;
+// Depth-first over sibling pairs: both children are placed when their
+// parent is expanded, so the pair the stack traversal fetches together
+// is adjacent.
+static void sibling_pair_order(const std::vector<BVHNode> &nodes, std::vector<int> &order) {
+    order.push_back(0);
+    std::vector<int> stack{0};
+    while (!stack.empty()) {
+        const BVHNode &node = nodes[stack.back()];
+        stack.pop_back();
+        if (node.isLeaf()) continue;
+        order.push_back(node.left);
+        order.push_back(node.right);
+        stack.push_back(node.right);
+        stack.push_back(node.left);
+    }
+}
+
+static void breadth_first_order(const std::vector<BVHNode> &nodes, std::vector<int> &order) {
+    order.push_back(0);
+    for (size_t i = 0; i < order.size(); ++i) {
+        const BVHNode &node = nodes[order[i]];
+        if (node.isLeaf()) continue;
+        order.push_back(node.left);
+        order.push_back(node.right);
+    }
+}
+
+// van Emde Boas: the top half of the levels below root is laid out
+// recursively, then each subtree hanging off it. Nodes levels deep below
+// root are not placed but returned in frontier.
+static void van_emde_boas_order(const std::vector<BVHNode> &nodes, const std::vector<int> &height, const int root,
+                                const int levels, std::vector<int> &order, std::vector<int> &frontier) {
+    const BVHNode &node = nodes[root];
+    if (levels == 1 || node.isLeaf()) {
+        order.push_back(root);
+        if (!node.isLeaf()) {
+            frontier.push_back(node.left);
+            frontier.push_back(node.right);
+        }
+        return;
+    }
+    const int top = levels / 2;
+    std::vector<int> middle;
+    van_emde_boas_order(nodes, height, root, top, order, middle);
+    for (const int m: middle)
+        van_emde_boas_order(nodes, height, m, std::min(levels - top, height[m]), order, frontier);
+}
+
+// Subtree clustering (Yoon and Manocha 2006): each cluster grows from its
+// root by always adding the candidate with the largest surface area, the
+// node a ray entering the cluster is most likely to visit next. Candidates
+// left over when the cluster is full become the roots of later clusters.
+static void clustered_order(const std::vector<BVHNode> &nodes, std::vector<int> &order) {
+    std::vector<int> roots{0}, candidates;
+    while (!roots.empty()) {
+        candidates.assign(1, roots.back());
+        roots.pop_back();
+        for (int placed = 0; placed < kBvhClusterNodes && !candidates.empty(); ++placed) {
+            size_t best = 0;
+            float bestArea = -1.0f;
+            for (size_t k = 0; k < candidates.size(); ++k) {
+                const BVHNode &c = nodes[candidates[k]];
+                const float area = half_area(c.bMin, c.bMax);
+                if (area > bestArea) {
+                    best = k;
+                    bestArea = area;
+                }
+            }
+            const int n = candidates[best];
+            candidates.erase(candidates.begin() + static_cast<std::ptrdiff_t>(best));
+            order.push_back(n);
+            if (!nodes[n].isLeaf()) {
+                candidates.push_back(nodes[n].left);
+                candidates.push_back(nodes[n].right);
+            }
+        }
+        // Reversed so the first leftover candidate is clustered next.
+        roots.insert(roots.end(), candidates.rbegin(), candidates.rend());
+    }
+}
+
+void reorder_bvh(std::vector<BVHNode> &nodes, std::vector<CPU_Triangle> &tris, const BVHLayout layout,
+                 std::vector<int> *sourceIndex) {
+    if (nodes.empty()) return;
+
+    std::vector<int> order;
+    order.reserve(nodes.size());
+    switch (layout) {
+        case BVHLayout::DepthFirst: depth_first_order(nodes, order);
+            break;
+        case BVHLayout::SiblingPairs: sibling_pair_order(nodes, order);
+            break;
+        case BVHLayout::BreadthFirst: breadth_first_order(nodes, order);
+            break;
+        case BVHLayout::VanEmdeBoas: {
+            // Levels of every subtree (leaf = 1); children come after their parent.
+            std::vector<int> height(nodes.size(), 1);
+            for (size_t n = nodes.size(); n-- > 0;) {
+                const BVHNode &node = nodes[n];
+                if (!node.isLeaf()) height[n] = 1 + std::max(height[node.left], height[node.right]);
+            }
+            std::vector<int> frontier;
+            van_emde_boas_order(nodes, height, 0, height[0], order, frontier);
+            break;
+        }
+        case BVHLayout::Clustered: clustered_order(nodes, order);
+            break;
+    }
+
+    std::vector<int> newIndex(nodes.size(), -1);
+    for (size_t i = 0; i < order.size(); ++i) newIndex[order[i]] = static_cast<int>(i);
+
+    // Triangles follow the leaves in their new order.
+    std::vector<BVHNode> outNodes;
+    outNodes.reserve(order.size());
+    std::vector<CPU_Triangle> outTris;
+    outTris.reserve(tris.size());
+    std::vector<int> outSource;
+    if (sourceIndex) outSource.reserve(sourceIndex->size());
+    for (const int n: order) {
+        BVHNode node = nodes[n];
+        if (node.isLeaf()) {
+            node.first = static_cast<int>(outTris.size());
+            for (int i = nodes[n].first; i < nodes[n].first + nodes[n].count; ++i) {
+                outTris.push_back(tris[i]);
+                if (sourceIndex) outSource.push_back((*sourceIndex)[i]);
+            }
+        } else {
+            node.left = newIndex[node.left];
+            node.right = newIndex[node.right];
+        }
+        outNodes.push_back(node);
+    }
+
+    nodes = std::move(outNodes);
+    tris = std::move(outTris);
+    if (sourceIndex) *sourceIndex = std::move(outSource);
+}
+
+bool optimize_bvh(std::vector<BVHNode> &nodes, std::vector<CPU_Triangle> &tris, const BVHBuildSettings &settings,
+                  const double budgetMs, BVHOptimizeStats *outStats, std::vector<int> *sourceIndex) {
+    using Clock = std::chrono::steady_clock;
+    const auto t0 = Clock::now();
+    BVHOptimizeStats stats;
+    stats.sahBefore = stats.sahAfter = bvh_sah_cost(nodes, settings);
+    if (nodes.size() < 5 || budgetMs <= 0.0) {
+        if (outStats) *outStats = stats;
         return false;
     }
 
-    // Extract triangles in world/model space.
-    std::vector<CPU_Triangle> triCPU;
-    gather_model_triangles(*bvhModel, modelTransform, triCPU);
+    TreeletTree tree{nodes, std::vector<float>(nodes.size(), 0.0f), settings.traversalCost, settings.intersectCost};
+
+    // Post-order of the current topology (children before parents).
+    std::vector<int> order, stack;
+    order.reserve(nodes.size());
+    auto postOrder = [&] {
+        order.clear();
+        stack.assign(1, 0);
+        while (!stack.empty()) {
+            const int n = stack.back();
+            stack.pop_back();
+            order.push_back(n);
+            if (!nodes[n].isLeaf()) {
+                stack.push_back(nodes[n].left);
+                stack.push_back(nodes[n].right);
+            }
+        }
+        std::reverse(order.begin(), order.end());
+    };
+
+    bool outOfTime = false;
+    int visited = 0;
+    while (!outOfTime) {
+        postOrder();
+        int restructured = 0;
+        for (const int n: order) {
+            tree.updateCost(n);
+            if (nodes[n].isLeaf()) continue;
+            if (++visited % 64 == 0 &&
+                std::chrono::duration<double, std::milli>(Clock::now() - t0).count() > budgetMs) {
+                outOfTime = true;
+                break;
+            }
+            if (optimize_treelet(tree, n)) ++restructured;
+        }
+        stats.treelets += restructured;
+        if (!outOfTime) ++stats.passes;
+        if (restructured == 0) break;
+    }
 
-    // Build BVH on CPU.
-    const std::vector<BVHNode> nodesCPU = build_bvh(triCPU);
-    outNodeCount = static_cast<int>(nodesCPU.size());
-    outTriCount = static_cast<int>(triCPU.size());
+    reorder_bvh(nodes, tris, BVHLayout::DepthFirst, sourceIndex);
+
+    stats.sahAfter = bvh_sah_cost(nodes, settings);
+    stats.optimizeMs = std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+    if (outStats) *outStats = stats;
+    return stats.treelets > 0;
+}
 
-    // Upload to GPU as texture buffers.
-    upload_bvh_tbo(nodesCPU, triCPU, handle.nodeTex, handle.nodeBuf, handle.triTex, handle.triBuf);
+// -------- Refit (same topology, new vertex positions) -----------
+// Copies the new triangles into leaf order, then recomputes bounds with one
+// reverse sweep: in pre-order every child is stored after its parent.
+bool refit_bvh(BVHGeometry &geom, const std::vector<CPU_Triangle> &sourceTris, const BVHBuildSettings &settings,
+               BVHRefitStats *outStats) {
+    const auto t0 = std::chrono::steady_clock::now();
+    const int triCount = static_cast<int>(geom.tris.size());
+    if (geom.nodes.empty() || geom.sourceIndex.size() != geom.tris.size())
+        return false;
+    // Spatial splits duplicate triangles, so only the index range is checked.
+    const int sourceCount = static_cast<int>(sourceTris.size());
+    if (!std::all_of(geom.sourceIndex.begin(), geom.sourceIndex.end(),
+                     [sourceCount](const int i) { return i >= 0 && i < sourceCount; }))
+        return false;
+
+    // Triangles: copy in parallel, tracking the changed range per chunk.
+    const int threads = resolve_thread_count(settings);
+    const int chunks = triCount >= kParallelRangeMin ? threads : 1;
+    std::vector<int> chunkLo(chunks, triCount), chunkHi(chunks, 0);
+    parallel_chunks(0, triCount, chunks, [&](const int chunk, const int cb, const int ce) {
+        for (int i = cb; i < ce; ++i) {
+            const CPU_Triangle &src = sourceTris[geom.sourceIndex[i]];
+            CPU_Triangle &dst = geom.tris[i];
+            if (src.v0 == dst.v0 && src.e1 == dst.e1 && src.e2 == dst.e2) continue;
+            dst = src;
+            chunkLo[chunk] = std::min(chunkLo[chunk], i);
+            chunkHi[chunk] = i + 1;
+        }
+    });
+    int triLo = triCount, triHi = 0;
+    for (int c = 0; c < chunks; ++c) {
+        triLo = std::min(triLo, chunkLo[c]);
+        triHi = std::max(triHi, chunkHi[c]);
+    }
+
+    // Nodes: bottom-up bounds; only leaves touching changed triangles can
+    // start a change, but any node may end up with identical bounds again.
+    int nodeLo = static_cast<int>(geom.nodes.size()), nodeHi = 0;
+    for (int i = static_cast<int>(geom.nodes.size()) - 1; i >= 0; --i) {
+        BVHNode &node = geom.nodes[i];
+        glm::vec3 bMin(1e30f), bMax(-1e30f);
+        if (node.isLeaf()) {
+            for (int k = node.first; k < node.first + node.count; ++k) {
+                bMin = glm::min(bMin, tri_min(geom.tris[k]));
+                bMax = glm::max(bMax, tri_max(geom.tris[k]));
+            }
+        } else {
+            bMin = glm::min(geom.nodes[node.left].bMin, geom.nodes[node.right].bMin);
+            bMax = glm::max(geom.nodes[node.left].bMax, geom.nodes[node.right].bMax);
+        }
+        if (bMin != node.bMin || bMax != node.bMax) {
+            node.bMin = bMin;
+            node.bMax = bMax;
+            nodeLo = i;
+            nodeHi = std::max(nodeHi, i + 1);
+        }
+    }
+
+    if (outStats) {
+        const auto t1 = std::chrono::steady_clock::now();
+        outStats->refitMs = std::chrono::duration<double, std::milli>(t1 - t0).count();
+        outStats->sahCost = bvh_sah_cost(geom.nodes, settings);
+        outStats->sahRatio = geom.builtSahCost > 0.0f ? outStats->sahCost / geom.builtSahCost : 1.0f;
+        outStats->dirtyNodeBegin = nodeHi > nodeLo ? nodeLo : 0;
+        outStats->dirtyNodeEnd = nodeHi > nodeLo ? nodeHi : 0;
+        outStats->dirtyTriBegin = triHi > triLo ? triLo : 0;
+        outStats->dirtyTriEnd = triHi > triLo ? triHi : 0;
+    }
+    return true;
+}
+
+// -------- Upload to TBOs (GL_TEXTURE_BUFFER) -----------
+// Skip (miss) links of a tree rooted at node 0: skip[left] = right and
+// skip[right] = skip[parent]. Walked from the root rather than in array
+// order, so trees edited by BVHDynamic (children before their parent,
+// unused slots) get the same links; unreachable slots keep -1. Refits keep
+// the topology and therefore the links.
+static std::vector<int> skip_links(const BVHNode *nodes, const size_t count) {
+    std::vector<int> skip(count, -1);
+    if (count == 0) return skip;
+    std::vector<int> stack{0};
+    while (!stack.empty()) {
+        const int i = stack.back();
+        stack.pop_back();
+        const BVHNode &n = nodes[i];
+        if (n.isLeaf()) continue;
+        skip[n.left] = n.right;
+        skip[n.right] = skip[i];
+        stack.push_back(n.left);
+        stack.push_back(n.right);
+    }
+    return skip;
+}
+
+static int32_t float_bits(const float f) {
+    int32_t bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+
+// Packers write one item to dst, which may be mapped GL memory (write
+// only, no alignment beyond 4 bytes assumed).
+
+// Pack nodes: 2 texels per node (RGBA32I each, bounds as float bits)
+//  tex0 = [bMin.x, bMin.y, bMin.z, inner ? left  : first]
+//  tex1 = [bMax.x, bMax.y, bMax.z, inner ? right : -count]
+// A negative tex1.w marks a leaf. Indices stay exact up to 2^31.
+// nodeOffset/triOffset rebase a BLAS that is stored after other trees.
+static constexpr size_t kNodeBytes = 8 * sizeof(int32_t);
+
+static void pack_node(const BVHNode &n, void *dst, const int nodeOffset = 0, const int triOffset = 0) {
+    const bool leaf = n.isLeaf();
+    const int32_t words[8] = {
+        float_bits(n.bMin.x), float_bits(n.bMin.y), float_bits(n.bMin.z),
+        leaf ? n.first + triOffset : n.left + nodeOffset,
+        float_bits(n.bMax.x), float_bits(n.bMax.y), float_bits(n.bMax.z),
+        leaf ? -n.count : n.right + nodeOffset,
+    };
+    std::memcpy(dst, words, sizeof(words));
+}
+
+// Pack skip links: 1 R32I texel per node, rebased like the nodes; only
+// read by the stackless traversal.
+static void pack_skips(const BVHNode *nodes, const size_t count, std::vector<int32_t> &out, const int nodeOffset = 0) {
+    for (const int skip: skip_links(nodes, count)) out.push_back(skip < 0 ? -1 : skip + nodeOffset);
+}
+
+// Pack triangles: 3 texels per tri (float bits, read as RGBA32UI)
+//  tex0 = [v0.x, v0.y, v0.z, 0]
+//  tex1 = [e1.x, e1.y, e1.z, 0]
+//  tex2 = [e2.x, e2.y, e2.z, 0]
+static void pack_tri(const CPU_Triangle &t, void *dst) {
+    const float words[12] = {
+        t.v0.x, t.v0.y, t.v0.z, 0.0f,
+        t.e1.x, t.e1.y, t.e1.z, 0.0f,
+        t.e2.x, t.e2.y, t.e2.z, 0.0f,
+    };
+    std::memcpy(dst, words, sizeof(words));
+}
+
+// Pack the world-to-unit-triangle transform (BVHTriTest::Affine), one row
+// per texel, such that p = v0 + u * e1 + v * e2 + w * n (n = e1 x e2) has
+//  u = dot(row0.xyz, p) + row0.w,  v = ... row1,  w = ... row2.
+// The rows of [e1 e2 n]^-1 are cross products over its determinant |n|^2,
+// so row 2 is n / |n|^2: the normal comes for free. Computed in double;
+// degenerate triangles pack zeros, which the shader never reports as hit.
+static void pack_tri_affine(const CPU_Triangle &t, void *dst) {
+    const glm::dvec3 v0(t.v0), e1(t.e1), e2(t.e2);
+    const glm::dvec3 n = glm::cross(e1, e2);
+    const double det = glm::dot(n, n);
+    float words[12] = {};
+    if (det > 0.0) {
+        const glm::dvec3 rows[3] = {glm::cross(e2, n) / det, glm::cross(n, e1) / det, n / det};
+        for (int r = 0; r < 3; ++r) {
+            words[4 * r + 0] = static_cast<float>(rows[r].x);
+            words[4 * r + 1] = static_cast<float>(rows[r].y);
+            words[4 * r + 2] = static_cast<float>(rows[r].z);
+            words[4 * r + 3] = static_cast<float>(-glm::dot(rows[r], v0));
+        }
+    }
+    std::memcpy(dst, words, sizeof(words));
+}
+
+// Float triangle packer for the handle's test.
+using TriPackFn = void (*)(const CPU_Triangle &, void *);
+
+static TriPackFn tri_packer(const BVHTriTest test) {
+    return test == BVHTriTest::Affine ? pack_tri_affine : pack_tri;
+}
+
+// -------- Compressed triangles -----------
+// Lattice cell of p (rounded), as an offset from quant.origin.
+static glm::ivec3 quant_cell(const BVHTriQuant &quant, const glm::vec3 &p) {
+    constexpr int kMaxCell = (1 << BVHTriQuant::kBits) - 1;
+    glm::ivec3 c;
+    for (int a = 0; a < 3; ++a) {
+        const int cell = static_cast<int>(std::lround(p[a] / quant.scale)) - quant.origin[a];
+        c[a] = std::clamp(cell, 0, kMaxCell);
+    }
+    return c;
+}
+
+// Same expression as the shader: exact, since origin + cell < 2^24.
+static glm::vec3 quant_decode(const BVHTriQuant &quant, const glm::ivec3 &c) {
+    return glm::vec3(quant.origin + c) * quant.scale;
+}
+
+bool BVHTriQuant::covers(const glm::vec3 &lo, const glm::vec3 &hi) const {
+    if (!enabled()) return false;
+    constexpr float kMaxCell = static_cast<float>((1 << kBits) - 1);
+    const glm::vec3 absMax = glm::max(glm::abs(lo), glm::abs(hi));
+    const float maxAbs = std::max(absMax.x, std::max(absMax.y, absMax.z));
+    for (int a = 0; a < 3; ++a) {
+        if (std::floor(lo[a] / scale) < static_cast<float>(origin[a])) return false;
+        if (std::ceil(hi[a] / scale) > static_cast<float>(origin[a]) + kMaxCell) return false;
+    }
+    return maxAbs <= std::ldexp(scale, 22);
+}
+
+BVHTriQuant make_bvh_tri_quant(const glm::vec3 &lo, const glm::vec3 &hi) {
+    const glm::vec3 extent = glm::max(hi - lo, glm::vec3(0.0f));
+    const glm::vec3 absMax = glm::max(glm::abs(lo), glm::abs(hi));
+    const float maxExtent = std::max(extent.x, std::max(extent.y, extent.z));
+    const float maxAbs = std::max(absMax.x, std::max(absMax.y, absMax.z));
+
+    // Span the box in kBits bits (two cells of slack for rounding at both
+    // ends) and keep absolute cell indices below 2^22.
+    const float minScale = std::max({maxExtent / static_cast<float>((1 << BVHTriQuant::kBits) - 2),
+                                     std::ldexp(maxAbs, -22),
+                                     1e-30f});
+    int e = 0;
+    std::frexp(minScale, &e); // minScale <= 2^e
+
+    BVHTriQuant quant;
+    quant.scale = std::ldexp(1.0f, e);
+    for (int a = 0; a < 3; ++a) {
+        quant.origin[a] = static_cast<int>(std::floor(lo[a] / quant.scale));
+    }
+    return quant;
+}
+
+glm::vec3 quantize_bvh_point(const BVHTriQuant &quant, const glm::vec3 &p) {
+    return quant_decode(quant, quant_cell(quant, p));
+}
+
+void quantize_bvh_triangles(std::vector<CPU_Triangle> &tris, const BVHTriQuant &quant) {
+    for (auto &t: tris) {
+        const glm::vec3 p0 = quantize_bvh_point(quant, t.v0);
+        const glm::vec3 p1 = quantize_bvh_point(quant, t.v0 + t.e1);
+        const glm::vec3 p2 = quantize_bvh_point(quant, t.v0 + t.e2);
+        t.v0 = p0;
+        t.e1 = p1 - p0;
+        t.e2 = p2 - p0;
+    }
+}
+
+void bvh_triangle_bounds(const std::vector<CPU_Triangle> &tris, glm::vec3 &outMin, glm::vec3 &outMax) {
+    outMin = glm::vec3(1e30f);
+    outMax = glm::vec3(-1e30f);
+    for (const auto &t: tris) {
+        outMin = glm::min(outMin, tri_min(t));
+        outMax = glm::max(outMax, tri_max(t));
+    }
+}
+
+// Pack a snapped triangle: 2 RGB32UI texels, 21 bits per coordinate.
+// Each vertex takes two words: x | y << 21 and y >> 11 | z << 10.
+static void pack_tri_quant(const CPU_Triangle &t, const BVHTriQuant &quant, void *dst) {
+    const glm::vec3 verts[3] = {t.v0, t.v0 + t.e1, t.v0 + t.e2};
+    uint32_t words[6];
+    for (int k = 0; k < 3; ++k) {
+        const glm::uvec3 c(quant_cell(quant, verts[k]));
+        words[2 * k + 0] = c.x | c.y << 21;
+        words[2 * k + 1] = c.y >> 11 | c.z << 10;
+    }
+    std::memcpy(dst, words, sizeof(words));
+}
+
+// -------- Indexed triangles -----------
+// Corners are rebuilt as v0 + e1 and v0 + e2, which can round differently
+// from the v0 of another triangle sharing the vertex, so corners within
+// kWeldUlps ulps of the largest coordinate are welded rather than compared
+// bitwise. Candidates are looked up in a hash of cells kWeldCellUlps ulps
+// wide; a corner close to a cell face also checks the cell across it.
+static constexpr int kWeldUlps = 8;
+static constexpr int kWeldCellUlps = 128;
+
+struct VertexWelder {
+    static constexpr uint32_t kNone = ~uint32_t(0); ///< Ends a cell's chain.
+
+    float cell = 1.0f; ///< Cell size.
+    float tol = 0.0f; ///< Largest per-axis distance between welded corners.
+    std::unordered_map<uint64_t, uint32_t> cells; ///< Newest vertex of each occupied cell.
+    std::vector<uint32_t> next; ///< Per vertex: the previous vertex in its cell, or kNone.
+    std::vector<glm::vec3> verts; ///< Welded vertices, in order of first use.
+};
+
+static uint64_t weld_cell_key(const glm::ivec3 &c) {
+    constexpr uint64_t mask = (uint64_t(1) << 21) - 1;
+    return (static_cast<uint64_t>(c.x) & mask) | (static_cast<uint64_t>(c.y) & mask) << 21 |
+           (static_cast<uint64_t>(c.z) & mask) << 42;
+}
+
+// Index of the vertex p is welded to (the closest one within tol); appends
+// p if none is close enough. Every vertex of a cell is a candidate, not just
+// its first one, so dense or far-off meshes share as much as sparse ones.
+static uint32_t weld_vertex(VertexWelder &w, const glm::vec3 &p) {
+    const glm::vec3 f = p / w.cell;
+    const glm::vec3 fl = glm::floor(f);
+    const glm::ivec3 c(fl);
+    const float edge = w.tol / w.cell;
+    glm::ivec3 step(0);
+    for (int a = 0; a < 3; ++a) step[a] = f[a] - fl[a] < edge ? -1 : f[a] - fl[a] > 1.0f - edge ? 1 : 0;
+
+    // Own cell (m = 0) and the neighbours across the faces p is close to.
+    uint32_t best = VertexWelder::kNone;
+    float bestDist = w.tol;
+    for (int m = 0; m < 8; ++m) {
+        if (((m & 1) && !step.x) || ((m & 2) && !step.y) || ((m & 4) && !step.z)) continue;
+        const glm::ivec3 n = c + glm::ivec3(m & 1 ? step.x : 0, m & 2 ? step.y : 0, m & 4 ? step.z : 0);
+        const auto it = w.cells.find(weld_cell_key(n));
+        if (it == w.cells.end()) continue;
+        for (uint32_t v = it->second; v != VertexWelder::kNone; v = w.next[v]) {
+            const glm::vec3 d = glm::abs(w.verts[v] - p);
+            const float dist = std::max(d.x, std::max(d.y, d.z));
+            if (dist <= bestDist) {
+                best = v;
+                bestDist = dist;
+                if (dist == 0.0f) return best;
+            }
+        }
+    }
+    if (best != VertexWelder::kNone) return best;
+
+    const auto id = static_cast<uint32_t>(w.verts.size());
+    w.verts.push_back(p);
+    auto [it, inserted] = w.cells.try_emplace(weld_cell_key(c), id);
+    w.next.push_back(inserted ? VertexWelder::kNone : it->second);
+    it->second = id;
+    return id;
+}
+
+// Welds the corners of triangles [0, triCount) (tri(i) returns triangle i)
+// into outVerts and writes three vertex indices per triangle to outIndices.
+template<typename GetTri>
+static void index_triangles(const size_t triCount, GetTri &&tri, std::vector<glm::vec3> &outVerts,
+                            std::vector<uint32_t> &outIndices) {
+    float maxAbs = 0.0f;
+    for (size_t i = 0; i < triCount; ++i) {
+        const CPU_Triangle &t = tri(i);
+        const glm::vec3 hi = glm::max(glm::max(glm::abs(t.v0), glm::abs(t.v0 + t.e1)), glm::abs(t.v0 + t.e2));
+        maxAbs = std::max(maxAbs, std::max(hi.x, std::max(hi.y, hi.z)));
+    }
+    const int exponent = maxAbs > 0.0f ? std::ilogb(maxAbs) : 0;
+    const float ulp = std::ldexp(1.0f, exponent - 23);
+
+    VertexWelder w;
+    w.cell = ulp * kWeldCellUlps;
+    w.tol = ulp * kWeldUlps;
+    w.cells.reserve(triCount);
+    w.verts.reserve(triCount / 2 + 3);
+    w.next.reserve(triCount / 2 + 3);
+    outIndices.resize(triCount * 3);
+    for (size_t i = 0; i < triCount; ++i) {
+        const CPU_Triangle &t = tri(i);
+        outIndices[3 * i + 0] = weld_vertex(w, t.v0);
+        outIndices[3 * i + 1] = weld_vertex(w, t.v0 + t.e1);
+        outIndices[3 * i + 2] = weld_vertex(w, t.v0 + t.e2);
+    }
+    outVerts = std::move(w.verts);
+}
+
+// Creates (if needed) and fills one buffer + buffer texture of the given format.
+static void upload_texture_buffer(const void *data, const size_t bytes, const GLenum format, GLuint &tex,
+                                  GLuint &buf) {
+    if (!buf)
+        glGenBuffers(1, &buf);
+    glBindBuffer(GL_TEXTURE_BUFFER, buf);
+    glBufferData(GL_TEXTURE_BUFFER, static_cast<GLsizeiptr>(bytes), data, GL_DYNAMIC_DRAW);
+
+    if (!tex)
+        glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_BUFFER, tex);
+    glTexBuffer(GL_TEXTURE_BUFFER, format, buf);
+}
+
+// Creates (if needed) and fills one buffer + RGBA32F buffer texture.
+static void upload_texture_buffer(const std::vector<float> &data, GLuint &tex, GLuint &buf) {
+    upload_texture_buffer(data.data(), data.size() * sizeof(float), GL_RGBA32F, tex, buf);
+}
+
+// -------- Texture buffer limits -----------
+// GL_MAX_TEXTURE_BUFFER_SIZE is 2^27 texels on most desktop drivers but may
+// be as low as 2^16. Nodes and triangles are paged at the largest power of
+// two under it; everything else must fit in one buffer.
+static constexpr int kMaxPageShift = 28; // kBvhMaxPages pages of 2^28 texels keep indices in an int
+static constexpr int64_t kMinTexelLimit = 16; // keeps every item within two pages
+
+static int64_t texelLimit = int64_t(1) << 27;
+static int pageShift = 27;
+
+void set_bvh_texel_limit(int64_t maxTexels) {
+    if (maxTexels <= 0) {
+        GLint64 limit = 0;
+        glGetInteger64v(GL_MAX_TEXTURE_BUFFER_SIZE, &limit);
+        maxTexels = limit;
+    }
+    texelLimit = std::max(maxTexels, kMinTexelLimit);
+    pageShift = 0;
+    while (pageShift < kMaxPageShift && (int64_t(2) << pageShift) <= texelLimit) ++pageShift;
+}
+
+int64_t bvh_texel_limit() {
+    return texelLimit;
+}
+
+int bvh_page_texels() {
+    return 1 << pageShift;
+}
+
+int bvh_page_shift() {
+    return pageShift;
+}
+
+// Texels of one node, triangle or wide node.
+static constexpr int64_t kNodeTexels = 2;
+
+static int64_t wide_node_texels(const int width) {
+    return 1 + 3 * width / 4;
+}
+
+bool bvh_fits_texture_limits(const size_t nodeCount, const size_t triCount, const int width, const bool compressTris,
+                             const size_t instanceCount, std::string *outReason) {
+    const int64_t paged = int64_t(kBvhMaxPages) * bvh_page_texels();
+    auto refuse = [&](const char *what, const int64_t texels, const int64_t limit) {
+        if (outReason)
+            *outReason = std::string(what) + " need " + std::to_string(texels) + " texels, limit " +
+                         std::to_string(limit);
+        return false;
+    };
+
+    const int64_t triTexels = static_cast<int64_t>(triCount) * (compressTris ? 2 : 3);
+    if (triTexels > paged) return refuse("triangles", triTexels, paged);
+    if (width <= 2) {
+        const int64_t nodeTexels = static_cast<int64_t>(nodeCount) * kNodeTexels;
+        if (nodeTexels > paged) return refuse("nodes", nodeTexels, paged);
+        if (static_cast<int64_t>(nodeCount) > texelLimit)
+            return refuse("skip links", static_cast<int64_t>(nodeCount), texelLimit);
+    } else {
+        // Every wide node replaces at least one inner binary node.
+        const int64_t wideTexels = wide_node_texels(width) * static_cast<int64_t>(nodeCount / 2 + 1);
+        if (wideTexels > texelLimit) return refuse("wide nodes", wideTexels, texelLimit);
+    }
+    const int64_t instTexels = static_cast<int64_t>(instanceCount) * 4;
+    if (instTexels > texelLimit) return refuse("instances", instTexels, texelLimit);
+    return true;
+}
+
+// -------- Streaming upload -----------
+// Nodes and triangles are packed straight into mapped buffer memory, one
+// chunk at a time, so no packed staging copy of the tree exists on the
+// host and packing overlaps the driver's transfer of the previous chunk.
+static constexpr size_t kStreamChunkBytes = 16u << 20;
+
+// Calls pack(i, dst) for items [0, count) of itemBytes each and writes
+// them to buf at byteOffset. Each chunk is packed by all hardware threads.
+// Fresh storage is mapped unsynchronized; updates of a buffer the GPU may
+// still be reading let the driver wait for it. A chunk that cannot be
+// mapped (or whose contents are lost on unmap) goes through a chunk-sized
+// staging copy instead.
+template<typename Pack>
+static void stream_buffer(const GLuint buf, const size_t byteOffset, const size_t count, const size_t itemBytes,
+                          const bool fresh, Pack &&pack) {
+    if (count == 0) return;
+    glBindBuffer(GL_TEXTURE_BUFFER, buf);
+
+    const int threads = resolve_thread_count(BVHBuildSettings{});
+    const size_t chunkItems = std::max<size_t>(1, kStreamChunkBytes / itemBytes);
+    const GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT |
+                              (fresh ? GL_MAP_UNSYNCHRONIZED_BIT : 0);
+    std::vector<unsigned char> staging;
+
+    for (size_t begin = 0; begin < count; begin += chunkItems) {
+        const size_t n = std::min(chunkItems, count - begin);
+        const auto offset = static_cast<GLintptr>(byteOffset + begin * itemBytes);
+        const auto bytes = static_cast<GLsizeiptr>(n * itemBytes);
+        auto fill = [&](unsigned char *dst) {
+            const int chunks = n >= static_cast<size_t>(kParallelRangeMin) ? threads : 1;
+            parallel_chunks(0, static_cast<int>(n), chunks, [&](int, const int cb, const int ce) {
+                for (int i = cb; i < ce; ++i) pack(begin + i, dst + static_cast<size_t>(i) * itemBytes);
+            });
+        };
+
+        if (void *mapped = glMapBufferRange(GL_TEXTURE_BUFFER, offset, bytes, access)) {
+            fill(static_cast<unsigned char *>(mapped));
+            if (glUnmapBuffer(GL_TEXTURE_BUFFER) == GL_TRUE) continue;
+        }
+        staging.resize(static_cast<size_t>(bytes));
+        fill(staging.data());
+        glBufferSubData(GL_TEXTURE_BUFFER, offset, bytes, staging.data());
+    }
+}
+
+// Allocates buf for count items, streams them in and (re)points tex at it.
+// Returns the buffer size in bytes.
+template<typename Pack>
+static size_t stream_texture_buffer(const size_t count, const size_t itemBytes, const GLenum format, GLuint &tex,
+                                    GLuint &buf, Pack &&pack) {
+    if (!buf)
+        glGenBuffers(1, &buf);
+    glBindBuffer(GL_TEXTURE_BUFFER, buf);
+    glBufferData(GL_TEXTURE_BUFFER, static_cast<GLsizeiptr>(count * itemBytes), nullptr, GL_STATIC_DRAW);
+    stream_buffer(buf, 0, count, itemBytes, true, std::forward<Pack>(pack));
+
+    if (!tex)
+        glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_BUFFER, tex);
+    glTexBuffer(GL_TEXTURE_BUFFER, format, buf);
+    return count * itemBytes;
+}
+
+// -------- Paged streams -----------
+static size_t texel_bytes(const GLenum format) {
+    switch (format) {
+        case GL_RGB32UI: return 12;
+        case GL_R32I: return 4;
+        default: return 16; // RGBA32I, RGBA32UI, RGBA32F
+    }
+}
+
+// (Re)allocates the pages holding bytes of data and points each page's
+// texture at its buffer; pages no longer needed are released. Returns
+// false, leaving no pages, if the data needs more than kBvhMaxPages.
+static bool alloc_pages(BVHPages &pages, const size_t bytes, const GLenum format) {
+    const size_t pageBytes = static_cast<size_t>(bvh_page_texels()) * texel_bytes(format);
+    const size_t count = std::max<size_t>(1, (bytes + pageBytes - 1) / pageBytes);
+    if (count > kBvhMaxPages) {
+        pages.release();
+        return false;
+    }
+
+    for (size_t p = 0; p < kBvhMaxPages; ++p) {
+        if (p >= count) {
+            if (pages.tex[p]) glDeleteTextures(1, &pages.tex[p]);
+            if (pages.buf[p]) glDeleteBuffers(1, &pages.buf[p]);
+            pages.tex[p] = pages.buf[p] = 0;
+            continue;
+        }
+        if (!pages.buf[p])
+            glGenBuffers(1, &pages.buf[p]);
+        glBindBuffer(GL_TEXTURE_BUFFER, pages.buf[p]);
+        glBufferData(GL_TEXTURE_BUFFER, static_cast<GLsizeiptr>(std::min(pageBytes, bytes - p * pageBytes)),
+                     nullptr, GL_STATIC_DRAW);
+
+        if (!pages.tex[p])
+            glGenTextures(1, &pages.tex[p]);
+        glBindTexture(GL_TEXTURE_BUFFER, pages.tex[p]);
+        glTexBuffer(GL_TEXTURE_BUFFER, format, pages.buf[p]);
+    }
+    pages.count = static_cast<int>(count);
+    pages.pageBytes = pageBytes;
+    return true;
+}
+
+bool alloc_bvh_pages(BVHPages &pages, const size_t bytes, const GLenum format) {
+    const bool ok = alloc_pages(pages, bytes, format);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    return ok;
+}
+
+// stream_buffer() over items [first, first + count) of a paged stream.
+// Runs of items inside one page are streamed as usual; an item that
+// straddles two pages is packed into a scratch buffer and split.
+template<typename Pack>
+static void stream_pages(const BVHPages &pages, const size_t first, const size_t count, const size_t itemBytes,
+                         const bool fresh, Pack &&pack) {
+    const size_t end = first + count;
+    for (size_t i = first; i < end;) {
+        const size_t byte = i * itemBytes;
+        const size_t page = byte / pages.pageBytes;
+        if (page >= static_cast<size_t>(pages.count)) return;
+        const size_t pageEnd = (page + 1) * pages.pageBytes;
+        const size_t offset = byte - page * pages.pageBytes;
+
+        const size_t n = std::min(end, pageEnd / itemBytes) - i; // items ending inside this page
+        if (n > 0) {
+            stream_buffer(pages.buf[page], offset, n, itemBytes, fresh,
+                          [&pack, i](const size_t k, void *dst) { pack(i + k, dst); });
+            i += n;
+            continue;
+        }
+
+        unsigned char scratch[BVHTriQuant::kFloatBytes]; // largest paged item
+        pack(i, scratch);
+        const size_t head = pageEnd - byte;
+        glBindBuffer(GL_TEXTURE_BUFFER, pages.buf[page]);
+        glBufferSubData(GL_TEXTURE_BUFFER, static_cast<GLintptr>(offset), static_cast<GLsizeiptr>(head), scratch);
+        glBindBuffer(GL_TEXTURE_BUFFER, pages.buf[page + 1]);
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, static_cast<GLsizeiptr>(itemBytes - head), scratch + head);
+        ++i;
+    }
+}
+
+// Allocates pages for count items and streams them in. Returns the stream
+// size in bytes, or 0 (no pages) if it exceeds kBvhMaxPages pages.
+template<typename Pack>
+static size_t stream_texture_pages(const size_t count, const size_t itemBytes, const GLenum format, BVHPages &pages,
+                                   Pack &&pack) {
+    if (!alloc_pages(pages, count * itemBytes, format)) return 0;
+    stream_pages(pages, 0, count, itemBytes, true, std::forward<Pack>(pack));
+    return count * itemBytes;
+}
+
+// Node (RGBA32I, paged) and skip-link (R32I) buffers of one tree. Returns their size in bytes.
+static size_t upload_bvh_nodes(const BVHNode *nodes, const size_t nodeCount, BVHHandle &handle) {
+    size_t bytes = stream_texture_pages(nodeCount, kNodeBytes, GL_RGBA32I, handle.nodePages,
+                                        [nodes](const size_t i, void *dst) { pack_node(nodes[i], dst); });
+    std::vector<int32_t> skipData;
+    skipData.reserve(nodeCount);
+    pack_skips(nodes, nodeCount, skipData);
+    upload_texture_buffer(skipData.data(), skipData.size() * sizeof(int32_t), GL_R32I, handle.skipTex,
+                          handle.skipBuf);
+    return bytes + skipData.size() * sizeof(int32_t);
+}
+
+// Welded vertices (RGB32F) and three indices per triangle (RGB32UI, paged).
+// Sets handle.triBytes. Returns false, uploading nothing, if the vertices
+// do not fit in one texture buffer.
+template<typename GetTri>
+static bool upload_bvh_tris_indexed(const size_t triCount, GetTri &&tri, BVHHandle &handle) {
+    std::vector<glm::vec3> verts;
+    std::vector<uint32_t> indices;
+    index_triangles(triCount, tri, verts, indices);
+    if (static_cast<int64_t>(verts.size()) > bvh_texel_limit()) return false;
+
+    const uint32_t *idx = indices.data();
+    handle.triBytes = stream_texture_pages(triCount, 3 * sizeof(uint32_t), GL_RGB32UI, handle.triPages,
+                                           [idx](const size_t i, void *dst) {
+                                               std::memcpy(dst, idx + 3 * i, 3 * sizeof(uint32_t));
+                                           });
+    upload_texture_buffer(verts.data(), verts.size() * sizeof(glm::vec3), GL_RGB32F, handle.vertTex,
+                          handle.vertBuf);
+    handle.triBytes += verts.size() * sizeof(glm::vec3);
+    return true;
+}
+
+// Triangle buffer in the handle's encoding. Returns its size in bytes.
+static size_t upload_bvh_tris(const CPU_Triangle *tris, const size_t triCount, BVHHandle &handle) {
+    // Neither the lattice nor shared vertices have an affine form: use Möller–Trumbore.
+    if (handle.triQuant.enabled()) {
+        handle.indexedTris = false;
+        if (handle.triTest == BVHTriTest::Affine) handle.triTest = BVHTriTest::MollerTrumbore;
+        handle.releaseVerts();
+        const BVHTriQuant &quant = handle.triQuant;
+        handle.triBytes = stream_texture_pages(
+            triCount, BVHTriQuant::kQuantBytes, GL_RGB32UI, handle.triPages,
+            [tris, &quant](const size_t i, void *dst) { pack_tri_quant(tris[i], quant, dst); });
+        return handle.triBytes;
+    }
+    if (handle.indexedTris) {
+        if (handle.triTest == BVHTriTest::Affine) handle.triTest = BVHTriTest::MollerTrumbore;
+        if (upload_bvh_tris_indexed(
+                triCount, [tris](const size_t i) -> const CPU_Triangle & { return tris[i]; }, handle))
+            return handle.triBytes;
+        handle.indexedTris = false; // too many vertices for one buffer: store them directly
+    }
+    handle.releaseVerts();
+    const auto pack = tri_packer(handle.triTest);
+    handle.triBytes = stream_texture_pages(triCount, BVHTriQuant::kFloatBytes, GL_RGBA32UI, handle.triPages,
+                                           [tris, pack](const size_t i, void *dst) { pack(tris[i], dst); });
+    return handle.triBytes;
+}
+
+// Upload BVH nodes + triangles into texture buffers for use in GLSL.
+void upload_bvh_tbo(const std::vector<BVHNode> &nodes,
+                    const std::vector<CPU_Triangle> &tris,
+                    GLuint &outNodeTex,
+                    GLuint &outNodeBuf,
+                    GLuint &outTriTex,
+                    GLuint &outTriBuf) {
+    // No nodes: only the triangles are needed (collapsed layouts keep nodes elsewhere).
+    if (!nodes.empty()) {
+        stream_texture_buffer(nodes.size(), kNodeBytes, GL_RGBA32I, outNodeTex, outNodeBuf,
+                              [&nodes](const size_t i, void *dst) { pack_node(nodes[i], dst); });
+    }
+    stream_texture_buffer(tris.size(), BVHTriQuant::kFloatBytes, GL_RGBA32UI, outTriTex, outTriBuf,
+                          [&tris](const size_t i, void *dst) { pack_tri(tris[i], dst); });
+
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+// Re-upload only the given node/triangle ranges of an existing BVH.
+void update_bvh_tbo(const std::vector<BVHNode> &nodes,
+                    const std::vector<CPU_Triangle> &tris,
+                    BVHHandle &handle,
+                    const int nodeBegin,
+                    const int nodeEnd,
+                    const int triBegin,
+                    const int triEnd,
+                    const std::vector<int> *skips) {
+    // Skip links depend on the topology only, which a refit keeps.
+    if (nodeEnd > nodeBegin && handle.nodePages.count) {
+        const BVHNode *data = nodes.data();
+        stream_pages(handle.nodePages, static_cast<size_t>(nodeBegin), static_cast<size_t>(nodeEnd - nodeBegin),
+                     kNodeBytes, false, [data](const size_t i, void *dst) { pack_node(data[i], dst); });
+        if (skips && handle.skipBuf) {
+            const std::vector<int32_t> links(skips->begin() + nodeBegin, skips->begin() + nodeEnd);
+            glBindBuffer(GL_TEXTURE_BUFFER, handle.skipBuf);
+            glBufferSubData(GL_TEXTURE_BUFFER, static_cast<GLintptr>(nodeBegin) * sizeof(int32_t),
+                            static_cast<GLsizeiptr>(links.size() * sizeof(int32_t)), links.data());
+        }
+    }
+
+    if (triEnd > triBegin && handle.triPages.count) {
+        const CPU_Triangle *data = tris.data();
+        const auto first = static_cast<size_t>(triBegin);
+        const auto count = static_cast<size_t>(triEnd - triBegin);
+        const BVHTriQuant &quant = handle.triQuant;
+        if (handle.indexedTris) {
+            // Welding spans the whole set: re-index every triangle.
+            upload_bvh_tris(tris.data(), tris.size(), handle);
+        } else if (quant.enabled()) {
+            stream_pages(handle.triPages, first, count, BVHTriQuant::kQuantBytes, false,
+                         [data, &quant](const size_t i, void *dst) { pack_tri_quant(data[i], quant, dst); });
+        } else {
+            const auto pack = tri_packer(handle.triTest);
+            stream_pages(handle.triPages, first, count, BVHTriQuant::kFloatBytes, false,
+                         [data, pack](const size_t i, void *dst) { pack(data[i], dst); });
+        }
+    }
+
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+// Re-upload the triangles only, in the handle's (possibly new) encoding.
+size_t upload_bvh_triangles(const std::vector<CPU_Triangle> &tris, BVHHandle &handle) {
+    const size_t bytes = upload_bvh_tris(tris.data(), tris.size(), handle);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    return bytes;
+}
+
+// -------- Extract triangles from Model -----------
+// Appends the triangles of one mesh, applying M.
+static void gather_mesh_triangles(const Mesh &mesh, const glm::mat4 &M, std::vector<CPU_Triangle> &outTris,
+                                  const BVHTriQuant *snap = nullptr) {
+    // Assumes:
+    //  mesh.vertices[i].Position (glm::vec3)
+    //  mesh.indices (uint32_t triplets)
+    const auto &V = mesh.vertices;
+    const auto &I = mesh.indices;
+    for (size_t k = 0; k + 2 < I.size(); k += 3) {
+        auto p0 = glm::vec3(M * glm::vec4(V[I[k]].Position, 1.0f));
+        auto p1 = glm::vec3(M * glm::vec4(V[I[k + 1]].Position, 1.0f));
+        auto p2 = glm::vec3(M * glm::vec4(V[I[k + 2]].Position, 1.0f));
+        if (snap) {
+            p0 = quantize_bvh_point(*snap, p0);
+            p1 = quantize_bvh_point(*snap, p1);
+            p2 = quantize_bvh_point(*snap, p2);
+        }
+
+        CPU_Triangle T{};
+        T.v0 = p0;
+        T.e1 = p1 - p0;
+        T.e2 = p2 - p0;
+        outTris.push_back(T);
+    }
+}
+
+// Flattens a LearnOpenGL-style Model into CPU_Triangle list, applying M.
+void gather_model_triangles(const Model &model,
+                            const glm::mat4 &M,
+                            std::vector<CPU_Triangle> &outTris,
+                            const BVHTriQuant *snap) {
+    for (const auto &mesh: model.meshes) {
+        gather_mesh_triangles(mesh, M, outTris, snap);
+    }
+}
+
+// -------- Two-level scenes (TLAS over per-mesh BLAS) -----------
+// One object-space BLAS per mesh; stats are summed, SAH is tri-weighted.
+void build_blas_from_model(const Model &model, const BVHBuildSettings &settings, std::vector<BVHBlas> &outBlas,
+                           BVHBuildStats *outStats) {
+    outBlas.clear();
+    BVHBuildStats total;
+    double weightedSah = 0.0;
+    int totalTris = 0;
+
+    for (const auto &mesh: model.meshes) {
+        BVHBlas blas;
+        gather_mesh_triangles(mesh, glm::mat4(1.0f), blas.tris);
+        if (blas.tris.empty()) continue;
+
+        BVHBuildStats stats;
+        blas.nodes = build_bvh(blas.tris, settings, &stats);
+        total.buildMs += stats.buildMs;
+        total.leafCount += stats.leafCount;
+        total.threadCount = stats.threadCount;
+        weightedSah += static_cast<double>(stats.sahCost) * blas.tris.size();
+        totalTris += static_cast<int>(blas.tris.size());
+        outBlas.push_back(std::move(blas));
+    }
+
+    if (outStats) {
+        total.sahCost = totalTris > 0 ? static_cast<float>(weightedSah / totalTris) : 0.0f;
+        *outStats = total;
+    }
+}
+
+// World-space bounds of a transformed box (all 8 corners).
+static void transform_bounds(const glm::mat4 &M, const glm::vec3 &bMin, const glm::vec3 &bMax,
+                             glm::vec3 &outMin, glm::vec3 &outMax) {
+    outMin = glm::vec3(1e30f);
+    outMax = glm::vec3(-1e30f);
+    for (int corner = 0; corner < 8; ++corner) {
+        const glm::vec3 p((corner & 1) ? bMax.x : bMin.x,
+                          (corner & 2) ? bMax.y : bMin.y,
+                          (corner & 4) ? bMax.z : bMin.z);
+        const glm::vec3 w = glm::vec3(M * glm::vec4(p, 1.0f));
+        outMin = glm::min(outMin, w);
+        outMax = glm::max(outMax, w);
+    }
+}
+
+// TLAS: binned SAH over instance bounds, one instance per leaf.
+void build_tlas(BVHScene &scene, const BVHBuildSettings &settings, BVHBuildStats *outStats) {
+    const auto t0 = std::chrono::steady_clock::now();
+    scene.tlas.clear();
+    scene.instanceOrder.clear();
+
+    const int count = static_cast<int>(scene.instances.size());
+    if (count == 0) {
+        if (outStats) *outStats = BVHBuildStats{};
+        return;
+    }
+
+    BVHBuildSettings tlasSettings = settings;
+    tlasSettings.method = BVHBuildMethod::BinnedSAH;
+    tlasSettings.leafMax = 1;
+    BuildContext ctx{tlasSettings};
+    ctx.threadCount = 1; // a few hundred boxes: threads cost more than they save
+
+    std::vector<BuildRef> refs(count);
+    for (int i = 0; i < count; ++i) {
+        const BVHInstance &inst = scene.instances[i];
+        const BVHNode &root = scene.blas[inst.blas].nodes[0];
+        refs[i].triIndex = i;
+        transform_bounds(inst.transform, root.bMin, root.bMax, refs[i].bMin, refs[i].bMax);
+        refs[i].c = 0.5f * (refs[i].bMin + refs[i].bMax);
+    }
+
+    scene.tlas.reserve(scene.tlasCapacity());
+    build_recursive(scene.tlas, refs, 0, count, ctx);
+
+    // Leaves index refs, so the instance buffer is simply uploaded in refs order.
+    scene.instanceOrder.resize(count);
+    for (int i = 0; i < count; ++i) scene.instanceOrder[i] = refs[i].triIndex;
+
+    if (outStats) {
+        const auto t1 = std::chrono::steady_clock::now();
+        outStats->buildMs = std::chrono::duration<double, std::milli>(t1 - t0).count();
+        outStats->sahCost = bvh_sah_cost(scene.tlas, tlasSettings);
+        outStats->leafCount = count;
+        outStats->threadCount = 1;
+    }
+}
+
+// Node index of each BLAS root in the uploaded node buffer.
+static std::vector<int> blas_root_offsets(const BVHScene &scene) {
+    std::vector<int> offsets(scene.blas.size());
+    int offset = scene.tlasCapacity();
+    for (size_t b = 0; b < scene.blas.size(); ++b) {
+        offsets[b] = offset;
+        offset += static_cast<int>(scene.blas[b].nodes.size());
+    }
+    return offsets;
+}
+
+// Packs TLAS node i; slots past the TLAS up to tlasCapacity() get empty boxes.
+static void pack_tlas_node(const BVHScene &scene, const size_t i, void *dst) {
+    static const BVHNode kUnused{glm::vec3(1e30f), glm::vec3(-1e30f), -1, -1, 0, 0};
+    pack_node(i < scene.tlas.size() ? scene.tlas[i] : kUnused, dst);
+}
+
+// TLAS skip links, padded with -1 up to tlasCapacity().
+static void pack_tlas_skips(const BVHScene &scene, std::vector<int32_t> &out) {
+    pack_skips(scene.tlas.data(), scene.tlas.size(), out);
+    out.resize(static_cast<size_t>(scene.tlasCapacity()), -1);
+}
+
+// Pack instances: 4 texels per instance
+//  tex0..2 = rows of the world-to-object matrix (xyz = linear part, w = translation)
+//  tex3    = [blasRoot & 0xFFFF, blasRoot >> 16, 0, 0] (both halves exact as floats)
+static void pack_instances(const BVHScene &scene, std::vector<float> &out) {
+    const std::vector<int> roots = blas_root_offsets(scene);
+    for (const int idx: scene.instanceOrder) {
+        const BVHInstance &inst = scene.instances[idx];
+        const glm::mat4 W = glm::inverse(inst.transform);
+        for (int row = 0; row < 3; ++row) {
+            for (int col = 0; col < 4; ++col) out.push_back(W[col][row]);
+        }
+        out.push_back(static_cast<float>(roots[inst.blas] & 0xFFFF));
+        out.push_back(static_cast<float>(roots[inst.blas] >> 16));
+        out.push_back(0.0f);
+        out.push_back(0.0f);
+    }
+}
+
+// Full upload: TLAS region, every BLAS (rebased), triangles, instances.
+size_t upload_bvh_scene(const BVHScene &scene, BVHHandle &handle) {
+    const std::vector<int> roots = blas_root_offsets(scene);
+    std::vector<int> triOffsets(scene.blas.size());
+    for (size_t b = 1; b < scene.blas.size(); ++b)
+        triOffsets[b] = triOffsets[b - 1] + static_cast<int>(scene.blas[b - 1].tris.size());
+
+    // Item i of the node (triangle) buffer belongs to the last BLAS starting at or before it.
+    auto blasOf = [](const std::vector<int> &starts, const size_t i) {
+        return static_cast<size_t>(std::upper_bound(starts.begin(), starts.end(), static_cast<int>(i)) -
+                                   starts.begin() - 1);
+    };
+
+    const auto tlasCapacity = static_cast<size_t>(scene.tlasCapacity());
+    size_t nodeBytes = stream_texture_pages(
+        static_cast<size_t>(scene.nodeCount()), kNodeBytes, GL_RGBA32I, handle.nodePages,
+        [&](const size_t i, void *dst) {
+            if (i < tlasCapacity) {
+                pack_tlas_node(scene, i, dst);
+                return;
+            }
+            const size_t b = blasOf(roots, i);
+            pack_node(scene.blas[b].nodes[i - roots[b]], dst, roots[b], triOffsets[b]);
+        });
+
+    std::vector<int32_t> skipData;
+    skipData.reserve(static_cast<size_t>(scene.nodeCount()));
+    pack_tlas_skips(scene, skipData);
+    for (size_t b = 0; b < scene.blas.size(); ++b)
+        pack_skips(scene.blas[b].nodes.data(), scene.blas[b].nodes.size(), skipData, roots[b]);
+    upload_texture_buffer(skipData.data(), skipData.size() * sizeof(int32_t), GL_R32I, handle.skipTex,
+                          handle.skipBuf);
+    nodeBytes += skipData.size() * sizeof(int32_t);
+
+    handle.triQuant = BVHTriQuant{}; // BLAS triangles stay uncompressed
+    const auto triCount = static_cast<size_t>(scene.triCount());
+    auto blasTri = [&](const size_t i) -> const CPU_Triangle & {
+        const size_t b = blasOf(triOffsets, i);
+        return scene.blas[b].tris[i - triOffsets[b]];
+    };
+    if (handle.indexedTris) {
+        if (handle.triTest == BVHTriTest::Affine) handle.triTest = BVHTriTest::MollerTrumbore;
+        if (!upload_bvh_tris_indexed(triCount, blasTri, handle))
+            handle.indexedTris = false; // too many vertices for one buffer: store them directly
+    }
+    if (!handle.indexedTris) {
+        handle.releaseVerts();
+        const auto pack = tri_packer(handle.triTest);
+        handle.triBytes = stream_texture_pages(triCount, BVHTriQuant::kFloatBytes, GL_RGBA32UI, handle.triPages,
+                                               [&](const size_t i, void *dst) { pack(blasTri(i), dst); });
+    }
+
+    std::vector<float> instData;
+    instData.reserve(scene.instances.size() * 16);
+    pack_instances(scene, instData);
+    upload_texture_buffer(instData, handle.instTex, handle.instBuf);
+
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    return nodeBytes;
+}
+
+// TLAS-only update: the TLAS region is a fixed-size prefix of the node buffer.
+void update_bvh_tlas_tbo(const BVHScene &scene, const BVHHandle &handle) {
+    if (!handle.nodePages.count || !handle.skipBuf || !handle.instBuf) return;
+
+    stream_pages(handle.nodePages, 0, static_cast<size_t>(scene.tlasCapacity()), kNodeBytes, false,
+                 [&scene](const size_t i, void *dst) { pack_tlas_node(scene, i, dst); });
+
+    std::vector<int32_t> skipData;
+    pack_tlas_skips(scene, skipData);
+    glBindBuffer(GL_TEXTURE_BUFFER, handle.skipBuf);
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, static_cast<GLsizeiptr>(skipData.size() * sizeof(int32_t)),
+                    skipData.data());
+
+    std::vector<float> data;
+    pack_instances(scene, data);
+    glBindBuffer(GL_TEXTURE_BUFFER, handle.instBuf);
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, static_cast<GLsizeiptr>(data.size() * sizeof(float)), data.data());
+
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+// -------- Wide BVH (BVH4/BVH8 collapse + 8-bit child boxes) -----------
+// Picks the per-axis quantization step 2^e so 255 steps cover the node box,
+// then bumps e until the float-decoded upper corner really reaches bMax.
+static void set_quant_frame(BVHWideNode &node, const glm::vec3 &bMin, const glm::vec3 &bMax) {
+    node.origin = bMin;
+    for (int a = 0; a < 3; ++a) {
+        const float extent = bMax[a] - bMin[a];
+        int e = -126;
+        if (extent > 0.0f) {
+            std::frexp(extent / 255.0f, &e); // extent / 255 <= 2^e
+            e = std::clamp(e, -126, 127);
+            while (e < 127 && bMin[a] + 255.0f * std::ldexp(1.0f, e) < bMax[a]) ++e;
+        }
+        node.exponent[a] = static_cast<int8_t>(e);
+    }
+}
+
+// Conservative 8-bit child box: decoded lo <= bMin and hi >= bMax, using
+// the same float expression (origin + q * step) as the shader.
+static void quantize_child(const BVHWideNode &node, const glm::vec3 &bMin, const glm::vec3 &bMax,
+                           BVHWideNode::Child &out) {
+    for (int a = 0; a < 3; ++a) {
+        const float step = std::ldexp(1.0f, node.exponent[a]);
+        const float o = node.origin[a];
+        int lo = std::clamp(static_cast<int>(std::floor((bMin[a] - o) / step)), 0, 255);
+        int hi = std::clamp(static_cast<int>(std::ceil((bMax[a] - o) / step)), 0, 255);
+        while (lo > 0 && o + static_cast<float>(lo) * step > bMin[a]) --lo;
+        while (hi < 255 && o + static_cast<float>(hi) * step < bMax[a]) ++hi;
+        out.qMin[a] = static_cast<uint8_t>(lo);
+        out.qMax[a] = static_cast<uint8_t>(hi);
+    }
+}
+
+// Greedy collapse: open the largest inner child until all slots are used.
+static std::vector<BVHWideNode> collapse_bvh(const BVHNode *nodes, const size_t nodeCount, const int width) {
+    std::vector<BVHWideNode> wide;
+    if (nodeCount == 0) return wide;
+    const int maxSlots = std::clamp(width, 2, BVHWideNode::kMaxWidth);
+
+    // (binary node, wide node) pairs still to be filled in.
+    std::vector<std::pair<int, int>> stack;
+    wide.emplace_back();
+    stack.emplace_back(0, 0);
+
+    while (!stack.empty()) {
+        const auto [b, w] = stack.back();
+        stack.pop_back();
+        const BVHNode &src = nodes[b];
+
+        int slots[BVHWideNode::kMaxWidth];
+        int used = 0;
+        if (src.isLeaf()) {
+            slots[used++] = b;
+        } else {
+            slots[used++] = src.left;
+            slots[used++] = src.right;
+        }
+
+        while (used < maxSlots) {
+            int best = -1;
+            float bestArea = -1.0f;
+            for (int k = 0; k < used; ++k) {
+                const BVHNode &c = nodes[slots[k]];
+                const float area = half_area(c.bMin, c.bMax);
+                if (!c.isLeaf() && area > bestArea) {
+                    best = k;
+                    bestArea = area;
+                }
+            }
+            if (best < 0) break;
+            const BVHNode &open = nodes[slots[best]];
+            slots[best] = open.left;
+            slots[used++] = open.right;
+        }
+
+        BVHWideNode node;
+        set_quant_frame(node, src.bMin, src.bMax);
+        node.childCount = static_cast<uint8_t>(used);
+        for (int k = 0; k < used; ++k) {
+            const BVHNode &c = nodes[slots[k]];
+            BVHWideNode::Child &child = node.children[k];
+            quantize_child(node, c.bMin, c.bMax, child);
+            if (c.isLeaf()) {
+                child.count = static_cast<uint8_t>(std::min(c.count, 255)); // leafMax keeps this far below 255
+                child.index = c.first;
+            } else {
+                child.count = 0;
+                child.index = static_cast<int>(wide.size());
+                wide.emplace_back();
+                stack.emplace_back(slots[k], child.index);
+            }
+        }
+        wide[w] = node;
+    }
+    return wide;
+}
+
+std::vector<BVHWideNode> collapse_bvh(const std::vector<BVHNode> &nodes, const int width) {
+    return collapse_bvh(nodes.data(), nodes.size(), width);
+}
+
+// Pack wide nodes: 1 + 3 * width / 4 RGBA32UI texels per node (see bvh.h).
+static void pack_wide_node(const BVHWideNode &n, const int width, void *dst) {
+    uint32_t words[4 + 3 * BVHWideNode::kMaxWidth];
+    for (int a = 0; a < 3; ++a) std::memcpy(&words[a], &n.origin[a], sizeof(uint32_t));
+    words[3] = static_cast<uint32_t>(n.exponent[0] + 128) |
+               static_cast<uint32_t>(n.exponent[1] + 128) << 8 |
+               static_cast<uint32_t>(n.exponent[2] + 128) << 16 |
+               static_cast<uint32_t>(n.childCount) << 24;
+
+    for (int k = 0; k < width; ++k) {
+        const BVHWideNode::Child &c = n.children[k];
+        words[4 + 3 * k + 0] = c.qMin[0] | c.qMin[1] << 8 | c.qMin[2] << 16 | static_cast<uint32_t>(c.qMax[0]) << 24;
+        words[4 + 3 * k + 1] = c.qMax[1] | c.qMax[2] << 8 | c.count << 16;
+        words[4 + 3 * k + 2] = static_cast<uint32_t>(c.index);
+    }
+    std::memcpy(dst, words, (4 + 3 * width) * sizeof(uint32_t));
+}
+
+size_t upload_bvh_wide_tbo(const std::vector<BVHWideNode> &wide, const int width, BVHHandle &handle) {
+    const size_t bytes = stream_texture_buffer(wide.size(), (4 + 3 * width) * sizeof(uint32_t), GL_RGBA32UI,
+                                               handle.wideTex, handle.wideBuf,
+                                               [&wide, width](const size_t i, void *dst) {
+                                                   pack_wide_node(wide[i], width, dst);
+                                               });
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    handle.wideStackSize = wide_bvh_stack_size(wide);
+    return bytes;
+}
+
+int wide_bvh_stack_size(const std::vector<BVHWideNode> &wide) {
+    if (wide.empty()) return 0;
+    // collapse_bvh() appends children after their parent, so a reverse sweep
+    // sees every child before the node that pushes it.
+    std::vector<int> need(wide.size(), 1);
+    for (size_t w = wide.size(); w-- > 0;) {
+        const BVHWideNode &n = wide[w];
+        int inner = 0;
+        int deepest = 0;
+        for (int k = 0; k < n.childCount; ++k) {
+            const BVHWideNode::Child &c = n.children[k];
+            if (c.count > 0 || c.index < 0) continue;
+            ++inner;
+            deepest = std::max(deepest, need[c.index]);
+        }
+        need[w] = std::max({1, inner, inner - 1 + deepest});
+    }
+    return need[0];
+}
+
+// Single-level upload in the requested layout.
+size_t upload_bvh(const BVHNode *nodes, const size_t nodeCount, const CPU_Triangle *tris, const size_t triCount,
+                  const int width, BVHHandle &handle, int *outNodeCount) {
+    upload_bvh_tris(tris, triCount, handle);
+
+    if (width <= 2) {
+        handle.releaseWide();
+        const size_t bytes = upload_bvh_nodes(nodes, nodeCount, handle);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        if (outNodeCount) *outNodeCount = static_cast<int>(nodeCount);
+        return bytes;
+    }
+
+    // Wide layout: binary nodes are not needed on the GPU.
+    handle.releaseNodes();
+    const std::vector<BVHWideNode> wide = collapse_bvh(nodes, nodeCount, width);
+    if (outNodeCount) *outNodeCount = static_cast<int>(wide.size());
+    return upload_bvh_wide_tbo(wide, width, handle);
+}
+
+size_t upload_bvh(const std::vector<BVHNode> &nodes, const std::vector<CPU_Triangle> &tris, const int width,
+                  BVHHandle &handle, int *outNodeCount) {
+    return upload_bvh(nodes.data(), nodes.size(), tris.data(), tris.size(), width, handle, outNodeCount);
+}
+
+// -------- Progressive preview -----------
+// Three grid cells, in the order of the triangle's vertices.
+struct CellTriangle {
+    uint64_t c[3];
+
+    bool operator==(const CellTriangle &o) const {
+        return c[0] == o.c[0] && c[1] == o.c[1] && c[2] == o.c[2];
+    }
+};
+
+struct CellTriangleHash {
+    size_t operator()(const CellTriangle &t) const {
+        uint64_t h = t.c[0] * 0x9E3779B97F4A7C15ull;
+        h ^= t.c[1] + 0x9E3779B97F4A7C15ull + (h << 6) + (h >> 2);
+        h ^= t.c[2] + 0x9E3779B97F4A7C15ull + (h << 6) + (h >> 2);
+        return static_cast<size_t>(h);
+    }
+};
+
+static constexpr int kAxisBits = 21; // per axis in a 64-bit cell key
+
+// One clustering pass with cells of the given size. Each vertex moves to
+// the centre of its cell; triangles that collapse, and repeats of a kept
+// triangle, are dropped.
+static std::vector<CPU_Triangle> cluster_triangles(const std::vector<CPU_Triangle> &tris, const glm::vec3 &lo,
+                                                   const float cell) {
+    const float inv = 1.0f / cell;
+    auto axis = [](const float v) {
+        return static_cast<uint64_t>(std::clamp(v, 0.0f, static_cast<float>((1 << kAxisBits) - 1)));
+    };
+    auto cellOf = [&](const glm::vec3 &p) {
+        const glm::vec3 c = (p - lo) * inv;
+        return axis(c.x) | axis(c.y) << kAxisBits | axis(c.z) << (2 * kAxisBits);
+    };
+    auto centre = [&](const uint64_t key) {
+        const uint64_t mask = (1u << kAxisBits) - 1;
+        const glm::vec3 c(static_cast<float>(key & mask),
+                          static_cast<float>(key >> kAxisBits & mask),
+                          static_cast<float>(key >> (2 * kAxisBits) & mask));
+        return lo + (c + 0.5f) * cell;
+    };
+
+    std::vector<CPU_Triangle> out;
+    std::unordered_set<CellTriangle, CellTriangleHash> kept;
+    for (const auto &t: tris) {
+        const CellTriangle ct{{cellOf(t.v0), cellOf(t.v0 + t.e1), cellOf(t.v0 + t.e2)}};
+        if (ct.c[0] == ct.c[1] || ct.c[1] == ct.c[2] || ct.c[0] == ct.c[2]) continue;
+
+        // Same cells in either winding: keep the first one seen.
+        CellTriangle sorted = ct;
+        std::sort(sorted.c, sorted.c + 3);
+        if (!kept.insert(sorted).second) continue;
+
+        CPU_Triangle T{};
+        T.v0 = centre(ct.c[0]);
+        T.e1 = centre(ct.c[1]) - T.v0;
+        T.e2 = centre(ct.c[2]) - T.v0;
+        out.push_back(T);
+    }
+    return out;
+}
+
+std::vector<CPU_Triangle> simplify_bvh_proxy(const std::vector<CPU_Triangle> &tris, const size_t targetTris) {
+    if (tris.empty() || targetTris == 0) return {};
+    glm::vec3 lo, hi;
+    bvh_triangle_bounds(tris, lo, hi);
+    const float extent = std::max(hi.x - lo.x, std::max(hi.y - lo.y, hi.z - lo.z));
+    if (!(extent > 0.0f)) return {};
+
+    // A surface through an n^3 grid touches about n^2 cells, and clustering
+    // leaves about 2 triangles per touched cell. Noisy or volumetric input
+    // keeps more, so coarsen until the proxy is within twice the target.
+    float n = std::max(2.0f, std::sqrt(static_cast<float>(targetTris) * 0.5f));
+    std::vector<CPU_Triangle> proxy;
+    for (int attempt = 0; attempt < 4; ++attempt) {
+        proxy = cluster_triangles(tris, lo, extent / n);
+        if (proxy.size() <= 2 * targetTris || n <= 2.0f) break;
+        n = std::max(2.0f, n * std::sqrt(static_cast<float>(targetTris) / static_cast<float>(proxy.size())));
+    }
+    return proxy;
+}
+
+// -------- Model loading -----------
+BVHPrepared::BVHPrepared() = default;
+BVHPrepared::~BVHPrepared() = default;
+BVHPrepared::BVHPrepared(BVHPrepared &&) noexcept = default;
+BVHPrepared &BVHPrepared::operator=(BVHPrepared &&) noexcept = default;
+
+bool bvh_gpu_build_applies(const BVHBuildSettings &settings) {
+    return settings.gpuBuild && settings.gpuWidth == 2 && !settings.compressTris;
+}
+
+bool bvh_gpu_build_fits(const size_t triCount, std::string *outReason) {
+    // Scratch streams: 3 texels per source triangle, 4 per slot of the sort width.
+    int64_t pow2 = 1;
+    while (pow2 < static_cast<int64_t>(triCount)) pow2 *= 2;
+    const int64_t page = bvh_page_texels();
+    if (int64_t(3) * static_cast<int64_t>(triCount) > page || 4 * pow2 > page) {
+        if (outReason)
+            *outReason = "scratch buffers need " + std::to_string(4 * pow2) + " texels, page size " +
+                         std::to_string(page);
+        return false;
+    }
+    return bvh_fits_texture_limits(triCount > 0 ? 2 * triCount - 1 : 0, triCount, 2, false, 0, outReason);
+}
+
+// CPU half of a load: no GL calls, safe on a worker thread.
+bool prepare_bvh_from_model_path(const char *path, const glm::mat4 &modelTransform, const BVHBuildSettings &settings,
+                                 BVHPrepared &out, const bool wantGeometry, const char *cacheDir,
+                                 const size_t previewTris, const BVHPreviewFn &onPreview) {
+    const auto t0 = std::chrono::steady_clock::now();
+    out = BVHPrepared{};
+
+    // Cache hit: the finished tree is read from the mapped file, skipping import and build.
+    // GPU-built trees are never read back, so there is nothing to cache.
+    const bool gpuBuild = bvh_gpu_build_applies(settings);
+    const uint64_t cacheKey = cacheDir && !gpuBuild ? bvh_cache_key(path, modelTransform, settings) : 0;
+    const std::string cachePath = cacheKey ? bvh_cache_file(cacheDir, cacheKey) : std::string();
+    if (cacheKey) {
+        auto cache = std::make_shared<BVHCacheFile>();
+        if (cache->open(cachePath, cacheKey)) {
+            out.triQuant = cache->triQuant();
+            out.stats = cache->stats();
+            out.stats.fromCache = true;
+            if (wantGeometry) {
+                BVHGeometry &geometry = out.geometry;
+                geometry.nodes.assign(cache->nodes(), cache->nodes() + cache->nodeCount());
+                geometry.tris.assign(cache->tris(), cache->tris() + cache->triCount());
+                geometry.sourceIndex.assign(cache->sourceIndex(), cache->sourceIndex() + cache->triCount());
+                geometry.builtSahCost = out.stats.sahCost;
+            } else {
+                out.cache = std::move(cache); // uploaded straight from the mapping
+            }
+            out.stats.loadMs =
+                    std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+            return true;
+        }
+    }
+
+    // Import without GL objects; upload_prepared_bvh() creates them.
+    out.model = std::make_unique<Model>(path, false);
+    if (out.model->meshes.empty()) {
+        out.model.reset();
+        return false;
+    }
+
+    // Extract triangles in world/model space.
+    std::vector<CPU_Triangle> triCPU;
+    gather_model_triangles(*out.model, modelTransform, triCPU);
+
+    // Compressed triangles: fit the lattice, then gather again snapping the
+    // source vertices so shared vertices land on the same cell.
+    if (settings.compressTris && !triCPU.empty()) {
+        glm::vec3 lo, hi;
+        bvh_triangle_bounds(triCPU, lo, hi);
+        out.triQuant = make_bvh_tri_quant(lo, hi);
+        triCPU.clear();
+        gather_model_triangles(*out.model, modelTransform, triCPU, &out.triQuant);
+    }
+
+    // Progressive: hand out a BVH over a simplified proxy first, so the
+    // caller can draw something while the full tree is built.
+    if (onPreview && previewTris > 0 && triCPU.size() > 4 * previewTris) {
+        BVHPrepared preview;
+        preview.triQuant = out.triQuant;
+        preview.geometry.tris = simplify_bvh_proxy(triCPU, previewTris);
+        if (preview.triQuant.enabled()) quantize_bvh_triangles(preview.geometry.tris, preview.triQuant);
+
+        BVHBuildSettings previewSettings = settings;
+        previewSettings.optimizeMs = 0.0f;
+        preview.geometry.nodes = build_bvh(preview.geometry.tris, previewSettings, &preview.stats);
+        preview.geometry.builtSahCost = preview.stats.sahCost;
+        if (!preview.geometry.tris.empty()) onPreview(preview);
+    }
+
+    // GPU build: the caller builds over the triangles in source order.
+    // Models the builder would refuse are built here, off the GL thread.
+    BVHGeometry &geometry = out.geometry;
+    if (gpuBuild && bvh_gpu_build_fits(triCPU.size())) {
+        geometry.tris = std::move(triCPU);
+        out.gpuDeferred = true;
+        return true;
+    }
+
+    // Build BVH on CPU. Source indices are needed for refits and the cache.
+    const bool wantSource = wantGeometry || cacheKey;
+    geometry.nodes = build_bvh(triCPU, settings, &out.stats, wantSource ? &geometry.sourceIndex : nullptr);
+    geometry.tris = std::move(triCPU);
+    geometry.builtSahCost = out.stats.sahCost;
+
+    // A failed write only costs the next load a rebuild.
+    if (cacheKey)
+        out.stats.cacheWritten = write_bvh_cache(cachePath, cacheKey, geometry, out.triQuant, out.stats);
+    return true;
+}
+
+// GL half of a load: creates the model's buffers and uploads the tree.
+bool upload_prepared_bvh(BVHPrepared &prepared, const BVHBuildSettings &settings, BVHHandle &handle,
+                         int &outNodeCount, int &outTriCount, std::string *outReason) {
+    // A GPU build nobody ran (background loads hand it back to the loader instead).
+    if (prepared.gpuDeferred) {
+        BVHGeometry &geometry = prepared.geometry;
+        geometry.nodes = build_bvh(geometry.tris, settings, &prepared.stats, &geometry.sourceIndex);
+        geometry.builtSahCost = prepared.stats.sahCost;
+        prepared.gpuDeferred = false;
+    }
+
+    const int gpuWidth = settings.gpuWidth;
+    const size_t nodeCount = prepared.cache ? prepared.cache->nodeCount() : prepared.geometry.nodes.size();
+    const size_t triCount = prepared.cache ? prepared.cache->triCount() : prepared.geometry.tris.size();
+    if (!bvh_fits_texture_limits(nodeCount, triCount, gpuWidth, prepared.triQuant.enabled(), 0, outReason))
+        return false;
+
+    const auto t0 = std::chrono::steady_clock::now();
+    if (prepared.model) prepared.model->upload();
+
+    handle.triQuant = prepared.triQuant;
+    handle.triTest = settings.triTest;
+    handle.indexedTris = settings.indexedTris;
+    BVHBuildStats &stats = prepared.stats;
+    if (prepared.cache) {
+        const BVHCacheFile &cache = *prepared.cache;
+        stats.nodeBytes = upload_bvh(cache.nodes(), cache.nodeCount(), cache.tris(), cache.triCount(), gpuWidth,
+                                     handle, &outNodeCount);
+        outTriCount = static_cast<int>(cache.triCount());
+    } else {
+        const BVHGeometry &geometry = prepared.geometry;
+        stats.nodeBytes = upload_bvh(geometry.nodes, geometry.tris, gpuWidth, handle, &outNodeCount);
+        outTriCount = static_cast<int>(geometry.tris.size());
+    }
+    stats.triBytes = handle.triBytes;
+
+    if (stats.fromCache)
+        stats.loadMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    return true;
+}
+
+// High-level helper: load a model, build its BVH, and upload to GPU.
+bool rebuild_bvh_from_model_path(const char *path, const glm::mat4 &modelTransform, const BVHBuildSettings &settings,
+                                 std::unique_ptr<Model> &bvhModel, int &outNodeCount, int &outTriCount,
+                                 BVHHandle &handle, BVHBuildStats *outStats, BVHGeometry *outGeometry,
+                                 const char *cacheDir) {
+    // Drop previous GPU resources (if any).
+    handle.release();
+
+    BVHPrepared prepared;
+    if (!prepare_bvh_from_model_path(path, modelTransform, settings, prepared, outGeometry != nullptr, cacheDir)) {
+        bvhModel.reset();
+        outNodeCount = 0;
+        outTriCount = 0;
+        if (outGeometry) outGeometry->clear();
+        return false;
+    }
+
+    if (!upload_prepared_bvh(prepared, settings, handle, outNodeCount, outTriCount)) {
+        bvhModel.reset();
+        outNodeCount = 0;
+        outTriCount = 0;
+        if (outGeometry) outGeometry->clear();
+        return false;
+    }
+    bvhModel = std::move(prepared.model);
+    if (outStats) *outStats = prepared.stats;
 
+    // Keep a CPU copy for refits if the caller asked for one.
+    if (outGeometry) *outGeometry = std::move(prepared.geometry);
     return true;
 }
@@ -0,0 +1,275 @@
+#include "scene/bvh_cache.h"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <type_traits>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// -------- File layout -----------
+// Bump kCacheVersion whenever the builder output or this layout changes;
+// older files are then rejected and rebuilt.
+static constexpr char kCacheMagic[8] = {'G', 'L', 'R', 'T', 'B', 'V', 'H', '\0'};
+static constexpr uint32_t kCacheVersion = 1;
+
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t nodeSize; // sizeof(BVHNode) of the writer
+    uint32_t triSize; // sizeof(CPU_Triangle) of the writer
+    uint32_t reserved;
+    uint64_t key;
+    uint64_t nodeCount;
+    uint64_t triCount;
+    int32_t quantOrigin[3];
+    float quantScale;
+    double buildMs;
+    double optimizeMs;
+    float sahCost;
+    float unoptimizedSahCost;
+    float dupFactor;
+    int32_t leafCount;
+    int32_t threadCount;
+    int32_t pad;
+};
+
+static_assert(std::is_trivially_copyable_v<CacheHeader>);
+static_assert(std::is_trivially_copyable_v<BVHNode> && std::is_trivially_copyable_v<CPU_Triangle>);
+static_assert(sizeof(CacheHeader) % alignof(uint64_t) == 0, "arrays must start aligned");
+
+static size_t cache_bytes(const uint64_t nodeCount, const uint64_t triCount) {
+    return sizeof(CacheHeader) + nodeCount * sizeof(BVHNode) + triCount * (sizeof(CPU_Triangle) + sizeof(int));
+}
+
+// -------- Memory mapping -----------
+// Maps a whole file read-only. The view stays valid after the handles are
+// closed, so only the pointer and size need to be kept.
+static const void *map_file(const std::string &path, size_t &outBytes) {
+    outBytes = 0;
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return nullptr;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return nullptr;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (!mapping) return nullptr;
+    const void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!view) return nullptr;
+    outBytes = static_cast<size_t>(size.QuadPart);
+    return view;
+#else
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return nullptr;
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return nullptr;
+    }
+    void *view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (view == MAP_FAILED) return nullptr;
+    outBytes = static_cast<size_t>(st.st_size);
+    return view;
+#endif
+}
+
+static void unmap_file(const void *view, const size_t bytes) {
+    if (!view) return;
+#ifdef _WIN32
+    (void) bytes;
+    UnmapViewOfFile(view);
+#else
+    munmap(const_cast<void *>(view), bytes);
+#endif
+}
+
+// -------- Key -----------
+static constexpr uint64_t kFnvOffset = 0xcbf29ce484222325ull;
+static constexpr uint64_t kFnvPrime = 0x100000001b3ull;
+
+static uint64_t fnv1a(const void *data, const size_t bytes, uint64_t hash) {
+    const auto *p = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < bytes; ++i) {
+        hash ^= p[i];
+        hash *= kFnvPrime;
+    }
+    return hash;
+}
+
+template<typename T>
+static uint64_t fnv1a_value(const T &value, const uint64_t hash) {
+    return fnv1a(&value, sizeof(T), hash);
+}
+
+uint64_t bvh_settings_hash(const glm::mat4 &modelTransform, const BVHBuildSettings &settings, const uint64_t seed) {
+    uint64_t hash = seed ? seed : kFnvOffset;
+    for (int c = 0; c < 4; ++c)
+        for (int r = 0; r < 4; ++r) hash = fnv1a_value(modelTransform[c][r], hash);
+
+    hash = fnv1a_value(static_cast<int>(settings.method), hash);
+    hash = fnv1a_value(settings.leafMax, hash);
+    hash = fnv1a_value(settings.sahBins, hash);
+    hash = fnv1a_value(settings.mortonBits, hash);
+    hash = fnv1a_value(settings.traversalCost, hash);
+    hash = fnv1a_value(settings.intersectCost, hash);
+    hash = fnv1a_value(settings.compressTris, hash);
+    hash = fnv1a_value(settings.splitBudget, hash);
+    hash = fnv1a_value(settings.optimizeMs, hash);
+    hash = fnv1a_value(static_cast<int>(settings.layout), hash);
+    hash = fnv1a_value(bvh_gpu_build_applies(settings), hash); // an ignored gpuBuild leaves the tree unchanged
+    return hash != 0 ? hash : 1; // 0 means "no key"
+}
+
+uint64_t bvh_cache_key(const char *path, const glm::mat4 &modelTransform, const BVHBuildSettings &settings) {
+    size_t bytes = 0;
+    const void *view = map_file(path, bytes);
+    if (!view) return 0;
+    const uint64_t fileHash = fnv1a(view, bytes, kFnvOffset);
+    unmap_file(view, bytes);
+    return bvh_settings_hash(modelTransform, settings, fileHash);
+}
+
+std::string bvh_cache_file(const std::string &dir, const uint64_t key) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.bvh", static_cast<unsigned long long>(key));
+    return (std::filesystem::path(dir) / name).string();
+}
+
+// -------- Write -----------
+bool write_bvh_cache(const std::string &file, const uint64_t key, const BVHGeometry &geometry,
+                     const BVHTriQuant &triQuant, const BVHBuildStats &stats) {
+    namespace fs = std::filesystem;
+    if (geometry.sourceIndex.size() != geometry.tris.size()) return false;
+
+    std::error_code ec;
+    const fs::path target(file);
+    if (target.has_parent_path()) fs::create_directories(target.parent_path(), ec);
+
+    CacheHeader h{};
+    std::memcpy(h.magic, kCacheMagic, sizeof(h.magic));
+    h.version = kCacheVersion;
+    h.nodeSize = sizeof(BVHNode);
+    h.triSize = sizeof(CPU_Triangle);
+    h.key = key;
+    h.nodeCount = geometry.nodes.size();
+    h.triCount = geometry.tris.size();
+    for (int a = 0; a < 3; ++a) h.quantOrigin[a] = triQuant.origin[a];
+    h.quantScale = triQuant.scale;
+    h.buildMs = stats.buildMs;
+    h.optimizeMs = stats.optimizeMs;
+    h.sahCost = stats.sahCost;
+    h.unoptimizedSahCost = stats.unoptimizedSahCost;
+    h.dupFactor = stats.dupFactor;
+    h.leafCount = stats.leafCount;
+    h.threadCount = stats.threadCount;
+
+    const fs::path temp = target.string() + ".tmp";
+    {
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char *>(&h), sizeof(h));
+        out.write(reinterpret_cast<const char *>(geometry.nodes.data()),
+                  static_cast<std::streamsize>(geometry.nodes.size() * sizeof(BVHNode)));
+        out.write(reinterpret_cast<const char *>(geometry.tris.data()),
+                  static_cast<std::streamsize>(geometry.tris.size() * sizeof(CPU_Triangle)));
+        out.write(reinterpret_cast<const char *>(geometry.sourceIndex.data()),
+                  static_cast<std::streamsize>(geometry.sourceIndex.size() * sizeof(int)));
+        if (!out) {
+            out.close();
+            fs::remove(temp, ec);
+            return false;
+        }
+    }
+
+    fs::rename(temp, target, ec);
+    if (ec) {
+        fs::remove(temp, ec);
+        return false;
+    }
+    return true;
+}
+
+// -------- Read -----------
+BVHCacheFile::~BVHCacheFile() {
+    close();
+}
+
+void BVHCacheFile::close() {
+    unmap_file(mapping, mappingBytes);
+    mapping = nullptr;
+    mappingBytes = 0;
+    nodePtr = nullptr;
+    triPtr = nullptr;
+    sourcePtr = nullptr;
+    nodeCnt = triCnt = 0;
+    quant = BVHTriQuant{};
+    buildStats = BVHBuildStats{};
+}
+
+bool BVHCacheFile::open(const std::string &file, const uint64_t key) {
+    close();
+    mapping = map_file(file, mappingBytes);
+    if (!mapping) return false;
+
+    CacheHeader h{};
+    if (mappingBytes < sizeof(h)) {
+        close();
+        return false;
+    }
+    std::memcpy(&h, mapping, sizeof(h));
+    if (std::memcmp(h.magic, kCacheMagic, sizeof(h.magic)) != 0 || h.version != kCacheVersion ||
+        h.nodeSize != sizeof(BVHNode) || h.triSize != sizeof(CPU_Triangle) || h.key != key ||
+        h.nodeCount == 0 || h.nodeCount > INT32_MAX || h.triCount > INT32_MAX ||
+        mappingBytes != cache_bytes(h.nodeCount, h.triCount)) {
+        close();
+        return false;
+    }
+
+    const auto *base = static_cast<const unsigned char *>(mapping) + sizeof(CacheHeader);
+    nodeCnt = static_cast<size_t>(h.nodeCount);
+    triCnt = static_cast<size_t>(h.triCount);
+    nodePtr = reinterpret_cast<const BVHNode *>(base);
+    triPtr = reinterpret_cast<const CPU_Triangle *>(base + nodeCnt * sizeof(BVHNode));
+    sourcePtr = reinterpret_cast<const int *>(base + nodeCnt * sizeof(BVHNode) + triCnt * sizeof(CPU_Triangle));
+
+    // A damaged file must not reach the GPU: children come after their
+    // parent and leaves stay inside the triangle array.
+    const auto nodes = static_cast<long long>(nodeCnt);
+    const auto tris = static_cast<long long>(triCnt);
+    for (long long n = 0; n < nodes; ++n) {
+        const BVHNode &node = nodePtr[n];
+        const bool ok = node.isLeaf()
+                            ? node.first >= 0 && node.first + static_cast<long long>(node.count) <= tris
+                            : node.left > n && node.left < nodes && node.right > n && node.right < nodes;
+        if (!ok) {
+            close();
+            return false;
+        }
+    }
+
+    for (int a = 0; a < 3; ++a) quant.origin[a] = h.quantOrigin[a];
+    quant.scale = h.quantScale;
+    buildStats.buildMs = h.buildMs;
+    buildStats.optimizeMs = h.optimizeMs;
+    buildStats.sahCost = h.sahCost;
+    buildStats.unoptimizedSahCost = h.unoptimizedSahCost;
+    buildStats.dupFactor = h.dupFactor;
+    buildStats.leafCount = h.leafCount;
+    buildStats.threadCount = h.threadCount;
+    return true;
+}
@@ -0,0 +1,513 @@
+#include "scene/bvh_dynamic.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <queue>
+
+// -------- Helpers -----------
+static float half_area(const glm::vec3 &bMin, const glm::vec3 &bMax) {
+    const glm::vec3 e = glm::max(bMax - bMin, glm::vec3(0.0f));
+    return e.x * e.y + e.y * e.z + e.z * e.x;
+}
+
+// Spare slots kept beyond what assign() and a growing insert need.
+static constexpr size_t kMinSpare = 1024;
+
+// Dirty slots closer than this are uploaded as one run.
+static constexpr int kRunGap = 8;
+
+// Capacity after growing to hold needed slots: 1.5x, so growth is rare.
+static size_t grown_capacity(const size_t current, const size_t needed) {
+    return std::max(needed, current + current / 2 + kMinSpare);
+}
+
+// Sorts runs and merges those less than gap apart.
+static void coalesce_runs(std::vector<std::pair<int, int>> &runs, const int gap) {
+    std::sort(runs.begin(), runs.end());
+    size_t out = 0;
+    for (const auto &run: runs) {
+        if (out > 0 && run.first <= runs[out - 1].second + gap)
+            runs[out - 1].second = std::max(runs[out - 1].second, run.second);
+        else
+            runs[out++] = run;
+    }
+    runs.resize(out);
+}
+
+// -------- Slots -----------
+void BVHDynamic::clear() {
+    *this = BVHDynamic{};
+}
+
+void BVHDynamic::growNodes(const size_t capacity) {
+    if (capacity <= nodeArray.size()) return;
+    BVHNode unused{};
+    unused.left = unused.right = -1;
+    nodeArray.resize(capacity, unused);
+    parentArray.resize(capacity, -1);
+    skipArray.resize(capacity, -1);
+    ownerArray.resize(capacity, -1);
+    nodeDirty.resize(capacity, 0);
+    fullUpload = true;
+}
+
+void BVHDynamic::growTris(const size_t capacity) {
+    if (capacity <= triArray.size()) return;
+    triArray.resize(capacity, CPU_Triangle{});
+    fullUpload = true;
+}
+
+int BVHDynamic::allocNode() {
+    ++liveNodeCount;
+    if (!freeNodes.empty()) {
+        const int n = freeNodes.back();
+        freeNodes.pop_back();
+        return n;
+    }
+    if (static_cast<size_t>(nodeEnd) == nodeArray.size())
+        growNodes(grown_capacity(nodeArray.size(), static_cast<size_t>(nodeEnd) + 1));
+    return nodeEnd++;
+}
+
+// First fit among the freed runs, else appended.
+int BVHDynamic::allocTris(const int count) {
+    for (size_t k = 0; k < freeTriRuns.size(); ++k) {
+        auto &run = freeTriRuns[k];
+        if (run.second < count) continue;
+        const int first = run.first;
+        run.first += count;
+        run.second -= count;
+        if (run.second == 0) freeTriRuns.erase(freeTriRuns.begin() + static_cast<std::ptrdiff_t>(k));
+        return first;
+    }
+    const size_t needed = static_cast<size_t>(triEnd) + static_cast<size_t>(count);
+    if (needed > triArray.size()) growTris(grown_capacity(triArray.size(), needed));
+    const int first = triEnd;
+    triEnd += count;
+    return first;
+}
+
+void BVHDynamic::freeTris(const int first, const int count) {
+    auto it = std::lower_bound(freeTriRuns.begin(), freeTriRuns.end(), std::make_pair(first, 0));
+    it = freeTriRuns.insert(it, {first, count});
+    // Merge with the following run, then with the preceding one.
+    if (it + 1 != freeTriRuns.end() && it->first + it->second == (it + 1)->first) {
+        it->second += (it + 1)->second;
+        freeTriRuns.erase(it + 1);
+    }
+    if (it != freeTriRuns.begin() && (it - 1)->first + (it - 1)->second == it->first) {
+        (it - 1)->second += it->second;
+        it = freeTriRuns.erase(it) - 1;
+    }
+    // A run at the end just shortens the used part.
+    if (it->first + it->second == triEnd) {
+        triEnd = it->first;
+        freeTriRuns.erase(it);
+    }
+}
+
+std::pair<size_t, size_t> BVHDynamic::capacityAfterInsert(const size_t triCount) const {
+    // A tree over n triangles has at most 2n - 1 nodes, plus the new parent.
+    const size_t needNodes = 2 * triCount;
+    const size_t spareNodes = freeNodes.size() + (nodeArray.size() - static_cast<size_t>(nodeEnd));
+    size_t nodeCapacity = nodeArray.size();
+    if (needNodes > spareNodes)
+        nodeCapacity = grown_capacity(nodeCapacity, static_cast<size_t>(nodeEnd) + needNodes - freeNodes.size());
+
+    size_t triCapacity = triArray.size();
+    bool fitsFreeRun = false;
+    for (const auto &run: freeTriRuns) fitsFreeRun |= static_cast<size_t>(run.second) >= triCount;
+    if (!fitsFreeRun && static_cast<size_t>(triEnd) + triCount > triCapacity)
+        triCapacity = grown_capacity(triCapacity, static_cast<size_t>(triEnd) + triCount);
+    return {nodeCapacity, triCapacity};
+}
+
+// -------- Topology -----------
+void BVHDynamic::markNode(const int n) {
+    if (nodeDirty[n]) return;
+    nodeDirty[n] = 1;
+    dirtyNodes.push_back(n);
+}
+
+void BVHDynamic::replaceChild(const int parent, const int oldChild, const int newChild) {
+    BVHNode &p = nodeArray[parent];
+    if (p.left == oldChild) p.left = newChild;
+    else p.right = newChild;
+    parentArray[newChild] = parent;
+    markNode(parent);
+}
+
+// Copies node from into slot to; used to keep the root at node 0. The
+// caller sets the parent and the skip link of the new slot.
+void BVHDynamic::moveNode(const int from, const int to) {
+    BVHNode &node = nodeArray[to];
+    node = nodeArray[from];
+    ownerArray[to] = ownerArray[from];
+    if (node.isLeaf()) {
+        std::vector<int> &leaves = ranges[ownerArray[to]].leaves;
+        *std::find(leaves.begin(), leaves.end(), from) = to;
+    } else {
+        parentArray[node.left] = to;
+        parentArray[node.right] = to;
+    }
+    skipArray[to] = -2; // forces relink() to propagate
+    markNode(to);
+}
+
+// Sets the skip link of n and of the right spine below it, which inherits it.
+// Stops at the first node that already has the value: the rest of the spine
+// was consistent before and still is.
+void BVHDynamic::setSkip(int n, const int value) {
+    while (skipArray[n] != value) {
+        skipArray[n] = value;
+        markNode(n);
+        const BVHNode &node = nodeArray[n];
+        if (node.isLeaf()) break;
+        n = node.right;
+    }
+}
+
+// Re-derives the skip links below n after its children changed. Must run
+// top-down: n's own link has to be up to date.
+void BVHDynamic::relink(const int n) {
+    const BVHNode &node = nodeArray[n];
+    if (node.isLeaf()) return;
+    setSkip(node.left, node.right);
+    setSkip(node.right, skipArray[n]);
+}
+
+// Branch and bound over the tree: the cost of pairing the new box with
+// node s is the area of their union plus the area every ancestor of s
+// grows by. A subtree is skipped once the inherited growth plus the new
+// box's own area cannot beat the best so far.
+int BVHDynamic::findSibling(const glm::vec3 &bMin, const glm::vec3 &bMax) const {
+    struct Candidate {
+        float bound; // lower bound of the cost anywhere below node
+        float inherited; // area growth of the ancestors
+        int node;
+        bool operator<(const Candidate &other) const { return bound > other.bound; } // smallest bound first
+    };
+    const float area = half_area(bMin, bMax);
+    std::priority_queue<Candidate> queue;
+    queue.push({area, 0.0f, 0});
+
+    int best = 0;
+    float bestCost = FLT_MAX;
+    while (!queue.empty()) {
+        const Candidate c = queue.top();
+        queue.pop();
+        if (c.bound >= bestCost) break;
+
+        const BVHNode &node = nodeArray[c.node];
+        const float direct = half_area(glm::min(node.bMin, bMin), glm::max(node.bMax, bMax));
+        if (direct + c.inherited < bestCost) {
+            bestCost = direct + c.inherited;
+            best = c.node;
+        }
+        if (node.isLeaf()) continue;
+
+        const float inherited = c.inherited + direct - half_area(node.bMin, node.bMax);
+        if (area + inherited < bestCost) {
+            queue.push({area + inherited, inherited, node.left});
+            queue.push({area + inherited, inherited, node.right});
+        }
+    }
+    return best;
+}
+
+// Tree rotation at n: swaps one child with a grandchild under the other
+// child when that shrinks the surface area of the node that changes (n's
+// own box stays the same). Returns true if a rotation was applied.
+bool BVHDynamic::rotate(const int n) {
+    const BVHNode &node = nodeArray[n];
+    if (node.isLeaf()) return false;
+
+    int bestChild = -1;
+    bool bestLeft = false; // which grandchild of bestChild moves up
+    float bestGain = 0.0f;
+    auto consider = [&](const int child, const int other) {
+        const BVHNode &c = nodeArray[child];
+        if (c.isLeaf()) return;
+        const BVHNode &o = nodeArray[other];
+        const float before = half_area(c.bMin, c.bMax);
+        for (const bool moveLeft: {true, false}) {
+            const BVHNode &kept = nodeArray[moveLeft ? c.right : c.left];
+            const float gain = before - half_area(glm::min(kept.bMin, o.bMin), glm::max(kept.bMax, o.bMax));
+            if (gain > bestGain && gain > 1e-6f * before) {
+                bestGain = gain;
+                bestChild = child;
+                bestLeft = moveLeft;
+            }
+        }
+    };
+    consider(node.right, node.left);
+    consider(node.left, node.right);
+    if (bestChild < 0) return false;
+
+    const int other = bestChild == node.left ? node.right : node.left;
+    BVHNode &c = nodeArray[bestChild];
+    const int up = bestLeft ? c.left : c.right;
+    if (bestLeft) c.left = other;
+    else c.right = other;
+    parentArray[other] = bestChild;
+    replaceChild(n, other, up);
+
+    const BVHNode &l = nodeArray[c.left];
+    const BVHNode &r = nodeArray[c.right];
+    c.bMin = glm::min(l.bMin, r.bMin);
+    c.bMax = glm::max(l.bMax, r.bMax);
+    markNode(bestChild);
+
+    relink(n);
+    relink(bestChild);
+    return true;
+}
+
+// Refits n and its ancestors, trying a rotation at each. Returns the
+// number of rotations.
+int BVHDynamic::refitUp(int n) {
+    int rotations = 0;
+    for (; n >= 0; n = parentArray[n]) {
+        BVHNode &node = nodeArray[n];
+        const BVHNode &l = nodeArray[node.left];
+        const BVHNode &r = nodeArray[node.right];
+        const glm::vec3 lo = glm::min(l.bMin, r.bMin);
+        const glm::vec3 hi = glm::max(l.bMax, r.bMax);
+        if (lo != node.bMin || hi != node.bMax) {
+            node.bMin = lo;
+            node.bMax = hi;
+            markNode(n);
+        }
+        if (rotate(n)) ++rotations;
+    }
+    return rotations;
+}
+
+// Unlinks a leaf: its sibling takes the place of their parent. Returns the
+// number of rotations on the refitted path.
+int BVHDynamic::removeLeaf(const int leaf) {
+    const int p = parentArray[leaf];
+    const int sibling = nodeArray[p].left == leaf ? nodeArray[p].right : nodeArray[p].left;
+
+    auto freeNode = [this](const int n) {
+        parentArray[n] = -1;
+        ownerArray[n] = -1;
+        freeNodes.push_back(n);
+        --liveNodeCount;
+    };
+    freeNode(leaf);
+
+    if (p == 0) {
+        // The sibling becomes the root, which has to stay in slot 0.
+        moveNode(sibling, 0);
+        parentArray[0] = -1;
+        skipArray[0] = -1;
+        freeNode(sibling);
+        relink(0);
+        return 0;
+    }
+
+    const int g = parentArray[p];
+    replaceChild(g, p, sibling);
+    freeNode(p);
+    relink(g);
+    return refitUp(g);
+}
+
+// -------- Edits -----------
+void BVHDynamic::assign(std::vector<BVHNode> nodes, std::vector<CPU_Triangle> tris) {
+    clear();
+    if (nodes.empty()) return;
+    nodeEnd = static_cast<int>(nodes.size());
+    triEnd = static_cast<int>(tris.size());
+    nodeArray = std::move(nodes);
+    triArray = std::move(tris);
+    growNodes(nodeArray.size() + nodeArray.size() / 8 + kMinSpare);
+    growTris(triArray.size() + triArray.size() / 8 + kMinSpare);
+
+    // Parents, skip links and leaf owners (children are stored after their parent).
+    Range all{0, triEnd, {}};
+    for (int n = 0; n < nodeEnd; ++n) {
+        const BVHNode &node = nodeArray[n];
+        if (node.isLeaf()) {
+            ownerArray[n] = 0;
+            all.leaves.push_back(n);
+            continue;
+        }
+        parentArray[node.left] = parentArray[node.right] = n;
+        skipArray[node.left] = node.right;
+        skipArray[node.right] = skipArray[n];
+    }
+    ranges.push_back(std::move(all));
+    liveNodeCount = nodeEnd;
+    liveTriCount = triEnd;
+    liveRangeCount = 1;
+    fullUpload = true;
+}
+
+int BVHDynamic::insert(std::vector<CPU_Triangle> tris, const BVHBuildSettings &settings, BVHEditStats *outStats) {
+    if (!active() || tris.empty()) return -1;
+    const auto t0 = std::chrono::steady_clock::now();
+
+    // Plain build: no spatial splits (the triangle count must be known up
+    // front), no time-bounded optimization, builder order.
+    BVHBuildSettings local = settings;
+    local.splitBudget = 0.0f;
+    local.optimizeMs = 0.0f;
+    local.layout = BVHLayout::DepthFirst;
+    const std::vector<BVHNode> sub = build_bvh(tris, local);
+    const int count = static_cast<int>(tris.size());
+    const int subCount = static_cast<int>(sub.size());
+
+    // Grow at most once: the subtree plus its new parent.
+    const size_t spare = freeNodes.size() + (nodeArray.size() - static_cast<size_t>(nodeEnd));
+    if (static_cast<size_t>(subCount) + 1 > spare)
+        growNodes(grown_capacity(nodeArray.size(), static_cast<size_t>(nodeEnd) + subCount + 1 - freeNodes.size()));
+
+    const int id = static_cast<int>(ranges.size());
+    Range range;
+    range.first = allocTris(count);
+    range.count = count;
+    std::copy(tris.begin(), tris.end(), triArray.begin() + range.first);
+    dirtyTris.emplace_back(range.first, range.first + count);
+
+    // Subtree into free slots; its right spine keeps -1 until it is linked in.
+    std::vector<int> slot(sub.size());
+    for (int &s: slot) s = allocNode();
+    std::vector<int> subSkip(sub.size(), -1);
+    for (int i = 0; i < subCount; ++i) {
+        BVHNode node = sub[i];
+        const int n = slot[i];
+        if (node.isLeaf()) {
+            node.first += range.first;
+            ownerArray[n] = id;
+            range.leaves.push_back(n);
+        } else {
+            subSkip[node.left] = node.right;
+            subSkip[node.right] = subSkip[i];
+            node.left = slot[node.left];
+            node.right = slot[node.right];
+            parentArray[node.left] = parentArray[node.right] = n;
+            ownerArray[n] = -1;
+        }
+        nodeArray[n] = node;
+        skipArray[n] = subSkip[i] < 0 ? -1 : slot[subSkip[i]];
+        markNode(n);
+    }
+    ranges.push_back(std::move(range));
+
+    // New parent of the subtree and the cheapest sibling.
+    const int x = slot[0];
+    int sibling = findSibling(sub[0].bMin, sub[0].bMax);
+    int p;
+    if (sibling == 0) {
+        // Pairing with the whole tree: the old root moves out of slot 0.
+        sibling = allocNode();
+        moveNode(0, sibling);
+        p = 0;
+        parentArray[0] = -1;
+        skipArray[0] = -1;
+    } else {
+        p = allocNode();
+        replaceChild(parentArray[sibling], sibling, p);
+        skipArray[p] = -2;
+        ownerArray[p] = -1;
+    }
+    BVHNode &parent = nodeArray[p];
+    parent.bMin = glm::min(nodeArray[sibling].bMin, sub[0].bMin);
+    parent.bMax = glm::max(nodeArray[sibling].bMax, sub[0].bMax);
+    parent.left = sibling;
+    parent.right = x;
+    parent.first = -1;
+    parent.count = 0;
+    parentArray[sibling] = parentArray[x] = p;
+    markNode(p);
+
+    if (p != 0) relink(parentArray[p]);
+    relink(p);
+    const int rotations = refitUp(p);
+
+    liveTriCount += count;
+    ++liveRangeCount;
+    if (outStats) {
+        outStats->editMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        outStats->rotations = rotations;
+    }
+    return id;
+}
+
+bool BVHDynamic::remove(const int id, BVHEditStats *outStats) {
+    if (id < 0 || id >= static_cast<int>(ranges.size()) || ranges[id].count == 0 || liveRangeCount <= 1)
+        return false;
+    const auto t0 = std::chrono::steady_clock::now();
+
+    Range &range = ranges[id];
+    int rotations = 0;
+    while (!range.leaves.empty()) {
+        const int leaf = range.leaves.back();
+        range.leaves.pop_back();
+        rotations += removeLeaf(leaf);
+    }
+    freeTris(range.first, range.count);
+    liveTriCount -= range.count;
+    range.count = 0;
+    --liveRangeCount;
+
+    if (outStats) {
+        outStats->editMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        outStats->rotations = rotations;
+    }
+    return true;
+}
+
+// -------- Upload -----------
+void BVHDynamic::upload(BVHHandle &handle, BVHEditStats *outStats) {
+    const auto t0 = std::chrono::steady_clock::now();
+    BVHEditStats stats;
+
+    if (fullUpload) {
+        stats.fullUpload = true;
+        stats.nodesUploaded = static_cast<int>(nodeArray.size());
+        stats.trisUploaded = static_cast<int>(triArray.size());
+        stats.bytesUploaded = upload_bvh(nodeArray, triArray, 2, handle) + handle.triBytes;
+    } else {
+        std::vector<std::pair<int, int>> nodeRuns;
+        nodeRuns.reserve(dirtyNodes.size());
+        for (const int n: dirtyNodes) nodeRuns.emplace_back(n, n + 1);
+        coalesce_runs(nodeRuns, kRunGap);
+        for (const auto &[begin, end]: nodeRuns) {
+            update_bvh_tbo(nodeArray, triArray, handle, begin, end, 0, 0, &skipArray);
+            stats.nodesUploaded += end - begin;
+        }
+        stats.bytesUploaded += static_cast<size_t>(stats.nodesUploaded) * (sizeof(int32_t) * 9);
+
+        coalesce_runs(dirtyTris, 0);
+        if (handle.indexedTris && !dirtyTris.empty()) {
+            // Shared vertices span the whole set: one re-index covers every run.
+            update_bvh_tbo(nodeArray, triArray, handle, 0, 0, 0, static_cast<int>(triArray.size()));
+            stats.trisUploaded = static_cast<int>(triArray.size());
+            stats.bytesUploaded += handle.triBytes;
+        } else {
+            const auto triBytes = static_cast<size_t>(handle.triQuant.bytesPerTri());
+            for (const auto &[begin, end]: dirtyTris) {
+                update_bvh_tbo(nodeArray, triArray, handle, 0, 0, begin, end);
+                stats.trisUploaded += end - begin;
+            }
+            stats.bytesUploaded += static_cast<size_t>(stats.trisUploaded) * triBytes;
+        }
+    }
+
+    for (const int n: dirtyNodes) nodeDirty[n] = 0;
+    dirtyNodes.clear();
+    dirtyTris.clear();
+    fullUpload = false;
+
+    stats.uploadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    if (outStats) {
+        outStats->uploadMs = stats.uploadMs;
+        outStats->nodesUploaded = stats.nodesUploaded;
+        outStats->trisUploaded = stats.trisUploaded;
+        outStats->bytesUploaded = stats.bytesUploaded;
+        outStats->fullUpload = stats.fullUpload;
+    }
+}
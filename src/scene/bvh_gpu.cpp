@@ -0,0 +1,400 @@
+#include "scene/bvh_gpu.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+// Bytes of one box (two RGBA32F texels), key (RG32UI), node and triangle.
+static constexpr size_t kBoxBytes = 32;
+static constexpr size_t kKeyBytes = 8;
+static constexpr size_t kNodeBytes = 32;
+static constexpr size_t kTriBytes = BVHTriQuant::kFloatBytes;
+
+// Items per vertex of the bounds reduction (matches lbvh.vert).
+static constexpr int kReduceFan = 16;
+
+// Texture units the passes read from.
+static constexpr int kTrisUnit = 0;
+static constexpr int kBoxesUnit = 1;
+static constexpr int kKeysUnit = 2;
+
+static void bind_input(const int unit, const GLuint tex) {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_BUFFER, tex);
+}
+
+static void copy_buffer(const GLuint src, const size_t srcOffset, const GLuint dst, const size_t dstOffset,
+                        const size_t bytes) {
+    glBindBuffer(GL_COPY_READ_BUFFER, src);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, dst);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(srcOffset),
+                        static_cast<GLintptr>(dstOffset), static_cast<GLsizeiptr>(bytes));
+}
+
+static void read_buffer(const GLuint buf, const size_t offset, const size_t bytes, void *dst) {
+    glBindBuffer(GL_COPY_READ_BUFFER, buf);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, static_cast<GLintptr>(offset), static_cast<GLsizeiptr>(bytes), dst);
+}
+
+// -------- Setup -----------
+BVHGpuBuilder::BVHGpuBuilder() = default;
+
+BVHGpuBuilder::~BVHGpuBuilder() {
+    release();
+}
+
+bool BVHGpuBuilder::init(const std::string &vertPath, const std::string &fragPath) {
+    release();
+    auto compile = [&](const char *pass, const std::vector<const char *> &outputs) {
+        auto program = std::make_unique<Shader>(vertPath.c_str(), fragPath.c_str(),
+                                                std::string("#define ") + pass + " 1\n", outputs);
+        return program->isValid() ? std::move(program) : nullptr;
+    };
+    const std::vector<const char *> box = {"oMin", "oMax"};
+    const std::vector<const char *> key = {"oKey"};
+    centroidPass = compile("LBVH_CENTROID_BOUNDS", box);
+    reducePass = compile("LBVH_REDUCE", box);
+    mortonPass = compile("LBVH_MORTON", key);
+    sortPass = compile("LBVH_SORT", key);
+    leafPass = compile("LBVH_LEAF_BOXES", box);
+    levelPass = compile("LBVH_BOX_LEVEL", box);
+    nodePass = compile("LBVH_NODES", {"oNode0", "oNode1", "gl_NextBuffer", "oSkip"});
+    triPass = compile("LBVH_TRIS", {"oTex0", "oTex1", "oTex2"});
+    if (!centroidPass || !reducePass || !mortonPass || !sortPass || !leafPass || !levelPass || !nodePass ||
+        !triPass) {
+        release();
+        return false;
+    }
+
+    glGenVertexArrays(1, &vao);
+    glGenQueries(1, &timer);
+    initialized = true;
+    return true;
+}
+
+void BVHGpuBuilder::release() {
+    centroidPass.reset();
+    reducePass.reset();
+    mortonPass.reset();
+    sortPass.reset();
+    leafPass.reset();
+    levelPass.reset();
+    nodePass.reset();
+    triPass.reset();
+    for (Scratch *s: {&srcTris, &boxes[0], &boxes[1], &keys[0], &keys[1], &tree, &level}) freeScratch(*s);
+    if (vao) {
+        glDeleteVertexArrays(1, &vao);
+        vao = 0;
+    }
+    if (timer) {
+        glDeleteQueries(1, &timer);
+        timer = 0;
+    }
+    initialized = false;
+    lastCount = 0;
+}
+
+// Grows s to at least bytes; the contents are not kept.
+void BVHGpuBuilder::reserve(Scratch &s, const size_t bytes, const GLenum format) {
+    if (!s.buf) glGenBuffers(1, &s.buf);
+    if (!s.tex) glGenTextures(1, &s.tex);
+    if (s.bytes >= bytes) return;
+    glBindBuffer(GL_TEXTURE_BUFFER, s.buf);
+    glBufferData(GL_TEXTURE_BUFFER, static_cast<GLsizeiptr>(bytes), nullptr, GL_DYNAMIC_COPY);
+    glBindTexture(GL_TEXTURE_BUFFER, s.tex);
+    glTexBuffer(GL_TEXTURE_BUFFER, format, s.buf);
+    s.bytes = bytes;
+}
+
+void BVHGpuBuilder::freeScratch(Scratch &s) {
+    if (s.tex) glDeleteTextures(1, &s.tex);
+    if (s.buf) glDeleteBuffers(1, &s.buf);
+    s = Scratch{};
+}
+
+// One pass of the bound program over count points, captured into the
+// first bytes of out (binding 1, if any, is set up by the caller).
+void BVHGpuBuilder::draw(const GLuint out, const size_t bytes, const int count) {
+    glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 0, out, 0, static_cast<GLsizeiptr>(bytes));
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, count);
+    glEndTransformFeedback();
+    ++passCount;
+}
+
+// -------- Build -----------
+bool BVHGpuBuilder::build(const std::vector<CPU_Triangle> &tris, BVHHandle &handle, BVHGpuBuildStats *outStats,
+                          std::string *outReason) {
+    auto refuse = [outReason](const std::string &why) {
+        if (outReason) *outReason = why;
+        return false;
+    };
+    if (!initialized) return refuse("builder not initialized");
+    if (tris.empty()) return refuse("no triangles");
+
+    const auto t0 = std::chrono::steady_clock::now();
+    const int n = static_cast<int>(tris.size());
+    int pow2 = 1; // sort and segment tree width
+    while (pow2 < n) pow2 *= 2;
+    const int nodeCount = 2 * n - 1;
+
+    // Scratch streams are read whole through one texture buffer each, and
+    // the passes write nodes and triangles into the first page only.
+    std::string reason;
+    if (!bvh_gpu_build_fits(tris.size(), &reason)) return refuse(reason);
+
+    // Everything is allocated before the passes bind their inputs, since
+    // allocating rebinds the active texture unit. 4 pow2 fits in one page,
+    // and so do the nodes (4 n - 2 texels) and the triangles (3 n).
+    const int centroidGroups = (n + kReduceFan - 1) / kReduceFan;
+    const size_t keyBytes = static_cast<size_t>(pow2) * kKeyBytes;
+    const size_t triBytes = tris.size() * kTriBytes;
+    reserve(srcTris, triBytes, GL_RGBA32F);
+    reserve(boxes[0], static_cast<size_t>(centroidGroups) * kBoxBytes, GL_RGBA32F);
+    reserve(boxes[1], static_cast<size_t>(centroidGroups) * kBoxBytes, GL_RGBA32F);
+    reserve(keys[0], keyBytes, GL_RG32UI);
+    reserve(keys[1], keyBytes, GL_RG32UI);
+    reserve(tree, 2 * static_cast<size_t>(pow2) * kBoxBytes, GL_RGBA32F);
+    reserve(level, static_cast<size_t>(pow2) * kBoxBytes, GL_RGBA32F);
+
+    handle.releaseWide();
+    handle.releaseVerts();
+    handle.triQuant = BVHTriQuant{};
+    handle.indexedTris = false;
+    if (!alloc_bvh_pages(handle.nodePages, static_cast<size_t>(nodeCount) * kNodeBytes, GL_RGBA32I) ||
+        !alloc_bvh_pages(handle.triPages, triBytes, GL_RGBA32UI) || handle.nodePages.count != 1 ||
+        handle.triPages.count != 1) {
+        // The old contents are gone already; leave no half-allocated tree.
+        handle.releaseNodes();
+        handle.triPages.release();
+        handle.triBytes = 0;
+        return refuse("could not allocate single-page node and triangle buffers");
+    }
+    handle.triBytes = triBytes;
+    if (!handle.skipBuf) glGenBuffers(1, &handle.skipBuf);
+    glBindBuffer(GL_TEXTURE_BUFFER, handle.skipBuf);
+    glBufferData(GL_TEXTURE_BUFFER, static_cast<GLsizeiptr>(nodeCount) * 4, nullptr, GL_STATIC_DRAW);
+    if (!handle.skipTex) glGenTextures(1, &handle.skipTex);
+    glBindTexture(GL_TEXTURE_BUFFER, handle.skipTex);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R32I, handle.skipBuf);
+
+    // The only upload: the source triangles.
+    std::vector<float> src;
+    src.reserve(tris.size() * 12);
+    for (const CPU_Triangle &t: tris) {
+        for (const glm::vec3 &v: {t.v0, t.e1, t.e2}) {
+            src.push_back(v.x);
+            src.push_back(v.y);
+            src.push_back(v.z);
+            src.push_back(0.0f);
+        }
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, srcTris.buf);
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, static_cast<GLsizeiptr>(src.size() * sizeof(float)), src.data());
+
+    passCount = 0;
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBindVertexArray(vao);
+    glBeginQuery(GL_TIME_ELAPSED, timer);
+    bind_input(kTrisUnit, srcTris.tex);
+
+    // Centroid bounds: 16 to 1 reductions, then a 32-byte readback so the
+    // Morton grid is derived on the CPU exactly as build_bvh() does.
+    int groups = centroidGroups;
+    centroidPass->use();
+    centroidPass->setInt("uTris", kTrisUnit);
+    centroidPass->setInt("uCount", n);
+    draw(boxes[0].buf, static_cast<size_t>(groups) * kBoxBytes, groups);
+    int cur = 0;
+    reducePass->use();
+    reducePass->setInt("uBoxes", kBoxesUnit);
+    while (groups > 1) {
+        const int next = (groups + kReduceFan - 1) / kReduceFan;
+        bind_input(kBoxesUnit, boxes[cur].tex);
+        reducePass->setInt("uCount", groups);
+        draw(boxes[1 - cur].buf, static_cast<size_t>(next) * kBoxBytes, next);
+        cur = 1 - cur;
+        groups = next;
+    }
+    float bounds[8];
+    read_buffer(boxes[cur].buf, 0, sizeof(bounds), bounds);
+    const glm::vec3 cMin(bounds[0], bounds[1], bounds[2]);
+    const glm::vec3 extent = glm::vec3(bounds[4], bounds[5], bounds[6]) - cMin;
+    const glm::vec3 invExtent(extent.x > 0.0f ? 1.0f / extent.x : 0.0f,
+                              extent.y > 0.0f ? 1.0f / extent.y : 0.0f,
+                              extent.z > 0.0f ? 1.0f / extent.z : 0.0f);
+
+    // Morton keys, padded to a power of two, then a bitonic sort.
+    mortonPass->use();
+    mortonPass->setInt("uTris", kTrisUnit);
+    mortonPass->setInt("uCount", n);
+    mortonPass->setVec3("uCentroidMin", cMin);
+    mortonPass->setVec3("uInvExtent", invExtent);
+    draw(keys[0].buf, keyBytes, pow2);
+    cur = 0;
+    sortPass->use();
+    sortPass->setInt("uKeys", kKeysUnit);
+    for (int stage = 2; stage <= pow2; stage *= 2) {
+        sortPass->setInt("uStage", stage);
+        for (int stride = stage / 2; stride > 0; stride /= 2) {
+            bind_input(kKeysUnit, keys[cur].tex);
+            sortPass->setInt("uStride", stride);
+            draw(keys[1 - cur].buf, keyBytes, pow2);
+            cur = 1 - cur;
+        }
+    }
+    sortedKeys = cur;
+    bind_input(kKeysUnit, keys[cur].tex);
+
+    // Segment tree over the sorted leaf boxes: leaves at [pow2, 2 pow2),
+    // each level above written to scratch and copied into place.
+    leafPass->use();
+    leafPass->setInt("uTris", kTrisUnit);
+    leafPass->setInt("uKeys", kKeysUnit);
+    leafPass->setInt("uCount", n);
+    draw(level.buf, static_cast<size_t>(pow2) * kBoxBytes, pow2);
+    copy_buffer(level.buf, 0, tree.buf, static_cast<size_t>(pow2) * kBoxBytes, static_cast<size_t>(pow2) * kBoxBytes);
+    bind_input(kBoxesUnit, tree.tex);
+    levelPass->use();
+    levelPass->setInt("uBoxes", kBoxesUnit);
+    for (int first = pow2 / 2; first >= 1; first /= 2) {
+        const size_t bytes = static_cast<size_t>(first) * kBoxBytes;
+        levelPass->setInt("uLevel", first);
+        draw(level.buf, bytes, first);
+        copy_buffer(level.buf, 0, tree.buf, bytes, bytes);
+    }
+
+    // Nodes and skip links, straight into the buffers the tracer reads.
+
+    nodePass->use();
+    nodePass->setInt("uBoxes", kBoxesUnit);
+    nodePass->setInt("uKeys", kKeysUnit);
+    nodePass->setInt("uCount", n);
+    nodePass->setInt("uLeafBase", pow2);
+    glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 1, handle.skipBuf, 0, static_cast<GLsizeiptr>(nodeCount) * 4);
+    draw(handle.nodePages.buf[0], static_cast<size_t>(nodeCount) * kNodeBytes, nodeCount);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 1, 0);
+
+    // Triangles in leaf order.
+    triPass->use();
+    triPass->setInt("uTris", kTrisUnit);
+    triPass->setInt("uKeys", kKeysUnit);
+    triPass->setInt("uAffine", handle.triTest == BVHTriTest::Affine ? 1 : 0);
+    draw(handle.triPages.buf[0], triBytes, n);
+
+    glEndQuery(GL_TIME_ELAPSED);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glBindVertexArray(0);
+    glDisable(GL_RASTERIZER_DISCARD);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    for (const int unit: {kKeysUnit, kBoxesUnit, kTrisUnit}) bind_input(unit, 0);
+    glUseProgram(0);
+
+    GLuint64 ns = 0;
+    glGetQueryObjectui64v(timer, GL_QUERY_RESULT, &ns); // waits for the passes
+    lastCount = n;
+    if (outStats) {
+        outStats->buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        outStats->gpuMs = static_cast<double>(ns) * 1e-6;
+        outStats->passes = passCount;
+        outStats->nodeCount = nodeCount;
+        outStats->uploadBytes = src.size() * sizeof(float);
+        outStats->nodeBytes = static_cast<size_t>(nodeCount) * (kNodeBytes + 4);
+    }
+    return true;
+}
+
+// -------- Validation -----------
+BVHGpuValidation BVHGpuBuilder::validate(const std::vector<CPU_Triangle> &tris, const BVHHandle &handle) const {
+    BVHGpuValidation result;
+    if (lastCount == 0 || static_cast<int>(tris.size()) != lastCount || handle.nodePages.count == 0) return result;
+    const int n = lastCount;
+    const int nodeCount = 2 * n - 1;
+
+    // Read back the nodes, skip links and sorted keys.
+    std::vector<int32_t> words(static_cast<size_t>(nodeCount) * 8);
+    read_buffer(handle.nodePages.buf[0], 0, words.size() * sizeof(int32_t), words.data());
+    std::vector<int32_t> skips(static_cast<size_t>(nodeCount));
+    read_buffer(handle.skipBuf, 0, skips.size() * sizeof(int32_t), skips.data());
+    std::vector<uint32_t> sorted(static_cast<size_t>(n) * 2);
+    read_buffer(keys[sortedKeys].buf, 0, sorted.size() * sizeof(uint32_t), sorted.data());
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+    std::vector<BVHNode> gpu(static_cast<size_t>(nodeCount));
+    for (int i = 0; i < nodeCount; ++i) {
+        const int32_t *w = &words[static_cast<size_t>(i) * 8];
+        BVHNode &node = gpu[i];
+        std::memcpy(&node.bMin, w, 3 * sizeof(float));
+        std::memcpy(&node.bMax, w + 4, 3 * sizeof(float));
+        if (w[7] < 0) {
+            node.first = w[3];
+            node.count = -w[7];
+            node.left = node.right = -1;
+        } else {
+            node.left = w[3];
+            node.right = w[7];
+            node.first = -1;
+            node.count = 0;
+        }
+    }
+    result.nodeCount = nodeCount;
+    result.gpuSahCost = bvh_sah_cost(gpu);
+
+    // Skip links as skip_links() derives them, walked from the root.
+    // A child index out of range or reached twice counts as a mismatch.
+    std::vector<int> expect(static_cast<size_t>(nodeCount), -1);
+    std::vector<char> seen(static_cast<size_t>(nodeCount), 0);
+    std::vector<int> stack{0};
+    while (!stack.empty()) {
+        const int i = stack.back();
+        stack.pop_back();
+        const BVHNode &node = gpu[i];
+        if (node.isLeaf()) continue;
+        if (node.left < 0 || node.left >= nodeCount || node.right < 0 || node.right >= nodeCount ||
+            seen[node.left] || seen[node.right]) {
+            ++result.nodeMismatches;
+            continue;
+        }
+        seen[node.left] = seen[node.right] = 1;
+        expect[node.left] = node.right;
+        expect[node.right] = expect[i];
+        stack.push_back(node.left);
+        stack.push_back(node.right);
+    }
+    for (int i = 0; i < nodeCount; ++i) result.skipMismatches += expect[i] != skips[i];
+
+    // Reference: the CPU LBVH with the same code width and one triangle per leaf.
+    BVHBuildSettings reference;
+    reference.method = BVHBuildMethod::LBVH;
+    reference.mortonBits = 30;
+    reference.leafMax = 1;
+    std::vector<CPU_Triangle> cpuTris = tris;
+    std::vector<int> source;
+    const auto t0 = std::chrono::steady_clock::now();
+    const std::vector<BVHNode> cpu = build_bvh(cpuTris, reference, nullptr, &source);
+    result.cpuBuildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    result.cpuSahCost = bvh_sah_cost(cpu, reference);
+
+    // Walk both trees side by side: same shape, bounds and leaf triangles.
+    std::vector<std::pair<int, int>> pairs{{0, 0}};
+    while (!pairs.empty()) {
+        const auto [c, g] = pairs.back();
+        pairs.pop_back();
+        const BVHNode &a = cpu[c];
+        const BVHNode &b = gpu[g];
+        if (a.isLeaf() != b.isLeaf() || std::memcmp(&a.bMin, &b.bMin, sizeof(glm::vec3)) != 0 ||
+            std::memcmp(&a.bMax, &b.bMax, sizeof(glm::vec3)) != 0)
+            ++result.nodeMismatches;
+        if (a.isLeaf() != b.isLeaf()) continue;
+        if (a.isLeaf()) {
+            if (b.first < 0 || b.first >= n || source[a.first] != static_cast<int>(sorted[2 * b.first + 1]))
+                ++result.triMismatches;
+            continue;
+        }
+        if (b.left < 0 || b.left >= nodeCount || b.right < 0 || b.right >= nodeCount) continue;
+        pairs.emplace_back(a.left, b.left);
+        pairs.emplace_back(a.right, b.right);
+    }
+    return result;
+}
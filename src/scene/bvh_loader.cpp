@@ -0,0 +1,200 @@
+#include "scene/bvh_loader.h"
+#include "scene/model.h"
+
+const char *bvh_load_stage_name(const BVHLoadStage stage) {
+    switch (stage) {
+        case BVHLoadStage::Idle: return "idle";
+        case BVHLoadStage::Queued: return "queued";
+        case BVHLoadStage::Building: return "importing and building";
+        case BVHLoadStage::Refining: return "refining";
+        case BVHLoadStage::Keyframes: return "loading keyframes";
+        case BVHLoadStage::Metrics: return "computing metrics";
+    }
+    return "unknown";
+}
+
+BVHLoader::~BVHLoader() {
+    stop();
+}
+
+// -------- Render thread -----------
+uint64_t BVHLoader::submit(BVHLoadRequest request) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!worker.joinable()) {
+        stopping = false;
+        worker = std::thread(&BVHLoader::run, this);
+    }
+
+    latestPath = request.path;
+    latestStart = std::chrono::steady_clock::now();
+    pending = std::move(request);
+    pendingId = ++latestId;
+    hasPending = true;
+    stage = BVHLoadStage::Queued;
+    dropStale();
+    wake.notify_one();
+    return pendingId;
+}
+
+bool BVHLoader::poll(BVHLoadResult &out) {
+    std::lock_guard<std::mutex> lock(mutex);
+    dropStale();
+    if (completed.empty()) return false;
+    out = std::move(completed.front());
+    completed.pop_front();
+    return true;
+}
+
+bool BVHLoader::wait(BVHLoadResult &out) {
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [this] {
+        dropStale();
+        while (!completed.empty() && completed.front().preview) completed.pop_front();
+        return !completed.empty() || stage == BVHLoadStage::Idle || stopping;
+    });
+    if (completed.empty()) return false;
+    out = std::move(completed.front());
+    completed.pop_front();
+    return true;
+}
+
+void BVHLoader::cancel() {
+    std::lock_guard<std::mutex> lock(mutex);
+    hasPending = false;
+    ++latestId;
+    stage = BVHLoadStage::Idle;
+    completed.clear();
+}
+
+BVHLoadProgress BVHLoader::progress() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    BVHLoadProgress p;
+    p.stage = stage;
+    if (stage != BVHLoadStage::Idle) {
+        p.path = latestPath;
+        p.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - latestStart).count();
+    }
+    return p;
+}
+
+void BVHLoader::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        hasPending = false;
+        stage = BVHLoadStage::Idle;
+    }
+    wake.notify_one();
+    finished.notify_all();
+    if (worker.joinable()) worker.join();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    completed.clear();
+}
+
+void BVHLoader::dropStale() {
+    while (!completed.empty() && completed.front().id != latestId) completed.pop_front();
+}
+
+// -------- Worker thread -----------
+void BVHLoader::run() {
+    for (;;) {
+        uint64_t id;
+        BVHLoadRequest request;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return stopping || hasPending; });
+            if (stopping) return;
+            id = pendingId;
+            request = std::move(pending);
+            hasPending = false;
+        }
+
+        const auto t0 = std::chrono::steady_clock::now();
+        BVHLoadResult result;
+        process(id, request, result);
+        result.id = id;
+        result.request = std::move(request);
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (id == latestId) {
+                completed.push_back(std::move(result));
+                stage = BVHLoadStage::Idle;
+            }
+        }
+        finished.notify_all();
+    }
+}
+
+void BVHLoader::publishPreview(const uint64_t id, const BVHLoadRequest &request, BVHPrepared &preview,
+                               const double seconds) {
+    BVHLoadResult result;
+    result.id = id;
+    result.request = request;
+    result.ok = true;
+    result.preview = true;
+    result.prepared = std::move(preview);
+    result.seconds = seconds;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (id != latestId || stopping) return;
+        completed.push_back(std::move(result));
+        stage = BVHLoadStage::Refining;
+    }
+    finished.notify_all();
+}
+
+bool BVHLoader::setStage(const uint64_t id, const BVHLoadStage newStage) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (id != latestId || stopping) return false;
+    stage = newStage;
+    return true;
+}
+
+void BVHLoader::process(const uint64_t id, const BVHLoadRequest &request, BVHLoadResult &out) {
+    if (!setStage(id, BVHLoadStage::Building)) return;
+    const BVHBuildSettings &settings = request.settings;
+
+    // Two-level: one object-space BLAS per mesh; the TLAS depends on the
+    // instance placement and is built on the render thread.
+    if (request.twoLevel) {
+        out.prepared.model = std::make_unique<Model>(request.path, false);
+        if (out.prepared.model->meshes.empty()) {
+            out.prepared.model.reset();
+            return;
+        }
+        build_blas_from_model(*out.prepared.model, settings, out.blas, &out.prepared.stats);
+        out.ok = true;
+        return;
+    }
+
+    const char *cacheDir = request.cacheDir.empty() ? nullptr : request.cacheDir.c_str();
+    const auto t0 = std::chrono::steady_clock::now();
+    auto onPreview = [&](BVHPrepared &preview) {
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        publishPreview(id, request, preview, seconds);
+    };
+    if (!prepare_bvh_from_model_path(request.path.c_str(), request.modelTransform, settings, out.prepared, true,
+                                     cacheDir, request.previewTris, onPreview)) {
+        return;
+    }
+    out.ok = true;
+
+    // Sibling frames (name_0000.obj, name_0001.obj, ...) make this a keyframe sequence.
+    const std::vector<std::string> frames = find_keyframe_files(request.path);
+    out.keyframeFiles = static_cast<int>(frames.size());
+    if (!frames.empty()) {
+        if (!setStage(id, BVHLoadStage::Keyframes)) return;
+        load_keyframe_sequence(frames, request.modelTransform, out.anim);
+    }
+
+    // Shape metrics without end-point overlap, which is computed on request.
+    if (!setStage(id, BVHLoadStage::Metrics)) return;
+    out.metrics = compute_bvh_metrics(out.prepared.geometry.nodes,
+                                      out.prepared.geometry.tris,
+                                      settings,
+                                      settings.gpuWidth,
+                                      false);
+}
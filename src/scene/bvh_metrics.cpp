@@ -0,0 +1,476 @@
+#include "scene/bvh_metrics.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+
+// -------- Geometry helpers -----------
+static float half_area(const glm::vec3 &bMin, const glm::vec3 &bMax) {
+    const glm::vec3 e = glm::max(bMax - bMin, glm::vec3(0.0f));
+    return e.x * e.y + e.y * e.z + e.z * e.x;
+}
+
+static float volume(const glm::vec3 &bMin, const glm::vec3 &bMax) {
+    const glm::vec3 e = glm::max(bMax - bMin, glm::vec3(0.0f));
+    return e.x * e.y * e.z;
+}
+
+static bool boxes_overlap(const glm::vec3 &aMin, const glm::vec3 &aMax, const glm::vec3 &bMin, const glm::vec3 &bMax) {
+    return aMin.x <= bMax.x && aMin.y <= bMax.y && aMin.z <= bMax.z &&
+           bMin.x <= aMax.x && bMin.y <= aMax.y && bMin.z <= aMax.z;
+}
+
+static bool box_contains(const glm::vec3 &bMin, const glm::vec3 &bMax, const glm::vec3 &pMin, const glm::vec3 &pMax) {
+    return bMin.x <= pMin.x && bMin.y <= pMin.y && bMin.z <= pMin.z &&
+           pMax.x <= bMax.x && pMax.y <= bMax.y && pMax.z <= bMax.z;
+}
+
+// Area of a planar polygon.
+static float polygon_area(const glm::vec3 *p, const int n) {
+    glm::vec3 sum(0.0f);
+    for (int i = 1; i + 1 < n; ++i) sum += glm::cross(p[i] - p[0], p[i + 1] - p[0]);
+    return 0.5f * glm::length(sum);
+}
+
+// Area of the part of t inside [bMin, bMax] (Sutherland–Hodgman against the 6 slabs).
+static float clipped_area(const CPU_Triangle &t, const glm::vec3 &bMin, const glm::vec3 &bMax) {
+    constexpr int kMaxVerts = 9; // a triangle clipped by 6 planes has at most 9 vertices
+    glm::vec3 poly[kMaxVerts + 1] = {t.v0, t.v0 + t.e1, t.v0 + t.e2};
+    glm::vec3 next[kMaxVerts + 1];
+    int n = 3;
+    for (int plane = 0; plane < 6 && n > 0; ++plane) {
+        const int axis = plane >> 1;
+        const bool isMax = plane & 1;
+        const float bound = isMax ? bMax[axis] : bMin[axis];
+        auto inside = [&](const glm::vec3 &p) { return isMax ? p[axis] <= bound : p[axis] >= bound; };
+
+        int m = 0;
+        for (int i = 0; i < n; ++i) {
+            const glm::vec3 &a = poly[i];
+            const glm::vec3 &b = poly[(i + 1) % n];
+            const bool inA = inside(a);
+            const bool inB = inside(b);
+            if (inA) next[m++] = a;
+            if (inA != inB && m < kMaxVerts) {
+                glm::vec3 x = glm::mix(a, b, (bound - a[axis]) / (b[axis] - a[axis]));
+                x[axis] = bound;
+                next[m++] = x;
+            }
+        }
+        std::copy(next, next + m, poly);
+        n = m;
+    }
+    return n >= 3 ? polygon_area(poly, n) : 0.0f;
+}
+
+// -------- End-point overlap -----------
+// For triangle i, walks every node whose box it touches and adds the
+// clipped area for nodes whose subtree does not contain it. Nodes are
+// numbered in pre-order, so subtree n spans [enter[n], leave[n]) and
+// contains triangle i if the number of its leaf, leafOf[i], lies inside.
+// This holds for every BVHLayout, whatever the order of the triangles.
+static double epo_sum(const std::vector<BVHNode> &nodes, const std::vector<CPU_Triangle> &tris,
+                      const std::vector<int> &enter, const std::vector<int> &leave, const std::vector<int> &leafOf,
+                      const BVHBuildSettings &settings, const int triBegin, const int triEnd) {
+    double sum = 0.0;
+    std::vector<int> stack;
+    for (int i = triBegin; i < triEnd; ++i) {
+        const CPU_Triangle &t = tris[i];
+        const glm::vec3 tMin = glm::min(t.v0, glm::min(t.v0 + t.e1, t.v0 + t.e2));
+        const glm::vec3 tMax = glm::max(t.v0, glm::max(t.v0 + t.e1, t.v0 + t.e2));
+        const float fullArea = 0.5f * glm::length(glm::cross(t.e1, t.e2));
+
+        stack.assign(1, 0);
+        while (!stack.empty()) {
+            const int n = stack.back();
+            stack.pop_back();
+            const BVHNode &node = nodes[n];
+
+            // Children lie inside this box: nothing below it can touch the triangle.
+            if (!boxes_overlap(tMin, tMax, node.bMin, node.bMax)) continue;
+
+            if (leafOf[i] < enter[n] || leafOf[i] >= leave[n]) {
+                const bool contained = box_contains(node.bMin, node.bMax, tMin, tMax);
+                const float area = contained ? fullArea : clipped_area(t, node.bMin, node.bMax);
+                if (area <= 0.0f) continue;
+                sum += static_cast<double>(area) *
+                       (node.isLeaf() ? settings.intersectCost * static_cast<float>(node.count)
+                                      : settings.traversalCost);
+            }
+            if (!node.isLeaf()) {
+                stack.push_back(node.left);
+                stack.push_back(node.right);
+            }
+        }
+    }
+    return sum;
+}
+
+static float compute_epo(const std::vector<BVHNode> &nodes, const std::vector<CPU_Triangle> &tris,
+                         const BVHBuildSettings &settings) {
+    // Pre-order numbers of every subtree (children are stored after their parent).
+    const int nodeCount = static_cast<int>(nodes.size());
+    std::vector<int> enter(nodeCount), leave(nodeCount), size(nodeCount, 1);
+    for (int n = nodeCount - 1; n >= 0; --n)
+        if (!nodes[n].isLeaf()) size[n] += size[nodes[n].left] + size[nodes[n].right];
+    enter[0] = 0;
+    std::vector<int> leafOf(tris.size(), -1);
+    for (int n = 0; n < nodeCount; ++n) {
+        const BVHNode &node = nodes[n];
+        leave[n] = enter[n] + size[n];
+        if (node.isLeaf()) {
+            for (int i = node.first; i < node.first + node.count; ++i) leafOf[i] = enter[n];
+        } else {
+            enter[node.left] = enter[n] + 1;
+            enter[node.right] = enter[n] + 1 + size[node.left];
+        }
+    }
+
+    double totalArea = 0.0;
+    for (const auto &t: tris) totalArea += 0.5 * glm::length(glm::cross(t.e1, t.e2));
+    if (totalArea <= 0.0) return 0.0f;
+
+    // Independent per triangle: split into chunks, merge partial sums in order.
+    const int triCount = static_cast<int>(tris.size());
+    const int hw = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    const int chunks = std::clamp(triCount / 4096, 1, hw);
+    std::vector<double> partial(chunks, 0.0);
+    std::vector<std::thread> workers;
+    for (int c = 0; c < chunks; ++c) {
+        const int cb = static_cast<int>(static_cast<long long>(triCount) * c / chunks);
+        const int ce = static_cast<int>(static_cast<long long>(triCount) * (c + 1) / chunks);
+        auto work = [&, c, cb, ce] { partial[c] = epo_sum(nodes, tris, enter, leave, leafOf, settings, cb, ce); };
+        if (c + 1 < chunks) workers.emplace_back(work);
+        else work();
+    }
+    for (auto &w: workers) w.join();
+
+    double sum = 0.0;
+    for (const double p: partial) sum += p;
+    return static_cast<float>(sum / totalArea);
+}
+
+// -------- Stack estimate -----------
+// Worst case of the shader's push-all-children traversal: at node v the
+// stack holds the pending siblings of every ancestor, then v's children.
+static int binary_stack_high_water(const std::vector<BVHNode> &nodes) {
+    std::vector<int> pending(nodes.size(), 0);
+    int highWater = 1; // the root
+    for (size_t n = 0; n < nodes.size(); ++n) {
+        const BVHNode &node = nodes[n];
+        if (node.isLeaf()) continue;
+        highWater = std::max(highWater, pending[n] + 2);
+        pending[node.left] = pending[n] + 1;
+        pending[node.right] = pending[n] + 1;
+    }
+    return highWater;
+}
+
+static int wide_stack_high_water(const std::vector<BVHNode> &nodes, const int width) {
+    const std::vector<BVHWideNode> wide = collapse_bvh(nodes, width);
+    if (wide.empty()) return 0;
+
+    struct Item {
+        int node;
+        int pending;
+    };
+    std::vector<Item> stack{{0, 0}};
+    int highWater = 1;
+    while (!stack.empty()) {
+        const Item item = stack.back();
+        stack.pop_back();
+        const BVHWideNode &w = wide[item.node];
+
+        int innerChildren = 0;
+        for (int k = 0; k < w.childCount; ++k) innerChildren += w.children[k].count == 0 ? 1 : 0;
+        highWater = std::max(highWater, item.pending + innerChildren);
+        for (int k = 0; k < w.childCount; ++k) {
+            if (w.children[k].count == 0) stack.push_back({w.children[k].index, item.pending + innerChildren - 1});
+        }
+    }
+    return highWater;
+}
+
+BVHMetrics compute_bvh_metrics(const std::vector<BVHNode> &nodes, const std::vector<CPU_Triangle> &tris,
+                               const BVHBuildSettings &settings, const int gpuWidth, const bool withEpo) {
+    BVHMetrics m;
+    m.gpuWidth = gpuWidth;
+    if (nodes.empty()) return m;
+
+    m.nodeCount = static_cast<int>(nodes.size());
+    m.sahCost = bvh_sah_cost(nodes, settings);
+
+    // Depths (children are stored after their parent) and per-node sums.
+    std::vector<int> depth(nodes.size(), 0);
+    const float rootArea = std::max(half_area(nodes[0].bMin, nodes[0].bMax), 1e-30f);
+    double depthSum = 0.0, emptySum = 0.0, emptyWeight = 0.0;
+    for (size_t n = 0; n < nodes.size(); ++n) {
+        const BVHNode &node = nodes[n];
+        if (node.isLeaf()) {
+            ++m.leafCount;
+            m.triCount += node.count;
+            m.maxDepth = std::max(m.maxDepth, depth[n]);
+            depthSum += depth[n];
+            ++m.leafSizes[std::min(node.count, BVHMetrics::kLeafHistogramBins - 1)];
+            continue;
+        }
+        depth[node.left] = depth[n] + 1;
+        depth[node.right] = depth[n] + 1;
+
+        // Volume of this node that lies in neither child.
+        const float v = volume(node.bMin, node.bMax);
+        if (v > 0.0f) {
+            const BVHNode &l = nodes[node.left];
+            const BVHNode &r = nodes[node.right];
+            const float overlap = volume(glm::max(l.bMin, r.bMin), glm::min(l.bMax, r.bMax));
+            const float covered = volume(l.bMin, l.bMax) + volume(r.bMin, r.bMax) - overlap;
+            const double weight = half_area(node.bMin, node.bMax) / rootArea;
+            emptySum += weight * std::clamp(1.0f - covered / v, 0.0f, 1.0f);
+            emptyWeight += weight;
+        }
+    }
+    m.avgDepth = static_cast<float>(depthSum / m.leafCount);
+    m.avgLeafSize = static_cast<float>(m.triCount) / static_cast<float>(m.leafCount);
+    m.emptySpace = emptyWeight > 0.0 ? static_cast<float>(emptySum / emptyWeight) : 0.0f;
+
+    m.stackHighWater = gpuWidth > 2 ? wide_stack_high_water(nodes, gpuWidth) : binary_stack_high_water(nodes);
+    if (withEpo) m.epo = compute_epo(nodes, tris, settings);
+    return m;
+}
+
+// -------- Fetch locality -----------
+// Set-associative LRU cache over 64-bit line addresses.
+struct LineCache {
+    static constexpr int kSets = BVHLocality::kCacheBytes / (BVHLocality::kLineBytes * BVHLocality::kWays);
+
+    uint64_t tags[kSets][BVHLocality::kWays];
+    uint64_t used[kSets][BVHLocality::kWays] = {};
+    uint64_t clock = 0;
+
+    LineCache() {
+        for (auto &set: tags)
+            for (auto &tag: set) tag = ~0ull;
+    }
+
+    // Returns true on a hit; a miss replaces the least recently used way.
+    bool access(const uint64_t line) {
+        const int s = static_cast<int>(line % kSets);
+        int victim = 0;
+        for (int w = 0; w < BVHLocality::kWays; ++w) {
+            if (tags[s][w] == line) {
+                used[s][w] = ++clock;
+                return true;
+            }
+            if (used[s][w] < used[s][victim]) victim = w;
+        }
+        tags[s][victim] = line;
+        used[s][victim] = ++clock;
+        return false;
+    }
+};
+
+// Separate address ranges for the node, skip-link and triangle buffers.
+enum LocalityStream : uint64_t { kNodeStream = 0, kSkipStream = 1, kTriStream = 2 };
+
+struct LocalityCounter {
+    LineCache cache;
+    uint64_t nodeFetches = 0, nodeAccesses = 0, nodeMisses = 0;
+    uint64_t triAccesses = 0, triMisses = 0;
+
+    void fetch(const LocalityStream stream, const uint64_t offset, const uint64_t bytes) {
+        const uint64_t first = offset / BVHLocality::kLineBytes;
+        const uint64_t last = (offset + bytes - 1) / BVHLocality::kLineBytes;
+        for (uint64_t line = first; line <= last; ++line) {
+            const bool hit = cache.access(static_cast<uint64_t>(stream) << 56 | line);
+            if (stream == kTriStream) {
+                ++triAccesses;
+                triMisses += hit ? 0 : 1;
+            } else {
+                ++nodeAccesses;
+                nodeMisses += hit ? 0 : 1;
+            }
+        }
+    }
+
+    void fetchNode(const int n) {
+        ++nodeFetches;
+        fetch(kNodeStream, static_cast<uint64_t>(n) * sizeof(BVHNode), sizeof(BVHNode));
+    }
+};
+
+// Slab test with the interval clamped to t >= 0, like aabbHit().
+static bool locality_box_hit(const glm::vec3 &o, const glm::vec3 &invDir, const BVHNode &node, float &tEnter) {
+    const glm::vec3 t0 = (node.bMin - o) * invDir;
+    const glm::vec3 t1 = (node.bMax - o) * invDir;
+    const glm::vec3 lo = glm::min(t0, t1);
+    const glm::vec3 hi = glm::max(t0, t1);
+    tEnter = std::max(std::max(lo.x, lo.y), std::max(lo.z, 0.0f));
+    const float tExit = std::min(std::min(hi.x, hi.y), hi.z);
+    return tExit >= tEnter;
+}
+
+// Möller–Trumbore, as triHit().
+static bool locality_tri_hit(const glm::vec3 &o, const glm::vec3 &d, const CPU_Triangle &t, const float tMax,
+                             float &tHit) {
+    const glm::vec3 p = glm::cross(d, t.e2);
+    const float det = glm::dot(t.e1, p);
+    if (std::fabs(det) < 1e-12f) return false;
+    const float invDet = 1.0f / det;
+    const glm::vec3 s = o - t.v0;
+    const float u = glm::dot(s, p) * invDet;
+    if (u < 0.0f || u > 1.0f) return false;
+    const glm::vec3 q = glm::cross(s, t.e1);
+    const float v = glm::dot(d, q) * invDet;
+    if (v < 0.0f || u + v > 1.0f) return false;
+    const float tt = glm::dot(t.e2, q) * invDet;
+    if (tt < 1e-4f || tt > tMax) return false;
+    tHit = tt;
+    return true;
+}
+
+BVHLocality measure_bvh_locality(const std::vector<BVHNode> &nodes, const std::vector<CPU_Triangle> &tris,
+                                 const std::vector<glm::vec3> &origins, const std::vector<glm::vec3> &dirs,
+                                 const int triBytes, const bool stackless) {
+    BVHLocality result;
+    const size_t rayCount = std::min(origins.size(), dirs.size());
+    if (nodes.empty() || rayCount == 0) return result;
+    const auto t0 = std::chrono::steady_clock::now();
+
+    // Skip links as built by the upload (children are stored after their parent).
+    std::vector<int> skip;
+    if (stackless) {
+        skip.assign(nodes.size(), -1);
+        for (size_t n = 0; n < nodes.size(); ++n) {
+            if (nodes[n].isLeaf()) continue;
+            skip[nodes[n].left] = nodes[n].right;
+            skip[nodes[n].right] = skip[n];
+        }
+    }
+
+    LocalityCounter c;
+    const uint64_t entryBytes = static_cast<uint64_t>(std::max(triBytes, 1));
+    std::vector<int> stack;
+
+    for (size_t r = 0; r < rayCount; ++r) {
+        const glm::vec3 &o = origins[r];
+        const glm::vec3 &d = dirs[r];
+        const glm::vec3 invDir = 1.0f / d;
+        float tBest = 1e30f;
+
+        auto testLeaf = [&](const BVHNode &node) {
+            for (int i = node.first; i < node.first + node.count; ++i) {
+                c.fetch(kTriStream, static_cast<uint64_t>(i) * entryBytes, entryBytes);
+                float t;
+                if (locality_tri_hit(o, d, tris[i], tBest, t)) tBest = t;
+            }
+        };
+
+        if (stackless) {
+            int n = 0;
+            while (n >= 0) {
+                c.fetchNode(n);
+                const BVHNode &node = nodes[n];
+                float tEnter;
+                if (!locality_box_hit(o, invDir, node, tEnter) || tEnter > tBest) {
+                    c.fetch(kSkipStream, static_cast<uint64_t>(n) * sizeof(int32_t), sizeof(int32_t));
+                    n = skip[n];
+                } else if (node.isLeaf()) {
+                    testLeaf(node);
+                    c.fetch(kSkipStream, static_cast<uint64_t>(n) * sizeof(int32_t), sizeof(int32_t));
+                    n = skip[n];
+                } else {
+                    n = node.left;
+                }
+            }
+            continue;
+        }
+
+        stack.assign(1, 0);
+        while (!stack.empty()) {
+            const int n = stack.back();
+            stack.pop_back();
+            c.fetchNode(n);
+            const BVHNode &node = nodes[n];
+            float tEnter;
+            if (!locality_box_hit(o, invDir, node, tEnter) || tEnter > tBest) continue;
+            if (node.isLeaf()) {
+                testLeaf(node);
+                continue;
+            }
+
+            c.fetchNode(node.left);
+            c.fetchNode(node.right);
+            float tL, tR;
+            const bool hitL = locality_box_hit(o, invDir, nodes[node.left], tL) && tL <= tBest;
+            const bool hitR = locality_box_hit(o, invDir, nodes[node.right], tR) && tR <= tBest;
+            if (hitL && hitR) {
+                const bool leftFirst = tL < tR;
+                stack.push_back(leftFirst ? node.right : node.left);
+                stack.push_back(leftFirst ? node.left : node.right);
+            } else if (hitL) {
+                stack.push_back(node.left);
+            } else if (hitR) {
+                stack.push_back(node.right);
+            }
+        }
+    }
+
+    const auto rays = static_cast<double>(rayCount);
+    result.rays = static_cast<int>(rayCount);
+    result.nodeFetchesPerRay = static_cast<float>(static_cast<double>(c.nodeFetches) / rays);
+    result.nodeLinesPerRay = static_cast<float>(static_cast<double>(c.nodeMisses) / rays);
+    result.triLinesPerRay = static_cast<float>(static_cast<double>(c.triMisses) / rays);
+    if (c.nodeAccesses)
+        result.nodeHitRate = 1.0f - static_cast<float>(static_cast<double>(c.nodeMisses) / c.nodeAccesses);
+    if (c.triAccesses)
+        result.triHitRate = 1.0f - static_cast<float>(static_cast<double>(c.triMisses) / c.triAccesses);
+    result.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    return result;
+}
+
+// -------- JSON -----------
+static std::string json_escape(const std::string &s) {
+    std::string out;
+    out.reserve(s.size());
+    for (const char c: s) {
+        if (c == '"' || c == '\\') out += '\\';
+        if (static_cast<unsigned char>(c) < 0x20) continue;
+        out += c;
+    }
+    return out;
+}
+
+std::string bvh_metrics_to_json(const BVHMetrics &metrics, const BVHBuildStats &stats, const std::string &modelPath) {
+    char buf[1024];
+    std::string json = "{\n";
+    json += "  \"model\": \"" + json_escape(modelPath) + "\",\n";
+    std::snprintf(buf, sizeof(buf),
+                  "  \"build\": {\"ms\": %.3f, \"threads\": %d, \"dupFactor\": %.4f, \"optimizeMs\": %.3f, "
+                  "\"unoptimizedSahCost\": %.4f, \"nodeBytes\": %zu, \"triBytes\": %zu},\n",
+                  stats.buildMs, stats.threadCount, stats.dupFactor, stats.optimizeMs, stats.unoptimizedSahCost,
+                  stats.nodeBytes, stats.triBytes);
+    json += buf;
+    std::snprintf(buf, sizeof(buf),
+                  "  \"nodes\": %d,\n  \"leaves\": %d,\n  \"triangles\": %d,\n  \"sahCost\": %.4f,\n"
+                  "  \"epo\": %.4f,\n  \"maxDepth\": %d,\n  \"avgDepth\": %.3f,\n  \"avgLeafSize\": %.3f,\n"
+                  "  \"emptySpace\": %.4f,\n",
+                  metrics.nodeCount, metrics.leafCount, metrics.triCount, metrics.sahCost, metrics.epo,
+                  metrics.maxDepth, metrics.avgDepth, metrics.avgLeafSize, metrics.emptySpace);
+    json += buf;
+
+    json += "  \"leafSizes\": [";
+    for (int k = 1; k < BVHMetrics::kLeafHistogramBins; ++k) {
+        json += std::to_string(metrics.leafSizes[k]);
+        if (k + 1 < BVHMetrics::kLeafHistogramBins) json += ", ";
+    }
+    json += "],\n";
+
+    std::snprintf(buf, sizeof(buf),
+                  "  \"stack\": {\"gpuWidth\": %d, \"highWater\": %d, \"capacity\": %d, \"overflow\": %s}\n",
+                  metrics.gpuWidth, metrics.stackHighWater, BVHMetrics::kGpuStackSize,
+                  metrics.stackOverflows() ? "true" : "false");
+    json += buf;
+    json += "}\n";
+    return json;
+}
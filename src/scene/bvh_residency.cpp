@@ -0,0 +1,75 @@
+#include "scene/bvh_residency.h"
+#include "scene/bvh_cache.h"
+
+BVHResidentKey make_bvh_resident_key(const char *path, const glm::mat4 &modelTransform,
+                                     const BVHBuildSettings &settings) {
+    BVHResidentKey key;
+    std::error_code ec;
+    const auto writeTime = std::filesystem::last_write_time(path, ec);
+    if (ec) return key;
+
+    key.path = path;
+    key.writeTime = writeTime;
+    key.settingsHash = bvh_settings_hash(modelTransform, settings);
+    key.gpuWidth = settings.gpuWidth;
+    key.triTest = settings.triTest;
+    key.indexedTris = settings.indexedTris;
+    return key;
+}
+
+void BVHResidencyCache::setBudget(const size_t gpuLimit, const size_t cpuLimit) {
+    gpuBudget = gpuLimit;
+    cpuBudget = cpuLimit;
+    evict();
+}
+
+void BVHResidencyCache::put(BVHResident &&entry) {
+    BVHResident replaced;
+    take(entry.key, replaced);
+    replaced.handle.release();
+
+    // Never fits: keep the others rather than evicting them for nothing.
+    if (entry.gpuBytes() > gpuBudget || entry.cpuBytes() > cpuBudget) {
+        entry.handle.release();
+        return;
+    }
+
+    gpuUsed += entry.gpuBytes();
+    cpuUsed += entry.cpuBytes();
+    entries.push_front(std::move(entry));
+    evict();
+}
+
+bool BVHResidencyCache::take(const BVHResidentKey &key, BVHResident &out) {
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+        if (!(it->key == key)) continue;
+        gpuUsed -= it->gpuBytes();
+        cpuUsed -= it->cpuBytes();
+        out = std::move(*it);
+        entries.erase(it);
+        return true;
+    }
+    return false;
+}
+
+bool BVHResidencyCache::contains(const BVHResidentKey &key) const {
+    for (const auto &e: entries)
+        if (e.key == key) return true;
+    return false;
+}
+
+void BVHResidencyCache::clear() {
+    for (auto &e: entries) e.handle.release();
+    entries.clear();
+    gpuUsed = cpuUsed = 0;
+}
+
+void BVHResidencyCache::evict() {
+    while (!entries.empty() && (gpuUsed > gpuBudget || cpuUsed > cpuBudget)) {
+        BVHResident &oldest = entries.back();
+        gpuUsed -= oldest.gpuBytes();
+        cpuUsed -= oldest.cpuBytes();
+        oldest.handle.release();
+        entries.pop_back();
+    }
+}
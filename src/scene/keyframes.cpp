@@ -0,0 +1,110 @@
+#include "scene/keyframes.h"
+#include "scene/model.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+
+// -------- Sequence discovery -----------
+// Splits a stem like "wave_0012" into ("wave_", 4, 12). Returns false unless
+// the stem ends in a separator ('_', '-' or '.') followed by a padded frame
+// number of 2 to 9 digits, so "model1" or "model_1" are not frames.
+static bool split_frame_number(const std::string &stem, std::string &outPrefix, size_t &outWidth, long &outFrame) {
+    size_t digits = stem.size();
+    while (digits > 0 && std::isdigit(static_cast<unsigned char>(stem[digits - 1]))) --digits;
+    const size_t width = stem.size() - digits;
+    if (width < 2 || width > 9 || digits == 0) return false;
+    const char separator = stem[digits - 1];
+    if (separator != '_' && separator != '-' && separator != '.') return false;
+
+    outPrefix = stem.substr(0, digits);
+    outWidth = width;
+    outFrame = std::stol(stem.substr(digits));
+    return true;
+}
+
+std::vector<std::string> find_keyframe_files(const std::string &path) {
+    namespace fs = std::filesystem;
+    const fs::path p(path);
+
+    std::string prefix;
+    size_t width = 0;
+    long frame = 0;
+    if (!split_frame_number(p.stem().string(), prefix, width, frame)) return {};
+
+    std::vector<std::pair<long, std::string>> found;
+    try {
+        const fs::path dir = p.has_parent_path() ? p.parent_path() : fs::path(".");
+        for (const auto &entry: fs::directory_iterator(dir)) {
+            if (!entry.is_regular_file()) continue;
+            const auto &q = entry.path();
+            if (q.extension() != p.extension()) continue;
+
+            std::string otherPrefix;
+            size_t otherWidth = 0;
+            long otherFrame = 0;
+            if (split_frame_number(q.stem().string(), otherPrefix, otherWidth, otherFrame) &&
+                otherPrefix == prefix && otherWidth == width)
+                found.emplace_back(otherFrame, q.string());
+        }
+    } catch (const std::exception &) {
+        return {};
+    }
+
+    if (found.size() < 2) return {};
+    std::sort(found.begin(), found.end());
+
+    // Gaps mean unrelated numbered files rather than one exported sequence.
+    for (size_t i = 1; i < found.size(); ++i) {
+        if (found[i].first != found[i - 1].first + 1) return {};
+    }
+
+    std::vector<std::string> files;
+    files.reserve(found.size());
+    for (auto &f: found) files.push_back(std::move(f.second));
+    return files;
+}
+
+// -------- Loading -----------
+bool load_keyframe_sequence(const std::vector<std::string> &paths, const glm::mat4 &modelTransform,
+                            KeyframeSequence &out) {
+    out.clear();
+    for (const auto &path: paths) {
+        const Model model(path, false); // CPU geometry only, no GL objects
+        if (model.meshes.empty()) {
+            std::cerr << "[KEYFRAMES] Failed to load frame '" << path << "'\n";
+            out.clear();
+            return false;
+        }
+
+        std::vector<CPU_Triangle> tris;
+        gather_model_triangles(model, modelTransform, tris);
+        if (!out.frames.empty() && tris.size() != out.frames.front().size()) {
+            std::cerr << "[KEYFRAMES] Frame '" << path << "' has " << tris.size()
+                    << " triangles, expected " << out.frames.front().size() << "\n";
+            out.clear();
+            return false;
+        }
+        out.frames.push_back(std::move(tris));
+    }
+    return !out.empty();
+}
+
+// -------- Playback -----------
+void sample_keyframe_sequence(const KeyframeSequence &seq, const double seconds, std::vector<CPU_Triangle> &outTris) {
+    const int frameCount = seq.frameCount();
+    const double pos = std::fmod(std::max(seconds, 0.0) * seq.fps, static_cast<double>(frameCount));
+    const int k0 = std::min(static_cast<int>(pos), frameCount - 1);
+    const int k1 = (k0 + 1) % frameCount;
+    const float t = static_cast<float>(pos - k0);
+
+    const auto &a = seq.frames[k0];
+    const auto &b = seq.frames[k1];
+    outTris.resize(a.size());
+    for (size_t i = 0; i < a.size(); ++i) {
+        outTris[i].v0 = glm::mix(a[i].v0, b[i].v0, t);
+        outTris[i].e1 = glm::mix(a[i].e1, b[i].e1, t);
+        outTris[i].e2 = glm::mix(a[i].e2, b[i].e2, t);
+    }
+}
@@ -2,6 +2,7 @@
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
+#include <algorithm>
 #include <cstdarg>
 #include <iostream>
 #include <filesystem>
@@ -715,6 +716,9 @@ namespace ui {
         DrawMainControls(params, frame, input, rayMode, useBVH, showMotion);
         DrawKeybindLegend();
 
+        // Env picker sits below the BVH picker, whose height depends on its contents.
+        float envPickerY = ImGui::GetMainViewport()->WorkPos.y + 130.0f;
+
         // --------------------------------------------------------------------
         // BVH model picker (top-right) – only visible when BVH is enabled
         // --------------------------------------------------------------------
@@ -794,6 +798,352 @@ namespace ui {
 
                 ImGui::Separator();
                 ImGui::TextWrapped("Current: %s", bvhPicker.currentPath);
+
+                // Background load: the previous BVH is drawn until this one is swapped in.
+                if (bvhPicker.load.busy()) {
+                    char overlay[64];
+                    std::snprintf(overlay, sizeof(overlay), "%s (%.1f s)",
+                                  bvh_load_stage_name(bvhPicker.load.stage), bvhPicker.load.seconds);
+                    ImGui::TextWrapped("Loading: %s", bvhPicker.load.path.c_str());
+                    ImGui::ProgressBar(bvhPicker.load.fraction(), ImVec2(-1.0f, 0.0f), overlay);
+                }
+
+                // Builder selection: changing any setting rebuilds the current model.
+                ImGui::SeparatorText("Builder");
+                static const char *kBuildMethods[] = {"Median split", "Binned SAH", "LBVH (Morton)"};
+                int method = static_cast<int>(bvhPicker.build.method);
+                if (ImGui::Combo("Method", &method, kBuildMethods, IM_ARRAYSIZE(kBuildMethods))) {
+                    bvhPicker.build.method = static_cast<BVHBuildMethod>(method);
+                    bvhPicker.reloadRequested = true;
+                    Log("[BVH GUI] Builder: %s\n", kBuildMethods[method]);
+                }
+
+                // Sliders only trigger a rebuild once released, not on every drag step.
+                if (bvhPicker.build.method == BVHBuildMethod::BinnedSAH) {
+                    ImGui::SliderInt("SAH bins", &bvhPicker.build.sahBins, 4, 64, "%d", ImGuiSliderFlags_NoInput);
+                    if (ImGui::IsItemDeactivatedAfterEdit())
+                        bvhPicker.reloadRequested = true;
+                }
+
+                if (bvhPicker.build.method == BVHBuildMethod::LBVH) {
+                    bool wideCodes = bvhPicker.build.mortonBits > 30;
+                    if (ImGui::Checkbox("63-bit Morton codes", &wideCodes)) {
+                        bvhPicker.build.mortonBits = wideCodes ? 63 : 30;
+                        bvhPicker.reloadRequested = true;
+                    }
+                }
+
+                ImGui::SliderInt(bvhPicker.build.method == BVHBuildMethod::Median ? "Leaf size" : "Max leaf size",
+                                 &bvhPicker.build.leafMax, 1, 32, "%d", ImGuiSliderFlags_NoInput);
+                if (ImGui::IsItemDeactivatedAfterEdit())
+                    bvhPicker.reloadRequested = true;
+
+                // Spatial pre-splits: extra references as a percentage of the triangle count.
+                int splitPercent = static_cast<int>(bvhPicker.build.splitBudget * 100.0f + 0.5f);
+                if (ImGui::SliderInt("Split budget", &splitPercent, 0, 100, splitPercent == 0 ? "off" : "%d%%",
+                                     ImGuiSliderFlags_NoInput))
+                    bvhPicker.build.splitBudget = static_cast<float>(splitPercent) / 100.0f;
+                if (ImGui::IsItemDeactivatedAfterEdit())
+                    bvhPicker.reloadRequested = true;
+
+                // Treelet optimization after the build, bounded in time.
+                int optimizeMs = static_cast<int>(bvhPicker.build.optimizeMs);
+                if (ImGui::SliderInt("Optimize budget", &optimizeMs, 0, 5000, optimizeMs == 0 ? "off" : "%d ms",
+                                     ImGuiSliderFlags_NoInput))
+                    bvhPicker.build.optimizeMs = static_cast<float>(optimizeMs);
+                if (ImGui::IsItemDeactivatedAfterEdit())
+                    bvhPicker.reloadRequested = true;
+
+                // Memory order of the nodes; the tree and the traced image stay the same.
+                static const char *kLayouts[] = {"Depth-first", "Sibling pairs", "Breadth-first", "van Emde Boas",
+                                                 "Clustered (16 nodes)"};
+                static_assert(IM_ARRAYSIZE(kLayouts) == BvhModelPickerState::kLayoutCount);
+                int layout = static_cast<int>(bvhPicker.build.layout);
+                if (ImGui::Combo("Node layout", &layout, kLayouts, IM_ARRAYSIZE(kLayouts))) {
+                    bvhPicker.build.layout = static_cast<BVHLayout>(layout);
+                    bvhPicker.reloadRequested = true;
+                    Log("[BVH GUI] Node layout: %s\n", kLayouts[layout]);
+                }
+
+                ImGui::SliderInt("Build threads", &bvhPicker.build.threadCount, 0, 64,
+                                 bvhPicker.build.threadCount == 0 ? "auto" : "%d", ImGuiSliderFlags_NoInput);
+                if (ImGui::IsItemDeactivatedAfterEdit())
+                    bvhPicker.reloadRequested = true;
+
+                static const char *kGpuWidths[] = {"Binary", "BVH4 (quantized)", "BVH8 (quantized)"};
+                int widthIndex = bvhPicker.build.gpuWidth == 8 ? 2 : bvhPicker.build.gpuWidth == 4 ? 1 : 0;
+                if (ImGui::Combo("GPU layout", &widthIndex, kGpuWidths, IM_ARRAYSIZE(kGpuWidths))) {
+                    bvhPicker.build.gpuWidth = widthIndex == 2 ? 8 : widthIndex == 1 ? 4 : 2;
+                    bvhPicker.reloadRequested = true;
+                    Log("[BVH GUI] GPU layout: %s\n", kGpuWidths[widthIndex]);
+                }
+
+                // Binary layouts only: wide nodes are always walked with a stack.
+                static const char *kTraversals[] = {"Stack (64 entries)", "Stackless (skip links)"};
+                int traversal = bvhPicker.stacklessTraversal ? 1 : 0;
+                if (ImGui::Combo("Traversal", &traversal, kTraversals, IM_ARRAYSIZE(kTraversals))) {
+                    bvhPicker.stacklessTraversal = traversal == 1;
+                    bvhPicker.traversalChanged = true;
+                    Log("[BVH GUI] Traversal: %s\n", kTraversals[traversal]);
+                }
+
+                // Binary, uncompressed trees only; the settings above do not apply to it.
+                if (ImGui::Checkbox("Build on GPU (LBVH)", &bvhPicker.build.gpuBuild)) {
+                    bvhPicker.reloadRequested = true;
+                    Log("[BVH GUI] GPU build %s\n", bvhPicker.build.gpuBuild ? "enabled" : "disabled");
+                }
+                if (bvhPicker.build.gpuBuild) {
+                    ImGui::SameLine();
+                    ImGui::Checkbox("Validate", &bvhPicker.gpuValidate);
+                    if (!bvh_gpu_build_applies(bvhPicker.build))
+                        ImGui::Text("GPU build needs the binary layout and uncompressed triangles");
+                }
+
+                if (ImGui::Checkbox("Compressed triangles", &bvhPicker.build.compressTris)) {
+                    bvhPicker.reloadRequested = true;
+                    Log("[BVH GUI] Compressed triangles %s\n", bvhPicker.build.compressTris ? "enabled" : "disabled");
+                }
+
+                // Only the triangle buffer changes: repacked in place, no rebuild.
+                static const char *kTriTests[] = {"Moller-Trumbore", "Watertight", "Affine (precomputed)"};
+                int triTest = static_cast<int>(bvhPicker.build.triTest);
+                if (ImGui::Combo("Triangle test", &triTest, kTriTests, IM_ARRAYSIZE(kTriTests))) {
+                    bvhPicker.build.triTest = static_cast<BVHTriTest>(triTest);
+                    bvhPicker.triPackingChanged = true;
+                    Log("[BVH GUI] Triangle test: %s\n", kTriTests[triTest]);
+                }
+
+                // Direct: 48 B/tri, one fetch per triangle. Indexed: shared vertices, one more fetch.
+                static const char *kTriStorage[] = {"Direct (v0, e1, e2)", "Indexed vertices"};
+                int triStorage = bvhPicker.build.indexedTris ? 1 : 0;
+                if (ImGui::Combo("Triangle storage", &triStorage, kTriStorage, IM_ARRAYSIZE(kTriStorage))) {
+                    bvhPicker.build.indexedTris = triStorage == 1;
+                    bvhPicker.triPackingChanged = true;
+                    Log("[BVH GUI] Triangle storage: %s\n", kTriStorage[triStorage]);
+                }
+                if (bvhPicker.build.compressTris && bvhPicker.build.indexedTris)
+                    ImGui::Text("Compressed triangles are stored directly");
+                if ((bvhPicker.build.compressTris || bvhPicker.build.indexedTris) &&
+                    bvhPicker.build.triTest == BVHTriTest::Affine)
+                    ImGui::Text("%s triangles use Moller-Trumbore",
+                                bvhPicker.build.compressTris ? "Compressed" : "Indexed");
+
+                if (ImGui::Checkbox("Use BVH cache", &bvhPicker.useCache)) {
+                    Log("[BVH GUI] BVH cache %s\n", bvhPicker.useCache ? "enabled" : "disabled");
+                }
+
+                if (ImGui::Checkbox("Lean memory", &bvhPicker.leanMemory)) {
+                    bvhPicker.leanMemoryChanged = true;
+                    Log("[BVH GUI] Lean memory %s\n", bvhPicker.leanMemory ? "enabled" : "disabled");
+                }
+                ImGui::Text("Mesh CPU data: %.2f MB",
+                            static_cast<double>(bvhPicker.meshCpuBytes) / (1024.0 * 1024.0));
+
+                // Large models: draw a BVH over a simplified proxy while the full tree is built.
+                if (ImGui::Checkbox("Progressive preview", &bvhPicker.progressive)) {
+                    Log("[BVH GUI] Progressive preview %s\n", bvhPicker.progressive ? "enabled" : "disabled");
+                }
+                if (bvhPicker.progressive) {
+                    ImGui::SliderInt("Preview tris (K)", &bvhPicker.previewTrisK, 50, 4000, "%d",
+                                     ImGuiSliderFlags_NoInput);
+                    if (ImGui::IsItemDeactivatedAfterEdit())
+                        Log("[BVH GUI] Preview size: %dK triangles\n", bvhPicker.previewTrisK);
+                }
+
+                // Recently used BVHs stay uploaded; switching back to one is a handle swap.
+                ImGui::SliderInt("Resident GPU (MB)", &bvhPicker.residentGpuBudgetMB, 0, 4096, "%d",
+                                 ImGuiSliderFlags_NoInput);
+                if (ImGui::IsItemDeactivatedAfterEdit())
+                    bvhPicker.residentBudgetChanged = true;
+                ImGui::SliderInt("Resident CPU (MB)", &bvhPicker.residentCpuBudgetMB, 0, 8192, "%d",
+                                 ImGuiSliderFlags_NoInput);
+                if (ImGui::IsItemDeactivatedAfterEdit())
+                    bvhPicker.residentBudgetChanged = true;
+                ImGui::Text("Resident: %d BVH(s), %.1f MB GPU, %.1f MB CPU",
+                            bvhPicker.residentCount,
+                            static_cast<double>(bvhPicker.residentGpuBytes) / (1024.0 * 1024.0),
+                            static_cast<double>(bvhPicker.residentCpuBytes) / (1024.0 * 1024.0));
+
+                if (ImGui::Button("Benchmark thread scaling")) {
+                    bvhPicker.benchmarkRequested = true;
+                    Log("[BVH GUI] Thread-scaling benchmark requested\n");
+                }
+                ImGui::SameLine();
+                if (ImGui::Button("Benchmark traversal")) {
+                    bvhPicker.traversalBenchmarkRequested = true;
+                    Log("[BVH GUI] Traversal benchmark requested\n");
+                }
+                ImGui::SameLine();
+                if (ImGui::Button("Benchmark triangle tests")) {
+                    bvhPicker.triTestBenchmarkRequested = true;
+                    Log("[BVH GUI] Triangle test benchmark requested\n");
+                }
+                ImGui::SameLine();
+                if (ImGui::Button("Benchmark triangle storage")) {
+                    bvhPicker.triStorageBenchmarkRequested = true;
+                    Log("[BVH GUI] Triangle storage benchmark requested\n");
+                }
+
+                if (ImGui::Button("Measure node layouts")) {
+                    bvhPicker.layoutBenchmarkRequested = true;
+                    Log("[BVH GUI] Node layout measurement requested\n");
+                }
+                for (int k = 0; k < BvhModelPickerState::kLayoutCount; ++k) {
+                    const BVHLocality &loc = bvhPicker.layoutLocality[k];
+                    if (loc.rays == 0) continue;
+                    ImGui::Text("%-20s node %.2f lines/ray (%.0f%% hit)  tri %.2f (%.0f%% hit)",
+                                kLayouts[k], loc.nodeLinesPerRay, loc.nodeHitRate * 100.0f,
+                                loc.triLinesPerRay, loc.triHitRate * 100.0f);
+                }
+
+                ImGui::Text("Nodes: %d  Tris: %d (%.0f B/tri)  Leaves: %d",
+                            bvhPicker.nodeCount,
+                            bvhPicker.triCount,
+                            bvhPicker.triCount > 0
+                                ? static_cast<double>(bvhPicker.stats.triBytes) / bvhPicker.triCount
+                                : 0.0,
+                            bvhPicker.stats.leafCount);
+                ImGui::Text("Build: %.2f ms (%d thr)  SAH cost: %.2f  Dup: x%.2f",
+                            bvhPicker.stats.buildMs,
+                            bvhPicker.stats.threadCount,
+                            bvhPicker.stats.sahCost,
+                            bvhPicker.stats.dupFactor);
+                if (bvhPicker.stats.gpuBuilt) {
+                    const BVHGpuValidation &check = bvhPicker.gpuValidation;
+                    ImGui::Text("GPU build: %d passes, GPU %.2f ms, %.1f KB uploaded",
+                                bvhPicker.gpuBuild.passes,
+                                bvhPicker.gpuBuild.gpuMs,
+                                static_cast<double>(bvhPicker.gpuBuild.uploadBytes) / 1024.0);
+                    if (check.nodeCount > 0)
+                        ImGui::Text("Validation: %s (CPU SAH %.2f, CPU build %.2f ms)",
+                                    check.ok() ? "matches CPU LBVH" : "MISMATCH",
+                                    check.cpuSahCost,
+                                    check.cpuBuildMs);
+                }
+                ImGui::Text("Node buffer: %.1f KB  Triangle data: %.1f KB",
+                            static_cast<double>(bvhPicker.stats.nodeBytes) / 1024.0,
+                            static_cast<double>(bvhPicker.stats.triBytes) / 1024.0);
+                if (bvhPicker.triStorageMs[0] > 0.0) {
+                    ImGui::Text("Direct: %.1f MB, %.3f ms  Indexed: %.1f MB, %.3f ms",
+                                static_cast<double>(bvhPicker.triStorageBytes[0]) / (1024.0 * 1024.0),
+                                bvhPicker.triStorageMs[0],
+                                static_cast<double>(bvhPicker.triStorageBytes[1]) / (1024.0 * 1024.0),
+                                bvhPicker.triStorageMs[1]);
+                }
+                if (bvhPicker.stats.fromCache)
+                    ImGui::Text("Loaded from cache in %.2f ms", bvhPicker.stats.loadMs);
+                if (bvhPicker.stats.optimizeMs > 0.0)
+                    ImGui::Text("Optimized in %.1f ms: SAH %.2f -> %.2f",
+                                bvhPicker.stats.optimizeMs,
+                                bvhPicker.stats.unoptimizedSahCost,
+                                bvhPicker.stats.sahCost);
+
+                const BVHMetrics &metrics = bvhPicker.metrics;
+                if (metrics.nodeCount > 0) {
+                    ImGui::Text("Depth: %d max, %.1f avg  Leaf size: %.2f avg  Empty space: %.1f%%",
+                                metrics.maxDepth,
+                                metrics.avgDepth,
+                                metrics.avgLeafSize,
+                                metrics.emptySpace * 100.0f);
+                    if (bvhPicker.stacklessTraversal && bvhPicker.build.gpuWidth <= 2) {
+                        ImGui::Text("Stack: %d / %d (not used, stackless)",
+                                    metrics.stackHighWater,
+                                    BVHMetrics::kGpuStackSize);
+                    } else if (metrics.stackOverflows()) {
+                        ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.3f, 1.0f),
+                                           "Stack: %d / %d (overflows!)",
+                                           metrics.stackHighWater,
+                                           BVHMetrics::kGpuStackSize);
+                    } else {
+                        ImGui::Text("Stack: %d / %d", metrics.stackHighWater, BVHMetrics::kGpuStackSize);
+                    }
+
+                    if (bvhPicker.epoValid) {
+                        ImGui::Text("End-point overlap: %.2f", metrics.epo);
+                    } else if (ImGui::Button("Compute end-point overlap")) {
+                        bvhPicker.epoRequested = true;
+                        Log("[BVH GUI] End-point overlap requested\n");
+                    }
+
+                    // Leaf-size histogram; the last bar collects larger leaves.
+                    float leafBars[BVHMetrics::kLeafHistogramBins - 1];
+                    for (int k = 1; k < BVHMetrics::kLeafHistogramBins; ++k)
+                        leafBars[k - 1] = static_cast<float>(metrics.leafSizes[k]);
+                    ImGui::PlotHistogram("Leaf sizes", leafBars, IM_ARRAYSIZE(leafBars), 0, "1 .. 16+", 0.0f,
+                                         FLT_MAX, ImVec2(0.0f, 48.0f));
+                }
+
+                // Two-level scene: BLASes are built once, moving copies only rebuilds the TLAS.
+                ImGui::SeparatorText("Instancing");
+                if (ImGui::Checkbox("Two-level (TLAS + BLAS)", &bvhPicker.instancing)) {
+                    bvhPicker.reloadRequested = true;
+                    Log("[BVH GUI] Instancing %s\n", bvhPicker.instancing ? "enabled" : "disabled");
+                }
+                if (bvhPicker.instancing) {
+                    ImGui::SliderInt("Copies", &bvhPicker.instanceCopies, 1, 256, "%d", ImGuiSliderFlags_NoInput);
+                    if (ImGui::IsItemDeactivatedAfterEdit())
+                        bvhPicker.instancesChanged = true;
+                    ImGui::SliderFloat("Spacing", &bvhPicker.instanceSpacing, 0.5f, 10.0f, "%.1f",
+                                       ImGuiSliderFlags_NoInput);
+                    if (ImGui::IsItemDeactivatedAfterEdit())
+                        bvhPicker.instancesChanged = true;
+                    ImGui::Checkbox("Animate instances", &bvhPicker.animateInstances);
+                    ImGui::Text("Instances: %d  BLAS: %d  TLAS: %.3f ms",
+                                bvhPicker.instanceCount, bvhPicker.blasCount, bvhPicker.tlasStats.buildMs);
+                }
+
+                // Props are inserted into and removed from the live binary tree, no rebuild.
+                if (!bvhPicker.instancing) {
+                    ImGui::SeparatorText("Scene editing");
+                    const char *propLabel = bvhPicker.propPath[0] ? bvhPicker.propPath : "(current model)";
+                    if (ImGui::BeginCombo("Prop", propLabel)) {
+                        for (int i = 0; i < static_cast<int>(gModelFiles.size()); ++i) {
+                            if (ImGui::Selectable(gModelFiles[i].c_str(), i == bvhPicker.propIndex)) {
+                                bvhPicker.propIndex = i;
+                                std::snprintf(bvhPicker.propPath, sizeof(bvhPicker.propPath), "%s",
+                                              gModelFiles[i].c_str());
+                            }
+                        }
+                        ImGui::EndCombo();
+                    }
+                    if (ImGui::Button("Insert prop")) {
+                        bvhPicker.propInsertRequested = true;
+                        Log("[BVH GUI] Insert prop requested\n");
+                    }
+                    ImGui::SameLine();
+                    if (ImGui::Button("Remove prop") && bvhPicker.propCount > 0) {
+                        bvhPicker.propRemoveRequested = true;
+                        Log("[BVH GUI] Remove prop requested\n");
+                    }
+                    if (bvhPicker.propCount > 0) {
+                        ImGui::Text("Props: %d  Edit: %.2f ms  Upload: %.2f ms  Rotations: %d",
+                                    bvhPicker.propCount, bvhPicker.edit.editMs, bvhPicker.edit.uploadMs,
+                                    bvhPicker.edit.rotations);
+                        ImGui::Text("Uploaded: %d nodes, %d tris, %.1f KB%s", bvhPicker.edit.nodesUploaded,
+                                    bvhPicker.edit.trisUploaded, bvhPicker.edit.bytesUploaded / 1024.0,
+                                    bvhPicker.edit.fullUpload ? " (full)" : "");
+                    }
+                }
+
+                // Keyframe playback: refit every frame, rebuild when the SAH degrades too much.
+                if (bvhPicker.animFrameCount > 1) {
+                    ImGui::SeparatorText("Animation");
+                    if (ImGui::Checkbox("Play keyframes", &bvhPicker.animPlay)) {
+                        Log("[BVH GUI] Keyframe playback %s (%d frames)\n",
+                            bvhPicker.animPlay ? "started" : "paused", bvhPicker.animFrameCount);
+                    }
+                    ImGui::SliderFloat("Keyframe FPS", &bvhPicker.animFps, 1.0f, 60.0f, "%.0f",
+                                       ImGuiSliderFlags_NoInput);
+                    ImGui::SliderFloat("Rebuild at SAH x", &bvhPicker.build.refitRebuildRatio, 1.05f, 4.0f, "%.2f",
+                                       ImGuiSliderFlags_NoInput);
+                    ImGui::Text("Refit: %.2f ms  SAH x%.2f  Rebuilds: %d",
+                                bvhPicker.refit.refitMs, bvhPicker.refit.sahRatio, bvhPicker.refitRebuilds);
+                    ImGui::Text("Uploaded: %d nodes, %d tris",
+                                bvhPicker.refit.dirtyNodeEnd - bvhPicker.refit.dirtyNodeBegin,
+                                bvhPicker.refit.dirtyTriEnd - bvhPicker.refit.dirtyTriBegin);
+                }
+
+                envPickerY = std::max(envPickerY, ImGui::GetWindowPos().y + ImGui::GetWindowSize().y + 10.0f);
             }
             ImGui::End();
         }
@@ -838,9 +1188,8 @@ namespace ui {
             }
 
             const ImGuiViewport *vp = ImGui::GetMainViewport();
-            // Slightly below the BVH picker (offset y by ~120 px)
-            const ImVec2 pos(vp->WorkPos.x + vp->WorkSize.x - 10.0f,
-                             vp->WorkPos.y + 130.0f);
+            // Below the BVH picker (at least ~120 px from the top)
+            const ImVec2 pos(vp->WorkPos.x + vp->WorkSize.x - 10.0f, envPickerY);
 
             ImGui::SetNextWindowPos(pos, ImGuiCond_Always, ImVec2(1.0f, 0.0f));
 